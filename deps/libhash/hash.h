@@ -1,6 +1,41 @@
 #ifndef LIBHASH_HASH_H
 #define LIBHASH_HASH_H
 
-unsigned int h_compute_hash(const char *key, const int capacity, const int attempt);
+#include <stdint.h>
+
+/**
+ * Hashes a NUL-terminated key to 64 bits. Computed once per operation; probe
+ * sequences are derived from the result.
+ *
+ * @param key
+ * @return uint64_t
+ */
+uint64_t h_hash_key(const char *key);
+
+/**
+ * The first bucket probed for `hash` in a table of `capacity` buckets.
+ */
+static inline unsigned int
+h_probe_start (uint64_t hash, unsigned int capacity) {
+  return (unsigned int)(hash % capacity);
+}
+
+/**
+ * The probe step for `hash` i.e. the double hash. Capacities are prime, so any
+ * step in [1, capacity) visits every bucket before repeating.
+ */
+static inline unsigned int
+h_probe_step (uint64_t hash, unsigned int capacity) {
+  return 1 + (unsigned int)((hash >> 32) % (capacity - 1));
+}
+
+/**
+ * Advances `idx` by `step`, wrapping around the table.
+ */
+static inline unsigned int
+h_probe_next (unsigned int idx, unsigned int step, unsigned int capacity) {
+  idx += step;
+  return idx >= capacity ? idx - capacity : idx;
+}
 
 #endif /* LIBHASH_HASH_H */
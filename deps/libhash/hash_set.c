@@ -109,12 +109,11 @@ hs_insert (hash_set *hs, const void *key) {
     hs_resize_up(hs);
   }
 
-  void *new_entry          = strdup(key);
+  const uint64_t     hash        = h_hash_key(key);
+  const unsigned int step        = h_probe_step(hash, hs->capacity);
+  unsigned int       idx         = h_probe_start(hash, hs->capacity);
+  char              *current_key = hs->keys[idx];
 
-  unsigned int idx         = h_compute_hash(key, hs->capacity, 0);
-  char        *current_key = hs->keys[idx];
-
-  unsigned int i           = 1;
   // If there was a collision...
   while (current_key != NULL) {
     // Key already exists (update)
@@ -122,27 +121,28 @@ hs_insert (hash_set *hs, const void *key) {
       return;
     }
 
-    idx         = h_compute_hash(new_entry, hs->capacity, i);
+    idx         = h_probe_next(idx, step, hs->capacity);
     current_key = hs->keys[idx];
-    i++;
   }
 
-  hs->keys[idx] = new_entry;
+  hs->keys[idx] = strdup(key);
   hs->count++;
 }
 
 int
 hs_contains (hash_set *hs, const char *key) {
-  unsigned int idx         = h_compute_hash(key, hs->capacity, 0);
-  char        *current_key = hs->keys[idx];
+  const uint64_t     hash        = h_hash_key(key);
+  const unsigned int step        = h_probe_step(hash, hs->capacity);
+  unsigned int       idx         = h_probe_start(hash, hs->capacity);
+  char              *current_key = hs->keys[idx];
 
-  unsigned int i           = 1;
+  unsigned int i                 = 1;
   while (current_key != NULL) {
     if (strcmp(current_key, key) == 0) {
       return 1;
     }
 
-    idx         = h_compute_hash(key, hs->capacity, i);
+    idx         = h_probe_next(idx, step, hs->capacity);
     current_key = hs->keys[idx];
     i++;
 
@@ -178,10 +178,10 @@ hs_delete (hash_set *hs, const char *key) {
     hs_resize_down(hs);
   }
 
-  unsigned int i    = 0;
-  unsigned int idx  = h_compute_hash(key, hs->capacity, i);
-
-  char *current_key = hs->keys[idx];
+  const uint64_t     hash        = h_hash_key(key);
+  const unsigned int step        = h_probe_step(hash, hs->capacity);
+  unsigned int       idx         = h_probe_start(hash, hs->capacity);
+  char              *current_key = hs->keys[idx];
 
   while (current_key != NULL) {
     if (strcmp(current_key, key) == 0) {
@@ -193,7 +193,7 @@ hs_delete (hash_set *hs, const char *key) {
       return 1;
     }
 
-    idx         = h_compute_hash(key, hs->capacity, ++i);
+    idx         = h_probe_next(idx, step, hs->capacity);
     current_key = hs->keys[idx];
   }
 
@@ -4,243 +4,359 @@
 
 #include "hash.h"
 #include "libhash.h"
-#include "prime.h"
-#include "strdup/strdup.h"
 
-static ht_entry HT_SENTINEL_ENTRY = {NULL, NULL};
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+// Smallest table: a single group
+#define HT_MIN_CAPACITY  HT_GROUP_SIZE
+// Grow once more than 7/8 of the slots are full or deleted
+#define HT_MAX_LOAD_NUM  7
+#define HT_MAX_LOAD_DEN  8
+// Shrink (by half) once fewer than 1/8 of the slots are full. Far enough below
+// the 7/16 load a table is left at by growing that a table hovering around
+// either threshold doesn't keep resizing back and forth.
+#define HT_MIN_LOAD_DEN  8
+// Old slots moved per insert or delete while resizing. Enough to finish moving
+// long before the new slots fill up.
+#define HT_MIGRATE_SLOTS 8
+// First key block size; later blocks double up to HT_KEY_BLOCK_MAX
+#define HT_KEY_BLOCK_MIN 256
+#define HT_KEY_BLOCK_MAX (64 * 1024)
+
+struct ht_key_block {
+  ht_key_block *next;
+  size_t        size;
+  size_t        used;
+  char          data[];
+};
 
-static void __ht_insert(hash_table *ht, const char *key, void *value);
-static int  __ht_delete(hash_table *ht, const char *key);
-static void __ht_delete_table(hash_table *ht);
+/**
+ * A bitmask with bit i set if slot i of a group matched.
+ */
+typedef uint32_t ht_mask;
 
 /**
- * Resize the hash table. This implementation has a set capacity;
- * hash collisions rise beyond the capacity and `ht_insert` will fail.
- * To mitigate this, we resize up if the load (measured as the ratio of
- * entries count to capacity) is less than .1, or down if the load exceeds
- * .7. To resize, we create a new table approx. 1/2x or 2x times the current
- * table size, then insert into it all non-deleted entries.
- *
- * @param ht
- * @param base_capacity
- * @return int
+ * Matches the group at `ctrl` against the control byte `b`.
  */
-static void
-ht_resize (hash_table *ht, int base_capacity) {
-  if (base_capacity < HT_DEFAULT_CAPACITY) {
-    base_capacity = HT_DEFAULT_CAPACITY;
+static inline ht_mask
+ht_group_match (const uint8_t *ctrl, uint8_t b) {
+#ifdef __SSE2__
+  __m128i group = _mm_load_si128((const __m128i *)ctrl);
+  return (ht_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)b)));
+#else
+  ht_mask m = 0;
+  for (unsigned int i = 0; i < HT_GROUP_SIZE; i++) {
+    m |= (ht_mask)(ctrl[i] == b) << i;
   }
+  return m;
+#endif
+}
 
-  hash_table *new_ht = ht_init(base_capacity, ht->free_value);
-
-  for (unsigned int i = 0; i < ht->capacity; i++) {
-    ht_entry *r = ht->entries[i];
-    if (r != NULL && r != &HT_SENTINEL_ENTRY) {
-      __ht_insert(new_ht, r->key, r->value);
-    }
+/**
+ * Matches the group's free (empty or deleted) slots.
+ */
+static inline ht_mask
+ht_group_match_free (const uint8_t *ctrl) {
+#ifdef __SSE2__
+  // The high bit is set in exactly the free slots' bytes
+  return (ht_mask)_mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+#else
+  ht_mask m = 0;
+  for (unsigned int i = 0; i < HT_GROUP_SIZE; i++) {
+    m |= (ht_mask)((ctrl[i] & HT_CTRL_FREE) != 0) << i;
   }
+  return m;
+#endif
+}
 
-  ht->base_capacity      = new_ht->base_capacity;
-  ht->capacity           = new_ht->capacity;
-  ht->count              = new_ht->count;
+/**
+ * The 7-bit hash fragment kept in a full slot's control byte.
+ */
+static inline uint8_t
+ht_fragment (uint64_t hash) {
+  return hash & 0x7f;
+}
 
-  // Cannot free values - we may still be using them.
-  ht_entry **tmp_entries = ht->entries;
-  ht->entries            = new_ht->entries;
-  free(tmp_entries);
-
-  // TODO: Figure out why list_free doesnt work but this does
-  node_t *head = ht->occupied_buckets;
-  node_t *tmp;
-
-  while (!list_is_sentinel_node(head)) {
-    tmp  = head;
-    head = head->next;
-    free(tmp);
+/**
+ * The first group probed for `hash`. Groups are then probed at triangular
+ * offsets, which visits every group of a power-of-two table.
+ */
+static inline unsigned int
+ht_first_group (uint64_t hash, unsigned int n_groups) {
+  return (unsigned int)(hash >> 7) & (n_groups - 1);
+}
+
+/**
+ * Copies `key` into the table's key storage.
+ */
+static char *
+ht_key_copy (hash_table *ht, const char *key) {
+  size_t        len = strlen(key) + 1;
+  ht_key_block *b   = ht->keys;
+
+  if (!b || b->size - b->used < len) {
+    size_t size = b ? b->size * 2 : HT_KEY_BLOCK_MIN;
+    if (size > HT_KEY_BLOCK_MAX) {
+      size = HT_KEY_BLOCK_MAX;
+    }
+    if (size < len) {
+      size = len;
+    }
+
+    b       = malloc(sizeof(ht_key_block) + size);
+    b->next = ht->keys;
+    b->size = size;
+    b->used = 0;
+    ht->keys = b;
   }
 
-  ht->occupied_buckets = new_ht->occupied_buckets;
+  char *k  = b->data + b->used;
+  memcpy(k, key, len);
+  b->used += len;
 
-  free(new_ht);
+  return k;
 }
 
-/**
- * Resize the table to a larger size, the first prime subsequent
- * to approx. 2x the base capacity.
- *
- * @param ht
- */
 static void
-ht_resize_up (hash_table *ht) {
-  const unsigned int new_capacity = ht->base_capacity * 2;
-  ht_resize(ht, new_capacity);
+ht_key_blocks_free (ht_key_block *b) {
+  while (b) {
+    ht_key_block *next = b->next;
+    free(b);
+    b = next;
+  }
 }
 
 /**
- * Resize the table to a smaller size, the first prime subsequent
- * to approx. 1/2x the base capacity.
- *
- * @param ht
+ * Allocates `capacity` slots, all empty.
  */
 static void
-ht_resize_down (hash_table *ht) {
-  const unsigned int new_capacity = ht->base_capacity / 2;
-  ht_resize(ht, new_capacity);
+ht_alloc_slots (hash_table *ht, unsigned int capacity) {
+  ht->capacity = capacity;
+  ht->ctrl     = aligned_alloc(HT_GROUP_SIZE, capacity);
+  ht->entries  = malloc((size_t)capacity * sizeof(ht_entry));
+  memset(ht->ctrl, HT_CTRL_EMPTY, capacity);
 }
 
 /**
- * Initialize a new hash table entry with the given k, v pair
- *
- * @param k entry key
- * @param v entry value
- * @return ht_entry*
+ * Finds the first free slot on `hash`'s probe sequence.
  */
-static ht_entry *
-ht_entry_init (const char *k, void *v) {
-  ht_entry *r = malloc(sizeof(ht_entry));
-  r->key      = strdup(k);
-  r->value    = v;
-
-  return r;
+static unsigned int
+ht_find_free (const uint8_t *ctrl, unsigned int capacity, uint64_t hash) {
+  const unsigned int n_groups = capacity / HT_GROUP_SIZE;
+  unsigned int       g        = ht_first_group(hash, n_groups);
+
+  // There is always a free slot: the table never fills up
+  for (unsigned int i = 1;; i++) {
+    ht_mask m = ht_group_match_free(ctrl + g * HT_GROUP_SIZE);
+    if (m) {
+      return g * HT_GROUP_SIZE + __builtin_ctz(m);
+    }
+    g = (g + i) & (n_groups - 1);
+  }
 }
 
 /**
- * Delete a entry and deallocate its memory
+ * Finds the slot holding `key` among `capacity` slots.
  *
- * @param r entry to delete
+ * @return int The slot's index, or -1 if the key isn't there.
  */
-static void
-ht_delete_entry (ht_entry *r, free_fn *maybe_free_value) {
-  free(r->key);
-  if (maybe_free_value && r->value) {
-    maybe_free_value(r->value);
-    r->value = NULL;
+static int
+ht_find_in (const uint8_t *ctrl, ht_entry *entries, unsigned int capacity, const char *key, uint64_t hash) {
+  const unsigned int n_groups = capacity / HT_GROUP_SIZE;
+  const uint8_t      frag     = ht_fragment(hash);
+  unsigned int       g        = ht_first_group(hash, n_groups);
+
+  for (unsigned int i = 1;; i++) {
+    const uint8_t *group = ctrl + g * HT_GROUP_SIZE;
+
+    for (ht_mask m = ht_group_match(group, frag); m; m &= m - 1) {
+      unsigned int idx = g * HT_GROUP_SIZE + __builtin_ctz(m);
+      ht_entry    *r   = &entries[idx];
+      if (r->hash == hash && strcmp(r->key, key) == 0) {
+        return (int)idx;
+      }
+    }
+
+    // An empty slot ends the probe: the key would have been put there
+    if (ht_group_match(group, HT_CTRL_EMPTY)) {
+      return -1;
+    }
+    g = (g + i) & (n_groups - 1);
   }
-  free(r);
 }
 
-static void
-__ht_insert (hash_table *ht, const char *key, void *value) {
-  if (ht == NULL) {
-    return;
+/**
+ * Finds `key` in the table's slots or, mid-resize, its old ones.
+ */
+static ht_entry *
+ht_find (hash_table *ht, const char *key, uint64_t hash) {
+  int idx;
+  if ((idx = ht_find_in(ht->ctrl, ht->entries, ht->capacity, key, hash)) >= 0) {
+    return &ht->entries[idx];
   }
-
-  const unsigned int load = ht->count * 100 / ht->capacity;
-  if (load > 70) {
-    ht_resize_up(ht);
+  if (ht->old_ctrl && (idx = ht_find_in(ht->old_ctrl, ht->old_entries, ht->old_capacity, key, hash)) >= 0) {
+    return &ht->old_entries[idx];
   }
 
-  ht_entry *new_entry        = ht_entry_init(key, value);
-
-  unsigned int idx           = h_compute_hash(new_entry->key, ht->capacity, 0);
-  ht_entry    *current_entry = ht->entries[idx];
-  // If there was a hash collision, we need to perform double hashing and
-  // partial linear probing by incrementing this index and hashing it until we
-  // find a bucket.
-  unsigned int i             = 1;
-  while (current_entry != NULL && current_entry != &HT_SENTINEL_ENTRY) {
-    // If the keys match, then we've inserted this key before. Use this bucket.
-    if (strcmp(current_entry->key, key) == 0) {
-      ht_delete_entry(current_entry, NULL);
-      ht->entries[idx] = new_entry;
-      return;
-    }
+  return NULL;
+}
 
-    idx           = h_compute_hash(new_entry->key, ht->capacity, i);
-    current_entry = ht->entries[idx];
-    i++;
+/**
+ * Frees `key`'s slot: empties it if no probe can have passed it, else marks it
+ * deleted.
+ */
+static bool
+ht_slot_clear (uint8_t *ctrl, unsigned int idx) {
+  // No probe continues past a group with an empty slot, so none can have
+  // passed this one
+  if (ht_group_match(ctrl + (idx & ~(HT_GROUP_SIZE - 1)), HT_CTRL_EMPTY)) {
+    ctrl[idx] = HT_CTRL_EMPTY;
+    return false;
   }
 
-  ht->entries[idx] = new_entry;
-  list_prepend(&ht->occupied_buckets, idx);
-  ht->count++;
+  ctrl[idx] = HT_CTRL_DELETED;
+  return true;
 }
 
-static int
-__ht_delete (hash_table *ht, const char *key) {
-  const unsigned int load = ht->count * 100 / ht->capacity;
-
-  // TODO: const
-  if (load < 30) {
-    ht_resize_down(ht);
+/**
+ * Moves up to `n` entries from the old slots to the new ones, copying their
+ * keys into the new key storage. Frees the old slots once they're empty.
+ *
+ * @param ht
+ * @param n
+ */
+static void
+ht_migrate (hash_table *ht, unsigned int n) {
+  if (!ht->old_ctrl) {
+    return;
   }
 
-  unsigned int i          = 0;
-  unsigned int idx        = h_compute_hash(key, ht->capacity, i);
-
-  ht_entry *current_entry = ht->entries[idx];
-  while (current_entry != NULL && current_entry != &HT_SENTINEL_ENTRY) {
-    if (strcmp(current_entry->key, key) == 0) {
-      ht_delete_entry(current_entry, ht->free_value);
-      ht->entries[idx] = &HT_SENTINEL_ENTRY;
-      list_remove(&ht->occupied_buckets, idx);
-      ht->count--;
+  for (; n > 0 && ht->migrated < ht->old_capacity; ht->migrated++) {
+    if (ht->old_ctrl[ht->migrated] & HT_CTRL_FREE) {
+      continue;
+    }
 
-      return 1;
+    ht_entry    *r   = &ht->old_entries[ht->migrated];
+    unsigned int idx = ht_find_free(ht->ctrl, ht->capacity, r->hash);
+    if (ht->ctrl[idx] == HT_CTRL_DELETED) {
+      ht->deleted--;
     }
 
-    idx           = h_compute_hash(key, ht->capacity, ++i);
-    current_entry = ht->entries[idx];
+    ht->ctrl[idx]    = ht_fragment(r->hash);
+    ht->entries[idx] = (ht_entry){.key = ht_key_copy(ht, r->key), .value = r->value, .hash = r->hash};
+
+    // Not empty: probes for keys yet to move may need to pass it
+    ht->old_ctrl[ht->migrated] = HT_CTRL_DELETED;
+    n--;
+  }
+
+  if (ht->migrated < ht->old_capacity) {
+    return;
   }
 
-  return 0;
+  // Cannot free values - we may still be using them.
+  free(ht->old_ctrl);
+  free(ht->old_entries);
+  ht_key_blocks_free(ht->old_keys);
+  ht->old_ctrl     = NULL;
+  ht->old_entries  = NULL;
+  ht->old_capacity = 0;
+  ht->old_keys     = NULL;
 }
 
+/**
+ * Resize the hash table to `capacity` slots. The current slots become the old
+ * ones, which `ht_migrate` moves entries out of bit by bit; their keys move to
+ * fresh, compacted storage. Entries carry their key's hash, so nothing is
+ * rehashed. Also clears deleted slots.
+ *
+ * @param ht
+ * @param capacity
+ */
 static void
-__ht_delete_table (hash_table *ht) {
-  for (unsigned int i = 0; i < ht->capacity; i++) {
-    ht_entry *r = ht->entries[i];
-
-    if (r != NULL && r != &HT_SENTINEL_ENTRY) {
-      ht_delete_entry(r, ht->free_value);
-    }
+ht_resize (hash_table *ht, unsigned int capacity) {
+  if (capacity < HT_MIN_CAPACITY) {
+    capacity = HT_MIN_CAPACITY;
   }
 
-  free(ht->entries);
-  free(ht);
+  // One resize at a time
+  ht_migrate(ht, UINT32_MAX);
+
+  ht->old_ctrl       = ht->ctrl;
+  ht->old_entries    = ht->entries;
+  ht->old_capacity   = ht->capacity;
+  ht->old_keys       = ht->keys;
+  ht->migrated       = 0;
+
+  ht_alloc_slots(ht, capacity);
+  ht->keys           = NULL;
+  ht->deleted        = 0;
+  ht->dead_key_bytes = 0;
 }
 
 hash_table *
 ht_init (int base_capacity, free_fn *free_value) {
-  if (base_capacity < HT_DEFAULT_CAPACITY) {
-    base_capacity = HT_DEFAULT_CAPACITY;
+  // Room for `base_capacity` entries below the max load
+  unsigned int capacity = HT_MIN_CAPACITY;
+  while (base_capacity > 0 && capacity * HT_MAX_LOAD_NUM / HT_MAX_LOAD_DEN < (unsigned int)base_capacity) {
+    capacity *= 2;
   }
 
-  hash_table *ht       = malloc(sizeof(hash_table));
-  ht->base_capacity    = base_capacity;
+  hash_table *ht     = malloc(sizeof(hash_table));
+  ht->count          = 0;
+  ht->deleted        = 0;
+  ht->keys           = NULL;
+  ht->dead_key_bytes = 0;
+  ht->old_ctrl       = NULL;
+  ht->old_entries    = NULL;
+  ht->old_capacity   = 0;
+  ht->old_keys       = NULL;
+  ht->migrated       = 0;
+  ht->free_value     = free_value;
+  ht_alloc_slots(ht, capacity);
 
-  ht->capacity         = next_prime(ht->base_capacity);
-  ht->count            = 0;
-  ht->entries          = calloc((size_t)ht->capacity, sizeof(ht_entry *));
-  ht->free_value       = free_value;
-  ht->occupied_buckets = list_create_sentinel_node();
   return ht;
 }
 
 void
 ht_insert (hash_table *ht, const char *key, void *value) {
-  __ht_insert(ht, key, value);
-}
+  if (ht == NULL) {
+    return;
+  }
 
-ht_entry *
-ht_search (hash_table *ht, const char *key) {
-  unsigned int idx        = h_compute_hash(key, ht->capacity, 0);
+  const uint64_t hash = h_hash_key(key);
 
-  ht_entry *current_entry = ht->entries[idx];
+  ht_entry *r;
+  if ((r = ht_find(ht, key, hash))) {
+    // We've inserted this key before. Update its value.
+    r->value = value;
+    return;
+  }
 
-  unsigned int i          = 1;
+  ht_migrate(ht, HT_MIGRATE_SLOTS);
 
-  while (current_entry != NULL && current_entry != &HT_SENTINEL_ENTRY) {
-    if (strcmp(current_entry->key, key) == 0) {
-      return current_entry;
-    }
+  // Deleted slots count toward the load; only an empty slot ends a probe. Old
+  // slots not yet moved will need new ones too.
+  if ((ht->count + ht->deleted + 1) * HT_MAX_LOAD_DEN > ht->capacity * HT_MAX_LOAD_NUM) {
+    // Mostly deleted slots: rebuilding at the same size clears them
+    ht_resize(ht, ht->count * 2 > ht->capacity * HT_MAX_LOAD_NUM / HT_MAX_LOAD_DEN ? ht->capacity * 2 : ht->capacity);
+  }
 
-    idx           = h_compute_hash(key, ht->capacity, i);
-    current_entry = ht->entries[idx];
-    i++;
+  unsigned int idx = ht_find_free(ht->ctrl, ht->capacity, hash);
+  if (ht->ctrl[idx] == HT_CTRL_DELETED) {
+    ht->deleted--;
   }
 
-  return NULL;
+  ht->ctrl[idx]    = ht_fragment(hash);
+  ht->entries[idx] = (ht_entry){.key = ht_key_copy(ht, key), .value = value, .hash = hash};
+  ht->count++;
+}
+
+ht_entry *
+ht_search (hash_table *ht, const char *key) {
+  return ht_find(ht, key, h_hash_key(key));
 }
 
 void *
@@ -251,10 +367,57 @@ ht_get (hash_table *ht, const char *key) {
 
 void
 ht_delete_table (hash_table *ht) {
-  __ht_delete_table(ht);
+  if (ht->free_value) {
+    HT_ITER_START(ht)
+    if (entry->value) {
+      ht->free_value(entry->value);
+    }
+    HT_ITER_END
+  }
+
+  ht_key_blocks_free(ht->keys);
+  ht_key_blocks_free(ht->old_keys);
+  free(ht->ctrl);
+  free(ht->entries);
+  free(ht->old_ctrl);
+  free(ht->old_entries);
+  free(ht);
 }
 
 int
 ht_delete (hash_table *ht, const char *key) {
-  return __ht_delete(ht, key);
+  const uint64_t hash = h_hash_key(key);
+
+  int idx;
+  if ((idx = ht_find_in(ht->ctrl, ht->entries, ht->capacity, key, hash)) >= 0) {
+    ht_entry *r         = &ht->entries[idx];
+    ht->dead_key_bytes += strlen(r->key) + 1;
+    if (ht->free_value && r->value) {
+      ht->free_value(r->value);
+    }
+    ht->deleted += ht_slot_clear(ht->ctrl, idx);
+  } else if (ht->old_ctrl && (idx = ht_find_in(ht->old_ctrl, ht->old_entries, ht->old_capacity, key, hash)) >= 0) {
+    // Its key goes when the old slots do
+    ht_entry *r = &ht->old_entries[idx];
+    if (ht->free_value && r->value) {
+      ht->free_value(r->value);
+    }
+    ht_slot_clear(ht->old_ctrl, idx);
+  } else {
+    return 0;
+  }
+  ht->count--;
+
+  ht_migrate(ht, HT_MIGRATE_SLOTS);
+
+  if (ht->old_ctrl) {
+    // Settle the current resize before considering another
+  } else if (ht->capacity > HT_MIN_CAPACITY && ht->count * HT_MIN_LOAD_DEN < ht->capacity) {
+    ht_resize(ht, ht->capacity / 2);
+  } else if (ht->dead_key_bytes > HT_KEY_BLOCK_MAX && ht->dead_key_bytes * 2 > ht->capacity * sizeof(ht_entry)) {
+    // Churn without resizes would otherwise grow key storage without bound
+    ht_resize(ht, ht->capacity);
+  }
+
+  return 1;
 }
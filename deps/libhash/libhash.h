@@ -1,11 +1,22 @@
 #ifndef LIBHASH_H
 #define LIBHASH_H
 
-#include "list.h"
+#include <stddef.h>
+#include <stdint.h>
 
-#define HT_DEFAULT_CAPACITY 53
 #define HS_DEFAULT_CAPACITY 53
 
+/* Slots per control-byte group, probed at once */
+#define HT_GROUP_SIZE       16
+
+/*
+ * Control bytes. A full slot's byte is the low 7 bits of its key's hash (so
+ * the high bit is clear); free slots have the high bit set.
+ */
+#define HT_CTRL_EMPTY       0x80
+#define HT_CTRL_DELETED     0xfe
+#define HT_CTRL_FREE        0x80
+
 /**
  * A free function that will be invoked a hashmap value any time it is removed.
  *
@@ -15,37 +26,82 @@
 typedef void free_fn(void *value);
 
 /**
- * A hash table entry i.e. key / value pair
+ * A hash table entry i.e. key / value pair. Entries are stored inline in the
+ * table, so pointers to them (and their keys) are only valid until the table
+ * is next modified.
  */
 typedef struct {
-  char *key;
-  void *value;
+  char    *key;
+  void    *value;
+  /**
+   * The key's hash, kept so resizes never rehash the key.
+   */
+  uint64_t hash;
 } ht_entry;
 
 /**
- * A hash table
+ * A block of key storage.
+ */
+typedef struct ht_key_block ht_key_block;
+
+/**
+ * A hash table: open addressing over groups of `HT_GROUP_SIZE` slots, with a
+ * control byte per slot so a probe checks a whole group with a few (SSE2)
+ * instructions and only compares keys whose hash fragment matches.
  */
 typedef struct {
   /**
-   * Max number of entries which may be stored in the hash table. Adjustable.
-   * Calculated as the first prime subsequent to the base capacity.
+   * Number of slots; a power of two, and a multiple of `HT_GROUP_SIZE`.
+   * Adjustable: the table grows past 7/8 full and shrinks below 1/8.
    */
   unsigned int capacity;
 
   /**
-   * Base capacity (used to calculate load for resizing)
+   * Number of non-NULL entries in the hash table, including those still in
+   * the old slots
    */
-  unsigned int base_capacity;
+  unsigned int count;
 
   /**
-   * Number of non-NULL entries in the hash table
+   * Number of slots marked deleted. They lengthen probe sequences until
+   * reused or cleared by the next resize.
    */
-  unsigned int count;
+  unsigned int deleted;
+
+  /**
+   * A control byte per slot; see HT_CTRL_*
+   */
+  uint8_t *ctrl;
 
   /**
    * The hash table's entries
    */
-  ht_entry **entries;
+  ht_entry *entries;
+
+  /**
+   * Where keys are copied to, newest block first. A resize compacts them.
+   */
+  ht_key_block *keys;
+
+  /**
+   * Bytes of key storage held by deleted keys
+   */
+  size_t dead_key_bytes;
+
+  /**
+   * The slots being resized away from, if any. A resize moves entries out of
+   * them a few at a time, on each insert and delete, so no single operation
+   * pays for the whole table; until it's done, lookups check both.
+   */
+  uint8_t      *old_ctrl;
+  ht_entry     *old_entries;
+  unsigned int  old_capacity;
+  ht_key_block *old_keys;
+
+  /**
+   * The next old slot to move
+   */
+  unsigned int migrated;
 
   /**
    * Either a free_fn* or NULL; if set, this function pointer will be invoked
@@ -53,14 +109,12 @@ typedef struct {
    * however they want.
    */
   free_fn *free_value;
-
-  node_t *occupied_buckets;
 } hash_table;
 
 /**
- * Initialize a new hash table with a size of `max_size`
+ * Initialize a new hash table with room for about `base_capacity` entries
  *
- * @param max_size The hash table capacity
+ * @param base_capacity The expected number of entries, or 0
  * @param free_value See free_fn
  * @return hash_table*
  */
@@ -84,7 +138,7 @@ ht_entry *ht_search(hash_table *ht, const char *key);
 
 /**
  * Eagerly retrieve the value inside of the entry stored at the given key.
- * Will segfault if the key entry does not exist.
+ * Returns NULL if the key entry does not exist.
  *
  * @param ht
  * @param key
@@ -101,8 +155,8 @@ void ht_delete_table(hash_table *ht);
 /**
  * Delete a entry for the given key `key`. Because entries
  * may be part of a collision chain, and removing them completely
- * could cause infinite lookup attempts, we replace the deleted entry
- * with a NULL sentinel entry.
+ * could cut other keys' probes short, the slot is marked deleted
+ * unless no probe can have passed it.
  *
  * @param ht
  * @param key
@@ -112,15 +166,33 @@ void ht_delete_table(hash_table *ht);
  */
 int ht_delete(hash_table *ht, const char *key);
 
-#define HT_ITER_START(ht)                \
-  node_t *head = ht->occupied_buckets;   \
-  while (!list_is_sentinel_node(head)) { \
-    ht_entry *entry = ht->entries[head->value];
-
-#define HT_ITER_END  \
-  head = head->next; \
+/**
+ * Returns the `i`th of a table's slots (old slots last) if it's full, for
+ * HT_ITER_*.
+ */
+static inline ht_entry *
+ht_iter_slot (hash_table *ht, unsigned int i) {
+  if (i < ht->capacity) {
+    return ht->ctrl[i] & HT_CTRL_FREE ? NULL : &ht->entries[i];
   }
 
+  i -= ht->capacity;
+  return ht->old_ctrl[i] & HT_CTRL_FREE ? NULL : &ht->old_entries[i];
+}
+
+/*
+ * Iterates a table's entries, each as `ht_entry *entry`. The table must not be
+ * modified while iterating it.
+ */
+#define HT_ITER_START(ht)                                                               \
+  for (unsigned int _ht_i = 0; _ht_i < (ht)->capacity + (ht)->old_capacity; _ht_i++) { \
+    ht_entry *entry = ht_iter_slot((ht), _ht_i);                                        \
+    if (!entry) {                                                                       \
+      continue;                                                                         \
+    }
+
+#define HT_ITER_END }
+
 typedef struct {
   /**
    * Max number of keys which may be stored in the hash set. Adjustable.
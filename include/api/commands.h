@@ -1,19 +1,59 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include <sys/types.h>
+
 #include "libhash/libhash.h"
 #include "libutil/libutil.h"
 
+#define ERROR_MESSAGE_FMT "{\"error\":\"%s\"}"
+
+/**
+ * A command handler. Writes its response to `buf`, encoded in the format named
+ * by the request's "format" argument ("json", the default, or "msgpack").
+ *
+ * @param buf
+ * @param args The request's key/value pairs, including "command". May be NULL.
+ * @param caller The uid of the connected client. Besides root and the
+ * daemon's own user, callers may only control their own jobs and crontabs.
+ */
+typedef void command_handler(buffer_t* buf, hash_table* args, uid_t caller);
+
 /**
  * Retrieves the command handlers map singleton.
  * Initialized lazily.
  *
- * @return hash_table* i.e. HashTable<char*, void (*handler)(int)>
+ * @return hash_table* i.e. HashTable<char*, command_handler*>
  */
 hash_table* get_command_handlers_map(void);
 
-void write_jobs_info(buffer_t* buf);
-void write_crontabs_info(buffer_t* buf);
-void write_program_info(buffer_t* buf);
+/**
+ * Writes `{"error": msg}` in the format requested by `args`.
+ */
+void write_error(buffer_t* buf, hash_table* args, const char* msg);
+
+/* Times ("next") are UTC, as "YYYY-MM-DDTHH:MM:SS.000Z" in JSON and timestamp
+ * extensions in MessagePack */
+void write_jobs_info(buffer_t* buf, hash_table* args, uid_t caller);
+void write_crontabs_info(buffer_t* buf, hash_table* args, uid_t caller);
+void write_program_info(buffer_t* buf, hash_table* args, uid_t caller);
+/* Writes metrics in the OpenMetrics text format, whatever the requested format */
+void write_metrics_info(buffer_t* buf, hash_table* args, uid_t caller);
+
+/* Job control. Entries are identified by "id"; crontabs (pause/resume only) by
+ * "crontab", their file path. */
+void write_job_info(buffer_t* buf, hash_table* args, uid_t caller);
+void handle_run_now(buffer_t* buf, hash_table* args, uid_t caller);
+void handle_pause(buffer_t* buf, hash_table* args, uid_t caller);
+void handle_resume(buffer_t* buf, hash_table* args, uid_t caller);
+/* Signals a running job's process group; "signal" defaults to SIGTERM */
+void handle_kill_job(buffer_t* buf, hash_table* args, uid_t caller);
+/* Writes what has been captured of a job's output, running or recently finished,
+ * to the job's owner or a privileged caller */
+void write_job_output(buffer_t* buf, hash_table* args, uid_t caller);
+
+/* Sets log verbosity from the optional "level" spec (see `logger_set_levels`),
+ * if the caller is privileged, and writes the resulting level of each category */
+void handle_log_level(buffer_t* buf, hash_table* args, uid_t caller);
 
 #endif /* COMMANDS_H */
@@ -2,15 +2,58 @@
 #define CLI_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * How log records get to the log file.
+ */
+typedef enum {
+  /* Each log call writes to the file directly */
+  LOG_MODE_SYNC,
+  /* Log calls enqueue to a ring buffer drained by a writer thread; when the
+     ring is full, callers wait for space */
+  LOG_MODE_ASYNC_BLOCK,
+  /* Same as LOG_MODE_ASYNC_BLOCK, but records that don't fit are dropped */
+  LOG_MODE_ASYNC_DROP,
+} log_mode;
 
 /**
  * Command-line interface configuration options.
  */
 typedef struct {
   /* log file path, mutually exclusive with syslog */
-  char* log_file;
+  char*        log_file;
   /* use syslog, mutually exclusive with specified log file */
-  bool  syslog;
+  bool         syslog;
+  /* optional path of the shared-memory status segment; disabled if NULL */
+  char*        status_shm;
+  /* log file write mode; ignored when using syslog */
+  log_mode     log_mode;
+  /* rotate the log file once it reaches this many bytes; 0 disables */
+  size_t       log_max_size;
+  /* rotate the log file once it's been open this many seconds; 0 disables */
+  time_t       log_max_age;
+  /* rotated log files to keep */
+  unsigned int log_max_files;
+  /* gzip rotated log files in the background */
+  bool         log_compress;
+  /* optional path of the binary job journal; disabled if NULL */
+  char*        journal;
+  /* directory job output is captured to; a per-user default if NULL */
+  char*        output_dir;
+  /* bytes of output kept per job */
+  size_t       output_max;
+  /* program job reports are sent with; invoked like mail(1), without a shell */
+  char*        mail_cmd;
+  /* if set, batch reports per recipient and send one digest per this many seconds */
+  time_t       mail_digest;
+  /* if set, submit mail to this relay (host[:port] for SMTP, a socket path for LMTP) */
+  char*        mail_relay;
+  /* render job and entry ids as UUIDs (in IPC, status and mail) instead of hex */
+  bool         uuid_ids;
+  /* if set, members of this group may connect to the IPC socket too */
+  char*        socket_group;
 } cli_opts;
 
 /**
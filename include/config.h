@@ -46,4 +46,104 @@
 #  define MAILCMD_PATH "/usr/bin/mail"
 #endif
 
+/* Port of a mail relay given without one */
+#ifndef SMTP_PORT
+#  define SMTP_PORT "25"
+#endif
+
+/* Seconds an idle connection to the mail relay is kept open */
+#ifndef SMTP_IDLE_SECS
+#  define SMTP_IDLE_SECS 60
+#endif
+
+/* Seconds to wait on the mail relay before dropping the connection */
+#ifndef SMTP_TIMEOUT_SECS
+#  define SMTP_TIMEOUT_SECS 30
+#endif
+
+/* Attempts at submitting a message before giving up on it */
+#ifndef SMTP_MAX_ATTEMPTS
+#  define SMTP_MAX_ATTEMPTS 3
+#endif
+
+/* Seconds to wait before reconnecting to a mail relay that couldn't be reached */
+#ifndef SMTP_RETRY_SECS
+#  define SMTP_RETRY_SECS 10
+#endif
+
+/* Messages (each holding an open report) waiting for the mail relay at most */
+#ifndef SMTP_MAX_QUEUED
+#  define SMTP_MAX_QUEUED 512
+#endif
+
+/* Seconds to wait at shutdown for the mail relay to take what's queued */
+#ifndef SMTP_DRAIN_SECS
+#  define SMTP_DRAIN_SECS 10
+#endif
+
+/* Program used to compress rotated log files */
+#ifndef GZIP_PATH
+#  define GZIP_PATH "/bin/gzip"
+#endif
+
+/* Where pause state set via the IPC API is persisted, when running as root */
+#ifndef SYS_PAUSE_STATE_PATH
+#  define SYS_PAUSE_STATE_PATH "/var/lib/crond.paused"
+#endif
+
+/* Where pause state set via the IPC API is persisted, for non-root users; under their home directory */
+#ifndef USR_PAUSE_STATE_PATH_FMT
+#  define USR_PAUSE_STATE_PATH_FMT "%s/.crond.paused"
+#endif
+
+/* Where job output is captured, when running as root */
+#ifndef SYS_JOB_OUTPUT_DIR
+#  define SYS_JOB_OUTPUT_DIR "/var/lib/crond.output"
+#endif
+
+/* Where job output is captured, for non-root users */
+#ifndef USR_JOB_OUTPUT_DIR_FMT
+#  define USR_JOB_OUTPUT_DIR_FMT "%s/.crond.output"
+#endif
+
+/* Bytes of output kept per job by default; the rest is counted and discarded */
+#ifndef JOB_OUTPUT_MAX
+#  define JOB_OUTPUT_MAX (64 * 1024)
+#endif
+
+/* Output files of finished jobs kept for IPC; older ones are removed */
+#ifndef JOB_OUTPUT_KEEP
+#  define JOB_OUTPUT_KEEP 256
+#endif
+
+/* Max length of a single log record, header included; longer ones are truncated */
+#ifndef LOG_RECORD_MAX
+#  define LOG_RECORD_MAX 2048
+#endif
+
+/* Number of records in the async logger's ring buffer (must be a power of two) */
+#ifndef LOG_RING_SLOTS
+#  define LOG_RING_SLOTS 512
+#endif
+
+/* Max records the async logger's writer thread hands to a single writev */
+#ifndef LOG_WRITEV_BATCH
+#  define LOG_WRITEV_BATCH 64
+#endif
+
+/* Rotated log files kept by default when built-in log rotation is enabled */
+#ifndef LOG_MAX_FILES
+#  define LOG_MAX_FILES 5
+#endif
+
+/* Size cap of each binary journal file, header included */
+#ifndef JOURNAL_MAX_BYTES
+#  define JOURNAL_MAX_BYTES (4 * 1024 * 1024)
+#endif
+
+/* Number of journal files kept: the live one plus JOURNAL_MAX_FILES - 1 rotated ones */
+#ifndef JOURNAL_MAX_FILES
+#  define JOURNAL_MAX_FILES 4
+#endif
+
 #endif /* CONFIG_H */
@@ -3,27 +3,27 @@
 
 #include <fcntl.h>
 
-#define ROOT_UNAME     "root"
-#define ROOT_UID       0
-
-#define ALL_PERMS      07777
-#define OWNER_RW_PERMS 0600
-#define OWNER_RX_PERMS 0500
-
-#define HOMEDIR_ENVVAR "HOME"
-#define SHELL_ENVVAR   "SHELL"
-#define PATH_ENVVAR    "PATH"
-#define UNAME_ENVVAR   "USER"
-#define MAILTO_ENVVAR  "MAILTO"
-
-#define TINY_BUFFER    32
-#define SMALL_BUFFER   TINY_BUFFER * 8
-#define MED_BUFFER     SMALL_BUFFER * 4
-#define LARGE_BUFFER   MED_BUFFER * 2
-
-/* Mail command path | sender | hostname | subject |  recipient */
-#define MAILCMD_FMT    "%s -r%s@%s -s '%s' %s"
-#define MAIL_SUBJECT   "cron job completed"
+#define ROOT_UNAME        "root"
+#define ROOT_UID          0
+
+#define ALL_PERMS         07777
+#define OWNER_RW_PERMS    0600
+#define OWNER_RX_PERMS    0500
+#define OWNER_RWX_PERMS   0700
+
+#define HOMEDIR_ENVVAR    "HOME"
+#define SHELL_ENVVAR      "SHELL"
+#define PATH_ENVVAR       "PATH"
+#define UNAME_ENVVAR      "USER"
+#define MAILTO_ENVVAR     "MAILTO"
+#define MAILPOLICY_ENVVAR "MAILPOLICY"
+
+#define TINY_BUFFER       32
+#define SMALL_BUFFER      TINY_BUFFER * 8
+#define MED_BUFFER        SMALL_BUFFER * 4
+#define LARGE_BUFFER      MED_BUFFER * 2
+
+#define MAIL_SUBJECT      "cron job completed"
 
 #ifndef CHRONIC_VERSION
 #  define CHRONIC_VERSION "0.0.1"
@@ -1,10 +1,13 @@
 #ifndef CRON_ENTRY_H
 #define CRON_ENTRY_H
 
+#include <stdbool.h>
 #include <time.h>
 
 #include "ccronexpr/ccronexpr.h"
 #include "crontab.h"
+#include "exprpool.h"
+#include "utils/ident.h"
 
 #define HOURLY_EXPR         "0 * * * *"
 #define DAILY_EXPR          "0 0 * * *"
@@ -12,42 +15,61 @@
 #define MONTHLY_EXPR        "0 0 1 * *"
 
 #define MAX_SCHEDULE_LENGTH 32
-#define MAX_COMMAND_LENGTH  256
 
 /**
- * Represents a single line (entry) in a crontab.
+ * The parts of an entry that are only needed to run or describe it. Kept apart
+ * from `cron_entry`, in their crontab's `info_arena`, so that scanning entries
+ * for due jobs doesn't pull them into cache.
  */
 typedef struct {
   /**
-   * The pre-parsed cron expression.
+   * The original cron schedule specification in the entry. Pooled (see
+   * strpool.h), as are commands: most are shared by many entries.
    */
-  cron_expr *expr;
+  const char *schedule;
   /**
-   * The original cron schedule specification in the entry.
+   * The command specified by the entry. Pooled.
    */
-  char       schedule[MAX_SCHEDULE_LENGTH];
+  const char *cmd;
   /**
-   * The command specified by the entry.
+   * A unique identifier for the entry. Used for logging and non-critical
+   * functions.
    */
-  char       cmd[MAX_COMMAND_LENGTH];
+  ident_t     id;
+} cron_entry_info;
+
+/**
+ * Represents a single line (entry) in a crontab. Allocated from its crontab's
+ * arena, where a crontab's entries end up back to back.
+ */
+typedef struct {
   /**
    * The next execution time, relative to the current crond iteration.
    */
-  time_t     next;
+  time_t           next;
   /**
-   * A unique identifier for the entry. Used for logging and non-critical
-   * functions.
+   * The pre-parsed cron expression, shared with entries on the same schedule.
    */
-  char      *ident;
+  shared_expr     *expr;
   /**
    * A pointer to the entry's parent crontab.
    */
-  crontab_t *parent;
+  crontab_t       *parent;
+  /**
+   * The entry's schedule, command and id.
+   */
+  cron_entry_info *info;
+  /**
+   * Whether the entry has been paused via the IPC API. Mirrors the pause
+   * registry (see pause.h); only the main loop writes it.
+   */
+  bool             paused;
 } cron_entry;
 
 /**
  * Parses the raw line from the crontab file as an entry for the provided
- * crontab object.
+ * crontab object. The entry is allocated from the crontab's arena and freed
+ * with it.
  *
  * @param raw The raw line/entry.
  * @param curr The current crond iteration time.
@@ -58,6 +80,12 @@ typedef struct {
  */
 cron_entry *new_cron_entry(char *raw, time_t curr, crontab_t *ct, cadence_t cadence);
 
+/**
+ * Releases what an entry holds outside its crontab's arena i.e. its pooled
+ * strings and expression. Called as its crontab is freed.
+ */
+void release_cron_entry(cron_entry *entry);
+
 /**
  * Renews the `next` field on the given cron entry based on the current crond
  * iteration time.
@@ -67,9 +95,4 @@ cron_entry *new_cron_entry(char *raw, time_t curr, crontab_t *ct, cadence_t cade
  */
 void renew_cron_entry(cron_entry *entry, time_t curr);
 
-/**
- * Deallocates a cron entry.
- */
-void free_cron_entry(cron_entry *entry);
-
 #endif /* CRON_ENTRY_H */
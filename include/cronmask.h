@@ -0,0 +1,66 @@
+#ifndef CRONMASK_H
+#define CRONMASK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ccronexpr/ccronexpr.h"
+
+/**
+ * A cron expression's fields as one word each, so the next fire time can be
+ * found with bit scans instead of cron_next's walk through the calendar. Only
+ * plain five-field expressions in UTC fit: no seconds, years or L/W/#
+ * modifiers.
+ */
+typedef struct {
+  uint64_t minutes;
+  uint32_t hours;
+  /**
+   * Bits 1-31
+   */
+  uint32_t days_of_month;
+  /**
+   * Bits 0-11, January first
+   */
+  uint16_t months;
+  /**
+   * Bits 0-6, Sunday first
+   */
+  uint8_t  days_of_week;
+  /**
+   * Whether the expression fits; `cronmask_next` gives up on it otherwise
+   */
+  bool     usable;
+} cron_mask;
+
+/**
+ * Fills `mask` from `expr`.
+ *
+ * @param expr
+ * @param mask
+ * @return bool Whether the expression fits a mask, as in `mask->usable`
+ */
+bool cronmask_compile(const cron_expr *expr, cron_mask *mask);
+
+/**
+ * Returns the mask's next fire time after `curr`, the same as cron_next's, or
+ * CRON_INVALID_INSTANT if the mask isn't usable or the expression doesn't fire
+ * in the next four years; use cron_next then.
+ *
+ * @param mask
+ * @param curr
+ * @return time_t
+ */
+time_t cronmask_next(const cron_mask *mask, time_t curr);
+
+/**
+ * Fills `at` with the single bit each field of the UTC minute `minute` selects,
+ * so that a mask fires then if it shares a bit with `at` in every field.
+ *
+ * @param minute
+ * @param at
+ */
+void cronmask_at(time_t minute, cron_mask *at);
+
+#endif /* CRONMASK_H */
@@ -0,0 +1,99 @@
+#ifndef CRONMATCH_H
+#define CRONMATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "cronmask.h"
+
+/**
+ * Masks stored field by field (a structure of arrays), so whether each fires
+ * at a given minute can be tested several lanes at a time. Lanes are padded
+ * with empty masks, which never fire, to a multiple of 64.
+ */
+typedef struct {
+  uint32_t *minutes_lo;
+  uint32_t *minutes_hi;
+  uint32_t *hours;
+  uint32_t *days_of_month;
+  /**
+   * Months in bits 0-11, days of the week in bits 16-22
+   */
+  uint32_t *months_days_of_week;
+  size_t    count;
+  size_t    capacity;
+} cron_mask_set;
+
+typedef enum {
+  CRONMATCH_SCALAR,
+  CRONMATCH_SSE2,
+  CRONMATCH_AVX2,
+} cronmatch_kernel;
+
+/**
+ * Initializes an empty set.
+ *
+ * @param set
+ */
+void cronmatch_init(cron_mask_set *set);
+
+/**
+ * Frees the set's lanes, leaving it empty.
+ *
+ * @param set
+ */
+void cronmatch_free(cron_mask_set *set);
+
+/**
+ * Adds `mask` in a new lane, growing the set as needed. Masks that aren't
+ * usable take a lane that never fires.
+ *
+ * @param set
+ * @param mask
+ * @return size_t The lane
+ */
+size_t cronmatch_push(cron_mask_set *set, const cron_mask *mask);
+
+/**
+ * Overwrites lane `lane` with `mask`.
+ *
+ * @param set
+ * @param lane
+ * @param mask
+ */
+void cronmatch_put(cron_mask_set *set, size_t lane, const cron_mask *mask);
+
+/**
+ * Drops the last lane.
+ *
+ * @param set
+ */
+void cronmatch_pop(cron_mask_set *set);
+
+/**
+ * Sets bit `i` of `fired` (one word per 64 lanes, `capacity / 64` in all) for
+ * each lane `i` that fires at `minute`, clearing the rest.
+ *
+ * @param set
+ * @param minute
+ * @param fired
+ */
+void cronmatch_fires(const cron_mask_set *set, time_t minute, uint64_t *fired);
+
+/**
+ * Returns the fastest kernel this CPU supports, which `cronmatch_fires` uses
+ * unless told otherwise by `cronmatch_use`.
+ */
+cronmatch_kernel cronmatch_best(void);
+
+/**
+ * Makes `cronmatch_fires` use kernel `k`, if the CPU supports it.
+ *
+ * @param k
+ * @return bool Whether it does
+ */
+bool cronmatch_use(cronmatch_kernel k);
+
+#endif /* CRONMATCH_H */
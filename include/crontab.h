@@ -2,10 +2,12 @@
 #define CRONTAB_H
 
 #include <stdbool.h>
+#include <sys/types.h>
 #include <time.h>
 
 #include "libhash/libhash.h"
 #include "libutil/libutil.h"
+#include "utils/arena.h"
 
 typedef enum {
   /**
@@ -18,6 +20,29 @@ typedef enum {
   CADENCE_MONTHLY,
 } cadence_t;
 
+/**
+ * When the outcome of a crontab's jobs gets mailed. Set via the MAILPOLICY
+ * variable.
+ */
+typedef enum {
+  /**
+   * Every finished job (the default).
+   */
+  MAIL_ALWAYS,
+  /**
+   * Jobs that exited non-zero.
+   */
+  MAIL_ON_FAILURE,
+  /**
+   * Jobs that wrote any output.
+   */
+  MAIL_ON_OUTPUT,
+  /**
+   * No mail. Also implied by an empty MAILTO.
+   */
+  MAIL_NEVER,
+} mail_policy;
+
 /**
  * Holds metadata and configuration for one of the crontab directories being
  * tracked.
@@ -56,6 +81,17 @@ typedef struct {
  * crontabs.
  */
 typedef struct {
+  /**
+   * Holds the crontab itself and everything it owns bar the `entries` array
+   * and `vars` table: entries, variable values, envp. Freed all at once with
+   * the crontab.
+   */
+  arena_t    *arena;
+  /**
+   * Holds the entries' infos (see `cron_entry_info`), away from the entries
+   * themselves. Freed with the crontab.
+   */
+  arena_t    *info_arena;
   /**
    * The last time this crontab file was modified.
    */
@@ -64,6 +100,11 @@ typedef struct {
    * The owning user's username (and name of the crontab file).
    */
   char       *uname;
+  /**
+   * The owning user's uid; (uid_t)-1 if they aren't in the system user db.
+   * Only they and root may control the crontab's jobs via the IPC API.
+   */
+  uid_t       uid;
   /**
    * An array of this crontab's entries.
    * i.e. List<cron_entry*>
@@ -79,26 +120,66 @@ typedef struct {
    * "key=value" literals.
    */
   char      **envp;
+  /**
+   * Number of db versions referencing this crontab. Unmodified crontabs are
+   * carried over from one db version to the next rather than rebuilt, so a
+   * crontab may be shared by the published snapshot and the one being built.
+   * Only ever touched by the db owner (the main loop).
+   */
+  unsigned int refs;
+  /**
+   * Whether the whole crontab has been paused via the IPC API. Mirrors the
+   * pause registry (see pause.h); only the main loop writes it.
+   */
+  bool         paused;
+  /**
+   * When jobs' outcomes are mailed, per the MAILPOLICY and MAILTO variables.
+   */
+  mail_policy  mail_policy;
 } crontab_t;
 
 /**
  * Parses a file into new crontab.
  *
- * @param crontab_fd The file descriptor for the crontab file.
+ * @param crontab_fd The file descriptor for the crontab file. Borrowed; it's
+ * read from its current offset and left open.
  * @param is_root A flag indicating whether this is a system (root-owned)
  * crontab.
  * @param curr_time The current time.
  * @param mtime The last modified time of the file represented by `crontab_fd`.
- * @param uname The username (and filename).
+ * @param uname The username (and filename). Copied.
  * @return crontab_t*
  */
-crontab_t *new_crontab(int crontab_fd, bool is_root, time_t curr_time, time_t mtime, char *uname);
+crontab_t *new_crontab(int crontab_fd, bool is_root, time_t curr_time, time_t mtime, const char *uname);
 
 /**
- * Deallocates a crontab.
+ * Deallocates a crontab, regardless of its reference count.
  */
 void free_crontab(crontab_t *ct);
 
+/**
+ * Adds a reference to the given crontab e.g. when carrying it over into a new
+ * db version.
+ *
+ * @return crontab_t* The same crontab, for convenience.
+ */
+crontab_t *retain_crontab(crontab_t *ct);
+
+/**
+ * Drops a reference to the given crontab and deallocates it once no db version
+ * references it. This is the free function used by crontab db tables.
+ */
+void release_crontab(crontab_t *ct);
+
+/**
+ * Renews the next fire time of every entry in the db. Entries are otherwise
+ * renewed only as they fire, so this is for when the clock jumps.
+ *
+ * @param db A hash table of crontabs, in the form HashTable<char*, crontab_t*>
+ * @param curr The time to renew from.
+ */
+void renew_crontabs(hash_table *db, time_t curr);
+
 /**
  * Scans all crontabs in the given directory and updates them if needed.
  *
@@ -125,9 +206,12 @@ void scan_crontabs(hash_table *old_db, hash_table *new_db, dir_config *dir_conf,
 void scan_virtual_crontabs(hash_table *old_db, hash_table *new_db, dir_config *dir_conf, time_t curr, cadence_t cadence);
 
 /**
- * Updates the crontab database by scanning all files that have been modified.
+ * Builds the next version of the crontab database by scanning all files that
+ * have been modified. Unmodified crontabs are shared with (retained from) the
+ * given database, which is otherwise left intact so that readers may keep
+ * using it; the caller is responsible for releasing it (see `db_publish`).
  *
- * @param db A pointer to the crontab database.
+ * @param db A pointer to the current crontab database.
  * @param curr The current time.
  * @param dir_conf A variadic list of directories to be scanned.
  * @param ...
@@ -0,0 +1,69 @@
+#ifndef DB_H
+#define DB_H
+
+#include <stdatomic.h>
+
+#include "libhash/libhash.h"
+
+/**
+ * An immutable, published version of the crontab database.
+ *
+ * The main loop is the only writer: it builds a brand new table in `update_db`
+ * and publishes it via `db_publish`. Other threads (e.g. the IPC server) never
+ * read the `db` global directly; instead, they pin the current snapshot with
+ * `db_acquire` and unpin it with `db_release`. Retired snapshots are only freed
+ * once every reader that pinned them has drained, so readers never block the
+ * scheduler and the scheduler never blocks readers.
+ */
+typedef struct {
+  /**
+   * The crontab table for this version.
+   * i.e. HashTable<char*, crontab_t*>
+   */
+  hash_table   *crontabs;
+  /**
+   * Number of readers currently pinning this snapshot.
+   */
+  atomic_uint   refs;
+  /**
+   * Monotonically increasing version number; incremented on every publish.
+   */
+  unsigned long version;
+} db_snapshot;
+
+/**
+ * Publishes the given crontab table as the current snapshot. The previously
+ * published snapshot is retired and will be deallocated (along with its table)
+ * once all of its readers have released it.
+ *
+ * Must only be called from the thread that owns the db (the main loop).
+ *
+ * @param crontabs The new crontab table. Ownership transfers to the db. May be
+ * NULL, in which case readers will see no snapshot.
+ */
+void db_publish(hash_table *crontabs);
+
+/**
+ * Pins the current snapshot so it won't be deallocated while in use.
+ * Every successful call must be paired with a call to `db_release`.
+ *
+ * @return db_snapshot* The pinned snapshot, or NULL if nothing was published.
+ */
+db_snapshot *db_acquire(void);
+
+/**
+ * Unpins a snapshot previously returned by `db_acquire`. NULL-safe.
+ *
+ * @param snap
+ */
+void db_release(db_snapshot *snap);
+
+/**
+ * Deallocates any retired snapshots that no longer have readers.
+ * Called automatically on each publish; must only be called by the db owner.
+ *
+ * @return unsigned int The number of retired snapshots still awaiting readers.
+ */
+unsigned int db_reclaim(void);
+
+#endif /* DB_H */
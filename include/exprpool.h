@@ -0,0 +1,102 @@
+#ifndef EXPRPOOL_H
+#define EXPRPOOL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <stdbool.h>
+
+#include "ccronexpr/ccronexpr.h"
+#include "cronmask.h"
+
+// Minutes of lookahead kept for each expression: a day's worth
+#define EXPRPOOL_WINDOW 1440
+
+/**
+ * A parsed cron expression shared by every entry whose schedule parses to the
+ * same fields, whatever its text: "0,30 * * * *" and "0-59/30 * * * *" are one
+ * expression. Fleets have many entries but few distinct schedules.
+ */
+typedef struct {
+  cron_expr    expr;
+  /**
+   * The expression as bitmasks, for the common case of a plain schedule
+   */
+  cron_mask    mask;
+  /**
+   * The expression's lane in the pool's mask set; see `exprpool_advance`
+   */
+  size_t       lane;
+  /**
+   * Which minutes of the pool's window the expression fires in, bit `i` being
+   * the minute `i` minutes into the (UTC) day. Kept for usable masks only.
+   */
+  uint64_t     window[(EXPRPOOL_WINDOW + 63) / 64];
+  uint64_t     hash;
+  /**
+   * Number of entries using the expression
+   */
+  unsigned int refs;
+  /**
+   * The time `next` was last computed from, and the result, so that entries
+   * renewed at the same time share one lookup. A usable mask's result also
+   * holds for any time between the two. Only the main loop computes next
+   * times.
+   */
+  time_t       from;
+  time_t       next;
+} shared_expr;
+
+/**
+ * Returns the shared copy of `expr`, adding it if there is none yet. Each call
+ * must be matched by an `exprpool_release`. Main loop only, as are crontabs'
+ * building and freeing.
+ *
+ * @param expr
+ * @return shared_expr*
+ */
+shared_expr *exprpool_intern(const cron_expr *expr);
+
+/**
+ * Drops a reference taken by `exprpool_intern`, freeing the expression once no
+ * entry uses it.
+ */
+void exprpool_release(shared_expr *e);
+
+/**
+ * Returns the expression's next fire time after `curr`, as cron_next would,
+ * computing it at most once per distinct `curr`. Plain schedules skip
+ * cron_next: they look in their window first, then use `cronmask_next`.
+ *
+ * @param e
+ * @param curr
+ * @return time_t
+ */
+time_t exprpool_next(shared_expr *e, time_t curr);
+
+/**
+ * Slides every expression's window to start at the minute of `now`. Sliding
+ * forward less than a window works out only the minutes entering it, for all
+ * expressions at once (see cronmatch_fires); anything else, such as the clock
+ * going back, fills the windows anew. Main loop only, once per tick.
+ *
+ * @param now
+ */
+void exprpool_advance(time_t now);
+
+/**
+ * Returns whether `e` fires at `minute`: a bit test within the window, the
+ * next fire time after the minute before otherwise.
+ *
+ * @param e
+ * @param minute
+ * @return bool
+ */
+bool exprpool_fires(shared_expr *e, time_t minute);
+
+/**
+ * Returns the number of distinct expressions in use.
+ */
+size_t exprpool_count(void);
+
+#endif /* EXPRPOOL_H */
@@ -25,6 +25,9 @@ extern proginfo_t proginfo;
 /**
  * Stores all valid crontabs.
  * i.e. HashTable<char*, crontab_t*> where char* is the file name.
+ *
+ * This is the main loop's working copy. Other threads must not read it
+ * directly; they pin the published version via `db_acquire` (see db.h).
  */
 extern hash_table *db;
 
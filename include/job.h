@@ -1,10 +1,16 @@
 #ifndef JOB_H
 #define JOB_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #include "cronentry.h"
+#include "crontab.h"
+#include "joboutput.h"
 #include "libhash/libhash.h"
+#include "metrics.h"
+#include "utils/ident.h"
 
 /**
  * Represents all possible job states.
@@ -45,39 +51,65 @@ typedef enum {
  */
 typedef struct {
   /**
-   * A unique identifier for the job (UUID v4).
+   * A unique identifier for the job.
    */
-  char     *ident;
+  ident_t        id;
   /**
    * The command to be executed.
    */
-  char     *cmd;
+  char          *cmd;
   /**
    * The process id of the job when running. Starts as -1.
    */
-  pid_t     pid;
+  pid_t          pid;
   /**
    * The current job state.
    */
-  job_state state;
+  job_state      state;
   /**
    * The username or email address to whom results will be reported.
    * This is set by the MAILTO variable in the corresponding crontab.
    * If MAILTO is not present, this will be set to the owning user's username.
    */
-  char     *mailto;
+  char          *mailto;
+  /**
+   * The uid of the user whose crontab the job comes from; (uid_t)-1 for MAIL
+   * jobs and users who aren't in the system user db.
+   */
+  uid_t          owner;
+  /**
+   * When a CRON job's outcome is mailed to `mailto`, per its crontab.
+   */
+  mail_policy    mail_policy;
   /**
    * The job type.
    */
-  job_type  type;
+  job_type       type;
   /**
    * The return status of the job, once executed. Starts as -1.
    */
-  int       ret;
+  int            ret;
   /**
    * The time at which this job will next run.
    */
-  time_t    next_run;
+  time_t         next_run;
+  /**
+   * The owning user's counters. NULL for MAIL jobs.
+   */
+  metrics_user  *metrics;
+  /**
+   * The id of the entry this job runs; for MAIL jobs, the id of the job being
+   * reported on (0 for digests).
+   */
+  ident_t        entry_id;
+  /**
+   * Monotonic time (microseconds) at which the job was forked.
+   */
+  uint64_t       started_usec;
+  /**
+   * What was captured of a CRON job's output, once it has EXITED.
+   */
+  joboutput_info output;
 } job_t;
 
 /**
@@ -96,14 +128,60 @@ void reap_routine_init(void);
 void signal_reap_routine(void);
 
 /**
- * Iterates the crontab db and runs any job whose `next` timestamp matches the
- * current rounded timestamp.
+ * Sends every pending mail digest now, whether or not its window has elapsed,
+ * so none are lost when the daemon exits.
+ */
+void job_mail_flush(void);
+
+/**
+ * Sends a report by spawning the mail program, bypassing the mail relay; the
+ * relay's fallback for messages it couldn't deliver.
+ *
+ * @param mailto
+ * @param subject
+ * @param body_fd Borrowed.
+ */
+void job_mail_spawn(const char *mailto, const char *subject, int body_fd);
+
+/**
+ * Iterates the crontab db and runs any job whose schedule fires at the current
+ * rounded timestamp, as its expression's window has it (see exprpool_fires).
+ * Entries that fire, even paused ones, have their next fire time renewed;
+ * those are the only ones that need it.
  *
  * @param db A hash table of eligible jobs, in the form HashTable<char*, crontab_t*>
  * @param ts The current rounded time.
  */
 void try_run_jobs(hash_table *db, time_t ts);
 
+/**
+ * Runs a new job for the given entry immediately.
+ *
+ * @param entry The entry to run. Must remain valid for the duration of the call.
+ * @param id If not NULL, set to the new job's id.
+ */
+void run_cronjob(cron_entry *entry, ident_t *id);
+
+/**
+ * Finds the CRON job with the given id in the job queue and calls `fn` on it
+ * while holding the job queue lock, so `fn` must not block.
+ *
+ * @param id
+ * @param fn
+ * @param ctx Passed through to `fn`.
+ * @return bool Whether the job was found.
+ */
+bool job_visit(ident_t id, void (*fn)(job_t *job, void *ctx), void *ctx);
+
+/**
+ * Calls `fn` on the job queue while holding its lock, so jobs are neither
+ * added nor removed while `fn` walks it. `fn` must not block.
+ *
+ * @param fn
+ * @param ctx Passed through to `fn`.
+ */
+void job_queue_visit(void (*fn)(array_t *queue, void *ctx), void *ctx);
+
 /**
  * Creates a new job of type CRON.
  *
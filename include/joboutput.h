@@ -0,0 +1,93 @@
+#ifndef JOBOUTPUT_H
+#define JOBOUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "libutil/libutil.h"
+#include "utils/ident.h"
+#include "utils/retval.h"
+
+/**
+ * What was captured of a job's output.
+ */
+typedef struct {
+  /**
+   * Bytes kept in the job's output file; at most `opts.output_max`.
+   */
+  size_t bytes;
+  /**
+   * Bytes the job wrote past the cap, which were discarded.
+   */
+  size_t dropped;
+  /**
+   * Whether the job is still running (so more output may follow).
+   */
+  bool   running;
+  /**
+   * The uid of the job's owner, who may read the output via IPC.
+   */
+  uid_t  owner;
+} joboutput_info;
+
+/**
+ * Prepares the output directory (`opts.output_dir` or a per-user default) and
+ * starts the thread that drains job output pipes into per-job files. Output
+ * files left over from a previous run are removed. The directory must be ours,
+ * with mode 0700.
+ *
+ * @return retval_t ERR if capture is unavailable, in which case job output
+ * goes to the daemon's log as before.
+ */
+retval_t joboutput_init(void);
+
+/**
+ * Starts capturing output for the job `id`. The returned fd is the write
+ * end of a pipe for the job's stdout and stderr: dup2 it in the child and
+ * close it in the parent right after forking.
+ *
+ * @param id
+ * @param owner The uid of the job's owner, kept with the output so IPC only
+ * serves it to them (and root).
+ * @return int The pipe's write end, or -1 if output can't be captured.
+ */
+int joboutput_open(ident_t id, uid_t owner);
+
+/**
+ * Collects whatever output the (exited) job `id` left in its pipe and
+ * stops capturing. Its output file is kept for IPC until `JOB_OUTPUT_KEEP`
+ * newer jobs have finished.
+ *
+ * @param id
+ * @param info If not NULL, set to what was captured.
+ * @return retval_t ERR if the job's output wasn't being captured.
+ */
+retval_t joboutput_finish(ident_t id, joboutput_info *info);
+
+/**
+ * Looks up what has been captured so far for the job `id`.
+ *
+ * @param id
+ * @param info
+ * @return retval_t ERR if there is no (retained) output for the job.
+ */
+retval_t joboutput_stat(ident_t id, joboutput_info *info);
+
+/**
+ * Appends the captured output of the job `id` to `buf`.
+ *
+ * @param id
+ * @param buf
+ * @param info Set to what was captured, as of the read.
+ * @return retval_t ERR if there is no (retained) output for the job.
+ */
+retval_t joboutput_read(ident_t id, buffer_t *buf, joboutput_info *info);
+
+/**
+ * Formats the path of the output file of the job `id`. Takes no locks, so
+ * it's safe to call in a forked child.
+ */
+void joboutput_path(char *buf, size_t sz, ident_t id);
+
+#endif /* JOBOUTPUT_H */
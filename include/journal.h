@@ -0,0 +1,115 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define JOURNAL_MAGIC   0x43484a4e /* "CHJN" */
+#define JOURNAL_VERSION 1
+
+/**
+ * Journal event types.
+ */
+typedef enum {
+  /* A cron job was forked */
+  JOURNAL_JOB_STARTED = 1,
+  /* A cron job was reaped; `status`, `duration_usec` and the rusage fields are set */
+  JOURNAL_JOB_EXITED,
+  /* A mail job reporting on `entry_id`'s job was forked */
+  JOURNAL_MAIL_STARTED,
+  /* A mail job was reaped */
+  JOURNAL_MAIL_EXITED,
+} journal_event;
+
+/**
+ * A fixed-layout journal record. 128 bytes, so records stay cache-line aligned
+ * in the mapping.
+ */
+typedef struct {
+  /**
+   * Wall-clock time of the event, in microseconds since the epoch.
+   */
+  int64_t  ts_usec;
+  uint16_t type;
+  uint16_t reserved;
+  int32_t  pid;
+  /**
+   * The job's return status; -1 until it has exited.
+   */
+  int32_t  status;
+  uint32_t reserved2;
+  /**
+   * Time from fork to reap, in microseconds; 0 until the job has exited.
+   */
+  uint64_t duration_usec;
+  /**
+   * The job's and its entry's ids, as raw UUIDs (see `ident_to_uuid`); zero
+   * if absent. For mail jobs, `entry_id` is the id of the job being reported on.
+   */
+  uint8_t  job_id[16];
+  uint8_t  entry_id[16];
+  /**
+   * Resource usage of the job's process, as reported when it was reaped.
+   */
+  uint64_t utime_usec;
+  uint64_t stime_usec;
+  uint64_t maxrss_kb;
+  uint64_t majflt;
+  uint64_t inblock;
+  uint64_t oublock;
+  uint64_t nvcsw;
+  uint64_t nivcsw;
+} journal_record;
+
+/**
+ * The header at the start of each journal file, followed by `capacity` records.
+ *
+ * Records are only ever appended: a reader may use the first `count` records
+ * once it has loaded `count` (with acquire semantics).
+ */
+typedef struct {
+  uint32_t         magic;
+  uint32_t         version;
+  uint32_t         record_size;
+  uint32_t         capacity;
+  _Atomic uint64_t count;
+  uint8_t          reserved[104];
+} journal_header;
+
+_Static_assert(sizeof(journal_record) == 128, "journal records must stay 128 bytes");
+_Static_assert(sizeof(journal_header) == 128, "the journal header must stay 128 bytes");
+
+#ifndef JOURNAL_READER
+
+#  include <sys/resource.h>
+
+#  include "job.h"
+
+/**
+ * Opens and maps the journal if enabled via the CLI options, continuing an
+ * existing journal file if it's compatible. A no-op otherwise, as are the
+ * functions below.
+ *
+ * Each file holds up to JOURNAL_MAX_BYTES; when full, it's rotated to
+ * `<path>.1` (shifting older files up to JOURNAL_MAX_FILES) and a new one is
+ * started.
+ */
+void journal_init(void);
+
+/**
+ * Appends an event for the given job. Thread-safe.
+ *
+ * @param type
+ * @param job
+ * @param ru The reaped process's resource usage, for *_EXITED events. May be NULL.
+ */
+void journal_append(journal_event type, job_t *job, struct rusage *ru);
+
+/**
+ * Unmaps the journal.
+ */
+void journal_close(void);
+
+#endif /* JOURNAL_READER */
+
+#endif /* JOURNAL_H */
@@ -6,6 +6,7 @@
 #include <time.h>
 
 #include "cli.h"
+#include "utils/retval.h"
 
 typedef enum {
   LOG_LEVEL_ERROR = LOG_ERR,
@@ -14,10 +15,54 @@ typedef enum {
   LOG_LEVEL_DEBUG = LOG_DEBUG,
 } log_level;
 
-#define log_error(fmt, ...) printlogf(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
-#define log_warn(fmt, ...)  printlogf(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
-#define log_info(fmt, ...)  printlogf(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
-#define log_debug(fmt, ...) printlogf(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+/**
+ * Subsystems whose verbosity can be set independently.
+ */
+typedef enum {
+  /* Anything not covered below */
+  LOG_CAT_CORE,
+  /* Crontab scanning and parsing */
+  LOG_CAT_SCAN,
+  /* Schedule computation and job dispatch */
+  LOG_CAT_SCHED,
+  /* Running, reaping and mailing jobs */
+  LOG_CAT_JOB,
+  /* The IPC server and its commands */
+  LOG_CAT_IPC,
+  LOG_CAT_COUNT
+} log_category;
+
+/* Most verbose level compiled in; e.g. -DLOG_COMPILED_LEVEL=LOG_LEVEL_INFO
+   removes every log_debug call from the binary */
+#ifndef LOG_COMPILED_LEVEL
+#  define LOG_COMPILED_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/* The category of the log_* macros below. A source file that belongs to a
+   subsystem redefines it after its includes */
+#ifndef LOG_CATEGORY
+#  define LOG_CATEGORY LOG_CAT_CORE
+#endif
+
+/* Most verbose level logged per category, set at runtime */
+extern log_level log_thresholds[LOG_CAT_COUNT];
+
+#define log_enabled(cat, lvl) \
+  ((lvl) <= LOG_COMPILED_LEVEL && (lvl) <= __atomic_load_n(&log_thresholds[cat], __ATOMIC_RELAXED))
+
+/* The level checks run before the arguments are evaluated, so filtered-out
+   calls cost a load and a compare */
+#define log_at(cat, lvl, fmt, ...)             \
+  do {                                         \
+    if (log_enabled(cat, lvl)) {               \
+      printlogf(lvl, fmt, ##__VA_ARGS__);      \
+    }                                          \
+  } while (0)
+
+#define log_error(fmt, ...) log_at(LOG_CATEGORY, LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define log_warn(fmt, ...)  log_at(LOG_CATEGORY, LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define log_info(fmt, ...)  log_at(LOG_CATEGORY, LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define log_debug(fmt, ...) log_at(LOG_CATEGORY, LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
 
 /**
  * Initializes the logger using the CLI options to determine things such as
@@ -27,7 +72,8 @@ void logger_init(void);
 
 /**
  * Reinitializes the logger, provided the log file and/or file descriptor
- * was closed or invalidated.
+ * was closed or invalidated. Takes locks, so never call it from a signal
+ * handler.
  */
 void logger_reinit(void);
 
@@ -36,6 +82,24 @@ void logger_reinit(void);
  */
 void logger_close(void);
 
+/**
+ * Sets runtime verbosity from a spec: a comma-separated list of levels
+ * ("error", "warn", "info" or "debug"), each optionally prefixed with a
+ * category ("scan=debug"). A bare level applies to every category, e.g.
+ * "info,scan=debug". Nothing is changed if the spec is invalid.
+ *
+ * @param spec
+ * @return retval_t
+ */
+retval_t logger_set_levels(const char* spec);
+
+/**
+ * Returns the lowercase name of a level or category, as accepted by
+ * `logger_set_levels`.
+ */
+const char* log_level_name(log_level lvl);
+const char* log_category_name(log_category cat);
+
 /**
  * Printf but for logs! Prints to the log fd we've configured in
  * `logger_init`.
@@ -43,6 +107,6 @@ void logger_close(void);
  * @param fmt The format string
  * @param ... Everything else
  */
-void printlogf(log_level lvl, const char* fmt, ...);
+void printlogf(log_level lvl, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
 
 #endif /* LOGGER_H */
@@ -0,0 +1,33 @@
+#ifndef LOGROTATE_H
+#define LOGROTATE_H
+
+#include <stddef.h>
+
+/**
+ * Formats the path under which the logger stages the `seq`th rotated log file
+ * before it's archived.
+ *
+ * @param buf
+ * @param sz
+ * @param seq
+ */
+void logrotate_staged_path(char *buf, size_t sz, unsigned long seq);
+
+/**
+ * Hands the `seq`th staged log file to the background archiver, which shifts
+ * older files up (`<log>.1` to `<log>.2` etc, dropping any beyond
+ * `opts.log_max_files`), moves the staged file to `<log>.1` and, if enabled,
+ * compresses it. Staged files are archived in order. Never blocks on I/O; safe
+ * to call from the logging path.
+ *
+ * @param seq Must be one more than the last submitted sequence number.
+ */
+void logrotate_submit(unsigned long seq);
+
+/**
+ * Blocks until every submitted log file has been archived. Call before closing
+ * the log, since the archiver logs as it goes.
+ */
+void logrotate_drain(void);
+
+#endif /* LOGROTATE_H */
@@ -0,0 +1,72 @@
+#ifndef MAIL_H
+#define MAIL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "crontab.h"
+#include "job.h"
+#include "utils/retval.h"
+
+/**
+ * Sends a finished report to `mailto`. The body is read from `body_fd`, which
+ * is borrowed.
+ */
+typedef void mail_send_fn(const char *mailto, const char *subject, int body_fd);
+
+/**
+ * Parses a MAILPOLICY value: "always", "on-failure", "on-output" or "never".
+ *
+ * @param name
+ * @param policy Set to the parsed policy on success.
+ * @return retval_t ERR if the name is not recognized.
+ */
+retval_t mail_policy_parse(const char *name, mail_policy *policy);
+
+/**
+ * Whether an EXITED CRON job should be reported, per its crontab's policy.
+ */
+bool mail_wanted(job_t *job);
+
+/**
+ * Writes the report of an EXITED CRON job (command, exit status and captured
+ * output) to a new in-memory file.
+ *
+ * @param job
+ * @return int An fd for the report, positioned at the start, or -1 on failure.
+ * The caller must close it.
+ */
+int mail_report_open(job_t *job);
+
+/**
+ * Spawns the mail program to send `body_fd` to `mailto`. The program is
+ * exec'd directly (no shell), with the report as its stdin and `mailto` after
+ * a "--".
+ *
+ * @param mailto
+ * @param subject
+ * @param body_fd Borrowed; rewound before the program reads it.
+ * @return pid_t The mail program's pid, or -1 if it couldn't be spawned.
+ */
+pid_t mail_spawn(const char *mailto, const char *subject, int body_fd);
+
+/**
+ * Adds an EXITED CRON job's report to its recipient's pending digest, which
+ * starts the recipient's digest window if none is open. Callers must hold the
+ * job queue lock.
+ */
+void mail_digest_add(job_t *job);
+
+/**
+ * Sends (via `send`) and discards every digest whose window has elapsed by
+ * `now`, or every digest if `force`. Callers must hold the job queue lock.
+ *
+ * @param now
+ * @param force
+ * @param send
+ * @return unsigned int The number of digests sent.
+ */
+unsigned int mail_digest_flush(time_t now, bool force, mail_send_fn *send);
+
+#endif /* MAIL_H */
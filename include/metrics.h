@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "libutil/libutil.h"
+
+#define METRICS_MAX_USERS      128
+#define METRICS_MAX_UNAME      64
+#define METRICS_MAX_BUCKETS    12
+
+/* Label used for users that don't fit in the per-user table. */
+#define METRICS_OVERFLOW_UNAME "_other"
+
+/**
+ * Daemon-wide monotonic counters.
+ */
+typedef enum {
+  /* Crontab files (and virtual crontab executables) examined by update_db */
+  METRIC_FILES_SCANNED,
+  /* Crontab lines that looked like entries but failed to parse */
+  METRIC_PARSE_ERRORS,
+  /* Bytes written to the log file */
+  METRIC_LOG_BYTES,
+  /* IPC requests served */
+  METRIC_IPC_REQUESTS,
+  /* Async log records dropped because the ring buffer was full */
+  METRIC_LOG_DROPPED,
+  /* Async log calls that had to wait for space in the ring buffer */
+  METRIC_LOG_BLOCKED,
+  /* Log files rotated out by the built-in rotation */
+  METRIC_LOG_ROTATIONS,
+  /* Rotated log files compressed in the background */
+  METRIC_LOG_COMPRESSIONS,
+  /* Failed log rotation or compression attempts */
+  METRIC_LOG_ROTATE_ERRORS,
+  /* Records appended to the binary journal */
+  METRIC_JOURNAL_RECORDS,
+  /* Journal files rotated out because they were full */
+  METRIC_JOURNAL_ROTATIONS,
+  /* Bytes of job output captured to output files */
+  METRIC_JOB_OUTPUT_BYTES,
+  /* Bytes of job output discarded past the per-job cap */
+  METRIC_JOB_OUTPUT_DROPPED,
+  /* Messages accepted by the mail relay */
+  METRIC_MAIL_SUBMITTED,
+  /* Messages the mail relay rejected or that were given up on */
+  METRIC_MAIL_FAILED,
+  /* Connections made to the mail relay */
+  METRIC_MAIL_CONNECTIONS,
+  /* Cron entries whose next fire time was renewed */
+  METRIC_ENTRIES_RENEWED,
+  /* Next fire times an expression had to work out rather than reuse */
+  METRIC_NEXT_COMPUTED,
+  METRIC_COUNTER_COUNT
+} metrics_counter;
+
+/**
+ * Latency histograms. All observations are in microseconds.
+ */
+typedef enum {
+  /* Time taken to fork a cron job */
+  METRIC_SPAWN_LATENCY,
+  /* Time taken by one reaper pass over the job and mail queues */
+  METRIC_REAP_LATENCY,
+  /* Time taken to build a new db version in update_db */
+  METRIC_UPDATE_DB_DURATION,
+  /* Time taken to parse and handle an IPC request */
+  METRIC_IPC_LATENCY,
+  METRIC_HISTOGRAM_COUNT
+} metrics_histogram;
+
+/**
+ * Per-user job counters. Slots are claimed on first use and never released, so
+ * a pointer to one may be cached (e.g. on a job) for the life of the program.
+ */
+typedef struct {
+  atomic_int           state;
+  char                 uname[METRICS_MAX_UNAME];
+  atomic_uint_fast64_t jobs_launched;
+  atomic_uint_fast64_t jobs_failed;
+} metrics_user;
+
+/**
+ * Adds `n` to the given counter. Lock-free; safe to call from any thread.
+ */
+void metrics_add(metrics_counter counter, uint64_t n);
+
+/**
+ * Returns the current value of the given counter.
+ */
+uint64_t metrics_get(metrics_counter counter);
+
+/**
+ * Records an observation, in microseconds, in the given histogram. Lock-free;
+ * safe to call from any thread.
+ */
+void metrics_observe(metrics_histogram hist, uint64_t usec);
+
+/**
+ * Retrieves (claiming, if needed) the per-user counters for `uname`. Lock-free.
+ * If the table is full, returns the shared overflow slot.
+ *
+ * @param uname
+ * @return metrics_user* Never NULL.
+ */
+metrics_user *metrics_user_get(const char *uname);
+
+/**
+ * Renders all metrics into `buf` in the OpenMetrics text exposition format.
+ */
+void metrics_write(buffer_t *buf);
+
+#endif /* METRICS_H */
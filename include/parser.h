@@ -18,9 +18,23 @@ void            strip_comment(char *str);
 bool            is_comment_line(const char *str);
 bool            should_parse_line(const char *line);
 retval_t        parse_schedule(const char *s, char *dest);
-retval_t        parse_cmd(char *s, char *dest);
-retval_t        parse_expr(cron_entry *entry);
+/**
+ * Points `cmd` at the command part of entry line `s`. Commands have no length
+ * limit.
+ */
+retval_t        parse_cmd(char *s, char **cmd);
+/**
+ * Parses `schedule` into `expr`. Replaces tabs in `schedule` with spaces.
+ */
+retval_t        parse_expr(char *schedule, cron_expr *expr);
+/**
+ * Parses a crontab line into the entry's info and `expr`. The entry's strings
+ * and expression are pooled (see strpool.h, exprpool.h).
+ */
 retval_t        parse_entry(cron_entry *entry, char *line);
-parse_ln_result parse_line(char *ptr, int max_entries, hash_table *ht);
+/**
+ * Classifies a crontab line, adding it to the crontab's vars if it sets one.
+ */
+parse_ln_result parse_line(char *ptr, int max_entries, crontab_t *ct);
 
 #endif /* PARSER_H */
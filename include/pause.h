@@ -0,0 +1,73 @@
+#ifndef PAUSE_H
+#define PAUSE_H
+
+#include <stdbool.h>
+
+#include "cronentry.h"
+#include "crontab.h"
+#include "libhash/libhash.h"
+
+/**
+ * The pause registry records which crontabs and entries have been paused via
+ * the IPC API. It's persisted to disk so pauses survive restarts.
+ *
+ * Crontabs are keyed by file path. Entries are keyed by their crontab's file
+ * path plus a fingerprint of their schedule and command, since entry idents are
+ * regenerated whenever a crontab is re-parsed.
+ *
+ * The registry itself is never consulted during dispatch; the main loop copies
+ * it onto the `paused` flags of the db's crontabs and entries (see
+ * `pause_state_apply`), so checking whether something is paused costs a load.
+ */
+
+/**
+ * Loads any persisted pause state. Call once at startup, before the db is built.
+ * Until this is called, pause state is kept in memory only.
+ *
+ * @param path The state file path. If NULL, a default path is used depending
+ * on whether we're running as root.
+ */
+void pause_state_init(const char *path);
+
+/**
+ * Builds the registry key for the given crontab entry.
+ * Caller must call `free` on the returned char pointer.
+ *
+ * @param fpath The path of the entry's crontab.
+ * @param entry
+ */
+char *pause_entry_key(const char *fpath, cron_entry *entry);
+
+/**
+ * Pauses or resumes the crontab or entry identified by `key` and persists the
+ * change. Thread-safe. Takes effect on the next scheduler iteration.
+ *
+ * @param key A crontab file path, or a key from `pause_entry_key`.
+ * @param paused
+ */
+void pause_state_set(const char *key, bool paused);
+
+/**
+ * Returns whether the crontab or entry identified by `key` is paused.
+ * Thread-safe.
+ */
+bool pause_state_get(const char *key);
+
+/**
+ * Sets the `paused` flags of the given crontab and its entries from the
+ * registry. Used by the db owner when building crontabs.
+ *
+ * @param fpath The crontab's file path.
+ * @param ct
+ */
+void pause_state_apply(const char *fpath, crontab_t *ct);
+
+/**
+ * Re-applies the registry to every crontab in the db if it has changed since
+ * the last call. Must only be called by the db owner (the main loop).
+ *
+ * @param db i.e. HashTable<char*, crontab_t*>
+ */
+void pause_state_sync(hash_table *db);
+
+#endif /* PAUSE_H */
@@ -3,8 +3,18 @@
 
 /**
  * Sets up signal handlers e.g. SIGINT/SIGTERM so we can manage the daemon
- * process.
+ * process. The kill and hangup handlers only take note of the signal; the
+ * main loop acts on it in `sig_sleep`.
  */
 void sig_handlers_init(void);
 
+/**
+ * Sleeps for `secs` seconds, acting on signals as they arrive (on any thread):
+ * shuts down on a kill signal and reopens the log on SIGHUP. Must be called
+ * from the main loop, outside signal context.
+ *
+ * @param secs
+ */
+void sig_sleep(unsigned int secs);
+
 #endif /* SIG_H */
@@ -0,0 +1,45 @@
+#ifndef SMTP_H
+#define SMTP_H
+
+#include "mail.h"
+#include "utils/retval.h"
+
+/**
+ * Starts the mail submitter if a relay is configured (`opts.mail_relay`): a
+ * thread that hands job reports to the relay over one persistent connection,
+ * pipelining commands when the relay supports it. A relay given as an absolute
+ * path is spoken to in LMTP over that Unix socket; otherwise it's a
+ * `host[:port]` spoken to in SMTP.
+ *
+ * @param fallback Sends the messages the relay never accepts, and those still
+ * queued when `smtp_drain` gives up waiting, some other way. Called without
+ * any of the submitter's locks held.
+ * @return retval_t ERR if no relay is configured or its address is invalid, in
+ * which case reports are sent by spawning the mail program.
+ */
+retval_t smtp_init(mail_send_fn *fallback);
+
+/**
+ * Queues a report for submission to the relay.
+ *
+ * @param mailto A local user (qualified with our hostname) or an address.
+ * @param subject
+ * @param body_fd Borrowed; the report is read from offset 0 at submission time,
+ * so the caller may close it right away.
+ * @return retval_t ERR if the submitter isn't running, its queue is full
+ * (SMTP_MAX_QUEUED) or it can't take the message, in which case the caller
+ * should send it another way.
+ */
+retval_t smtp_submit(const char *mailto, const char *subject, int body_fd);
+
+/**
+ * Blocks until every queued message has been accepted or given up on, or for
+ * `timeout_secs` at most. Messages still waiting then are handed to the
+ * fallback; those the submitter is busy with are left to it.
+ *
+ * @param timeout_secs
+ * @return retval_t ERR if it timed out.
+ */
+retval_t smtp_drain(unsigned int timeout_secs);
+
+#endif /* SMTP_H */
@@ -0,0 +1,135 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define STATUS_SHM_MAGIC     0x43485253 /* "CHRS" */
+#define STATUS_SHM_VERSION   1
+#define STATUS_SHM_MAX_JOBS  64
+#define STATUS_SHM_CMD_LEN   64
+#define STATUS_SHM_IDENT_LEN 40
+
+/**
+ * A running job, as exposed in the status segment.
+ */
+typedef struct {
+  /**
+   * The job's process id; 0 means the slot is free.
+   */
+  int64_t pid;
+  /**
+   * Time (epoch seconds) at which the job was started.
+   */
+  int64_t started_at;
+  char    ident[STATUS_SHM_IDENT_LEN];
+  /**
+   * The job's command, truncated to fit.
+   */
+  char    cmd[STATUS_SHM_CMD_LEN];
+} status_job;
+
+/**
+ * The layout of the read-only status segment that local monitors can mmap to
+ * read daemon state without touching the IPC socket or any daemon thread.
+ *
+ * All fields are protected by the `seq` seqlock: it is odd while the daemon is
+ * updating the segment. Use `status_snapshot` to read a consistent copy.
+ */
+typedef struct {
+  uint32_t         magic;
+  uint32_t         version;
+  _Atomic uint64_t seq;
+  int64_t          pid;
+  /**
+   * Time (epoch seconds) at which the daemon started. Uptime is `now - start_time`.
+   */
+  int64_t          start_time;
+  /**
+   * Time (epoch seconds) of the last update to the segment.
+   */
+  int64_t          updated_at;
+  /**
+   * The rounded time of the last scheduler iteration.
+   */
+  int64_t          last_tick;
+  uint64_t         ticks;
+  uint64_t         jobs_launched;
+  uint64_t         jobs_exited;
+  uint64_t         jobs_failed;
+  /**
+   * Number of currently running cron jobs. May exceed STATUS_SHM_MAX_JOBS, in
+   * which case only the first STATUS_SHM_MAX_JOBS are listed in `jobs`.
+   */
+  uint32_t         running_jobs;
+  uint32_t         max_jobs;
+  status_job       jobs[STATUS_SHM_MAX_JOBS];
+} status_shm;
+
+/**
+ * Copies a consistent snapshot of the status segment into `dest`. Lock-free;
+ * retries while the daemon is mid-update.
+ *
+ * @param shm The mapped status segment.
+ * @param dest
+ * @param max_attempts Give up after this many torn reads.
+ * @return true if a consistent snapshot was copied.
+ */
+static inline bool
+status_snapshot (status_shm *shm, status_shm *dest, unsigned int max_attempts) {
+  while (max_attempts--) {
+    uint64_t before = atomic_load_explicit(&shm->seq, memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+
+    memcpy(dest, shm, sizeof(status_shm));
+    atomic_thread_fence(memory_order_acquire);
+
+    if (atomic_load_explicit(&shm->seq, memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+#ifndef STATUS_READER
+
+#  include <time.h>
+
+#  include "job.h"
+
+/**
+ * Creates and maps the status segment if enabled via the CLI options.
+ * A no-op otherwise, as are all of the update functions below.
+ */
+void status_init(void);
+
+/**
+ * Records a newly running cron job.
+ */
+void status_job_started(job_t *job);
+
+/**
+ * Records a cron job that has exited, with its return status.
+ */
+void status_job_exited(job_t *job);
+
+/**
+ * Records a scheduler iteration.
+ *
+ * @param ts The rounded time of the iteration.
+ */
+void status_tick(time_t ts);
+
+/**
+ * Unmaps and removes the status segment.
+ */
+void status_close(void);
+
+#endif /* STATUS_READER */
+
+#endif /* STATUS_H */
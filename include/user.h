@@ -15,6 +15,8 @@ typedef struct user {
   unsigned int uid;
   /* Username or root if root (shocker) */
   char*        uname;
+  /* Home directory */
+  char*        home;
   /* Is this root? */
   bool         root;
 } user_t;
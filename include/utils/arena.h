@@ -0,0 +1,49 @@
+#ifndef ARENA_UTILS_H
+#define ARENA_UTILS_H
+
+#include <stddef.h>
+
+typedef struct arena_chunk arena_chunk;
+
+/**
+ * A bump allocator. Everything allocated from an arena is freed at once, with
+ * the arena itself; nothing is freed individually. Not thread-safe.
+ */
+typedef struct {
+  /**
+   * The chunk being allocated from; earlier ones hang off it
+   */
+  arena_chunk *chunk;
+  /**
+   * Total bytes held in chunks, including unused space
+   */
+  size_t       reserved;
+} arena_t;
+
+/**
+ * Creates an arena. It lives in its own first chunk, so a small arena costs a
+ * single allocation.
+ */
+arena_t *arena_init(void);
+
+/**
+ * Returns `sz` bytes, suitably aligned for any type. Exits if out of memory.
+ */
+void *arena_alloc(arena_t *arena, size_t sz);
+
+/**
+ * Copies `s` into the arena.
+ */
+char *arena_strdup(arena_t *arena, const char *s);
+
+/**
+ * Formats a string into the arena, as with sprintf.
+ */
+char *arena_fmt(arena_t *arena, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Frees the arena and everything allocated from it.
+ */
+void arena_free(arena_t *arena);
+
+#endif /* ARENA_UTILS_H */
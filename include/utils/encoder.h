@@ -0,0 +1,80 @@
+#ifndef ENCODER_UTILS_H
+#define ENCODER_UTILS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libutil/libutil.h"
+#include "utils/retval.h"
+
+#define ENCODER_MAX_DEPTH 8
+#define ENCODER_STAGING   4096
+
+/**
+ * Wire formats an encoder can produce.
+ */
+typedef enum {
+  /**
+   * Plain JSON. Map and array sizes are ignored.
+   */
+  ENC_JSON,
+  /**
+   * MessagePack. Timestamps use the timestamp extension type (-1).
+   */
+  ENC_MSGPACK
+} enc_format;
+
+/**
+ * Streams a map/array document into a buffer in one of the supported formats,
+ * so a single handler can serve every format. Output is staged in a fixed
+ * block and appended to the buffer in bulk; call `enc_finish` when done.
+ *
+ * Containers must be given their exact size up front (MessagePack encodes
+ * it in the header).
+ */
+typedef struct {
+  buffer_t    *out;
+  enc_format   format;
+  unsigned int depth;
+  /**
+   * Per nesting level: whether it's a map, its declared size and the number of
+   * items (for maps, keys) written so far.
+   */
+  bool         is_map[ENCODER_MAX_DEPTH];
+  uint32_t     size[ENCODER_MAX_DEPTH];
+  uint32_t     n[ENCODER_MAX_DEPTH];
+  size_t       len;
+  char         staging[ENCODER_STAGING];
+} encoder_t;
+
+/**
+ * Parses a format name ("json" or "msgpack").
+ *
+ * @param name
+ * @param format Set to the parsed format on success.
+ * @return retval_t ERR if the name is not recognized.
+ */
+retval_t enc_format_parse(const char *name, enc_format *format);
+
+void enc_init(encoder_t *enc, buffer_t *out, enc_format format);
+
+void enc_map(encoder_t *enc, uint32_t size);
+void enc_array(encoder_t *enc, uint32_t size);
+/* Closes the innermost map or array */
+void enc_end(encoder_t *enc);
+
+void enc_key(encoder_t *enc, const char *key);
+void enc_str(encoder_t *enc, const char *s);
+void enc_int(encoder_t *enc, int64_t v);
+void enc_bool(encoder_t *enc, bool v);
+/* JSON: an ISO-8601 UTC string with millisecond precision */
+void enc_time(encoder_t *enc, time_t ts);
+
+/**
+ * Flushes any staged output to the buffer. Must be called once the document is
+ * complete.
+ */
+void enc_finish(encoder_t *enc);
+
+#endif /* ENCODER_UTILS_H */
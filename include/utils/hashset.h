@@ -0,0 +1,57 @@
+#ifndef HASHSET_UTILS_H
+#define HASHSET_UTILS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Returns the hash of an item, which the item is expected to store.
+ */
+typedef uint64_t hashset_hash_fn(const void *item);
+
+/**
+ * Returns whether `item` is the one `key` describes.
+ */
+typedef bool hashset_eq_fn(const void *item, const void *key);
+
+/**
+ * A set of pointers, for the interning pools: open addressing with linear
+ * probing over a power-of-two number of slots, kept at most half full so probe
+ * runs stay short. Removal shifts later entries of the run back into the
+ * hole, so lookups never need tombstones. Not thread-safe.
+ *
+ * Zero-initialize it apart from `hash_of`; the slots are allocated on the first
+ * `hashset_reserve`.
+ */
+typedef struct {
+  void           **slots;
+  size_t           capacity;
+  size_t           count;
+  hashset_hash_fn *hash_of;
+} hashset_t;
+
+/**
+ * Makes room for one more item, growing the set if needed. Call it before
+ * `hashset_probe` when an insert may follow, as growing moves the slots.
+ */
+void hashset_reserve(hashset_t *set);
+
+/**
+ * Looks for the item `key` describes among those hashed `hash`.
+ *
+ * @return void** Its slot, or the empty slot to insert it in.
+ */
+void **hashset_probe(hashset_t *set, uint64_t hash, hashset_eq_fn *eq, const void *key);
+
+/**
+ * Puts `item` in the empty slot `hashset_probe` returned.
+ */
+void hashset_insert(hashset_t *set, void **slot, void *item);
+
+/**
+ * Removes `item`, which must be in the set.
+ */
+void hashset_remove(hashset_t *set, const void *item);
+
+#endif /* HASHSET_UTILS_H */
@@ -0,0 +1,51 @@
+#ifndef IDENT_UTILS_H
+#define IDENT_UTILS_H
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "utils/retval.h"
+
+/**
+ * Identifies a job or entry: the daemon's start time (seconds) in the high 32
+ * bits plus a per-run counter. Unique and increasing within a run, and across
+ * runs unless one made over 2^32 idents per second of uptime. Never 0.
+ */
+typedef uint64_t ident_t;
+
+/* Buffer size for a rendered ident, in either form */
+#define IDENT_STR_LEN 37
+
+/* Formats an ident as hex for logging, e.g. log_info("[job " IDENT_FMT "]\n", job->id) */
+#define IDENT_FMT     "%016" PRIx64
+
+/**
+ * Returns a new ident. Lock-free.
+ */
+ident_t ident_next(void);
+
+/**
+ * Renders `id` for serialization (IPC, status, mail): 16 hex digits, or a
+ * version 8 UUID embedding them if `opts.uuid_ids` is set.
+ *
+ * @param id
+ * @param buf
+ * @return char* `buf`
+ */
+char *ident_format(ident_t id, char buf[IDENT_STR_LEN]);
+
+/**
+ * Parses an ident in either rendered form.
+ *
+ * @param s
+ * @param id
+ * @return retval_t ERR if `s` is neither form.
+ */
+retval_t ident_parse(const char *s, ident_t *id);
+
+/**
+ * Writes the UUID form of `id` as 16 raw bytes.
+ */
+void ident_to_uuid(ident_t id, uint8_t out[16]);
+
+#endif /* IDENT_UTILS_H */
@@ -4,8 +4,13 @@
 #include <stdbool.h>
 
 #include "libhash/libhash.h"
+#include "utils/arena.h"
 
-bool match_variable(char *line, hash_table *vars);
+/**
+ * If `line` sets a variable, e.g. `KEY=value`, sets it in `vars`; the value is
+ * copied into `arena`.
+ */
+bool match_variable(char *line, hash_table *vars, arena_t *arena);
 bool match_string(const char *string, const char *pattern);
 
 #endif /* REGEX_UTILS_H */
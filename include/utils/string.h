@@ -18,9 +18,4 @@ char* trim_whitespace(char* str);
  */
 void replace_tabs_with_spaces(char* str);
 
-/**
- * Generates a v4 UUID. Must be freed by caller.
- */
-char* create_uuid(void);
-
 #endif /* STRING_UTILS_H */
@@ -0,0 +1,30 @@
+#ifndef STRPOOL_UTILS_H
+#define STRPOOL_UTILS_H
+
+#include <stddef.h>
+
+/**
+ * Returns the pooled copy of `s`, adding it if it isn't pooled yet. Equal
+ * strings share one copy, so entries' commands and schedules, which repeat
+ * across crontabs, are only stored once. Each call must be matched by a
+ * `strpool_release`. Thread-safe.
+ *
+ * @param s
+ * @return const char*
+ */
+const char *strpool_intern(const char *s);
+
+/**
+ * Drops a reference taken by `strpool_intern`, freeing the copy once no one
+ * holds it.
+ *
+ * @param s A string returned by `strpool_intern`.
+ */
+void strpool_release(const char *s);
+
+/**
+ * Returns the number of distinct strings pooled.
+ */
+size_t strpool_count(void);
+
+#endif /* STRPOOL_UTILS_H */
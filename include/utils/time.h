@@ -1,8 +1,13 @@
 #ifndef TIME_UTILS_H
 #define TIME_UTILS_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
+/* Length of a "YYYY-mm-ddTHH:MM:SS.000Z" timestamp, excluding the terminator */
+#define TIME_STR_LEN 24
+
 /**
  * Rounds a given timestamp to the nearest N unit.
  *
@@ -38,6 +43,23 @@ get_sleep_duration (short interval, time_t now) {
  */
 void get_time(struct timespec *ts);
 
+/**
+ * Returns a monotonic timestamp in microseconds, for measuring durations.
+ */
+uint64_t get_monotonic_usec(void);
+
+/**
+ * Formats a UTC timestamp with millisecond precision into `buf` without
+ * allocating. The date/time prefix is cached per thread and keyed on `sec`, so
+ * calls within the same second only patch the millisecond digits.
+ *
+ * @param buf Must hold at least `TIME_STR_LEN + 1` bytes.
+ * @param sec
+ * @param msec 0-999
+ * @return size_t The formatted length, or 0 if `sec` can't be represented.
+ */
+size_t format_time_str(char *buf, time_t sec, long msec);
+
 /**
  * Converts the given time_t into a  stringified timestamp.
  * Caller must call `free` on the returned char pointer.
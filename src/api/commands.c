@@ -1,137 +1,567 @@
 #include "api/commands.h"
 
 #include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "db.h"
 #include "globals.h"
 #include "job.h"
+#include "joboutput.h"
 #include "logger.h"
+#include "metrics.h"
+#include "pause.h"
 #include "proginfo.h"
-#include "utils/json.h"
+#include "utils/encoder.h"
 #include "utils/time.h"
 #include "utils/xpanic.h"
 
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_IPC
+
 typedef struct {
-  const char* command;
-  void (*handler)(buffer_t*);
+  const char*      command;
+  command_handler* handler;
 } command_handler_entry;
 
 static command_handler_entry command_handler_map_index[] = {
   {.command = "IPC_LIST_JOBS",     .handler = write_jobs_info    },
   {.command = "IPC_LIST_CRONTABS", .handler = write_crontabs_info},
-  {.command = "IPC_SHOW_INFO",     .handler = write_program_info }
+  {.command = "IPC_SHOW_INFO",     .handler = write_program_info },
+  {.command = "IPC_METRICS",       .handler = write_metrics_info },
+  {.command = "IPC_JOB_INFO",      .handler = write_job_info     },
+  {.command = "IPC_RUN_NOW",       .handler = handle_run_now     },
+  {.command = "IPC_PAUSE",         .handler = handle_pause       },
+  {.command = "IPC_RESUME",        .handler = handle_resume      },
+  {.command = "IPC_KILL_JOB",      .handler = handle_kill_job    },
+  {.command = "IPC_JOB_OUTPUT",    .handler = write_job_output   },
+  {.command = "IPC_LOG_LEVEL",     .handler = handle_log_level   }
 };
 
 static pthread_once_t command_handlers_map_init_once = PTHREAD_ONCE_INIT;
 static hash_table*    command_handlers_map;
 
+static inline const char*
+get_arg (hash_table* args, const char* key) {
+  const char* v = args ? ht_get(args, key) : NULL;
+  return v && *v ? v : NULL;
+}
+
+/**
+ * Parses an id argument. Ids we never issued come back as 0, which matches no
+ * job or entry.
+ */
+static ident_t
+parse_id (const char* id) {
+  ident_t v;
+  return ident_parse(id, &v) == OK ? v : 0;
+}
+
+/**
+ * Whether `caller` may control any job or crontab, and change daemon settings:
+ * root and the daemon's own user may.
+ */
+static inline bool
+is_privileged (uid_t caller) {
+  return caller == 0 || caller == (uid_t)usr.uid;
+}
+
+/**
+ * Whether `caller` may control the jobs and crontabs of the user `owner`.
+ */
+static inline bool
+may_control (uid_t caller, uid_t owner) {
+  return is_privileged(caller) || caller == owner;
+}
+
+/**
+ * Starts an encoder in the format requested via the "format" argument, which
+ * the IPC server has already validated. Defaults to JSON.
+ */
+static inline void
+enc_init_for (encoder_t* enc, buffer_t* buf, hash_table* args) {
+  enc_format  format = ENC_JSON;
+  const char* name   = get_arg(args, "format");
+  if (name) {
+    enc_format_parse(name, &format);
+  }
+
+  enc_init(enc, buf, format);
+}
+
 void
-write_jobs_info (buffer_t* buf) {
-  buffer_append(buf, "[");
-
-  unsigned int len = array_size(job_queue);
-  foreach (job_queue, i) {
-    job_t* job = (job_t*)array_get_or_panic(job_queue, i);
-    if (job->type != CRON) {
-      continue;
-    }
+write_error (buffer_t* buf, hash_table* args, const char* msg) {
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
 
-    char* ts      = to_time_str_secs(job->next_run);
-    char* cmd_esc = escape_json_string(job->cmd);
+  enc_map(&enc, 1);
+  enc_key(&enc, "error");
+  enc_str(&enc, msg);
+  enc_end(&enc);
 
-    char* s       = s_fmt(
-      "{\"id\":\"%s\",\"cmd\":\"%s\",\"mailto\":\"%s\",\"state\":\"%s\","
-            "\"next\":\"%s\"}%s",
-      job->ident,
-      cmd_esc,
-      job->mailto,
-      job_state_names[job->state],
-      ts,
-      i != len - 1 ? "," : ""
-    );
+  enc_finish(&enc);
+}
 
-    buffer_append(buf, s);
+/**
+ * Writes the fields shared by IPC_LIST_JOBS and IPC_JOB_INFO records.
+ */
+static void
+enc_job (encoder_t* enc, job_t* job, bool detailed) {
+  enc_map(enc, detailed ? 7 : 5);
+  char ident[IDENT_STR_LEN];
+  enc_key(enc, "id");
+  enc_str(enc, ident_format(job->id, ident));
+  enc_key(enc, "cmd");
+  enc_str(enc, job->cmd);
+  enc_key(enc, "mailto");
+  enc_str(enc, job->mailto);
+  enc_key(enc, "state");
+  enc_str(enc, job_state_names[job->state]);
+  if (detailed) {
+    enc_key(enc, "pid");
+    enc_int(enc, job->pid);
+    enc_key(enc, "ret");
+    enc_int(enc, job->ret);
+  }
+  enc_key(enc, "next");
+  enc_time(enc, job->next_run);
+  enc_end(enc);
+}
 
-    free(cmd_esc);
-    free(s);
-    free(ts);
+/**
+ * Writes the CRON jobs in the queue. Runs under the queue lock: the count and
+ * the records must agree, or the encoder panics.
+ */
+static void
+write_jobs (array_t* queue, void* ctx) {
+  encoder_t* enc = ctx;
+
+  uint32_t n     = 0;
+  foreach (queue, i) {
+    n += ((job_t*)array_get_or_panic(queue, i))->type == CRON;
+  }
+
+  enc_array(enc, n);
+  foreach (queue, i) {
+    job_t* job = (job_t*)array_get_or_panic(queue, i);
+    if (job->type == CRON) {
+      enc_job(enc, job, false);
+    }
   }
-  buffer_append(buf, "]");
+  enc_end(enc);
 }
 
 void
-write_crontabs_info (buffer_t* buf) {
-  buffer_append(buf, "[");
+write_jobs_info (buffer_t* buf, hash_table* args, uid_t caller __attribute__((unused))) {
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+
+  // The main loop adds jobs and the reaper removes them as we go
+  job_queue_visit(write_jobs, &enc);
+
+  enc_finish(&enc);
+}
+
+static uint32_t
+count_entries (hash_table* crontabs) {
+  uint32_t n = 0;
+  HT_ITER_START(crontabs)
+  n += array_size(((crontab_t*)entry->value)->entries);
+  HT_ITER_END
+
+  return n;
+}
+
+void
+write_crontabs_info (buffer_t* buf, hash_table* args, uid_t caller __attribute__((unused))) {
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+
+  // Pin the current db version; the main loop may publish a new one (and
+  // retire this one) while we're iterating.
+  db_snapshot* snap = db_acquire();
+  if (!snap) {
+    enc_array(&enc, 0);
+    enc_end(&enc);
+    enc_finish(&enc);
+    return;
+  }
+
+  hash_table* crontabs = snap->crontabs;
+  enc_array(&enc, count_entries(crontabs));
 
-  unsigned int entries = db->count;
-  HT_ITER_START(db)
-  entries--;
-  crontab_t*   ct  = entry->value;
-  unsigned int len = array_size(ct->entries);
+  HT_ITER_START(crontabs)
+  crontab_t* ct = entry->value;
+  // Shared by all of the crontab's entries
+  char*      se = s_concat_arr(ct->envp, ", ");
+  bool       ct_paused = __atomic_load_n(&ct->paused, __ATOMIC_RELAXED);
 
   foreach (ct->entries, i) {
-    len--;
     cron_entry* ce = array_get_or_panic(ct->entries, i);
+    char        ident[IDENT_STR_LEN];
 
-    char* ts       = to_time_str_secs(ce->next);
-
-    char* se       = s_concat_arr(ct->envp, ", ");
-    char* cmd_esc  = escape_json_string(ce->cmd);
-
-    char* s        = s_fmt(
-      "{\"id\":\"%s\",\"filepath\":\"%s\",\"cmd\":\"%s\",\"schedule\":\"%s\","
-             "\"owner\":\"%s\","
-             "\"envp\":\"%s\",\"next\":\"%s\"}%s",
-      ce->ident,
-      entry->key,
-      cmd_esc,
-      ce->schedule,
-      ct->uname,
-      se,
-      ts,
-      entries != 0 || len != 0 ? "," : ""
-    );
-    buffer_append(buf, s);
-
-    free(cmd_esc);
-    free(s);
-    free(se);
-    free(ts);
+    enc_map(&enc, 8);
+    enc_key(&enc, "id");
+    enc_str(&enc, ident_format(ce->info->id, ident));
+    enc_key(&enc, "filepath");
+    enc_str(&enc, entry->key);
+    enc_key(&enc, "cmd");
+    enc_str(&enc, ce->info->cmd);
+    enc_key(&enc, "schedule");
+    enc_str(&enc, ce->info->schedule);
+    enc_key(&enc, "owner");
+    enc_str(&enc, ct->uname);
+    enc_key(&enc, "envp");
+    enc_str(&enc, se ? se : "");
+    enc_key(&enc, "next");
+    enc_time(&enc, __atomic_load_n(&ce->next, __ATOMIC_RELAXED));
+    enc_key(&enc, "paused");
+    enc_bool(&enc, ct_paused || __atomic_load_n(&ce->paused, __ATOMIC_RELAXED));
+    enc_end(&enc);
   }
+
+  free(se);
   HT_ITER_END
-  buffer_state(buf)[buffer_size(buf) - 1] = ',';
+  db_release(snap);
 
-  if (buffer_state(buf)[buffer_size(buf) - 1] == ',') {
-    buffer_state(buf)[buffer_size(buf) - 1] = ']';
-  } else {
-    buffer_append(buf, "]");
-  }
+  enc_end(&enc);
+  enc_finish(&enc);
 }
 
 void
-write_program_info (buffer_t* buf) {
-  char*  st     = to_time_str_millis(proginfo.start);
+write_program_info (buffer_t* buf, hash_table* args, uid_t caller __attribute__((unused))) {
+  char st[TIME_STR_LEN + 8];
+  format_time_str(st, proginfo.start->tv_sec, proginfo.start->tv_nsec / 1000000);
+
   time_t now    = time(NULL);
 
   double diff   = difftime(now, proginfo.start->tv_sec);
   char*  uptime = pretty_print_seconds(diff);
 
-  char* s       = s_fmt(
-    "{\"pid\": \"%d\",\"started_at\": \"%s\",\"uptime\": \"%s\","
-          "\"version\": \"%s\"}",
-    proginfo.pid,
-    st,
-    uptime,
-    proginfo.version
-  );
-  buffer_append(buf, s);
-
-  free(s);
-  free(st);
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+
+  enc_map(&enc, 4);
+  enc_key(&enc, "pid");
+  enc_int(&enc, proginfo.pid);
+  enc_key(&enc, "started_at");
+  enc_str(&enc, st);
+  enc_key(&enc, "uptime");
+  enc_str(&enc, uptime);
+  enc_key(&enc, "version");
+  enc_str(&enc, proginfo.version);
+  enc_end(&enc);
+
+  enc_finish(&enc);
+
   free(uptime);
 }
 
+void
+write_metrics_info (buffer_t* buf, hash_table* args __attribute__((unused)), uid_t caller __attribute__((unused))) {
+  metrics_write(buf);
+}
+
+/**
+ * Finds the entry with the given id in a pinned db snapshot.
+ *
+ * @param crontabs
+ * @param id
+ * @param fpath Set to the path of the entry's crontab, if found.
+ * @param owner Set to the entry's crontab, if found.
+ * @return cron_entry* NULL if not found.
+ */
+static cron_entry*
+find_entry (hash_table* crontabs, ident_t id, const char** fpath, crontab_t** owner) {
+  HT_ITER_START(crontabs)
+  crontab_t* ct = entry->value;
+  foreach (ct->entries, i) {
+    cron_entry* ce = array_get_or_panic(ct->entries, i);
+    if (ce->info->id == id) {
+      *fpath = entry->key;
+      *owner = ct;
+      return ce;
+    }
+  }
+  HT_ITER_END
+
+  return NULL;
+}
+
+static void
+write_job (job_t* job, void* ctx) {
+  encoder_t* enc = ctx;
+  enc_job(enc, job, true);
+}
+
+void
+write_job_info (buffer_t* buf, hash_table* args, uid_t caller __attribute__((unused))) {
+  const char* id = get_arg(args, "id");
+  if (!id) {
+    write_error(buf, args, "missing id");
+    return;
+  }
+
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+
+  if (!job_visit(parse_id(id), write_job, &enc)) {
+    write_error(buf, args, "no such job");
+    return;
+  }
+
+  enc_finish(&enc);
+}
+
+void
+handle_run_now (buffer_t* buf, hash_table* args, uid_t caller) {
+  const char* id = get_arg(args, "id");
+  if (!id) {
+    write_error(buf, args, "missing id");
+    return;
+  }
+
+  db_snapshot* snap = db_acquire();
+  const char*  fpath;
+  crontab_t*   ct;
+  cron_entry*  ce = snap ? find_entry(snap->crontabs, parse_id(id), &fpath, &ct) : NULL;
+
+  if (!ce) {
+    write_error(buf, args, "no such entry");
+  } else if (!may_control(caller, ct->uid)) {
+    write_error(buf, args, "permission denied");
+  } else {
+    ident_t job_id;
+    char    job_ident[IDENT_STR_LEN];
+    // Keep the snapshot pinned until the job has copied what it needs from the entry
+    run_cronjob(ce, &job_id);
+    log_info("[entry %s] run requested via IPC (job " IDENT_FMT ")\n", id, job_id);
+
+    encoder_t enc;
+    enc_init_for(&enc, buf, args);
+    enc_map(&enc, 2);
+    enc_key(&enc, "id");
+    enc_str(&enc, id);
+    enc_key(&enc, "job");
+    enc_str(&enc, ident_format(job_id, job_ident));
+    enc_end(&enc);
+    enc_finish(&enc);
+  }
+
+  if (snap) {
+    db_release(snap);
+  }
+}
+
+static void
+set_paused (buffer_t* buf, hash_table* args, uid_t caller, bool paused) {
+  const char* id      = get_arg(args, "id");
+  const char* crontab = get_arg(args, "crontab");
+
+  if (!crontab && !id) {
+    write_error(buf, args, "missing id or crontab");
+    return;
+  }
+
+  db_snapshot* snap = db_acquire();
+  crontab_t*   ct   = NULL;
+  char*        key;
+
+  if (crontab) {
+    // Crontabs not (yet) in the db have no owner to check against
+    ct  = snap ? ht_get(snap->crontabs, crontab) : NULL;
+    key = s_copy_or_panic(crontab);
+  } else {
+    const char* fpath;
+    cron_entry* ce = snap ? find_entry(snap->crontabs, parse_id(id), &fpath, &ct) : NULL;
+
+    if (!ce) {
+      if (snap) {
+        db_release(snap);
+      }
+      write_error(buf, args, "no such entry");
+      return;
+    }
+
+    key = pause_entry_key(fpath, ce);
+  }
+
+  bool allowed = may_control(caller, ct ? ct->uid : (uid_t)-1);
+  if (snap) {
+    db_release(snap);
+  }
+  if (!allowed) {
+    free(key);
+    write_error(buf, args, "permission denied");
+    return;
+  }
+
+  pause_state_set(key, paused);
+  free(key);
+
+  log_info("%s %s via IPC\n", paused ? "paused" : "resumed", crontab ? crontab : id);
+
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+  enc_map(&enc, 2);
+  enc_key(&enc, crontab ? "crontab" : "id");
+  enc_str(&enc, crontab ? crontab : id);
+  enc_key(&enc, "paused");
+  enc_bool(&enc, paused);
+  enc_end(&enc);
+  enc_finish(&enc);
+}
+
+void
+handle_pause (buffer_t* buf, hash_table* args, uid_t caller) {
+  set_paused(buf, args, caller, true);
+}
+
+void
+handle_resume (buffer_t* buf, hash_table* args, uid_t caller) {
+  set_paused(buf, args, caller, false);
+}
+
+typedef struct {
+  uid_t caller;
+  int   sig;
+  int   rc;
+  bool  denied;
+} kill_ctx;
+
+static void
+signal_job (job_t* job, void* ctx) {
+  kill_ctx* kc = ctx;
+  if (!may_control(kc->caller, job->owner)) {
+    kc->rc     = -1;
+    kc->denied = true;
+    return;
+  }
+  if (job->state != RUNNING || job->pid <= 0) {
+    kc->rc = -1;
+    return;
+  }
+
+  // Jobs are session (and so process group) leaders; signal the whole group
+  kc->rc = kill(-job->pid, kc->sig);
+}
+
+void
+handle_kill_job (buffer_t* buf, hash_table* args, uid_t caller) {
+  const char* id = get_arg(args, "id");
+  if (!id) {
+    write_error(buf, args, "missing id");
+    return;
+  }
+
+  kill_ctx    kc  = {.caller = caller, .sig = SIGTERM, .rc = 0, .denied = false};
+  const char* sig = get_arg(args, "signal");
+  if (sig) {
+    char* end;
+    long  n = strtol(sig, &end, 10);
+    if (*end || n < 1 || n >= NSIG) {
+      write_error(buf, args, "invalid signal");
+      return;
+    }
+    kc.sig = (int)n;
+  }
+
+  if (!job_visit(parse_id(id), signal_job, &kc)) {
+    write_error(buf, args, "no such job");
+    return;
+  }
+  if (kc.denied) {
+    write_error(buf, args, "permission denied");
+    return;
+  }
+  if (kc.rc != 0) {
+    write_error(buf, args, "job is not running");
+    return;
+  }
+
+  log_info("[job %s] sent signal %d via IPC\n", id, kc.sig);
+
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+  enc_map(&enc, 2);
+  enc_key(&enc, "id");
+  enc_str(&enc, id);
+  enc_key(&enc, "signal");
+  enc_int(&enc, kc.sig);
+  enc_end(&enc);
+  enc_finish(&enc);
+}
+
+void
+write_job_output (buffer_t* buf, hash_table* args, uid_t caller) {
+  const char* id = get_arg(args, "id");
+  if (!id) {
+    write_error(buf, args, "missing id");
+    return;
+  }
+
+  // Check whose output it is before reading any of it
+  joboutput_info info;
+  if (joboutput_stat(parse_id(id), &info) == OK && !may_control(caller, info.owner)) {
+    write_error(buf, args, "permission denied");
+    return;
+  }
+
+  buffer_t* output = buffer_init(NULL);
+  if (joboutput_read(parse_id(id), output, &info) != OK) {
+    buffer_free(output);
+    write_error(buf, args, "no output for job");
+    return;
+  }
+
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+  enc_map(&enc, 5);
+  enc_key(&enc, "id");
+  enc_str(&enc, id);
+  enc_key(&enc, "running");
+  enc_bool(&enc, info.running);
+  enc_key(&enc, "bytes");
+  enc_int(&enc, info.bytes);
+  enc_key(&enc, "dropped");
+  enc_int(&enc, info.dropped);
+  enc_key(&enc, "output");
+  // Output is text; anything past a NUL byte is cut off
+  enc_str(&enc, buffer_size(output) ? buffer_state(output) : "");
+  enc_end(&enc);
+  enc_finish(&enc);
+
+  buffer_free(output);
+}
+
+void
+handle_log_level (buffer_t* buf, hash_table* args, uid_t caller) {
+  const char* spec = get_arg(args, "level");
+  if (spec) {
+    if (!is_privileged(caller)) {
+      write_error(buf, args, "permission denied");
+      return;
+    }
+    if (logger_set_levels(spec) != OK) {
+      write_error(buf, args, "invalid level");
+      return;
+    }
+    log_info("log levels set to '%s' via IPC\n", spec);
+  }
+
+  encoder_t enc;
+  enc_init_for(&enc, buf, args);
+  enc_map(&enc, LOG_CAT_COUNT);
+  for (unsigned int i = 0; i < LOG_CAT_COUNT; i++) {
+    enc_key(&enc, log_category_name(i));
+    enc_str(&enc, log_level_name(__atomic_load_n(&log_thresholds[i], __ATOMIC_RELAXED)));
+  }
+  enc_end(&enc);
+  enc_finish(&enc);
+}
+
 static void
 command_handlers_map_init (void) {
   command_handlers_map = ht_init(11, NULL);
@@ -1,22 +1,33 @@
+#define _GNU_SOURCE  // For struct ucred
+
 #include "api/ipc.h"
 
 #include <errno.h>
+#include <grp.h>
 #include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #include "api/commands.h"
 #include "constants.h"
+#include "globals.h"
 #include "job.h"
 #include "logger.h"
+#include "metrics.h"
+#include "utils/encoder.h"
 #include "utils/file.h"
 #include "utils/json.h"
+#include "utils/time.h"
 #include "utils/xpanic.h"
 
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_IPC
+
 typedef enum {
   JOB_RUN_STATE_ACTIVE,
   JOB_RUN_STATE_PAUSED,
@@ -35,7 +46,6 @@ typedef struct {
 #define SOCKET_PATH          "/tmp/chronic.sock"
 #define MAX_CONCURRENT_CONNS 5
 #define RECV_BUFFER_SIZE     1024
-#define ERROR_MESSAGE_FMT    "{\"error\":\"%s\"}"
 
 static int server_fd = -1;
 
@@ -66,6 +76,18 @@ ipc_routine (void* arg __attribute__((unused))) {
       continue;
     }
 
+    uint64_t req_start = get_monotonic_usec();
+    metrics_add(METRIC_IPC_REQUESTS, 1);
+
+    // Handlers decide what the caller may do by its uid, so no uid, no service
+    struct ucred cred;
+    socklen_t    cred_len = sizeof(cred);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1) {
+      log_warn("failed to get client credentials (reason: %s)\n", strerror(errno));
+      close(client_fd);
+      continue;
+    }
+
     read(client_fd, readbuf, sizeof(readbuf));
     log_debug("API req: '%s'\n", readbuf);
 
@@ -81,16 +103,26 @@ ipc_routine (void* arg __attribute__((unused))) {
       goto client_done;
     }
 
+    enc_format  format;
+    const char* format_name = ht_get(pairs, "format");
+    if (format_name && enc_format_parse(format_name, &format) != OK) {
+      ipc_write_err(client_fd, "unknown format '%s'", format_name);
+      goto client_done;
+    }
+
     log_debug("received command '%s'\n", command);
-    void (*handler)(buffer_t*) = ht_get(get_command_handlers_map(), command);
+    command_handler* handler = ht_get(get_command_handlers_map(), command);
+    buffer_t*        writebuf = buffer_init(NULL);
 
     if (!handler) {
-      ipc_write_err(client_fd, "unknown command '%s'", command);
-      goto client_done;
+      char msg[128];
+      snprintf(msg, sizeof(msg), "unknown command '%s'", command);
+      // The format is known by now, so reply in it
+      write_error(writebuf, pairs, msg);
+    } else {
+      handler(writebuf, pairs, cred.uid);
     }
 
-    buffer_t* writebuf = buffer_init(NULL);
-    handler(writebuf);
     write(client_fd, buffer_state(writebuf), buffer_size(writebuf));
     buffer_free(writebuf);
 
@@ -98,6 +130,7 @@ ipc_routine (void* arg __attribute__((unused))) {
     memset(readbuf, 0, RECV_BUFFER_SIZE);
     ht_delete_table(pairs);
     close(client_fd);
+    metrics_observe(METRIC_IPC_LATENCY, get_monotonic_usec() - req_start);
   }
 
   return NULL;
@@ -133,11 +166,27 @@ ipc_init (void) {
     unlink(SOCKET_PATH);
   }
 
-  if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+  // Connecting takes write permission on the socket. The daemon runs with umask 0, so bind it owner-only
+  // from the start rather than chmod it after, when it'd already be open to anyone.
+  mode_t old_mask = umask(0177);
+  int    rc       = bind(server_fd, (struct sockaddr*)&addr, sizeof(addr));
+  umask(old_mask);
+  if (rc == -1) {
     log_error("failed to bind IPC server sock (reason: %s)\n", strerror(errno));
     xpanic("failed to bind socket");
   }
 
+  if (opts.socket_group) {
+    struct group* gr = getgrnam(opts.socket_group);
+    if (!gr) {
+      xpanic("unknown socket group '%s'", opts.socket_group);
+    }
+    if (chown(SOCKET_PATH, -1, gr->gr_gid) == -1 || chmod(SOCKET_PATH, 0660) == -1) {
+      xpanic("failed to open socket to group %s (reason: %s)", opts.socket_group, strerror(errno));
+    }
+    log_info("IPC socket open to group %s\n", opts.socket_group);
+  }
+
   if (listen(server_fd, MAX_CONCURRENT_CONNS) == -1) {
     log_error("failed to listen on IPC server sock (reason: %s)\n", strerror(errno));
     xpanic("failed to listen on socket");
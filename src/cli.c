@@ -1,7 +1,16 @@
 #include "cli.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "commander/commander.h"
+#include "config.h"
 #include "globals.h"
+#include "logger.h"
 #include "utils/xpanic.h"
 
 typedef struct {
@@ -41,6 +50,159 @@ setopt_syslog (command_t* self) {
   opts.syslog = true;
 }
 
+/**
+ * Enables the shared-memory status segment at the given path e.g.
+ * /dev/shm/chronic.status
+ */
+static void
+setopt_status_shm (command_t* self) {
+  opts.status_shm = s_copy_or_panic((char*)self->arg);
+}
+
+/**
+ * Enables the binary job journal at the given path.
+ */
+static void
+setopt_journal (command_t* self) {
+  opts.journal = s_copy_or_panic((char*)self->arg);
+}
+
+/**
+ * Enables asynchronous logging, with an optional overflow policy: "block"
+ * (the default) or "drop".
+ */
+static void
+setopt_async_log (command_t* self) {
+  const char* policy = self->arg;
+
+  if (!policy || strcmp(policy, "block") == 0) {
+    opts.log_mode = LOG_MODE_ASYNC_BLOCK;
+  } else if (strcmp(policy, "drop") == 0) {
+    opts.log_mode = LOG_MODE_ASYNC_DROP;
+  } else {
+    xpanic("unknown async log overflow policy '%s' (expected 'block' or 'drop')", policy);
+  }
+}
+
+/**
+ * Sets log verbosity, e.g. "info" or "info,scan=debug"; see `logger_set_levels`.
+ */
+static void
+setopt_log_level (command_t* self) {
+  if (logger_set_levels((char*)self->arg) != OK) {
+    xpanic(
+      "invalid log level spec '%s' (expected e.g. 'info' or 'info,scan=debug'; levels: error|warn|info|debug, "
+      "categories: core|scan|sched|job|ipc)",
+      (char*)self->arg
+    );
+  }
+}
+
+/**
+ * Parses a byte count with an optional K, M or G (binary) suffix.
+ */
+static size_t
+parse_size_or_panic (const char* opt, const char* arg) {
+  char*              end;
+  unsigned int       shift = 0;
+  errno                    = 0;
+  unsigned long long n     = strtoull(arg, &end, 10);
+
+  switch (*end) {
+    case 'K': shift = 10; end++; break;
+    case 'M': shift = 20; end++; break;
+    case 'G': shift = 30; end++; break;
+    default: break;
+  }
+
+  // strtoull would take leading space and signs
+  if (!isdigit((unsigned char)arg[0]) || *end || errno == ERANGE || n > SIZE_MAX >> shift) {
+    xpanic("invalid size '%s' for %s (expected e.g. 512, 64K or 1G)", arg, opt);
+  }
+
+  return n << shift;
+}
+
+/**
+ * Parses a plain decimal integer (no suffix) no greater than `max`.
+ */
+static unsigned long long
+parse_uint_or_panic (const char* opt, const char* arg, unsigned long long max) {
+  char* end;
+  errno                = 0;
+  unsigned long long n = strtoull(arg, &end, 10);
+
+  if (!isdigit((unsigned char)arg[0]) || *end || errno == ERANGE || n > max) {
+    xpanic("invalid value '%s' for %s (expected a whole number up to %llu)", arg, opt, max);
+  }
+
+  return n;
+}
+
+/**
+ * Parses a number of seconds. They're added to timestamps, so are capped well
+ * short of overflowing a time_t.
+ */
+static time_t
+parse_secs_or_panic (const char* opt, const char* arg) {
+  return (time_t)parse_uint_or_panic(opt, arg, INT_MAX);
+}
+
+static void
+setopt_log_max_size (command_t* self) {
+  opts.log_max_size = parse_size_or_panic("--log-max-size", self->arg);
+}
+
+static void
+setopt_log_max_age (command_t* self) {
+  opts.log_max_age = parse_secs_or_panic("--log-max-age", self->arg);
+}
+
+static void
+setopt_log_max_files (command_t* self) {
+  opts.log_max_files = parse_uint_or_panic("--log-max-files", self->arg, UINT_MAX);
+}
+
+static void
+setopt_log_compress (command_t* self) {
+  opts.log_compress = true;
+}
+
+static void
+setopt_output_dir (command_t* self) {
+  opts.output_dir = s_copy_or_panic(self->arg);
+}
+
+static void
+setopt_output_max (command_t* self) {
+  opts.output_max = parse_size_or_panic("--output-max", self->arg);
+}
+
+static void
+setopt_mail_cmd (command_t* self) {
+  opts.mail_cmd = s_copy_or_panic(self->arg);
+}
+
+static void
+setopt_mail_digest (command_t* self) {
+  opts.mail_digest = parse_secs_or_panic("--mail-digest", self->arg);
+}
+
+static void
+setopt_mail_relay (command_t* self) {
+  opts.mail_relay = s_copy_or_panic(self->arg);
+}
+
+static void
+setopt_uuid_ids (command_t* self) {
+  opts.uuid_ids = true;
+}
+
+static void
+setopt_socket_group (command_t* self) {
+  opts.socket_group = s_copy_or_panic(self->arg);
+}
+
 void
 cli_init (int argc, char** argv) {
   command_t  cmd;
@@ -50,8 +212,27 @@ cli_init (int argc, char** argv) {
   cmd.data   = (void*)&ctx;
   ctx.logopt = 0;
 
+  opts.log_max_files = LOG_MAX_FILES;
+  opts.output_max    = JOB_OUTPUT_MAX;
+  opts.mail_cmd      = MAILCMD_PATH;
+
   command_option(&cmd, "-L", "--log-file [path]", "log to specified file", setopt_logfile);
   command_option(&cmd, "-S", "--syslog", "log to syslog", setopt_syslog);
+  command_option(&cmd, "-l", "--log-level <spec>", "log verbosity e.g. info or info,scan=debug", setopt_log_level);
+  command_option(&cmd, "-s", "--log-max-size <size>", "rotate the log file at this size e.g. 64M", setopt_log_max_size);
+  command_option(&cmd, "-a", "--log-max-age <secs>", "rotate the log file after this many seconds", setopt_log_max_age);
+  command_option(&cmd, "-n", "--log-max-files <n>", "rotated log files to keep (default 5)", setopt_log_max_files);
+  command_option(&cmd, "-z", "--log-compress", "gzip rotated log files in the background", setopt_log_compress);
+  command_option(&cmd, "-M", "--status-shm [path]", "publish status to a shared-memory file", setopt_status_shm);
+  command_option(&cmd, "-J", "--journal <path>", "append job events to a binary journal", setopt_journal);
+  command_option(&cmd, "-A", "--async-log [policy]", "log from a background thread (policy: block|drop)", setopt_async_log);
+  command_option(&cmd, "-O", "--output-dir <dir>", "capture job output to this directory", setopt_output_dir);
+  command_option(&cmd, "-m", "--output-max <size>", "job output kept per job (default 64K)", setopt_output_max);
+  command_option(&cmd, "-x", "--mail-cmd <path>", "program to send job reports with (default " MAILCMD_PATH ")", setopt_mail_cmd);
+  command_option(&cmd, "-D", "--mail-digest <secs>", "send one digest per recipient per this many seconds", setopt_mail_digest);
+  command_option(&cmd, "-R", "--mail-relay <addr>", "submit mail to this SMTP relay (host[:port]) or LMTP socket (path)", setopt_mail_relay);
+  command_option(&cmd, "-U", "--uuid-ids", "render job and entry ids as UUIDs", setopt_uuid_ids);
+  command_option(&cmd, "-G", "--socket-group <group>", "let this group use the IPC socket (own jobs only)", setopt_socket_group);
 
   command_parse(&cmd, argc, argv);
   command_free(&cmd);
@@ -1,15 +1,17 @@
 #include "cronentry.h"
 
-#include <stdlib.h>
 #include <string.h>
 
 #include "logger.h"
+#include "metrics.h"
 #include "parser.h"
-#include "utils/retval.h"
-#include "utils/string.h"
-#include "utils/xmalloc.h"
+#include "utils/arena.h"
+#include "utils/strpool.h"
 #include "utils/xpanic.h"
 
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_SCHED
+
 static inline char*
 get_cadence (cadence_t cadence) {
   switch (cadence) {
@@ -24,68 +26,52 @@ get_cadence (cadence_t cadence) {
   }
 }
 
-static retval_t
-copy_schedule (cron_entry* entry, const char* schedule_override) {
-  size_t len = strlen(schedule_override);
-  if (len > MAX_SCHEDULE_LENGTH) {
-    log_warn("invalid schedule length for override (must be %d, was %s)\n", MAX_SCHEDULE_LENGTH, len);
-    return ERR;
-  }
-  memcpy(entry->schedule, schedule_override, len);
-  entry->schedule[len] = '\0';
-
-  return OK;
-}
-
-static retval_t
-copy_command (cron_entry* entry, const char* command) {
-  size_t len = strlen(command);
-  if (len > MAX_COMMAND_LENGTH) {
-    log_warn("invalid command length for override (must be %d, was %s)\n", MAX_COMMAND_LENGTH, len);
-    return ERR;
-  }
-  memcpy(entry->cmd, command, len);
-  entry->cmd[len] = '\0';
-
-  return OK;
-}
-
 cron_entry*
 new_cron_entry (char* raw, time_t curr, crontab_t* ct, cadence_t cadence) {
-  cron_entry* entry             = xmalloc(sizeof(cron_entry));
+  // A line that fails to parse leaves its space unused until the crontab goes
+  cron_entry* entry             = arena_alloc(ct->arena, sizeof(cron_entry));
+  entry->info                   = arena_alloc(ct->info_arena, sizeof(cron_entry_info));
   char*       schedule_override = get_cadence(cadence);
 
   if (schedule_override) {
-    copy_schedule(entry, schedule_override);
-    if (copy_schedule(entry, schedule_override) != OK || copy_command(entry, raw) != OK || parse_expr(entry) != OK) {
+    // parse_expr wants a writable copy
+    char      schedule[MAX_SCHEDULE_LENGTH];
+    cron_expr expr;
+    strcpy(schedule, schedule_override);
+    if (parse_expr(schedule, &expr) != OK) {
       log_error("Failed to parse entry schedule %s / %s\n", raw, schedule_override);
-
-      free(entry);
       return NULL;
     }
+
+    entry->expr           = exprpool_intern(&expr);
+    entry->info->schedule = strpool_intern(schedule);
+    entry->info->cmd      = strpool_intern(raw);
   } else if (parse_entry(entry, raw) != OK) {
     log_error("Failed to parse entry line %s\n", raw);
-    free(entry);
     return NULL;
   }
 
-  entry->parent = ct;
-  entry->next   = cron_next(entry->expr, curr);
-  entry->ident  = create_uuid();
+  entry->parent   = ct;
+  entry->next     = exprpool_next(entry->expr, curr);
+  entry->info->id = ident_next();
+  entry->paused   = false;
 
   return entry;
 }
 
 void
-renew_cron_entry (cron_entry* entry, time_t curr) {
-  log_debug("Updating time for entry %s\n", entry->ident);
-
-  entry->next = cron_next(entry->expr, curr);
+release_cron_entry (cron_entry* entry) {
+  exprpool_release(entry->expr);
+  strpool_release(entry->info->schedule);
+  strpool_release(entry->info->cmd);
 }
 
 void
-free_cron_entry (cron_entry* entry) {
-  free(entry->expr);
-  free(entry->ident);
-  free(entry);
+renew_cron_entry (cron_entry* entry, time_t curr) {
+  log_debug("Updating time for entry " IDENT_FMT "\n", entry->info->id);
+  metrics_add(METRIC_ENTRIES_RENEWED, 1);
+
+  // Entries of unmodified crontabs are shared with the published db snapshot,
+  // which IPC readers may be iterating concurrently.
+  __atomic_store_n(&entry->next, exprpool_next(entry->expr, curr), __ATOMIC_RELAXED);
 }
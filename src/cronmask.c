@@ -0,0 +1,160 @@
+#include "cronmask.h"
+
+#define CRONMASK_MAX_YEAR     2199
+// cron_next stops looking after four years; so do we
+#define CRONMASK_HORIZON_DAYS (4 * 366)
+
+static uint64_t
+get_bits (const uint8_t *bytes, unsigned int n_bits) {
+  uint64_t bits = 0;
+  for (unsigned int i = 0; i < n_bits; i++) {
+    bits |= (uint64_t)((bytes[i / 8] >> (i % 8)) & 1) << i;
+  }
+
+  return bits;
+}
+
+/**
+ * Whether the expression leaves seconds, years and the L/W/# modifiers at
+ * their defaults i.e. has five fields and nothing a mask can't express.
+ */
+static bool
+is_plain (const cron_expr *expr) {
+  if (get_bits(expr->seconds, 60) != 1 || expr->day_in_month[0] != 0 || expr->flags[0] != 0) {
+    return false;
+  }
+
+  // Every year from 1970 to 2199
+  for (unsigned int i = 0; i < 230; i++) {
+    if (!((expr->years[i / 8] >> (i % 8)) & 1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool
+cronmask_compile (const cron_expr *expr, cron_mask *mask) {
+  mask->minutes       = get_bits(expr->minutes, 60);
+  mask->hours         = (uint32_t)get_bits(expr->hours, 24);
+  mask->days_of_month = (uint32_t)get_bits(expr->days_of_month, 32) & ~1u;
+  mask->months        = (uint16_t)get_bits(expr->months, 12);
+  mask->days_of_week  = (uint8_t)get_bits(expr->days_of_week, 7);
+
+#ifdef CRON_USE_LOCAL_TIME
+  mask->usable = false;
+#else
+  mask->usable = is_plain(expr) && mask->minutes && mask->hours && mask->days_of_month && mask->months && mask->days_of_week;
+#endif
+
+  return mask->usable;
+}
+
+static bool
+is_leap (int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int
+days_in_month (int year, int month) {
+  static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+  return days[month] + (month == 1 && is_leap(year));
+}
+
+/**
+ * Converts days since the epoch to a date, after Howard Hinnant's
+ * civil_from_days. `month` counts from 0, `day` from 1.
+ */
+static void
+civil_from_days (int64_t z, int *year, int *month, int *day) {
+  z            += 719468;
+  int64_t  era  = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe  = (unsigned)(z - era * 146097);
+  unsigned yoe  = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy  = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp   = (5 * doy + 2) / 153;
+  unsigned m    = mp < 10 ? mp + 3 : mp - 9;
+
+  *day          = (int)(doy - (153 * mp + 2) / 5 + 1);
+  *month        = (int)m - 1;
+  *year         = (int)(yoe + era * 400) + (m <= 2);
+}
+
+void
+cronmask_at (time_t minute, cron_mask *at) {
+  int64_t days = (int64_t)minute / 86400;
+  int     year, month, day;
+  civil_from_days(days, &year, &month, &day);
+
+  at->minutes       = 1ull << (minute % 3600 / 60);
+  at->hours         = 1u << (minute % 86400 / 3600);
+  at->days_of_month = 1u << day;
+  at->months        = (uint16_t)(1u << month);
+  at->days_of_week  = (uint8_t)(1u << (days + 4) % 7);
+  at->usable        = minute >= 0;
+}
+
+time_t
+cronmask_next (const cron_mask *mask, time_t curr) {
+  if (!mask->usable || curr < 0) {
+    return CRON_INVALID_INSTANT;
+  }
+
+  // Expressions fire on whole minutes, so start at the one after `curr`
+  int64_t t      = (int64_t)curr / 60 * 60 + 60;
+  int64_t days   = t / 86400;
+  int     hour   = (int)(t % 86400 / 3600);
+  int     minute = (int)(t % 3600 / 60);
+  int     year, month, day;
+  civil_from_days(days, &year, &month, &day);
+  int     wday   = (int)((days + 4) % 7);
+
+  for (int64_t last = days + CRONMASK_HORIZON_DAYS; days <= last && year <= CRONMASK_MAX_YEAR;) {
+    if (!(mask->months >> month & 1)) {
+      // Skip the rest of the month
+      int left  = days_in_month(year, month) - day + 1;
+      days     += left;
+      wday      = (wday + left) % 7;
+      day       = 1;
+      hour      = minute = 0;
+      if (++month == 12) {
+        month = 0;
+        year++;
+      }
+      continue;
+    }
+
+    if ((mask->days_of_month >> day & 1) && (mask->days_of_week >> wday & 1)) {
+      uint32_t hours = mask->hours & (~0u << hour);
+      if (hours) {
+        int      h       = __builtin_ctz(hours);
+        uint64_t minutes = mask->minutes & (h == hour ? ~0ull << minute : ~0ull);
+        if (!minutes) {
+          // Nothing left this hour; try the next
+          hours   = mask->hours & (hour < 23 ? ~0u << (hour + 1) : 0);
+          h       = hours ? __builtin_ctz(hours) : -1;
+          minutes = mask->minutes;
+        }
+
+        if (h >= 0) {
+          return (time_t)(days * 86400 + h * 3600 + __builtin_ctzll(minutes) * 60);
+        }
+      }
+    }
+
+    days++;
+    wday = (wday + 1) % 7;
+    hour = minute = 0;
+    if (++day > days_in_month(year, month)) {
+      day = 1;
+      if (++month == 12) {
+        month = 0;
+        year++;
+      }
+    }
+  }
+
+  return CRON_INVALID_INSTANT;
+}
@@ -0,0 +1,188 @@
+#include "cronmatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/xmalloc.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#define CRONMATCH_FIELDS 5
+
+/**
+ * What a minute selects in each array, with the minutes array it selects from.
+ * A lane fires if `(lane & sel) == sel` in all four.
+ */
+typedef struct {
+  const uint32_t *minutes;
+  uint32_t        sel[4];
+} selector;
+
+typedef void(kernel_fn)(const cron_mask_set *set, const selector *s, uint64_t *fired);
+
+static void
+fires_scalar (const cron_mask_set *set, const selector *s, uint64_t *fired) {
+  for (size_t w = 0; w < set->capacity / 64; w++) {
+    uint64_t bits = 0;
+    for (unsigned int j = 0; j < 64; j++) {
+      size_t i  = w * 64 + j;
+      bool   f  = (s->minutes[i] & s->sel[0]) == s->sel[0] && (set->hours[i] & s->sel[1]) == s->sel[1] &&
+                (set->days_of_month[i] & s->sel[2]) == s->sel[2] && (set->months_days_of_week[i] & s->sel[3]) == s->sel[3];
+      bits     |= (uint64_t)f << j;
+    }
+    fired[w] = bits;
+  }
+}
+
+#ifdef __x86_64__
+// SSE2 is part of x86-64, so needs no check
+static void
+fires_sse2 (const cron_mask_set *set, const selector *s, uint64_t *fired) {
+  const __m128i s0 = _mm_set1_epi32((int)s->sel[0]), s1 = _mm_set1_epi32((int)s->sel[1]);
+  const __m128i s2 = _mm_set1_epi32((int)s->sel[2]), s3 = _mm_set1_epi32((int)s->sel[3]);
+
+  for (size_t w = 0; w < set->capacity / 64; w++) {
+    uint64_t bits = 0;
+    for (unsigned int j = 0; j < 64; j += 4) {
+      size_t  i  = w * 64 + j;
+      __m128i a  = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(s->minutes + i)), s0), s0);
+      __m128i b  = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(set->hours + i)), s1), s1);
+      __m128i c  = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(set->days_of_month + i)), s2), s2);
+      __m128i d  = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *)(set->months_days_of_week + i)), s3), s3);
+      __m128i f  = _mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d));
+      bits      |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(f)) << j;
+    }
+    fired[w] = bits;
+  }
+}
+
+__attribute__((target("avx2"))) static void
+fires_avx2 (const cron_mask_set *set, const selector *s, uint64_t *fired) {
+  const __m256i s0 = _mm256_set1_epi32((int)s->sel[0]), s1 = _mm256_set1_epi32((int)s->sel[1]);
+  const __m256i s2 = _mm256_set1_epi32((int)s->sel[2]), s3 = _mm256_set1_epi32((int)s->sel[3]);
+
+  for (size_t w = 0; w < set->capacity / 64; w++) {
+    uint64_t bits = 0;
+    for (unsigned int j = 0; j < 64; j += 8) {
+      size_t  i  = w * 64 + j;
+      __m256i a  = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(s->minutes + i)), s0), s0);
+      __m256i b  = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(set->hours + i)), s1), s1);
+      __m256i c  = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(set->days_of_month + i)), s2), s2);
+      __m256i d  = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(set->months_days_of_week + i)), s3), s3);
+      __m256i f  = _mm256_and_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, d));
+      bits      |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(f)) << j;
+    }
+    fired[w] = bits;
+  }
+}
+#endif
+
+static kernel_fn *kernel = NULL;
+
+cronmatch_kernel
+cronmatch_best (void) {
+#ifdef __x86_64__
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? CRONMATCH_AVX2 : CRONMATCH_SSE2;
+#else
+  return CRONMATCH_SCALAR;
+#endif
+}
+
+bool
+cronmatch_use (cronmatch_kernel k) {
+  switch (k) {
+    case CRONMATCH_SCALAR: kernel = fires_scalar; return true;
+#ifdef __x86_64__
+    case CRONMATCH_SSE2: kernel = fires_sse2; return true;
+    case CRONMATCH_AVX2:
+      if (cronmatch_best() == CRONMATCH_AVX2) {
+        kernel = fires_avx2;
+        return true;
+      }
+      return false;
+#endif
+    default: return false;
+  }
+}
+
+void
+cronmatch_init (cron_mask_set *set) {
+  *set = (cron_mask_set){0};
+}
+
+void
+cronmatch_free (cron_mask_set *set) {
+  // The arrays share one allocation
+  free(set->minutes_lo);
+  cronmatch_init(set);
+}
+
+static void
+set_grow (cron_mask_set *set) {
+  size_t    old_cap  = set->capacity;
+  size_t    capacity = old_cap ? old_cap * 2 : 64;
+  uint32_t *lanes    = xmalloc(CRONMATCH_FIELDS * capacity * sizeof(uint32_t));
+  memset(lanes, 0, CRONMATCH_FIELDS * capacity * sizeof(uint32_t));
+
+  uint32_t **fields[] = {&set->minutes_lo, &set->minutes_hi, &set->hours, &set->days_of_month, &set->months_days_of_week};
+  for (unsigned int f = 0; f < CRONMATCH_FIELDS; f++) {
+    if (old_cap) {
+      memcpy(lanes + f * capacity, *fields[f], old_cap * sizeof(uint32_t));
+    }
+  }
+  free(set->minutes_lo);
+
+  for (unsigned int f = 0; f < CRONMATCH_FIELDS; f++) {
+    *fields[f] = lanes + f * capacity;
+  }
+  set->capacity = capacity;
+}
+
+void
+cronmatch_put (cron_mask_set *set, size_t lane, const cron_mask *mask) {
+  static const cron_mask never = {0};
+  const cron_mask       *m     = mask->usable ? mask : &never;
+
+  set->minutes_lo[lane]          = (uint32_t)m->minutes;
+  set->minutes_hi[lane]          = (uint32_t)(m->minutes >> 32);
+  set->hours[lane]               = m->hours;
+  set->days_of_month[lane]       = m->days_of_month;
+  set->months_days_of_week[lane] = m->months | (uint32_t)m->days_of_week << 16;
+}
+
+size_t
+cronmatch_push (cron_mask_set *set, const cron_mask *mask) {
+  if (set->count == set->capacity) {
+    set_grow(set);
+  }
+
+  cronmatch_put(set, set->count, mask);
+  return set->count++;
+}
+
+void
+cronmatch_pop (cron_mask_set *set) {
+  static const cron_mask never = {0};
+  cronmatch_put(set, --set->count, &never);
+}
+
+void
+cronmatch_fires (const cron_mask_set *set, time_t minute, uint64_t *fired) {
+  if (!kernel) {
+    cronmatch_use(cronmatch_best());
+  }
+
+  cron_mask at;
+  cronmask_at(minute, &at);
+
+  unsigned int m = __builtin_ctzll(at.minutes);
+  selector     s = {
+        .minutes = m < 32 ? set->minutes_lo : set->minutes_hi,
+        .sel     = {1u << (m % 32), at.hours, at.days_of_month, at.months | (uint32_t)at.days_of_week << 16},
+  };
+
+  kernel(set, &s, fired);
+}
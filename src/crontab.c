@@ -15,13 +15,40 @@
 #include "cronentry.h"
 #include "globals.h"
 #include "logger.h"
+#include "mail.h"
+#include "metrics.h"
 #include "parser.h"
+#include "pause.h"
 #include "utils/file.h"
-#include "utils/xmalloc.h"
+#include "utils/time.h"
 #include "utils/xpanic.h"
 
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_SCAN
+
 #define MAXENTRIES 256
-#define RW_BUFFER  1024
+
+/**
+ * Sets the crontab's mail policy from its MAILPOLICY variable. An empty MAILTO
+ * turns mail off regardless.
+ *
+ * @param ct
+ */
+static void
+set_mail_policy (crontab_t* ct) {
+  char* mailto = ht_get(ct->vars, MAILTO_ENVVAR);
+  char* policy = ht_get(ct->vars, MAILPOLICY_ENVVAR);
+
+  ct->mail_policy = MAIL_ALWAYS;
+  if (policy && mail_policy_parse(policy, &ct->mail_policy) != OK) {
+    log_warn("invalid %s value '%s' for user %s; mailing every job\n", MAILPOLICY_ENVVAR, policy, ct->uname);
+  }
+
+  // Both `MAILTO=` and `MAILTO=""` mean no mail, as in other crons
+  if (mailto && (*mailto == '\0' || strcmp(mailto, "\"\"") == 0)) {
+    ct->mail_policy = MAIL_NEVER;
+  }
+}
 
 /**
  * Modifies and finalizes the given crontab's environment data by adding any
@@ -36,21 +63,22 @@ complete_env (crontab_t* ct) {
 
   // We don't want to have to create users for unit tests.
   struct passwd* pw = getpwnam(ct->uname);
+  ct->uid           = pw ? pw->pw_uid : (uid_t)-1;
   if (pw) {
     if (!ht_search(vars, HOMEDIR_ENVVAR)) {
-      ht_insert(vars, HOMEDIR_ENVVAR, s_copy_or_panic(pw->pw_dir));
+      ht_insert(vars, HOMEDIR_ENVVAR, arena_strdup(ct->arena, pw->pw_dir));
     }
 
     if (!ht_search(vars, SHELL_ENVVAR)) {
-      ht_insert(vars, SHELL_ENVVAR, s_copy_or_panic(pw->pw_shell));
+      ht_insert(vars, SHELL_ENVVAR, arena_strdup(ct->arena, pw->pw_shell));
     }
 
     if (!ht_search(vars, UNAME_ENVVAR)) {
-      ht_insert(vars, UNAME_ENVVAR, s_copy_or_panic(pw->pw_name));
+      ht_insert(vars, UNAME_ENVVAR, arena_strdup(ct->arena, pw->pw_name));
     }
 
     if (!ht_search(vars, PATH_ENVVAR)) {
-      ht_insert(vars, PATH_ENVVAR, s_copy_or_panic(DEFAULT_PATH));
+      ht_insert(vars, PATH_ENVVAR, DEFAULT_PATH);
     }
   } else {
     log_warn(
@@ -59,14 +87,17 @@ complete_env (crontab_t* ct) {
       ct->uname
     );
   }
+
+  set_mail_policy(ct);
+
   // Fill out the envp using the vars map. We're going to need this later and
   // forevermore, so we might as well get it out of the way upfront.
   if (vars->count > 0) {
-    ct->envp         = xmalloc(sizeof(char*) * vars->count + 1);
+    ct->envp         = arena_alloc(ct->arena, sizeof(char*) * (vars->count + 1));
 
     unsigned int idx = 0;
     HT_ITER_START(vars)
-    ct->envp[idx] = s_fmt("%s=%s", entry->key, entry->value);
+    ct->envp[idx] = arena_fmt(ct->arena, "%s=%s", entry->key, (char*)entry->value);
     idx++;
     HT_ITER_END
 
@@ -104,7 +135,7 @@ get_crontab_fd_if_valid (char* fpath, char* file_owner_uname, time_t last_mtime,
   }
 
   if (!S_ISREG(statbuf->st_mode)) {
-    log_warn("file %s is not a regular file", fpath);
+    log_warn("file %s is not a regular file\n", fpath);
     goto dont_process;
   }
 
@@ -147,14 +178,14 @@ get_crontab_fd_if_valid (char* fpath, char* file_owner_uname, time_t last_mtime,
 
   // Ensure there aren't any hard links
   if (has_hard_links(statbuf)) {
-    log_warn("file %s has hard symlinks (%d)\n", fpath, statbuf->st_nlink);
+    log_warn("file %s has hard symlinks (%lu)\n", fpath, (unsigned long)statbuf->st_nlink);
     goto dont_process;
   }
 
   if (last_mtime > -1) {
     // It shouldn't ever be greater than but whatever
     if (last_mtime >= statbuf->st_mtime) {
-      log_debug("file has not changed (mtime: %ld)\n", fpath, last_mtime);
+      log_debug("file %s has not changed (mtime: %ld)\n", fpath, (long)last_mtime);
       goto dont_process;
     }
   }
@@ -165,17 +196,37 @@ dont_process:
   return not_ok;
 }
 
+/**
+ * Allocates an empty crontab in a new arena, with another for its entries'
+ * infos.
+ */
+static crontab_t*
+alloc_crontab (time_t mtime, const char* uname) {
+  arena_t*   arena = arena_init();
+  crontab_t* ct    = arena_alloc(arena, sizeof(crontab_t));
+  ct->arena        = arena;
+  ct->info_arena   = arena_init();
+  ct->mtime        = mtime;
+  ct->uname        = arena_strdup(arena, uname);
+  ct->uid          = (uid_t)-1;
+  ct->envp         = NULL;
+  ct->refs         = 1;
+  ct->paused       = false;
+  ct->mail_policy  = MAIL_ALWAYS;
+  ct->entries      = array_init_or_panic();
+  // Values live in the arena
+  ct->vars         = ht_init_or_panic(0, NULL);
+
+  return ct;
+}
+
 crontab_t*
-new_virtual_crontab (time_t curr_time, time_t mtime, char* uname, char* fpath, cadence_t cadence) {
-  crontab_t* ct     = xmalloc(sizeof(crontab_t));
-  ct->mtime         = mtime;
-  ct->uname         = uname;
-  ct->envp          = NULL;
-  ct->entries       = array_init_or_panic();
-  ct->vars          = ht_init_or_panic(0, free);
+new_virtual_crontab (time_t curr_time, time_t mtime, const char* uname, char* fpath, cadence_t cadence) {
+  crontab_t*  ct    = alloc_crontab(mtime, uname);
 
   cron_entry* entry = new_cron_entry(fpath, curr_time, ct, cadence);
   if (!entry) {
+    metrics_add(METRIC_PARSE_ERRORS, 1);
     log_warn(
       "Failed to parse what was thought to be a cron entry: %s (user "
       "%s)\n",
@@ -183,6 +234,7 @@ new_virtual_crontab (time_t curr_time, time_t mtime, char* uname, char* fpath, c
       uname
     );
 
+    free_crontab(ct);
     return NULL;
   }
 
@@ -193,10 +245,15 @@ new_virtual_crontab (time_t curr_time, time_t mtime, char* uname, char* fpath, c
 }
 
 crontab_t*
-new_crontab (int crontab_fd, bool is_root, time_t curr_time, time_t mtime, char* uname) {
+new_crontab (int crontab_fd, bool is_root, time_t curr_time, time_t mtime, const char* uname) {
+  // Read through our own dup, so fclose leaves the caller's fd to the caller
   FILE* fd;
-  if (!(fd = fdopen(crontab_fd, "r"))) {
+  int   dup_fd;
+  if ((dup_fd = fcntl(crontab_fd, F_DUPFD_CLOEXEC, 0)) < 0 || !(fd = fdopen(dup_fd, "r"))) {
     log_warn("fdopen on crontab_fd %d failed (reason: %s)\n", crontab_fd, strerror(errno));
+    if (dup_fd >= 0) {
+      close(dup_fd);
+    }
     return NULL;
   }
 
@@ -211,25 +268,23 @@ new_crontab (int crontab_fd, bool is_root, time_t curr_time, time_t mtime, char*
 
   max_lines = max_entries * 10;
 
-  char buf[RW_BUFFER];
+  // Lines, and so commands, may be any length
+  char*  buf    = NULL;
+  size_t buf_sz = 0;
 
-  crontab_t* ct = xmalloc(sizeof(crontab_t));
-  ct->mtime     = mtime;
-  ct->uname     = uname;
-  ct->envp      = NULL;
-  ct->entries   = array_init_or_panic();
-  ct->vars      = ht_init_or_panic(0, free);
+  crontab_t* ct = alloc_crontab(mtime, uname);
 
-  while (fgets(buf, sizeof(buf), fd) != NULL && --max_lines) {
+  while (getline(&buf, &buf_sz, fd) != -1 && --max_lines) {
     char* ptr = buf;
 
-    switch (parse_line(ptr, max_entries, ct->vars)) {
+    switch (parse_line(ptr, max_entries, ct)) {
       case ENV_VAR_ADDED:
       case SKIP_LINE: continue;
       case DONE: break;
       case ENTRY: {
         cron_entry* entry = new_cron_entry(ptr, curr_time, ct, CADENCE_NA);
         if (!entry) {
+          metrics_add(METRIC_PARSE_ERRORS, 1);
           log_warn(
             "Failed to parse what was thought to be a cron entry: %s (user "
             "%s)\n",
@@ -239,7 +294,7 @@ new_crontab (int crontab_fd, bool is_root, time_t curr_time, time_t mtime, char*
           continue;
         }
 
-        log_debug("New entry (%s) for crontab %s\n", entry->ident, uname);
+        log_debug("New entry (" IDENT_FMT ") for crontab %s\n", entry->info->id, uname);
         array_push_or_panic(ct->entries, entry);
         max_entries--;
       }
@@ -247,6 +302,7 @@ new_crontab (int crontab_fd, bool is_root, time_t curr_time, time_t mtime, char*
     }
   }
 
+  free(buf);
   fclose(fd);
   complete_env(ct);
 
@@ -255,21 +311,34 @@ new_crontab (int crontab_fd, bool is_root, time_t curr_time, time_t mtime, char*
 
 void
 free_crontab (crontab_t* ct) {
-  free(ct->uname);
-  array_free(ct->entries, (free_fn*)free_cron_entry);
+  array_free(ct->entries, (free_fn*)release_cron_entry);
   ht_delete_table(ct->vars);
-  if (ct->envp) {
-    free(ct->envp);
+  arena_free(ct->info_arena);
+  // Also frees `ct`
+  arena_free(ct->arena);
+}
+
+crontab_t*
+retain_crontab (crontab_t* ct) {
+  ct->refs++;
+  return ct;
+}
+
+void
+release_crontab (crontab_t* ct) {
+  if (--ct->refs == 0) {
+    free_crontab(ct);
   }
-  free(ct);
 }
 
-static inline void
-renew_crontab_entries (crontab_t* ct, time_t curr) {
+void
+renew_crontabs (hash_table* db, time_t curr) {
+  HT_ITER_START(db)
+  crontab_t* ct = entry->value;
   foreach (ct->entries, i) {
-    cron_entry* entry = array_get_or_panic(ct->entries, i);
-    renew_cron_entry(entry, curr);
+    renew_cron_entry(array_get_or_panic(ct->entries, i), curr);
   }
+  HT_ITER_END
 }
 
 void
@@ -298,6 +367,7 @@ scan_crontabs (hash_table* old_db, hash_table* new_db, dir_config* dir_conf, tim
     char*       uname = dir_conf->is_root ? ROOT_UNAME : fname;
 
     log_debug("scanning file %s...\n", fpath);
+    metrics_add(METRIC_FILES_SCANNED, 1);
     // The file hasn't been processed before. Create the new crontab.
     if (!ct) {
       if ((crontab_fd = get_crontab_fd_if_valid(fpath, uname, 0, &statbuf, false)) < OK) {
@@ -307,7 +377,10 @@ scan_crontabs (hash_table* old_db, hash_table* new_db, dir_config* dir_conf, tim
 
       log_debug("creating new crontab from file %s...\n", fpath);
 
-      ct = new_crontab(crontab_fd, dir_conf->is_root, curr, statbuf.st_mtime, s_copy_or_panic(uname));
+      ct = new_crontab(crontab_fd, dir_conf->is_root, curr, statbuf.st_mtime, uname);
+      if (ct) {
+        pause_state_apply(fpath, ct);
+      }
     } else {
       // The file has been processed before. If the file has been modified, we need to re-process it.
       // Otherwise, renewing the next run time is sufficient.
@@ -324,16 +397,20 @@ scan_crontabs (hash_table* old_db, hash_table* new_db, dir_config* dir_conf, tim
       }
 
       if (ct->mtime >= statbuf.st_mtime) {
-        // The crontab was not modified, just renew the entries so we know when to run them next.
-        log_debug("existing file %s not modified, renewing entries if any\n", fpath);
-        renew_crontab_entries(ct, curr);
+        // The crontab was not modified. Its entries' next fire times still hold: each is renewed as it fires
+        // (see try_run_jobs), and all of them if the clock jumps (see renew_crontabs).
+        log_debug("existing file %s not modified, carrying it over\n", fpath);
 
-        // Make sure we don't accidentally free the old entries since they have been copied over.
-        ht_insert(old_db, fpath, NULL);
+        // The crontab is now shared by both db versions. The old db may still be pinned by readers,
+        // so we must not modify it; instead, take a reference so releasing the old db doesn't free it.
+        retain_crontab(ct);
       } else {
         // The crontab was modified, re-process.
         log_debug("existing file %s was modified, recreating crontab\n", fpath);
-        ct = new_crontab(crontab_fd, dir_conf->is_root, curr, statbuf.st_mtime, s_copy_or_panic(fname));
+        ct = new_crontab(crontab_fd, dir_conf->is_root, curr, statbuf.st_mtime, uname);
+        if (ct) {
+          pause_state_apply(fpath, ct);
+        }
       }
     }
 
@@ -361,6 +438,7 @@ scan_virtual_crontabs (hash_table* old_db, hash_table* new_db, dir_config* dir_c
     }
 
     log_debug("scanning cadence file %s...\n", fpath);
+    metrics_add(METRIC_FILES_SCANNED, 1);
 
     int         crontab_fd;
     struct stat statbuf;
@@ -370,24 +448,28 @@ scan_virtual_crontabs (hash_table* old_db, hash_table* new_db, dir_config* dir_c
     }
     close(crontab_fd);
 
-    crontab_t* ct    = ht_get(old_db, fpath);
-    char*      uname = s_copy(ROOT_UNAME);
+    crontab_t* ct = ht_get(old_db, fpath);
 
     if (!ct) {
       log_debug("creating new virtual crontab from cadence file %s...\n", fpath);
-      ct = new_virtual_crontab(curr, statbuf.st_mtime, uname, fpath, cadence);
+      ct = new_virtual_crontab(curr, statbuf.st_mtime, ROOT_UNAME, fpath, cadence);
+      if (ct) {
+        pause_state_apply(fpath, ct);
+      }
 
     } else {
       if (ct->mtime >= statbuf.st_mtime) {
-        log_debug("existing cadence file %s not modified, renewing the entry\n", fpath);
+        log_debug("existing cadence file %s not modified, carrying it over\n", fpath);
 
-        renew_crontab_entries(ct, curr);
-        ht_insert(old_db, fpath, NULL);
+        retain_crontab(ct);
       } else {
         log_debug("existing cadence file %s was modified, recreating virtual crontab\n", fpath);
 
-        ct = new_virtual_crontab(curr, statbuf.st_mtime, uname, s_copy_or_panic(fname), cadence);
-        // Don't set null in else path because we recreate the crontab and want the old one to be freed
+        ct = new_virtual_crontab(curr, statbuf.st_mtime, ROOT_UNAME, fpath, cadence);
+        if (ct) {
+          pause_state_apply(fpath, ct);
+        }
+        // Don't retain in this path because we recreate the crontab and want the old one to be freed
       }
     }
 
@@ -399,9 +481,11 @@ scan_virtual_crontabs (hash_table* old_db, hash_table* new_db, dir_config* dir_c
 
 hash_table*
 update_db (hash_table* db, time_t curr, dir_config* dir_conf, ...) {
+  uint64_t start      = get_monotonic_usec();
+
   // We HAVE to make a brand new db each time, else we will not be able to
   // tell if a file was deleted
-  hash_table* new_db = ht_init_or_panic(0, (free_fn*)free_crontab);
+  hash_table* new_db = ht_init_or_panic(0, (free_fn*)release_crontab);
 
   va_list args;
   va_start(args, dir_conf);
@@ -417,7 +501,7 @@ update_db (hash_table* db, time_t curr, dir_config* dir_conf, ...) {
 
   va_end(args);
 
-  ht_delete_table(db);
+  metrics_observe(METRIC_UPDATE_DB_DURATION, get_monotonic_usec() - start);
 
   return new_db;
 }
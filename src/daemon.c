@@ -15,10 +15,14 @@
 
 #include "api/ipc.h"
 #include "cli.h"
+#include "config.h"
 #include "globals.h"
 #include "job.h"
+#include "journal.h"
 #include "libutil/libutil.h"
 #include "logger.h"
+#include "smtp.h"
+#include "status.h"
 #include "utils/xpanic.h"
 
 #define LOCKFILE_BUFFER_SZ    512
@@ -152,6 +156,11 @@ daemon_lock (void) {
 void
 daemon_shutdown (void) {
   ipc_shutdown();
+  // Before the logger and queues go away; the digests' mail still needs both
+  job_mail_flush();
+  smtp_drain(SMTP_DRAIN_SECS);
+  status_close();
+  journal_close();
   logger_close();
   unlink(get_lockfile_path());
 
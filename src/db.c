@@ -0,0 +1,102 @@
+#include "db.h"
+
+#include <stdlib.h>
+
+#include "libutil/libutil.h"
+#include "logger.h"
+#include "utils/xmalloc.h"
+#include "utils/xpanic.h"
+
+/* The currently published snapshot. */
+static _Atomic(db_snapshot *) current = NULL;
+
+/*
+ * Number of readers that have loaded `current` but may not have bumped its
+ * refcount yet. While this is non-zero, a retired snapshot with zero refs might
+ * still be about to get pinned, so we can't free it.
+ */
+static atomic_uint acquiring          = 0;
+
+/* Snapshots that were replaced but may still have readers. Owner-only. */
+static array_t    *retired            = NULL;
+
+static unsigned long version          = 0;
+
+static void
+free_snapshot (db_snapshot *snap) {
+  if (snap->crontabs) {
+    ht_delete_table(snap->crontabs);
+  }
+  free(snap);
+}
+
+void
+db_publish (hash_table *crontabs) {
+  db_snapshot *snap = NULL;
+
+  if (crontabs) {
+    snap           = xmalloc(sizeof(db_snapshot));
+    snap->crontabs = crontabs;
+    snap->version  = ++version;
+    atomic_init(&snap->refs, 0);
+  }
+
+  db_snapshot *prev = atomic_exchange(&current, snap);
+  if (prev) {
+    if (!retired) {
+      retired = array_init_or_panic();
+    }
+    array_push_or_panic(retired, prev);
+  }
+
+  db_reclaim();
+}
+
+db_snapshot *
+db_acquire (void) {
+  atomic_fetch_add(&acquiring, 1);
+
+  db_snapshot *snap = atomic_load(&current);
+  if (snap) {
+    atomic_fetch_add(&snap->refs, 1);
+  }
+
+  atomic_fetch_sub(&acquiring, 1);
+
+  return snap;
+}
+
+void
+db_release (db_snapshot *snap) {
+  if (snap) {
+    atomic_fetch_sub(&snap->refs, 1);
+  }
+}
+
+unsigned int
+db_reclaim (void) {
+  if (!retired) {
+    return 0;
+  }
+
+  // A reader may be between loading a now-retired pointer and pinning it. Once
+  // no reader is mid-acquire, any reader of a retired snapshot is accounted for
+  // in its refcount.
+  if (atomic_load(&acquiring) == 0) {
+    for (size_t i = array_size(retired); i > 0; i--) {
+      db_snapshot *snap = array_get_or_panic(retired, i - 1);
+
+      if (atomic_load(&snap->refs) == 0) {
+        array_remove(retired, i - 1);
+        free_snapshot(snap);
+      }
+    }
+  }
+
+  unsigned int pending = array_size(retired);
+  if (pending > 0) {
+    log_debug("%u retired db snapshot(s) still pinned by readers\n", pending);
+  }
+
+  return pending;
+}
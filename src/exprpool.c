@@ -0,0 +1,253 @@
+#include "exprpool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cronmatch.h"
+#include "metrics.h"
+#include "utils/hashset.h"
+#include "utils/xmalloc.h"
+
+static uint64_t
+expr_hash_of (const void *item) {
+  return ((const shared_expr *)item)->hash;
+}
+
+static bool
+expr_eq (const void *item, const void *key) {
+  return memcmp(&((const shared_expr *)item)->expr, key, sizeof(cron_expr)) == 0;
+}
+
+// Every shared expression, found by its hash
+static hashset_t     pool         = {.hash_of = expr_hash_of};
+
+// Every expression's mask, by lane, for sliding the windows
+static cron_mask_set lanes;
+static shared_expr **by_lane      = NULL;
+static uint64_t     *fired        = NULL;
+static size_t        fired_lanes  = 0;
+
+// The windows' first minute; they all cover the same day
+static time_t        window_start = CRON_INVALID_INSTANT;
+
+/**
+ * FNV-1a over the expression's fields. They're all bytes, so there's no
+ * padding to trip over.
+ */
+static uint64_t
+expr_hash (const cron_expr *expr) {
+  const uint8_t *p = (const uint8_t *)expr;
+  uint64_t       h = 14695981039346656037ull;
+
+  for (size_t i = 0; i < sizeof(cron_expr); i++) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+
+  return h;
+}
+
+static inline bool
+in_window (time_t t) {
+  return window_start != CRON_INVALID_INSTANT && t >= window_start && t < window_start + EXPRPOOL_WINDOW * 60;
+}
+
+static inline unsigned int
+window_bit (time_t minute) {
+  return (unsigned int)(minute / 60 % EXPRPOOL_WINDOW);
+}
+
+static inline void
+window_put (uint64_t *window, unsigned int bit, bool fires) {
+  uint64_t b       = 1ull << (bit % 64);
+  window[bit / 64] = fires ? window[bit / 64] | b : window[bit / 64] & ~b;
+}
+
+/**
+ * Works out the whole of an expression's window, an hour at a time.
+ */
+static void
+window_fill (shared_expr *e) {
+  memset(e->window, 0, sizeof(e->window));
+  if (!e->mask.usable) {
+    return;
+  }
+
+  time_t end = window_start + EXPRPOOL_WINDOW * 60;
+  for (time_t hour = window_start - window_start % 3600; hour < end; hour += 3600) {
+    cron_mask at;
+    cronmask_at(hour, &at);
+    if (!(e->mask.hours & at.hours) || !(e->mask.days_of_month & at.days_of_month) || !(e->mask.months & at.months) ||
+        !(e->mask.days_of_week & at.days_of_week)) {
+      continue;
+    }
+
+    for (uint64_t m = e->mask.minutes; m; m &= m - 1) {
+      time_t t = hour + __builtin_ctzll(m) * 60;
+      if (in_window(t)) {
+        window_put(e->window, window_bit(t), true);
+      }
+    }
+  }
+}
+
+/**
+ * Returns the first minute after `curr` the expression fires in, if the window
+ * has one.
+ */
+static time_t
+window_next (const shared_expr *e, time_t curr) {
+  time_t first = curr - curr % 60 + 60;
+  if (curr < 0 || !in_window(first)) {
+    return CRON_INVALID_INSTANT;
+  }
+
+  // Scan word by word to the window's end, wrapping around the day
+  unsigned int bit  = window_bit(first);
+  unsigned int left = (unsigned int)((window_start + EXPRPOOL_WINDOW * 60 - first) / 60);
+  unsigned int seen = 0;
+  while (left > 0) {
+    unsigned int off  = bit % 64;
+    unsigned int span = 64 - off;
+    span              = span < EXPRPOOL_WINDOW - bit ? span : EXPRPOOL_WINDOW - bit;
+    span              = span < left ? span : left;
+
+    uint64_t bits     = e->window[bit / 64] >> off;
+    if (span < 64) {
+      bits &= (1ull << span) - 1;
+    }
+    if (bits) {
+      return first + (time_t)(seen + __builtin_ctzll(bits)) * 60;
+    }
+
+    seen += span;
+    left -= span;
+    bit   = (bit + span) % EXPRPOOL_WINDOW;
+  }
+
+  return CRON_INVALID_INSTANT;
+}
+
+shared_expr *
+exprpool_intern (const cron_expr *expr) {
+  uint64_t hash = expr_hash(expr);
+
+  hashset_reserve(&pool);
+  void **slot = hashset_probe(&pool, hash, expr_eq, expr);
+  if (*slot) {
+    shared_expr *e = *slot;
+    e->refs++;
+    return e;
+  }
+
+  shared_expr *e = xmalloc(sizeof(shared_expr));
+  e->expr        = *expr;
+  cronmask_compile(expr, &e->mask);
+  e->hash        = hash;
+  e->refs        = 1;
+  e->from        = CRON_INVALID_INSTANT;
+  e->next        = CRON_INVALID_INSTANT;
+
+  size_t cap     = lanes.capacity;
+  e->lane        = cronmatch_push(&lanes, &e->mask);
+  if (lanes.capacity != cap) {
+    shared_expr **grown = xmalloc(lanes.capacity * sizeof(shared_expr *));
+    if (cap) {
+      memcpy(grown, by_lane, cap * sizeof(shared_expr *));
+    }
+    free(by_lane);
+    by_lane = grown;
+  }
+  by_lane[e->lane] = e;
+
+  if (window_start != CRON_INVALID_INSTANT) {
+    window_fill(e);
+  }
+
+  hashset_insert(&pool, slot, e);
+
+  return e;
+}
+
+void
+exprpool_release (shared_expr *e) {
+  if (--e->refs > 0) {
+    return;
+  }
+
+  hashset_remove(&pool, e);
+
+  // Move the last lane into the freed one
+  shared_expr *last = by_lane[lanes.count - 1];
+  if (last != e) {
+    last->lane          = e->lane;
+    by_lane[last->lane] = last;
+    cronmatch_put(&lanes, last->lane, &last->mask);
+  }
+  cronmatch_pop(&lanes);
+
+  free(e);
+}
+
+time_t
+exprpool_next (shared_expr *e, time_t curr) {
+  bool known = e->mask.usable ? e->from != CRON_INVALID_INSTANT && e->from <= curr && curr < e->next : e->from == curr;
+  if (known) {
+    return e->next;
+  }
+
+  metrics_add(METRIC_NEXT_COMPUTED, 1);
+  e->next = e->mask.usable ? window_next(e, curr) : CRON_INVALID_INSTANT;
+  if (e->next == CRON_INVALID_INSTANT) {
+    e->next = cronmask_next(&e->mask, curr);
+  }
+  if (e->next == CRON_INVALID_INSTANT) {
+    e->next = cron_next(&e->expr, curr);
+  }
+  e->from = curr;
+
+  return e->next;
+}
+
+void
+exprpool_advance (time_t now) {
+  time_t start = now - now % 60;
+
+  if (window_start == CRON_INVALID_INSTANT || start < window_start || start - window_start >= EXPRPOOL_WINDOW * 60) {
+    window_start = start;
+    for (size_t lane = 0; lane < lanes.count; lane++) {
+      window_fill(by_lane[lane]);
+    }
+    return;
+  }
+
+  if (fired_lanes != lanes.capacity) {
+    free(fired);
+    fired       = xmalloc((lanes.capacity / 64 + 1) * sizeof(uint64_t));
+    fired_lanes = lanes.capacity;
+  }
+
+  // Each minute entering the window takes the bit of the one leaving it
+  for (time_t m = window_start + EXPRPOOL_WINDOW * 60; m < start + EXPRPOOL_WINDOW * 60; m += 60) {
+    cronmatch_fires(&lanes, m, fired);
+    unsigned int bit = window_bit(m);
+    for (size_t lane = 0; lane < lanes.count; lane++) {
+      window_put(by_lane[lane]->window, bit, fired[lane / 64] >> (lane % 64) & 1);
+    }
+  }
+  window_start = start;
+}
+
+bool
+exprpool_fires (shared_expr *e, time_t minute) {
+  if (e->mask.usable && in_window(minute) && minute % 60 == 0) {
+    return e->window[window_bit(minute) / 64] >> (window_bit(minute) % 64) & 1;
+  }
+
+  return exprpool_next(e, minute - 1) == minute;
+}
+
+size_t
+exprpool_count (void) {
+  return pool.count;
+}
@@ -5,19 +5,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "config.h"
 #include "cronentry.h"
 #include "globals.h"
+#include "journal.h"
 #include "libutil/libutil.h"
 #include "logger.h"
+#include "mail.h"
 #include "proginfo.h"
+#include "smtp.h"
+#include "status.h"
+#include "utils/time.h"
 #include "utils/string.h"
 #include "utils/xmalloc.h"
 #include "utils/xpanic.h"
 
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_JOB
+
 const char* job_state_names[] = {X(PENDING), X(RUNNING), X(EXITED)};
 
 // Mutex + cond var for the reaper daemon thread.
@@ -26,17 +35,29 @@ pthread_cond_t  cond          = PTHREAD_COND_INITIALIZER;
 
 job_t*
 new_cronjob (cron_entry* entry) {
-  job_t* job    = xmalloc(sizeof(job_t));
-  job->ident    = create_uuid();
-  job->type     = CRON;
-  job->state    = PENDING;
-  job->cmd      = s_copy_or_panic(entry->cmd);
-  job->ret      = -1;
-  job->pid      = -1;
-  job->next_run = entry->next;
-
-  ht_entry* r   = ht_search(entry->parent->vars, MAILTO_ENVVAR);
-  job->mailto   = s_copy_or_panic(r ? r->value : entry->parent->uname);
+  job_t* job        = xmalloc(sizeof(job_t));
+  job->id           = ident_next();
+  job->type         = CRON;
+  job->state        = PENDING;
+  job->cmd          = s_copy_or_panic(entry->info->cmd);
+  job->ret          = -1;
+  job->pid          = -1;
+  job->next_run     = entry->next;
+  job->owner        = entry->parent->uid;
+  job->metrics      = metrics_user_get(entry->parent->uname);
+  job->entry_id     = entry->info->id;
+  job->started_usec = 0;
+  job->output       = (joboutput_info){0};
+
+  ht_entry* r       = ht_search(entry->parent->vars, MAILTO_ENVVAR);
+  job->mailto       = s_copy_or_panic(r ? r->value : entry->parent->uname);
+  job->mail_policy  = entry->parent->mail_policy;
+
+  // The mail program runs as root and would take it for one of its options
+  if (job->mailto[0] == '-') {
+    log_warn("[job " IDENT_FMT "] not mailing %s '%s', which looks like an option\n", job->id, MAILTO_ENVVAR, job->mailto);
+    job->mail_policy = MAIL_NEVER;
+  }
 
   return job;
 }
@@ -44,7 +65,6 @@ new_cronjob (cron_entry* entry) {
 void
 free_cronjob (job_t* job) {
   free(job->cmd);
-  free(job->ident);
   free(job->mailto);
   free(job);
 }
@@ -52,38 +72,34 @@ free_cronjob (job_t* job) {
 /**
  * Creates a new job of type MAIL.
  *
- * @param og_job The original job about which this MAIL job is reporting.
+ * @param mailto The recipient.
+ * @param about_id The id of the job being reported on, or 0 for a digest.
+ * @param subject
  * @return job_t*
  */
 static job_t*
-new_mailjob (job_t* og_job) {
-  job_t* job  = xmalloc(sizeof(job_t));
-  job->ident  = create_uuid();
-  job->type   = MAIL;
-  job->state  = PENDING;
-  job->mailto = s_copy_or_panic(og_job->mailto);
-  job->ret    = -1;
-  job->pid    = -1;
-
-  char mail_cmd[MED_BUFFER];
-  sprintf(
-    mail_cmd,
-    MAILCMD_FMT,
-    MAILCMD_PATH,
-    DAEMON_IDENT,
-    proginfo.hostname,
-    MAIL_SUBJECT,
-    og_job->mailto
-  );
-
-  job->cmd = s_copy_or_panic(mail_cmd);
+new_mailjob (const char* mailto, ident_t about_id, const char* subject) {
+  job_t* job        = xmalloc(sizeof(job_t));
+  job->id           = ident_next();
+  job->type         = MAIL;
+  job->state        = PENDING;
+  job->mailto       = s_copy_or_panic(mailto);
+  job->owner        = (uid_t)-1;
+  job->mail_policy  = MAIL_NEVER;
+  job->ret          = -1;
+  job->pid          = -1;
+  job->metrics      = NULL;
+  job->entry_id     = about_id;
+  job->started_usec = 0;
+  job->output       = (joboutput_info){0};
+  // Only for display; the mail program is spawned directly, not via a shell
+  job->cmd          = s_fmt("%s -s '%s' -- %s", opts.mail_cmd, subject, mailto);
 
   return job;
 }
 
 void
 free_mailjob (job_t* job) {
-  free(job->ident);
   free(job->cmd);
   free(job->mailto);
   free(job);
@@ -95,15 +111,16 @@ free_mailjob (job_t* job) {
  * @param pid The process id to check.
  * @param status An int pointer into which the job's return status will be
  * stored, if applicable.
+ * @param ru Set to the process's resource usage once it has finished.
  * @return true when the job has finished and the status pointer has been set.
  * @return false when the job has not finished yet. The status pointer was
  * unused (so don't use it!).
  */
 static bool
-check_job (pid_t pid, int* status) {
-  int r = waitpid(pid, status, WNOHANG);
+check_job (pid_t pid, int* status, struct rusage* ru) {
+  int r = wait4(pid, status, WNOHANG, ru);
 
-  log_info("[pid=%d] waitpid result is %d\n", pid, r);
+  log_debug("[pid=%d] waitpid result is %d\n", pid, r);
 
   // -1 == error; 0 == still running; pid == dead
   if (r < 0 || r == pid) {
@@ -119,48 +136,91 @@ check_job (pid_t pid, int* status) {
 }
 
 /**
- * Creates and runs a MAIL job to report the given EXITED job `exited_job`.
+ * Sends a report by spawning the mail program, and queues the MAIL job that
+ * tracks it for reaping. Caller must hold the job queue lock.
  *
- * @param exited_job The EXITED job to report in the MAIL job.
+ * @param mailto
+ * @param about_id The id of the job being reported on, or 0 for a digest.
+ * @param subject
+ * @param body_fd Borrowed.
  */
 static void
-run_mailjob (job_t* exited_job) {
-  job_t* job = new_mailjob(exited_job);
-  array_push_or_panic(mail_queue, job);
-
-  log_info("[job %s] going to run mail cmd: %s\n", job->ident, job->cmd);
-
-  if ((job->pid = fork()) == 0) {
-    setsid();
-    dup2(STDERR_FILENO, STDOUT_FILENO);
+spawn_mailjob (const char* mailto, ident_t about_id, const char* subject, int body_fd) {
+  job_t* job = new_mailjob(mailto, about_id, subject);
 
-    FILE* mail_pipe = popen(job->cmd, "w");
+  log_info("[job " IDENT_FMT "] going to run mail cmd: %s\n", job->id, job->cmd);
 
-    if (mail_pipe == NULL) {
-      log_error("mail pipe was NULL in job %s (reason: %s)\n", strerror(errno));
-      exit(EXIT_FAILURE);
-    }
-
-    fprintf(mail_pipe, "command: %s", exited_job->cmd);
+  // Never queue a job without a process: the reaper would wait on pid -1
+  if ((job->pid = mail_spawn(mailto, subject, body_fd)) < 0) {
+    free_mailjob(job);
+    return;
+  }
 
-    if (pclose(mail_pipe) == -1) {
-      log_error("failed to close mail pipe in job %s (reason: %s)\n", strerror(errno));
-      exit(EXIT_FAILURE);
-    }
+  array_push_or_panic(mail_queue, job);
+  job->started_usec = get_monotonic_usec();
+  journal_append(JOURNAL_MAIL_STARTED, job, NULL);
+  job->state = RUNNING;
+}
 
-    exit(EXIT_SUCCESS);
+/**
+ * Sends `body_fd` to `mailto`: through the mail relay if one is configured,
+ * else by creating and running a MAIL job.
+ *
+ * @param mailto
+ * @param about_id The id of the job being reported on, or 0 for a digest.
+ * @param subject
+ * @param body_fd Borrowed.
+ */
+static void
+run_mailjob (const char* mailto, ident_t about_id, const char* subject, int body_fd) {
+  // Handing it to the relay needs no process at all
+  if (smtp_submit(mailto, subject, body_fd) == OK) {
+    log_info("queued mail to %s for the relay (%s)\n", mailto, subject);
+    return;
   }
 
-  job->state = RUNNING;
+  spawn_mailjob(mailto, about_id, subject, body_fd);
 }
 
 /**
- * Execute a cronjob for the given entry.
- * @param entry
+ * Sends a finished digest; see `mail_digest_flush`.
  */
 static void
-run_cronjob (cron_entry* entry) {
+send_digest (const char* mailto, const char* subject, int body_fd) {
+  run_mailjob(mailto, 0, subject, body_fd);
+}
+
+/**
+ * Reports the given EXITED CRON job, if its mail policy asks for it: right away,
+ * or via its recipient's digest when digests are on.
+ *
+ * @param exited_job
+ */
+static void
+report_job (job_t* exited_job) {
+  if (!mail_wanted(exited_job)) {
+    return;
+  }
+
+  if (opts.mail_digest > 0) {
+    mail_digest_add(exited_job);
+    return;
+  }
+
+  int body_fd;
+  if ((body_fd = mail_report_open(exited_job)) >= 0) {
+    run_mailjob(exited_job->mailto, exited_job->id, MAIL_SUBJECT, body_fd);
+    close(body_fd);
+  }
+}
+
+void
+run_cronjob (cron_entry* entry, ident_t* id) {
   job_t* job = new_cronjob(entry);
+  if (id) {
+    // Read before publishing the job; the reaper owns it from then on
+    *id = job->id;
+  }
 
   pthread_mutex_lock(&mutex);
   array_push_or_panic(job_queue, job);
@@ -169,16 +229,26 @@ run_cronjob (cron_entry* entry) {
   char* home  = ht_get_or_panic(entry->parent->vars, HOMEDIR_ENVVAR);
   char* shell = ht_get_or_panic(entry->parent->vars, SHELL_ENVVAR);
 
+  // Output goes through a pipe drained into the job's output file, if we can
+  int out_fd = joboutput_open(job->id, job->owner);
+
+  uint64_t fork_at = get_monotonic_usec();
   if ((job->pid = fork()) == 0) {
     // Detach from the crond and become session leader
     setsid();
 
-    dup2(STDERR_FILENO, STDOUT_FILENO);
+    if (out_fd >= 0) {
+      dup2(out_fd, STDOUT_FILENO);
+      dup2(out_fd, STDERR_FILENO);
+      close(out_fd);
+    } else {
+      dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
 
     log_debug(
-      "[job %s] Writing log from child process pid=%d homedir=%s shell=%s "
+      "[job " IDENT_FMT "] Writing log from child process pid=%d homedir=%s shell=%s "
       "cmd=%s\n",
-      job->ident,
+      job->id,
       getpid(),
       home,
       shell,
@@ -192,8 +262,18 @@ run_cronjob (cron_entry* entry) {
     _exit(EXIT_FAILURE);
   }
 
-  log_info("[job %s] New running job with pid %d\n", job->ident, job->pid);
+  if (out_fd >= 0) {
+    close(out_fd);
+  }
+
+  job->started_usec = get_monotonic_usec();
+  metrics_observe(METRIC_SPAWN_LATENCY, job->started_usec - fork_at);
+  atomic_fetch_add_explicit(&job->metrics->jobs_launched, 1, memory_order_relaxed);
+
+  log_info("[job " IDENT_FMT "] New running job with pid %d\n", job->id, job->pid);
+  journal_append(JOURNAL_JOB_STARTED, job, NULL);
   job->state = RUNNING;
+  status_job_started(job);
 }
 
 static void
@@ -202,18 +282,28 @@ reap_job (job_t* job) {
     case PENDING: break;
     case EXITED: break;
     case RUNNING: {
-      int status;
-      if (check_job(job->pid, &status)) {
+      int           status;
+      struct rusage ru;
+      if (check_job(job->pid, &status, &ru)) {
         log_debug(
-          "[job %s] transition RUNNING->EXITED (pid=%d, status=%d)\n",
-          job->ident,
+          "[job " IDENT_FMT "] transition RUNNING->EXITED (pid=%d, status=%d)\n",
+          job->id,
           job->pid,
           status
         );
 
         job->ret   = status;
+        journal_append(job->type == CRON ? JOURNAL_JOB_EXITED : JOURNAL_MAIL_EXITED, job, &ru);
         job->state = EXITED;
         job->pid   = -1;
+
+        if (job->type == CRON) {
+          joboutput_finish(job->id, &job->output);
+          status_job_exited(job);
+          if (status != 0) {
+            atomic_fetch_add_explicit(&job->metrics->jobs_failed, 1, memory_order_relaxed);
+          }
+        }
       }
     }
     default: break;
@@ -233,6 +323,7 @@ reap_routine (void* arg __attribute__((unused))) {
     pthread_cond_wait(&cond, &mutex);
 
     log_debug("%s\n", "in reaper thread");
+    uint64_t reap_start = get_monotonic_usec();
 
     foreach (job_queue, i) {
       job_t* job = array_get_or_panic(job_queue, i);
@@ -243,23 +334,28 @@ reap_routine (void* arg __attribute__((unused))) {
       if (job->state == EXITED) {
         array_remove(job_queue, i);
         if (job->type == CRON) {
-          run_mailjob(job);
+          report_job(job);
           free_cronjob(job);
         }
       }
     }
 
+    if (opts.mail_digest > 0) {
+      mail_digest_flush(time(NULL), false, send_digest);
+    }
+
     foreach (mail_queue, i) {
       job_t* job = array_get_or_panic(mail_queue, i);
       reap_job(job);
 
       if (job->state == EXITED) {
-        log_debug("[mail %s] finally exited\n", job->ident);
+        log_debug("[mail " IDENT_FMT "] finally exited\n", job->id);
         array_remove(mail_queue, i);
         free_mailjob(job);
       }
     }
 
+    metrics_observe(METRIC_REAP_LATENCY, get_monotonic_usec() - reap_start);
     pthread_mutex_unlock(&mutex);
   }
 
@@ -287,6 +383,53 @@ signal_reap_routine (void) {
   pthread_mutex_unlock(&mutex);
 }
 
+void
+job_mail_flush (void) {
+  if (opts.mail_digest == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&mutex);
+  unsigned int sent = mail_digest_flush(time(NULL), true, send_digest);
+  pthread_mutex_unlock(&mutex);
+
+  if (sent > 0) {
+    log_info("sent %u pending mail digest(s)\n", sent);
+  }
+}
+
+void
+job_mail_spawn (const char* mailto, const char* subject, int body_fd) {
+  pthread_mutex_lock(&mutex);
+  spawn_mailjob(mailto, 0, subject, body_fd);
+  pthread_mutex_unlock(&mutex);
+}
+
+bool
+job_visit (ident_t id, void (*fn)(job_t* job, void* ctx), void* ctx) {
+  bool found = false;
+
+  pthread_mutex_lock(&mutex);
+  foreach (job_queue, i) {
+    job_t* job = array_get_or_panic(job_queue, i);
+    if (job->type == CRON && job->id == id) {
+      fn(job, ctx);
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+
+  return found;
+}
+
+void
+job_queue_visit (void (*fn)(array_t* queue, void* ctx), void* ctx) {
+  pthread_mutex_lock(&mutex);
+  fn(job_queue, ctx);
+  pthread_mutex_unlock(&mutex);
+}
+
 void
 try_run_jobs (hash_table* db, time_t ts) {
   if (db->count > 0) {
@@ -294,9 +437,15 @@ try_run_jobs (hash_table* db, time_t ts) {
     crontab_t* ct = entry->value;
     foreach (ct->entries, i) {
       cron_entry* ce = array_get_or_panic(ct->entries, i);
-      if (ce->next == ts) {
-        run_cronjob(ce);
+      if (!exprpool_fires(ce->expr, ts)) {
+        continue;
+      }
+
+      if (!ct->paused && !ce->paused) {
+        run_cronjob(ce, NULL);
       }
+      // Paused or not, the entry is due again only after this
+      renew_cron_entry(ce, ts);
     }
     HT_ITER_END
   }
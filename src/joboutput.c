@@ -0,0 +1,427 @@
+#define _GNU_SOURCE  // For splice and pipe2
+
+#include "joboutput.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "constants.h"
+#include "globals.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils/xmalloc.h"
+#include "utils/xpanic.h"
+
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_JOB
+
+#define OUTPUT_FILE_FMT   "%s/" IDENT_FMT ".out"
+#define OUTPUT_FILE_EXT   ".out"
+// Hex digits in an output file's name, before the extension
+#define OUTPUT_NAME_LEN   16
+#define DRAIN_EVENTS      16
+// Moved per splice when discarding output past the cap
+#define DISCARD_CHUNK     (64 * 1024)
+
+/**
+ * A job's output capture.
+ */
+typedef struct {
+  ident_t id;
+  uid_t   owner;
+  /* The pipe's read end; -1 once it hit EOF or the job finished */
+  int     pipe_fd;
+  /* The output file; -1 once the job finished */
+  int     file_fd;
+  size_t  bytes;
+  size_t  dropped;
+} job_output;
+
+static char           *output_dir = NULL;
+static int             epoll_fd   = -1;
+static int             discard_fd = -1;
+// Cleared if the output fs doesn't support splice; we copy instead
+static bool            use_splice = true;
+
+// Guards both lists and every capture's fds and counters
+static pthread_mutex_t outputs_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Captures of running jobs i.e. List<job_output*> */
+static array_t        *live          = NULL;
+/* Captures of finished jobs, oldest first i.e. List<job_output*> */
+static array_t        *retained      = NULL;
+
+void
+joboutput_path (char *buf, size_t sz, ident_t id) {
+  snprintf(buf, sz, OUTPUT_FILE_FMT, output_dir, id);
+}
+
+static void
+free_output (job_output *o) {
+  if (o->pipe_fd >= 0) {
+    close(o->pipe_fd);
+  }
+  if (o->file_fd >= 0) {
+    close(o->file_fd);
+  }
+  free(o);
+}
+
+static job_output *
+find_output (array_t *list, ident_t id, size_t *idx) {
+  foreach (list, i) {
+    job_output *o = array_get_or_panic(list, i);
+    if (o->id == id) {
+      if (idx) {
+        *idx = i;
+      }
+      return o;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Stops watching a capture's pipe. Caller must hold the lock.
+ */
+static void
+close_pipe (job_output *o) {
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, o->pipe_fd, NULL);
+  close(o->pipe_fd);
+  o->pipe_fd = -1;
+}
+
+/**
+ * Moves up to `len` bytes from the pipe to `to` without blocking on the pipe.
+ */
+static ssize_t
+move_bytes (int from, int to, size_t len) {
+  if (use_splice) {
+    ssize_t n = splice(from, NULL, to, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n >= 0 || errno != EINVAL) {
+      return n;
+    }
+    log_warn("output directory %s doesn't support splice; copying job output instead\n", output_dir);
+    use_splice = false;
+  }
+
+  char    buf[PIPE_BUF * 4];
+  ssize_t n = read(from, buf, len < sizeof(buf) ? len : sizeof(buf));
+  if (n > 0 && to != discard_fd) {
+    for (ssize_t w = 0, r; w < n; w += r) {
+      if ((r = write(to, buf + w, n - w)) < 0) {
+        return -1;
+      }
+    }
+  }
+
+  return n;
+}
+
+/**
+ * Moves whatever is in a capture's pipe to its output file, discarding what
+ * doesn't fit under the cap. Caller must hold the lock.
+ */
+static void
+drain (job_output *o) {
+  while (o->pipe_fd >= 0) {
+    size_t  room    = o->bytes < opts.output_max ? opts.output_max - o->bytes : 0;
+    bool    discard = room == 0;
+    ssize_t n       = move_bytes(o->pipe_fd, discard ? discard_fd : o->file_fd, discard ? DISCARD_CHUNK : room);
+
+    if (n > 0) {
+      if (discard) {
+        o->dropped += n;
+        metrics_add(METRIC_JOB_OUTPUT_DROPPED, n);
+      } else {
+        o->bytes += n;
+        metrics_add(METRIC_JOB_OUTPUT_BYTES, n);
+      }
+    } else if (n == 0) {
+      // Every writer is gone
+      close_pipe(o);
+    } else if (errno == EAGAIN) {
+      return;
+    } else if (errno != EINTR) {
+      log_warn("[job " IDENT_FMT "] failed to capture output (reason: %s)\n", o->id, strerror(errno));
+      close_pipe(o);
+    }
+  }
+}
+
+/**
+ * Drains job output pipes as they become readable, so jobs never block on a
+ * full pipe.
+ */
+static void *
+drain_routine (void *arg __attribute__((unused))) {
+  struct epoll_event events[DRAIN_EVENTS];
+
+  while (true) {
+    int n = epoll_wait(epoll_fd, events, DRAIN_EVENTS, -1);
+    if (n < 0) {
+      if (errno != EINTR) {
+        log_warn("epoll_wait failed on job output (reason: %s)\n", strerror(errno));
+      }
+      continue;
+    }
+
+    pthread_mutex_lock(&outputs_mutex);
+    for (int e = 0; e < n; e++) {
+      // Look the capture up by fd: it may have finished since epoll_wait returned
+      foreach (live, i) {
+        job_output *o = array_get_or_panic(live, i);
+        if (o->pipe_fd == events[e].data.fd) {
+          drain(o);
+          break;
+        }
+      }
+    }
+    pthread_mutex_unlock(&outputs_mutex);
+  }
+
+  return NULL;
+}
+
+static void
+drain_routine_init (void) {
+  pthread_t      thread_id;
+  pthread_attr_t attr;
+  int            rc = pthread_attr_init(&attr);
+  if (rc != 0) {
+    xpanic("pthread_attr_init failed with rc %d\n", rc);
+  }
+  if ((rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) != 0) {
+    xpanic("pthread_attr_setdetachstate failed with rc %d\n", rc);
+  }
+  if ((rc = pthread_create(&thread_id, &attr, drain_routine, NULL)) != 0) {
+    xpanic("pthread_create failed with rc %d\n", rc);
+  }
+}
+
+/**
+ * Whether `name` is one we'd give an output file i.e. IDENT_FMT + ".out".
+ */
+static bool
+is_output_file (const char *name) {
+  for (unsigned int i = 0; i < OUTPUT_NAME_LEN; i++) {
+    if (!isxdigit((unsigned char)name[i]) || isupper((unsigned char)name[i])) {
+      return false;
+    }
+  }
+
+  return strcmp(name + OUTPUT_NAME_LEN, OUTPUT_FILE_EXT) == 0;
+}
+
+/**
+ * Removes output files left behind by a previous run; nothing refers to them.
+ * The directory may be shared, so anything we wouldn't have created is kept.
+ */
+static void
+remove_stale_files (void) {
+  DIR *dir;
+  if (!(dir = opendir(output_dir))) {
+    return;
+  }
+
+  struct dirent *de;
+  while ((de = readdir(dir))) {
+    if (is_output_file(de->d_name)) {
+      unlinkat(dirfd(dir), de->d_name, 0);
+    }
+  }
+
+  closedir(dir);
+}
+
+retval_t
+joboutput_init (void) {
+  free(output_dir);
+  output_dir = opts.output_dir ? s_copy_or_panic(opts.output_dir)
+               : usr.root      ? s_copy_or_panic(SYS_JOB_OUTPUT_DIR)
+                               : s_fmt(USR_JOB_OUTPUT_DIR_FMT, usr.home);
+
+  if (mkdir(output_dir, OWNER_RWX_PERMS) < 0 && errno != EEXIST) {
+    log_warn("failed to create job output directory %s (reason: %s)\n", output_dir, strerror(errno));
+    return ERR;
+  }
+
+  // One made by another user would let them read or plant job output
+  struct stat st;
+  if (lstat(output_dir, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid()
+      || (st.st_mode & ALL_PERMS) != OWNER_RWX_PERMS) {
+    log_warn("not capturing job output to %s, which must be a directory of ours with mode 0700\n", output_dir);
+    return ERR;
+  }
+
+  if ((discard_fd = open(DEV_NULL, O_WRONLY | O_CLOEXEC)) < 0
+      || (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    log_warn("failed to set up job output capture (reason: %s)\n", strerror(errno));
+    return ERR;
+  }
+
+  remove_stale_files();
+
+  live     = array_init_or_panic();
+  retained = array_init_or_panic();
+  drain_routine_init();
+
+  log_info("capturing job output to %s (up to %zu bytes per job)\n", output_dir, opts.output_max);
+  return OK;
+}
+
+int
+joboutput_open (ident_t id, uid_t owner) {
+  if (epoll_fd < 0) {
+    return -1;
+  }
+
+  char path[MED_BUFFER * 2];
+  joboutput_path(path, sizeof(path), id);
+
+  // CLOEXEC both ends so other jobs don't inherit them; the child's dup2 clears it
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0) {
+    log_warn("[job " IDENT_FMT "] failed to create output pipe (reason: %s)\n", id, strerror(errno));
+    return -1;
+  }
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+  // Not O_APPEND: splice can't write to append-only files
+  int file_fd;
+  if ((file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, OWNER_RW_PERMS)) < 0) {
+    log_warn("[job " IDENT_FMT "] failed to create output file %s (reason: %s)\n", id, path, strerror(errno));
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+
+  job_output *o = xmalloc(sizeof(job_output));
+  o->id         = id;
+  o->owner      = owner;
+  o->pipe_fd    = fds[0];
+  o->file_fd    = file_fd;
+  o->bytes      = 0;
+  o->dropped    = 0;
+
+  pthread_mutex_lock(&outputs_mutex);
+  array_push_or_panic(live, o);
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = o->pipe_fd};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, o->pipe_fd, &ev) < 0) {
+    xpanic("epoll_ctl failed on job output pipe (reason: %s)\n", strerror(errno));
+  }
+  pthread_mutex_unlock(&outputs_mutex);
+
+  return fds[1];
+}
+
+static inline void
+fill_info (job_output *o, joboutput_info *info, bool running) {
+  info->bytes   = o->bytes;
+  info->dropped = o->dropped;
+  info->running = running;
+  info->owner   = o->owner;
+}
+
+retval_t
+joboutput_finish (ident_t id, joboutput_info *info) {
+  if (epoll_fd < 0) {
+    return ERR;
+  }
+
+  size_t idx;
+  pthread_mutex_lock(&outputs_mutex);
+
+  job_output *o = find_output(live, id, &idx);
+  if (!o) {
+    pthread_mutex_unlock(&outputs_mutex);
+    return ERR;
+  }
+
+  // The job has exited, so all it wrote is in the pipe by now. Anything its
+  // leftover background processes write later is lost.
+  drain(o);
+  if (o->pipe_fd >= 0) {
+    close_pipe(o);
+  }
+  close(o->file_fd);
+  o->file_fd = -1;
+
+  if (info) {
+    fill_info(o, info, false);
+  }
+
+  array_remove(live, idx);
+  array_push_or_panic(retained, o);
+
+  while (array_size(retained) > JOB_OUTPUT_KEEP) {
+    job_output *oldest = array_get_or_panic(retained, 0);
+    array_remove(retained, 0);
+    char        path[MED_BUFFER * 2];
+    joboutput_path(path, sizeof(path), oldest->id);
+    unlink(path);
+    free_output(oldest);
+  }
+
+  pthread_mutex_unlock(&outputs_mutex);
+
+  return OK;
+}
+
+retval_t
+joboutput_stat (ident_t id, joboutput_info *info) {
+  if (epoll_fd < 0) {
+    return ERR;
+  }
+
+  pthread_mutex_lock(&outputs_mutex);
+
+  job_output *o;
+  bool        running = true;
+  if (!(o = find_output(live, id, NULL))) {
+    running = false;
+    o       = find_output(retained, id, NULL);
+  }
+  if (o) {
+    fill_info(o, info, running);
+  }
+
+  pthread_mutex_unlock(&outputs_mutex);
+
+  return o ? OK : ERR;
+}
+
+retval_t
+joboutput_read (ident_t id, buffer_t *buf, joboutput_info *info) {
+  if (joboutput_stat(id, info) != OK) {
+    return ERR;
+  }
+
+  char path[MED_BUFFER * 2];
+  joboutput_path(path, sizeof(path), id);
+
+  int fd;
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return ERR;
+  }
+
+  // Files are capped at output_max, so read them whole
+  char    chunk[PIPE_BUF * 4];
+  ssize_t n;
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+    buffer_append_with(buf, chunk, n);
+  }
+  close(fd);
+
+  return n < 0 ? ERR : OK;
+}
@@ -0,0 +1,202 @@
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "globals.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils/time.h"
+
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_JOB
+
+#define JOURNAL_CAPACITY ((JOURNAL_MAX_BYTES - sizeof(journal_header)) / sizeof(journal_record))
+#define JOURNAL_SIZE     (sizeof(journal_header) + JOURNAL_CAPACITY * sizeof(journal_record))
+
+#define JOURNAL_GUARD  \
+  if (!opts.journal) { \
+    return;            \
+  }
+
+static journal_header *jrnl = NULL;
+// Serializes appends (the main loop, the reaper and the IPC thread) and rotation
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline journal_record *
+records (void) {
+  return (journal_record *)(jrnl + 1);
+}
+
+/**
+ * Whether a mapped file is a journal we can keep appending to.
+ */
+static inline bool
+is_compatible (journal_header *hdr) {
+  return hdr->magic == JOURNAL_MAGIC && hdr->version == JOURNAL_VERSION && hdr->record_size == sizeof(journal_record)
+         && hdr->capacity == JOURNAL_CAPACITY && atomic_load(&hdr->count) <= JOURNAL_CAPACITY;
+}
+
+/**
+ * Opens and maps the journal file, continuing it if compatible and starting a
+ * fresh one otherwise. Caller must hold the lock.
+ */
+static void
+journal_open (void) {
+  int fd;
+  if ((fd = open(opts.journal, O_RDWR | O_CREAT | O_NOFOLLOW, 0644)) < 0) {
+    log_warn("failed to open journal %s (reason: %s)\n", opts.journal, strerror(errno));
+    return;
+  }
+
+  struct stat st;
+  bool        existing = fstat(fd, &st) == 0 && st.st_size == (off_t)JOURNAL_SIZE;
+
+  // The journal is preallocated at its cap up front, so appends never grow it
+  if (!existing && (ftruncate(fd, 0) < 0 || ftruncate(fd, JOURNAL_SIZE) < 0)) {
+    log_warn("failed to size journal %s (reason: %s)\n", opts.journal, strerror(errno));
+    close(fd);
+    return;
+  }
+
+  void *addr = mmap(NULL, JOURNAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (addr == MAP_FAILED) {
+    log_warn("failed to map journal %s (reason: %s)\n", opts.journal, strerror(errno));
+    return;
+  }
+
+  jrnl = addr;
+  if (existing && is_compatible(jrnl)) {
+    log_info("continuing journal %s at record %lu\n", opts.journal, (unsigned long)atomic_load(&jrnl->count));
+    return;
+  }
+
+  memset(jrnl, 0, sizeof(journal_header));
+  jrnl->magic       = JOURNAL_MAGIC;
+  jrnl->version     = JOURNAL_VERSION;
+  jrnl->record_size = sizeof(journal_record);
+  jrnl->capacity    = JOURNAL_CAPACITY;
+  atomic_store(&jrnl->count, 0);
+}
+
+/**
+ * Shifts `path` to `path.1`, `path.1` to `path.2` etc, dropping the oldest, and
+ * starts a new journal. Caller must hold the lock.
+ */
+static void
+journal_rotate (void) {
+  munmap(jrnl, JOURNAL_SIZE);
+  jrnl = NULL;
+
+  char from[MED_BUFFER * 2], to[MED_BUFFER * 2];
+  for (int i = JOURNAL_MAX_FILES - 1; i > 0; i--) {
+    if (i == 1) {
+      snprintf(from, sizeof(from), "%s", opts.journal);
+    } else {
+      snprintf(from, sizeof(from), "%s.%d", opts.journal, i - 1);
+    }
+    snprintf(to, sizeof(to), "%s.%d", opts.journal, i);
+
+    if (rename(from, to) < 0 && errno != ENOENT) {
+      log_warn("failed to rotate journal %s to %s (reason: %s)\n", from, to, strerror(errno));
+    }
+  }
+
+  // With a single file, there's nothing to rotate to; the journal just restarts
+  if (JOURNAL_MAX_FILES == 1) {
+    unlink(opts.journal);
+  }
+
+  metrics_add(METRIC_JOURNAL_ROTATIONS, 1);
+  journal_open();
+}
+
+void
+journal_init (void) {
+  JOURNAL_GUARD
+
+  pthread_mutex_lock(&journal_mutex);
+  journal_open();
+  pthread_mutex_unlock(&journal_mutex);
+
+  if (jrnl) {
+    log_info("appending job events to journal %s\n", opts.journal);
+  }
+}
+
+static inline uint64_t
+timeval_usec (struct timeval *tv) {
+  return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+void
+journal_append (journal_event type, job_t *job, struct rusage *ru) {
+  JOURNAL_GUARD
+
+  // Build the record before taking the lock
+  journal_record rec = {0};
+  struct timespec now;
+  get_time(&now);
+
+  rec.ts_usec = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+  rec.type    = type;
+  rec.pid     = job->pid;
+  rec.status  = job->ret;
+
+  ident_to_uuid(job->id, rec.job_id);
+  if (job->entry_id) {
+    ident_to_uuid(job->entry_id, rec.entry_id);
+  }
+
+  if (type == JOURNAL_JOB_EXITED || type == JOURNAL_MAIL_EXITED) {
+    rec.duration_usec = get_monotonic_usec() - job->started_usec;
+  }
+
+  if (ru) {
+    rec.utime_usec = timeval_usec(&ru->ru_utime);
+    rec.stime_usec = timeval_usec(&ru->ru_stime);
+    rec.maxrss_kb  = ru->ru_maxrss;
+    rec.majflt     = ru->ru_majflt;
+    rec.inblock    = ru->ru_inblock;
+    rec.oublock    = ru->ru_oublock;
+    rec.nvcsw      = ru->ru_nvcsw;
+    rec.nivcsw     = ru->ru_nivcsw;
+  }
+
+  pthread_mutex_lock(&journal_mutex);
+
+  if (jrnl && atomic_load_explicit(&jrnl->count, memory_order_relaxed) == JOURNAL_CAPACITY) {
+    journal_rotate();
+  }
+
+  if (jrnl) {
+    uint64_t n = atomic_load_explicit(&jrnl->count, memory_order_relaxed);
+    records()[n] = rec;
+    // Publish the record to concurrent readers of the file only once it's complete
+    atomic_store_explicit(&jrnl->count, n + 1, memory_order_release);
+    metrics_add(METRIC_JOURNAL_RECORDS, 1);
+  }
+
+  pthread_mutex_unlock(&journal_mutex);
+}
+
+void
+journal_close (void) {
+  JOURNAL_GUARD
+
+  pthread_mutex_lock(&journal_mutex);
+  if (jrnl) {
+    munmap(jrnl, JOURNAL_SIZE);
+    jrnl = NULL;
+  }
+  pthread_mutex_unlock(&journal_mutex);
+}
@@ -1,16 +1,23 @@
 #include "logger.h"
 
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "config.h"
 #include "globals.h"
 #include "libutil/libutil.h"
+#include "logrotate.h"
+#include "metrics.h"
 #include "proginfo.h"
 #include "utils/time.h"
 #include "utils/xpanic.h"
@@ -23,67 +30,597 @@
     return;           \
   }
 
+#if LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)
+#  error "LOG_RING_SLOTS must be a power of two"
+#endif
+
+/* Records no larger than PIPE_BUF are written atomically even to pipes */
+#if LOG_RECORD_MAX > PIPE_BUF
+#  error "LOG_RECORD_MAX must not exceed PIPE_BUF"
+#endif
+
+#define RING_MASK        (LOG_RING_SLOTS - 1)
+/* How long the writer sleeps when idle before re-checking the ring, and how
+   long a blocked caller waits before retrying */
+#define WRITER_IDLE_NSEC 100000000L
+#define BLOCKED_NSEC     10000000L
+
 #define Y(e) [e] = &(#e)[10]
 static const char *log_level_names[] = {Y(LOG_LEVEL_ERROR), Y(LOG_LEVEL_WARN), Y(LOG_LEVEL_INFO), Y(LOG_LEVEL_DEBUG)};
 
-static int log_fd = -1;
+static const char *log_level_spec_names[] = {
+  [LOG_LEVEL_ERROR] = "error",
+  [LOG_LEVEL_WARN]  = "warn",
+  [LOG_LEVEL_INFO]  = "info",
+  [LOG_LEVEL_DEBUG] = "debug",
+};
+
+static const char *log_category_names[] = {
+  [LOG_CAT_CORE]  = "core",
+  [LOG_CAT_SCAN]  = "scan",
+  [LOG_CAT_SCHED] = "sched",
+  [LOG_CAT_JOB]   = "job",
+  [LOG_CAT_IPC]   = "ipc",
+};
+
+log_level log_thresholds[LOG_CAT_COUNT] = {
+  [0 ... LOG_CAT_COUNT - 1] = LOG_LEVEL_DEBUG,
+};
+
+// Atomic since the async writer thread reads it while SIGHUP may reopen the log
+static atomic_int log_fd = -1;
+
+/* Built-in rotation: bytes in and open time of the current log file */
+static atomic_size_t   log_size      = 0;
+static _Atomic time_t  log_opened_at = 0;
+static unsigned long   rotate_seq    = 0;
+/* Only the daemon rotates; forked children write to whatever file they inherited */
+static pid_t           rotate_pid    = 0;
+static pthread_mutex_t rotate_mutex  = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * A slot in the async ring buffer. `seq` tracks the slot's lap: it equals the
+ * slot's position when free, position + 1 once a record has been published
+ * into it, and position + LOG_RING_SLOTS once the writer has released it.
+ */
+typedef struct {
+  atomic_size_t seq;
+  unsigned int  len;
+  char          data[LOG_RECORD_MAX];
+} log_record;
+
+/**
+ * The calling thread's record under construction. Thread-local so concurrent
+ * callers never share continuation state, and static so logging never touches
+ * the heap.
+ */
+typedef struct {
+  unsigned int len;
+  char         data[LOG_RECORD_MAX];
+} pending_record;
+
+static _Thread_local pending_record pending;
+
+static log_record     *ring         = NULL;
+static atomic_size_t   enqueue_pos;
+/* Only touched by the writer thread */
+static size_t          dequeue_pos;
+static atomic_bool     async_active = false;
+static atomic_bool     stopping     = false;
+static atomic_bool     writer_idle  = false;
+static atomic_uint     blocked;
+static pthread_t       writer_thread;
+static pid_t           writer_pid;
+static pthread_mutex_t ring_mutex   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  ring_ready   = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  ring_space   = PTHREAD_COND_INITIALIZER;
+
+static void
+timed_wait (pthread_cond_t *cond, long nsec) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+
+  deadline.tv_nsec += nsec;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_cond_timedwait(cond, &ring_mutex, &deadline);
+}
+
+/**
+ * Claims a free slot for a new record.
+ *
+ * @param pos Set to the claimed slot's position.
+ * @return log_record* NULL if the ring is full.
+ */
+static log_record *
+ring_claim (size_t *pos) {
+  size_t p = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+
+  while (true) {
+    log_record *r   = &ring[p & RING_MASK];
+    size_t      seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+    intptr_t    lap = (intptr_t)seq - (intptr_t)p;
+
+    if (lap == 0) {
+      if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &p, p + 1, memory_order_relaxed, memory_order_relaxed)) {
+        *pos = p;
+        return r;
+      }
+    } else if (lap < 0) {
+      // The writer hasn't released this slot since its last lap
+      return NULL;
+    } else {
+      p = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * Claims a slot, applying the configured overflow policy when the ring is full.
+ *
+ * @return log_record* NULL if the record should be dropped.
+ */
+static log_record *
+ring_claim_or_wait (size_t *pos) {
+  log_record *r = ring_claim(pos);
+  if (r || opts.log_mode == LOG_MODE_ASYNC_DROP) {
+    if (!r) {
+      metrics_add(METRIC_LOG_DROPPED, 1);
+    }
+    return r;
+  }
+
+  metrics_add(METRIC_LOG_BLOCKED, 1);
+
+  pthread_mutex_lock(&ring_mutex);
+  atomic_fetch_add(&blocked, 1);
+  while (!(r = ring_claim(pos))) {
+    timed_wait(&ring_space, BLOCKED_NSEC);
+  }
+  atomic_fetch_sub(&blocked, 1);
+  pthread_mutex_unlock(&ring_mutex);
+
+  return r;
+}
+
+static void
+ring_publish (log_record *r, size_t pos) {
+  atomic_store_explicit(&r->seq, pos + 1, memory_order_release);
+
+  if (atomic_load(&writer_idle)) {
+    pthread_mutex_lock(&ring_mutex);
+    pthread_cond_signal(&ring_ready);
+    pthread_mutex_unlock(&ring_mutex);
+  }
+}
+
+/**
+ * Collects up to LOG_WRITEV_BATCH consecutive published records.
+ *
+ * @return unsigned int The number of records collected.
+ */
+static unsigned int
+ring_collect (struct iovec *iov) {
+  unsigned int n = 0;
+
+  while (n < LOG_WRITEV_BATCH) {
+    size_t      pos = dequeue_pos + n;
+    log_record *r   = &ring[pos & RING_MASK];
+
+    if (atomic_load_explicit(&r->seq, memory_order_acquire) != pos + 1) {
+      break;
+    }
+
+    iov[n].iov_base = r->data;
+    iov[n].iov_len  = r->len;
+    n++;
+  }
+
+  return n;
+}
+
+static void
+track_opened (int fd) {
+  struct stat st;
+  atomic_store(&log_size, fstat(fd, &st) == 0 ? (size_t)st.st_size : 0);
+  atomic_store(&log_opened_at, time(NULL));
+}
+
+/**
+ * Points the log fd (and stderr) at a freshly opened log file. dup2 swaps the
+ * file behind the existing fd number atomically, so concurrent writers never
+ * see a closed or recycled fd.
+ */
+static retval_t
+reopen_log (void) {
+  int fd;
+  if ((fd = open(opts.log_file, O_WRONLY | O_CREAT | O_APPEND, OWNER_RW_PERMS)) < 0) {
+    return ERR;
+  }
+
+  if (log_fd < 0) {
+    log_fd = fd;
+  } else {
+    dup2(fd, log_fd);
+    close(fd);
+  }
+  dup2(log_fd, STDERR_FILENO);
+
+  // Only now: writers racing the swap may have hit either file
+  track_opened(log_fd);
+
+  return OK;
+}
+
+static inline bool
+rotation_due (void) {
+  return (opts.log_max_size && atomic_load_explicit(&log_size, memory_order_relaxed) >= opts.log_max_size)
+         || (opts.log_max_age && time(NULL) - atomic_load_explicit(&log_opened_at, memory_order_relaxed) >= opts.log_max_age);
+}
+
+/**
+ * Stages the current log file and starts a new one. Archiving (shifting older
+ * files, compression) happens on a background thread, so this costs a rename
+ * and an open. Caller must hold `rotate_mutex`.
+ *
+ * Nothing here may log: we may be inside `printlogf` on this thread.
+ */
+static void
+rotate (void) {
+  char staged[MED_BUFFER * 2];
+  logrotate_staged_path(staged, sizeof(staged), rotate_seq + 1);
+
+  if (rename(opts.log_file, staged) < 0) {
+    metrics_add(METRIC_LOG_ROTATE_ERRORS, 1);
+    // Don't retry on every write; wait for another full interval
+    track_opened(log_fd);
+    atomic_store(&log_size, 0);
+    return;
+  }
+
+  if (reopen_log() != OK) {
+    // Keep writing to the staged file rather than losing logs
+    rename(staged, opts.log_file);
+    metrics_add(METRIC_LOG_ROTATE_ERRORS, 1);
+    track_opened(log_fd);
+    atomic_store(&log_size, 0);
+    return;
+  }
+
+  logrotate_submit(++rotate_seq);
+}
+
+/**
+ * Accounts for bytes written to the log file and rotates it if it's due.
+ */
+static void
+log_written (size_t n) {
+  metrics_add(METRIC_LOG_BYTES, n);
+  atomic_fetch_add_explicit(&log_size, n, memory_order_relaxed);
+
+  if ((opts.log_max_size || opts.log_max_age) && rotation_due() && getpid() == rotate_pid
+      && pthread_mutex_trylock(&rotate_mutex) == 0) {
+    // Another writer may have rotated while we were checking
+    if (rotation_due()) {
+      rotate();
+    }
+    pthread_mutex_unlock(&rotate_mutex);
+  }
+}
+
+static void
+write_batch (struct iovec *iov, unsigned int n) {
+  size_t total = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    total += iov[i].iov_len;
+  }
+
+  // Short writes are rare for regular files, but pick up where we left off
+  while (n > 0) {
+    ssize_t w = writev(log_fd, iov, n);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+
+    while (n > 0 && (size_t)w >= iov->iov_len) {
+      w -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base  = (char *)iov->iov_base + w;
+      iov->iov_len  -= w;
+    }
+  }
+
+  log_written(total);
+}
+
+static void *
+writer_routine (void *arg __attribute__((unused))) {
+  struct iovec iov[LOG_WRITEV_BATCH];
+
+  while (true) {
+    unsigned int n = ring_collect(iov);
+
+    if (n == 0) {
+      if (atomic_load(&stopping)) {
+        break;
+      }
+
+      pthread_mutex_lock(&ring_mutex);
+      atomic_store(&writer_idle, true);
+      // Re-check with the flag set so a publish can't slip by unsignalled
+      if (ring_collect(iov) == 0 && !atomic_load(&stopping)) {
+        timed_wait(&ring_ready, WRITER_IDLE_NSEC);
+      }
+      atomic_store(&writer_idle, false);
+      pthread_mutex_unlock(&ring_mutex);
+      continue;
+    }
+
+    write_batch(iov, n);
+
+    for (unsigned int i = 0; i < n; i++) {
+      size_t pos = dequeue_pos + i;
+      atomic_store_explicit(&ring[pos & RING_MASK].seq, pos + LOG_RING_SLOTS, memory_order_release);
+    }
+    dequeue_pos += n;
+
+    if (atomic_load(&blocked)) {
+      pthread_mutex_lock(&ring_mutex);
+      pthread_cond_broadcast(&ring_space);
+      pthread_mutex_unlock(&ring_mutex);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Forked children (cron jobs, mail) don't inherit the writer thread, so they
+ * must write directly.
+ */
+static void
+on_fork_child (void) {
+  atomic_store(&async_active, false);
+  // The parent still owns whatever the forking thread had pending
+  pending.len = 0;
+}
+
+static void
+logger_async_stop (void) {
+  // Only the process that started the writer may stop it
+  if (!atomic_load(&async_active) || getpid() != writer_pid) {
+    return;
+  }
+
+  pthread_mutex_lock(&ring_mutex);
+  atomic_store(&stopping, true);
+  pthread_cond_signal(&ring_ready);
+  pthread_mutex_unlock(&ring_mutex);
+
+  pthread_join(writer_thread, NULL);
+  atomic_store(&async_active, false);
+}
+
+static void
+register_hooks (void) {
+  pthread_atfork(NULL, NULL, on_fork_child);
+  // Flush what's queued if we exit without a clean shutdown e.g. xpanic
+  atexit(logger_async_stop);
+}
+
+static void
+logger_async_start (void) {
+  if (atomic_load(&async_active)) {
+    return;
+  }
+
+  if (!ring && !(ring = malloc(sizeof(log_record) * LOG_RING_SLOTS))) {
+    xpanic("%s\n", "failed to allocate the log ring buffer");
+  }
+  for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+    atomic_init(&ring[i].seq, i);
+  }
+  atomic_store(&enqueue_pos, 0);
+  dequeue_pos = 0;
+  atomic_store(&stopping, false);
+
+  writer_pid = getpid();
+
+  int rc;
+  if ((rc = pthread_create(&writer_thread, NULL, writer_routine, NULL)) != 0) {
+    xpanic("pthread_create failed with rc %d\n", rc);
+  }
+
+  atomic_store(&async_active, true);
+}
+
+/**
+ * Writes a complete record with a single write, so concurrent writers to the
+ * O_APPEND log (threads and forked children alike) never interleave mid-line.
+ */
+static void
+write_record (const char *buf, unsigned int len) {
+  unsigned int total = len;
+
+  while (len > 0) {
+    ssize_t w = write(log_fd, buf, len);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    buf += w;
+    len -= w;
+  }
+
+  log_written(total);
+}
+
+/**
+ * Hands a complete record to the async writer or writes it directly.
+ */
+static void
+emit_record (const char *buf, unsigned int len) {
+  if (atomic_load_explicit(&async_active, memory_order_relaxed)) {
+    size_t      pos;
+    log_record *r = ring_claim_or_wait(&pos);
+
+    if (r) {
+      memcpy(r->data, buf, len);
+      r->len = len;
+      ring_publish(r, pos);
+    }
+  } else {
+    write_record(buf, len);
+  }
+}
+
+static retval_t
+parse_level (const char *name, size_t len, log_level *lvl) {
+  for (unsigned int i = 0; i < sizeof(log_level_spec_names) / sizeof(log_level_spec_names[0]); i++) {
+    const char *candidate = log_level_spec_names[i];
+    if (candidate && strlen(candidate) == len && strncmp(name, candidate, len) == 0) {
+      *lvl = (log_level)i;
+      return OK;
+    }
+  }
+
+  return ERR;
+}
+
+static retval_t
+parse_category (const char *name, size_t len, log_category *cat) {
+  for (unsigned int i = 0; i < LOG_CAT_COUNT; i++) {
+    if (strlen(log_category_names[i]) == len && strncmp(name, log_category_names[i], len) == 0) {
+      *cat = (log_category)i;
+      return OK;
+    }
+  }
+
+  return ERR;
+}
+
+retval_t
+logger_set_levels (const char *spec) {
+  log_level next[LOG_CAT_COUNT];
+  for (unsigned int i = 0; i < LOG_CAT_COUNT; i++) {
+    next[i] = __atomic_load_n(&log_thresholds[i], __ATOMIC_RELAXED);
+  }
+
+  // Parse the whole spec before applying any of it
+  const char *item = spec;
+  while (true) {
+    const char *end = strchr(item, ',');
+    size_t      len = end ? (size_t)(end - item) : strlen(item);
+    const char *eq  = memchr(item, '=', len);
+    log_level   lvl;
+
+    if (eq) {
+      log_category cat;
+      if (parse_category(item, eq - item, &cat) != OK || parse_level(eq + 1, len - (eq + 1 - item), &lvl) != OK) {
+        return ERR;
+      }
+      next[cat] = lvl;
+    } else {
+      if (parse_level(item, len, &lvl) != OK) {
+        return ERR;
+      }
+      for (unsigned int i = 0; i < LOG_CAT_COUNT; i++) {
+        next[i] = lvl;
+      }
+    }
+
+    if (!end) {
+      break;
+    }
+    item = end + 1;
+  }
+
+  for (unsigned int i = 0; i < LOG_CAT_COUNT; i++) {
+    __atomic_store_n(&log_thresholds[i], next[i], __ATOMIC_RELAXED);
+  }
+
+  return OK;
+}
+
+const char *
+log_level_name (log_level lvl) {
+  return log_level_spec_names[lvl];
+}
+
+const char *
+log_category_name (log_category cat) {
+  return log_category_names[cat];
+}
 
 void
 printlogf (log_level lvl, const char *fmt, ...) {
-  va_list va;
+  pending_record *rec = &pending;
+  va_list         va;
   va_start(va, fmt);
 
   if (opts.syslog) {
-    char buf[LARGE_BUFFER];
-    vsnprintf(buf, LARGE_BUFFER, fmt, va);
-    syslog(lvl, buf);
-  } else {
-    char         buf[LARGE_BUFFER];
-    // Used to omit the header in the case of multi-line logs
-    static short suppress_header = 0;
+    vsnprintf(rec->data, sizeof(rec->data), fmt, va);
+    syslog(lvl, "%s", rec->data);
+    va_end(va);
+    return;
+  }
 
+  // A new record starts with the header; continuations append to the pending one
+  if (rec->len == 0) {
     struct timespec ts_info;
     get_time(&ts_info);
 
-    unsigned int buflen, headerlen = 0;
-    buf[0] = 0;
-
-    if (!suppress_header) {
-      char *ts = to_time_str_millis(&ts_info);
-
-      if ((headerlen = snprintf(
-             buf,
-             SMALL_BUFFER,
-             LOG_HEADER,
-             ts,
-             log_level_names[lvl],
-             proginfo.hostname
-           ))
-          >= SMALL_BUFFER) {
-        headerlen = SMALL_BUFFER - 1;
-      }
+    char ts[TIME_STR_LEN + 8];
+    format_time_str(ts, ts_info.tv_sec, ts_info.tv_nsec / 1000000);
 
-      free(ts);
+    if ((rec->len = snprintf(rec->data, SMALL_BUFFER, LOG_HEADER, ts, log_level_names[lvl], proginfo.hostname))
+        >= SMALL_BUFFER) {
+      rec->len = SMALL_BUFFER - 1;
     }
+  }
 
-    if ((buflen = vsnprintf(buf + headerlen, sizeof(buf) - headerlen, fmt, va) + headerlen) >= sizeof(buf)) {
-      buflen = sizeof(buf) - 1;
-    }
+  size_t room = sizeof(rec->data) - rec->len;
+  int    n    = vsnprintf(rec->data + rec->len, room, fmt, va);
+  va_end(va);
 
-    write(log_fd, buf, buflen);
-    // If the log doesn't end with a newline, omit the header next time (next
-    // line is a continuation of that log entry)
-    suppress_header = (buf[buflen - 1] != '\n');
+  if (n < 0) {
+    n = 0;
   }
 
-  va_end(va);
+  if ((size_t)n >= room) {
+    // Truncated: terminate the record so the next one starts on its own line
+    rec->len                 = sizeof(rec->data) - 1;
+    rec->data[rec->len - 1]  = '\n';
+  } else {
+    rec->len += n;
+  }
+
+  // If the log doesn't end with a newline, hold it: the next call from this
+  // thread is a continuation of the same record
+  if (rec->len > 0 && rec->data[rec->len - 1] == '\n') {
+    emit_record(rec->data, rec->len);
+    rec->len = 0;
+  }
 }
 
 static void
 logger_open (char *log_file) {
   if ((log_fd = open(log_file, O_WRONLY | O_CREAT | O_APPEND, OWNER_RW_PERMS)) >= 0) {
-    fclose(stderr);
+    // Keep the stderr stream open so e.g. panics land in the log too
     dup2(log_fd, STDERR_FILENO);
+    track_opened(log_fd);
+    rotate_pid = getpid();
   } else {
     perror("open");
     exit(errno);
@@ -99,6 +636,9 @@ syslog_open (void) {
 
 void
 logger_init (void) {
+  static pthread_once_t hooks_once = PTHREAD_ONCE_INIT;
+  pthread_once(&hooks_once, register_hooks);
+
   if (opts.log_file) {
     logger_open(opts.log_file);
   } else if (opts.syslog) {
@@ -107,6 +647,10 @@ logger_init (void) {
     opts.log_file = s_copy_or_panic(DEFAULT_LOGFILE_PATH);
     logger_open(opts.log_file);
   }
+
+  if (!opts.syslog && opts.log_mode != LOG_MODE_SYNC) {
+    logger_async_start();
+  }
 }
 
 void
@@ -115,14 +659,12 @@ logger_reinit (void) {
   struct stat file_stat;
 
   if (opts.log_file) {
-    // Check for invalidated fd
-    if (fstat(log_fd, &fd_stat) < 0) {
-      logger_init();
-    }
-
-    // Was the log file removed? Or do the fd and file have different inodes now?
-    if (stat(opts.log_file, &file_stat) < 0 || fd_stat.st_ino != file_stat.st_ino) {
-      logger_init();
+    // Was the fd invalidated or the log file removed? Or do the fd and file have
+    // different inodes now, e.g. after an external logrotate?
+    if (fstat(log_fd, &fd_stat) < 0 || stat(opts.log_file, &file_stat) < 0 || fd_stat.st_ino != file_stat.st_ino) {
+      pthread_mutex_lock(&rotate_mutex);
+      reopen_log();
+      pthread_mutex_unlock(&rotate_mutex);
     }
   }
 }
@@ -130,9 +672,27 @@ logger_reinit (void) {
 void
 logger_close (void) {
   LOG_GUARD
+
+  // Terminate and flush anything this thread left pending
+  if (pending.len > 0) {
+    if (pending.len == sizeof(pending.data) - 1) {
+      pending.len--;
+    }
+    pending.data[pending.len++] = '\n';
+    emit_record(pending.data, pending.len);
+    pending.len = 0;
+  }
+
+  if (getpid() == rotate_pid) {
+    logrotate_drain();
+  }
+
+  logger_async_stop();
   close(log_fd);
+  log_fd = -1;
 
   if (opts.log_file) {
     free(opts.log_file);
+    opts.log_file = NULL;
   }
 }
@@ -0,0 +1,163 @@
+#include "logrotate.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "constants.h"
+#include "globals.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils/xpanic.h"
+
+#define STAGED_FMT "%s.rotating.%lu"
+
+extern char **environ;
+
+static unsigned long   submitted     = 0;
+static unsigned long   archived      = 0;
+static pthread_mutex_t archive_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  archive_cond  = PTHREAD_COND_INITIALIZER;
+
+void
+logrotate_staged_path (char *buf, size_t sz, unsigned long seq) {
+  snprintf(buf, sz, STAGED_FMT, opts.log_file, seq);
+}
+
+static void
+compress (const char *path) {
+  char *const argv[] = {"gzip", "-f", (char *)path, NULL};
+  pid_t       pid;
+  int         status;
+
+  int rc;
+  if ((rc = posix_spawn(&pid, GZIP_PATH, NULL, NULL, argv, environ)) != 0) {
+    metrics_add(METRIC_LOG_ROTATE_ERRORS, 1);
+    log_warn("failed to spawn %s to compress %s (reason: %s)\n", GZIP_PATH, path, strerror(rc));
+    return;
+  }
+
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    metrics_add(METRIC_LOG_ROTATE_ERRORS, 1);
+    log_warn("failed to compress rotated log file %s\n", path);
+    return;
+  }
+
+  metrics_add(METRIC_LOG_COMPRESSIONS, 1);
+}
+
+/**
+ * Moves `from` to `to`, if it exists.
+ */
+static void
+shift (const char *from, const char *to) {
+  if (rename(from, to) < 0 && errno != ENOENT) {
+    log_warn("failed to rename %s to %s (reason: %s)\n", from, to, strerror(errno));
+  }
+}
+
+static void
+archive (unsigned long seq) {
+  static const char *suffixes[] = {"", ".gz"};
+
+  char         staged[MED_BUFFER * 2], from[MED_BUFFER * 2], to[MED_BUFFER * 2];
+  unsigned int keep = opts.log_max_files;
+  logrotate_staged_path(staged, sizeof(staged), seq);
+
+  if (keep == 0) {
+    unlink(staged);
+    metrics_add(METRIC_LOG_ROTATIONS, 1);
+    return;
+  }
+
+  for (unsigned int s = 0; s < sizeof(suffixes) / sizeof(suffixes[0]); s++) {
+    snprintf(to, sizeof(to), "%s.%u%s", opts.log_file, keep, suffixes[s]);
+    unlink(to);
+
+    for (unsigned int i = keep - 1; i > 0; i--) {
+      snprintf(from, sizeof(from), "%s.%u%s", opts.log_file, i, suffixes[s]);
+      snprintf(to, sizeof(to), "%s.%u%s", opts.log_file, i + 1, suffixes[s]);
+      shift(from, to);
+    }
+  }
+
+  snprintf(to, sizeof(to), "%s.1", opts.log_file);
+  if (rename(staged, to) < 0) {
+    metrics_add(METRIC_LOG_ROTATE_ERRORS, 1);
+    log_warn("failed to rename %s to %s (reason: %s)\n", staged, to, strerror(errno));
+    return;
+  }
+
+  log_info("rotated log file to %s\n", to);
+  metrics_add(METRIC_LOG_ROTATIONS, 1);
+
+  if (opts.log_compress) {
+    compress(to);
+  }
+}
+
+/**
+ * Archives staged log files in order, off the logging path.
+ */
+static void *
+archive_routine (void *arg __attribute__((unused))) {
+  while (true) {
+    pthread_mutex_lock(&archive_mutex);
+    while (archived == submitted) {
+      pthread_cond_wait(&archive_cond, &archive_mutex);
+    }
+    unsigned long seq = archived + 1;
+    pthread_mutex_unlock(&archive_mutex);
+
+    archive(seq);
+
+    pthread_mutex_lock(&archive_mutex);
+    archived = seq;
+    // Wake anyone draining as well
+    pthread_cond_broadcast(&archive_cond);
+    pthread_mutex_unlock(&archive_mutex);
+  }
+
+  return NULL;
+}
+
+static void
+archive_routine_init (void) {
+  pthread_t      thread_id;
+  pthread_attr_t attr;
+  int            rc = pthread_attr_init(&attr);
+  if (rc != 0) {
+    xpanic("pthread_attr_init failed with rc %d\n", rc);
+  }
+  if ((rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) != 0) {
+    xpanic("pthread_attr_setdetachstate failed with rc %d\n", rc);
+  }
+  if ((rc = pthread_create(&thread_id, &attr, archive_routine, NULL)) != 0) {
+    xpanic("pthread_create failed with rc %d\n", rc);
+  }
+}
+
+void
+logrotate_submit (unsigned long seq) {
+  static pthread_once_t archive_once = PTHREAD_ONCE_INIT;
+  pthread_once(&archive_once, archive_routine_init);
+
+  pthread_mutex_lock(&archive_mutex);
+  submitted = seq;
+  pthread_cond_broadcast(&archive_cond);
+  pthread_mutex_unlock(&archive_mutex);
+}
+
+void
+logrotate_drain (void) {
+  pthread_mutex_lock(&archive_mutex);
+  while (archived != submitted) {
+    pthread_cond_wait(&archive_cond, &archive_mutex);
+  }
+  pthread_mutex_unlock(&archive_mutex);
+}
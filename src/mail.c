@@ -0,0 +1,233 @@
+#define _GNU_SOURCE  // For memfd_create and POSIX_SPAWN_SETSID
+
+#include "mail.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "globals.h"
+#include "joboutput.h"
+#include "libhash/libhash.h"
+#include "logger.h"
+#include "utils/xmalloc.h"
+#include "utils/xpanic.h"
+
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_JOB
+
+/* Job count | failed job count */
+#define DIGEST_SUBJECT_FMT "cron digest: %u jobs (%u failed)"
+
+extern char **environ;
+
+static const char *mail_policy_names[] = {
+  [MAIL_ALWAYS]     = "always",
+  [MAIL_ON_FAILURE] = "on-failure",
+  [MAIL_ON_OUTPUT]  = "on-output",
+  [MAIL_NEVER]      = "never",
+};
+
+/**
+ * A recipient's pending digest.
+ */
+typedef struct {
+  /* In-memory file the job reports are appended to */
+  int          fd;
+  unsigned int jobs;
+  unsigned int failed;
+  /* When the first report was added */
+  time_t       opened;
+} digest;
+
+/* Pending digests by recipient i.e. HashTable<char*, digest*> */
+static hash_table *digests = NULL;
+
+retval_t
+mail_policy_parse (const char *name, mail_policy *policy) {
+  for (unsigned int i = 0; i < sizeof(mail_policy_names) / sizeof(mail_policy_names[0]); i++) {
+    if (strcmp(name, mail_policy_names[i]) == 0) {
+      *policy = (mail_policy)i;
+      return OK;
+    }
+  }
+
+  return ERR;
+}
+
+bool
+mail_wanted (job_t *job) {
+  switch (job->mail_policy) {
+    case MAIL_ALWAYS: return true;
+    case MAIL_ON_FAILURE: return job->ret != 0;
+    case MAIL_ON_OUTPUT: return job->output.bytes > 0 || job->output.dropped > 0;
+    case MAIL_NEVER:
+    default: return false;
+  }
+}
+
+/**
+ * Appends a job's command, exit status and captured output to `fd`.
+ */
+static void
+write_report (int fd, job_t *job) {
+  dprintf(fd, "command: %s\nexit status: %d\n", job->cmd, job->ret);
+
+  if (job->output.bytes == 0 && job->output.dropped == 0) {
+    return;
+  }
+
+  char path[MED_BUFFER * 2];
+  joboutput_path(path, sizeof(path), job->id);
+
+  int out_fd;
+  if ((out_fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    dprintf(fd, "\n(output unavailable: %s)\n", strerror(errno));
+    return;
+  }
+
+  dprintf(fd, "\n");
+
+  // Kernel-side copy from the output file
+  off_t  offset = 0;
+  size_t left   = job->output.bytes;
+  while (left > 0) {
+    ssize_t n = sendfile(fd, out_fd, &offset, left);
+    if (n <= 0) {
+      break;
+    }
+    left -= n;
+  }
+  close(out_fd);
+
+  if (job->output.dropped > 0) {
+    dprintf(fd, "\n(%zu more bytes of output were discarded)\n", job->output.dropped);
+  }
+}
+
+static int
+open_body (void) {
+  int fd;
+  if ((fd = memfd_create("crond-mail", MFD_CLOEXEC)) < 0) {
+    log_error("failed to create mail body (reason: %s)\n", strerror(errno));
+  }
+
+  return fd;
+}
+
+int
+mail_report_open (job_t *job) {
+  int fd;
+  if ((fd = open_body()) >= 0) {
+    write_report(fd, job);
+  }
+
+  return fd;
+}
+
+pid_t
+mail_spawn (const char *mailto, const char *subject, int body_fd) {
+  char sender[MED_BUFFER];
+  snprintf(sender, sizeof(sender), "%s@%s", DAEMON_IDENT, proginfo.hostname);
+
+  // "--" so a recipient can never pass for an option
+  char *const argv[] = {opts.mail_cmd, "-r", sender, "-s", (char *)subject, "--", (char *)mailto, NULL};
+
+  // The report is the program's stdin; its own output goes to our log
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, body_fd, STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, STDERR_FILENO, STDOUT_FILENO);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+
+  lseek(body_fd, 0, SEEK_SET);
+
+  pid_t pid;
+  int   rc = posix_spawn(&pid, opts.mail_cmd, &actions, &attr, argv, environ);
+
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  if (rc != 0) {
+    log_error("failed to spawn %s to mail %s (reason: %s)\n", opts.mail_cmd, mailto, strerror(rc));
+    return -1;
+  }
+
+  return pid;
+}
+
+static void
+free_digest (digest *d) {
+  close(d->fd);
+  free(d);
+}
+
+void
+mail_digest_add (job_t *job) {
+  if (!digests) {
+    digests = ht_init_or_panic(0, (free_fn *)free_digest);
+  }
+
+  digest *d = ht_get(digests, job->mailto);
+  if (!d) {
+    int fd;
+    if ((fd = open_body()) < 0) {
+      return;
+    }
+
+    d         = xmalloc(sizeof(digest));
+    d->fd     = fd;
+    d->jobs   = 0;
+    d->failed = 0;
+    d->opened = time(NULL);
+    ht_insert(digests, job->mailto, d);
+  }
+
+  char ident[IDENT_STR_LEN];
+  dprintf(d->fd, "%s---- [job %s]\n", d->jobs > 0 ? "\n" : "", ident_format(job->id, ident));
+  write_report(d->fd, job);
+
+  d->jobs++;
+  d->failed += job->ret != 0;
+}
+
+unsigned int
+mail_digest_flush (time_t now, bool force, mail_send_fn *send) {
+  if (!digests || digests->count == 0) {
+    return 0;
+  }
+
+  // Collect first: we can't delete from the table while iterating it
+  array_t *due = array_init_or_panic();
+  HT_ITER_START(digests)
+  digest *d = entry->value;
+  if (force || now - d->opened >= opts.mail_digest) {
+    array_push_or_panic(due, s_copy_or_panic(entry->key));
+  }
+  HT_ITER_END
+
+  foreach (due, i) {
+    char   *mailto = array_get_or_panic(due, i);
+    digest *d      = ht_get(digests, mailto);
+
+    char subject[TINY_BUFFER * 2];
+    snprintf(subject, sizeof(subject), DIGEST_SUBJECT_FMT, d->jobs, d->failed);
+    send(mailto, subject, d->fd);
+
+    ht_delete(digests, mailto);
+  }
+
+  unsigned int n = array_size(due);
+  array_free(due, free);
+
+  return n;
+}
@@ -14,11 +14,18 @@
 #include "cronentry.h"
 #include "crontab.h"
 #include "daemon.h"
+#include "db.h"
+#include "exprpool.h"
 #include "globals.h"
 #include "job.h"
+#include "joboutput.h"
+#include "journal.h"
 #include "logger.h"
+#include "pause.h"
 #include "proginfo.h"
 #include "sig.h"
+#include "smtp.h"
+#include "status.h"
 #include "user.h"
 #include "utils/time.h"
 #include "utils/xpanic.h"
@@ -52,8 +59,10 @@ main (int argc, char** argv) {
 
   daemon_lock();
   sig_handlers_init();
+  pause_state_init(NULL);
 
-  db         = ht_init_or_panic(0, (free_fn*)free_crontab);
+  db         = ht_init_or_panic(0, (free_fn*)release_crontab);
+  db_publish(db);
 
   job_queue  = array_init_or_panic();
   mail_queue = array_init_or_panic();
@@ -61,6 +70,10 @@ main (int argc, char** argv) {
   struct timespec ts;
   get_time(&ts);
   proginfo_init(&ts);
+  status_init();
+  journal_init();
+  joboutput_init();
+  smtp_init(job_mail_spawn);
 
   char* s_ts = to_time_str_millis(&ts);
   log_info("cron daemon (pid=%d) started at %s\n", proginfo.pid, s_ts);
@@ -68,8 +81,11 @@ main (int argc, char** argv) {
 
   time_t start_time = ts.tv_sec;
   time_t current_iter_time;
+  // The last minute dispatched; entries built at startup are due after it
+  time_t last_tick  = start_time - start_time % loop_interval;
 
   db = update_db(db, start_time, ALL_DIRS);
+  db_publish(db);
 
   reap_routine_init();
   ipc_init();
@@ -82,19 +98,37 @@ main (int argc, char** argv) {
 
     unsigned short sleep_dur = get_sleep_duration(loop_interval, time(NULL));
     log_debug("Sleeping for %d seconds...\n", sleep_dur);
-    sleep(sleep_dur);
+    sig_sleep(sleep_dur);
 
     current_iter_time        = time(NULL);
     time_t rounded_timestamp = round_ts(current_iter_time, loop_interval);
 
-    char* c_ts               = to_time_str_secs(current_iter_time);
-    char* r_ts               = to_time_str_secs(rounded_timestamp);
+    char c_ts[TIME_STR_LEN + 8], r_ts[TIME_STR_LEN + 8];
+    format_time_str(c_ts, current_iter_time, 0);
+    format_time_str(r_ts, rounded_timestamp, 0);
     log_debug("Current iter time: %s (rounded to %s)\n", c_ts, r_ts);
-    free(c_ts);
-    free(r_ts);
 
-    try_run_jobs(db, rounded_timestamp);
+    // Pick up any pauses/resumes made via IPC since the last iteration
+    pause_state_sync(db);
+    exprpool_advance(rounded_timestamp);
+
+    // Entries are renewed as they fire, which leaves them stale if the clock
+    // skips or repeats minutes
+    if (rounded_timestamp != last_tick + loop_interval && rounded_timestamp != last_tick) {
+      format_time_str(c_ts, last_tick, 0);
+      log_info("clock jumped from %s to %s, renewing all entries\n", c_ts, r_ts);
+      renew_crontabs(db, rounded_timestamp - 1);
+    }
+
+    // Waking just before a minute and again on it would dispatch it twice
+    if (rounded_timestamp != last_tick) {
+      try_run_jobs(db, rounded_timestamp);
+    }
+    last_tick = rounded_timestamp;
+
+    status_tick(rounded_timestamp);
     db = update_db(db, current_iter_time, ALL_DIRS);
+    db_publish(db);
   }
 
   exit(EXIT_FAILURE);
@@ -0,0 +1,282 @@
+#include "metrics.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "globals.h"
+#include "proginfo.h"
+
+#define LINE_BUFFER 512
+
+typedef struct {
+  const char *name;
+  const char *help;
+} counter_meta;
+
+typedef struct {
+  const char          *name;
+  const char          *help;
+  /* Bucket upper bounds in microseconds, zero-terminated */
+  const uint64_t       bounds[METRICS_MAX_BUCKETS];
+  /* Non-cumulative bucket counts; the last slot is +Inf */
+  atomic_uint_fast64_t buckets[METRICS_MAX_BUCKETS + 1];
+  atomic_uint_fast64_t sum;
+} histogram;
+
+static const counter_meta counter_metas[METRIC_COUNTER_COUNT] = {
+  [METRIC_FILES_SCANNED]      = {"chronic_files_scanned",            "Crontab files examined while updating the db"},
+  [METRIC_PARSE_ERRORS]       = {"chronic_parse_errors",             "Crontab entries that failed to parse"        },
+  [METRIC_LOG_BYTES]          = {"chronic_log_written_bytes",        "Bytes written to the log file"               },
+  [METRIC_IPC_REQUESTS]       = {"chronic_ipc_requests",             "IPC requests served"                         },
+  [METRIC_LOG_DROPPED]        = {"chronic_log_dropped",              "Async log records dropped on overflow"       },
+  [METRIC_LOG_BLOCKED]        = {"chronic_log_blocked",              "Async log calls that waited for ring space"  },
+  [METRIC_LOG_ROTATIONS]      = {"chronic_log_rotations",            "Log files rotated out"                       },
+  [METRIC_LOG_COMPRESSIONS]   = {"chronic_log_compressions",         "Rotated log files compressed"                },
+  [METRIC_LOG_ROTATE_ERRORS]  = {"chronic_log_rotate_errors",        "Failed log rotations or compressions"        },
+  [METRIC_JOURNAL_RECORDS]    = {"chronic_journal_records",          "Records appended to the binary journal"      },
+  [METRIC_JOURNAL_ROTATIONS]  = {"chronic_journal_rotations",        "Journal files rotated out when full"         },
+  [METRIC_JOB_OUTPUT_BYTES]   = {"chronic_job_output_bytes",         "Bytes of job output captured"                },
+  [METRIC_JOB_OUTPUT_DROPPED] = {"chronic_job_output_dropped_bytes", "Bytes of job output past the per-job cap"    },
+  [METRIC_MAIL_SUBMITTED]     = {"chronic_mail_submitted",           "Messages accepted by the mail relay"         },
+  [METRIC_MAIL_FAILED]        = {"chronic_mail_failed",              "Messages the mail relay didn't accept"       },
+  [METRIC_MAIL_CONNECTIONS]   = {"chronic_mail_connections",         "Connections made to the mail relay"          },
+  [METRIC_ENTRIES_RENEWED]    = {"chronic_entries_renewed",          "Cron entries whose next fire time was renewed"},
+  [METRIC_NEXT_COMPUTED]      = {"chronic_next_fire_computed",       "Next fire times worked out rather than reused"},
+};
+
+static atomic_uint_fast64_t counters[METRIC_COUNTER_COUNT];
+
+// clang-format off
+static histogram histograms[METRIC_HISTOGRAM_COUNT] = {
+  [METRIC_SPAWN_LATENCY]      = {
+    .name   = "chronic_spawn_latency_seconds",
+    .help   = "Time taken to fork a cron job",
+    .bounds = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000}
+  },
+  [METRIC_REAP_LATENCY]       = {
+    .name   = "chronic_reap_latency_seconds",
+    .help   = "Time taken by a reaper pass over the job and mail queues",
+    .bounds = {10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000}
+  },
+  [METRIC_UPDATE_DB_DURATION] = {
+    .name   = "chronic_update_db_duration_seconds",
+    .help   = "Time taken to build a new crontab db version",
+    .bounds = {100, 1000, 5000, 10000, 50000, 100000, 250000, 500000, 1000000, 5000000}
+  },
+  [METRIC_IPC_LATENCY]        = {
+    .name   = "chronic_ipc_request_latency_seconds",
+    .help   = "Time taken to parse and handle an IPC request",
+    .bounds = {50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000}
+  },
+};
+// clang-format on
+
+enum { SLOT_EMPTY, SLOT_CLAIMING, SLOT_READY };
+
+static metrics_user users[METRICS_MAX_USERS];
+static metrics_user overflow_user = {.state = SLOT_READY, .uname = METRICS_OVERFLOW_UNAME};
+
+static inline uint32_t
+hash_uname (const char *s) {
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void
+metrics_add (metrics_counter counter, uint64_t n) {
+  atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+}
+
+uint64_t
+metrics_get (metrics_counter counter) {
+  return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+void
+metrics_observe (metrics_histogram hist, uint64_t usec) {
+  histogram   *h   = &histograms[hist];
+  unsigned int idx = 0;
+
+  while (idx < METRICS_MAX_BUCKETS && h->bounds[idx] && usec > h->bounds[idx]) {
+    idx++;
+  }
+  if (idx < METRICS_MAX_BUCKETS && !h->bounds[idx]) {
+    idx = METRICS_MAX_BUCKETS;
+  }
+
+  atomic_fetch_add_explicit(&h->buckets[idx], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum, usec, memory_order_relaxed);
+}
+
+metrics_user *
+metrics_user_get (const char *uname) {
+  if (strlen(uname) >= METRICS_MAX_UNAME) {
+    return &overflow_user;
+  }
+
+  uint32_t start = hash_uname(uname) % METRICS_MAX_USERS;
+
+  for (unsigned int i = 0; i < METRICS_MAX_USERS; i++) {
+    metrics_user *slot  = &users[(start + i) % METRICS_MAX_USERS];
+    int           state = atomic_load_explicit(&slot->state, memory_order_acquire);
+
+    if (state == SLOT_EMPTY) {
+      int expected = SLOT_EMPTY;
+      if (atomic_compare_exchange_strong(&slot->state, &expected, SLOT_CLAIMING)) {
+        strcpy(slot->uname, uname);
+        atomic_store_explicit(&slot->state, SLOT_READY, memory_order_release);
+        return slot;
+      }
+      state = expected;
+    }
+
+    // Another thread is mid-claim; the name is published momentarily
+    while (state == SLOT_CLAIMING) {
+      state = atomic_load_explicit(&slot->state, memory_order_acquire);
+    }
+
+    if (strcmp(slot->uname, uname) == 0) {
+      return slot;
+    }
+  }
+
+  return &overflow_user;
+}
+
+/**
+ * Formats microseconds as seconds, without trailing zeros.
+ */
+static void
+format_seconds (char *dest, size_t sz, uint64_t usec) {
+  int len = snprintf(dest, sz, "%lu.%06lu", (unsigned long)(usec / 1000000), (unsigned long)(usec % 1000000));
+
+  while (len > 0 && dest[len - 1] == '0') {
+    dest[--len] = '\0';
+  }
+  if (len > 0 && dest[len - 1] == '.') {
+    dest[len]     = '0';
+    dest[len + 1] = '\0';
+  }
+}
+
+/**
+ * Writes a label value, escaping it per the exposition format.
+ */
+static void
+append_label_value (buffer_t *buf, const char *s) {
+  for (; *s; s++) {
+    switch (*s) {
+      case '\\': buffer_append(buf, "\\\\"); break;
+      case '"': buffer_append(buf, "\\\""); break;
+      case '\n': buffer_append(buf, "\\n"); break;
+      default: buffer_append_char(buf, *s);
+    }
+  }
+}
+
+static void
+write_user_counter (buffer_t *buf, const char *name, const char *help, size_t offset) {
+  char line[LINE_BUFFER];
+
+  snprintf(line, sizeof(line), "# TYPE %s counter\n# HELP %s %s\n", name, name, help);
+  buffer_append(buf, line);
+
+  for (unsigned int i = 0; i <= METRICS_MAX_USERS; i++) {
+    metrics_user *u = i < METRICS_MAX_USERS ? &users[i] : &overflow_user;
+    if (atomic_load_explicit(&u->state, memory_order_acquire) != SLOT_READY) {
+      continue;
+    }
+
+    uint64_t v = atomic_load_explicit((atomic_uint_fast64_t *)((char *)u + offset), memory_order_relaxed);
+    if (u == &overflow_user && v == 0) {
+      continue;
+    }
+
+    snprintf(line, sizeof(line), "%s_total{user=\"", name);
+    buffer_append(buf, line);
+    append_label_value(buf, u->uname);
+    snprintf(line, sizeof(line), "\"} %lu\n", (unsigned long)v);
+    buffer_append(buf, line);
+  }
+}
+
+static void
+write_histogram (buffer_t *buf, histogram *h) {
+  char line[LINE_BUFFER];
+  char le[TINY_BUFFER];
+
+  snprintf(line, sizeof(line), "# TYPE %s histogram\n# HELP %s %s\n", h->name, h->name, h->help);
+  buffer_append(buf, line);
+
+  uint64_t cumulative = 0;
+  for (unsigned int i = 0; i < METRICS_MAX_BUCKETS && h->bounds[i]; i++) {
+    cumulative += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    format_seconds(le, sizeof(le), h->bounds[i]);
+
+    snprintf(line, sizeof(line), "%s_bucket{le=\"%s\"} %lu\n", h->name, le, (unsigned long)cumulative);
+    buffer_append(buf, line);
+  }
+
+  cumulative += atomic_load_explicit(&h->buckets[METRICS_MAX_BUCKETS], memory_order_relaxed);
+  format_seconds(le, sizeof(le), atomic_load_explicit(&h->sum, memory_order_relaxed));
+
+  snprintf(
+    line,
+    sizeof(line),
+    "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %s\n%s_count %lu\n",
+    h->name,
+    (unsigned long)cumulative,
+    h->name,
+    le,
+    h->name,
+    (unsigned long)cumulative
+  );
+  buffer_append(buf, line);
+}
+
+void
+metrics_write (buffer_t *buf) {
+  char line[LINE_BUFFER];
+
+  if (proginfo.start) {
+    snprintf(
+      line,
+      sizeof(line),
+      "# TYPE chronic_start_time_seconds gauge\n# HELP chronic_start_time_seconds Time at which the daemon "
+      "started\nchronic_start_time_seconds %ld\n",
+      (long)proginfo.start->tv_sec
+    );
+    buffer_append(buf, line);
+  }
+
+  write_user_counter(buf, "chronic_jobs_launched", "Cron jobs launched", offsetof(metrics_user, jobs_launched));
+  write_user_counter(buf, "chronic_jobs_failed", "Cron jobs that exited non-zero", offsetof(metrics_user, jobs_failed));
+
+  for (unsigned int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+    const counter_meta *m = &counter_metas[i];
+
+    snprintf(
+      line,
+      sizeof(line),
+      "# TYPE %s counter\n# HELP %s %s\n%s_total %lu\n",
+      m->name,
+      m->name,
+      m->help,
+      m->name,
+      (unsigned long)atomic_load_explicit(&counters[i], memory_order_relaxed)
+    );
+    buffer_append(buf, line);
+  }
+
+  for (unsigned int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+    write_histogram(buf, &histograms[i]);
+  }
+
+  buffer_append(buf, "# EOF\n");
+}
@@ -9,7 +9,10 @@
 #include "logger.h"
 #include "utils/regex.h"
 #include "utils/string.h"
-#include "utils/xmalloc.h"
+#include "utils/strpool.h"
+
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_SCAN
 
 // Basically whether we support seconds
 #define SUPPORTED_CRONEXPR_COLS 5
@@ -91,7 +94,7 @@ parse_schedule (const char* s, char* dest) {
 }
 
 retval_t
-parse_cmd (char* s, char* dest) {
+parse_cmd (char* s, char** cmd) {
   if (!s) {
     return ERR;
   }
@@ -103,34 +106,23 @@ parse_cmd (char* s, char* dest) {
     return ERR;
   }
 
-  s   += idx;
-  len  = strlen(s);
-
-  if (len > MAX_COMMAND_LENGTH) {
-    return ERR;
-  }
-
-  memcpy(dest, s, len);
-  dest[len] = '\0';
+  *cmd = s + idx;
 
   return OK;
 }
 
 retval_t
-parse_expr (cron_entry* entry) {
-  cron_expr*  expr = xmalloc(sizeof(cron_expr));
-  const char* err  = NULL;
+parse_expr (char* schedule, cron_expr* expr) {
+  const char* err = NULL;
 
-  replace_tabs_with_spaces(entry->schedule);
-  cron_parse_expr(entry->schedule, expr, &err);
+  replace_tabs_with_spaces(schedule);
+  cron_parse_expr(schedule, expr, &err);
 
   if (err) {
     log_warn("error parsing cron expression: %s\n\n", err);
-    free(expr);
     return ERR;
   }
 
-  entry->expr = expr;
   return OK;
 }
 
@@ -142,18 +134,24 @@ parse_entry (cron_entry* entry, char* line) {
 
   strip_comment(line);
   char* line_cp = s_trim(line);
-  if (parse_schedule(line_cp, entry->schedule) != OK || parse_cmd(line_cp, entry->cmd) != OK) {
+  char      schedule[MAX_SCHEDULE_LENGTH];
+  char*     cmd;
+  cron_expr expr;
+  if (parse_schedule(line_cp, schedule) != OK || parse_cmd(line_cp, &cmd) != OK || parse_expr(schedule, &expr) != OK) {
     free(line_cp);
     return ERR;
   }
 
+  entry->expr           = exprpool_intern(&expr);
+  entry->info->schedule = strpool_intern(schedule);
+  entry->info->cmd      = strpool_intern(cmd);
   free(line_cp);
 
-  return parse_expr(entry);
+  return OK;
 }
 
 parse_ln_result
-parse_line (char* ptr, int max_entries, hash_table* vars) {
+parse_line (char* ptr, int max_entries, crontab_t* ct) {
   if (max_entries == 1) {
     return DONE;
   }
@@ -176,7 +174,7 @@ parse_line (char* ptr, int max_entries, hash_table* vars) {
     return SKIP_LINE;
   }
 
-  if (match_variable(ptr, vars)) {
+  if (match_variable(ptr, ct->vars, ct->arena)) {
     return ENV_VAR_ADDED;
   }
 
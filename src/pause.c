@@ -0,0 +1,204 @@
+#include "pause.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "globals.h"
+#include "logger.h"
+#include "utils/xpanic.h"
+
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_IPC
+
+#define ENTRY_KEY_FMT "%s#%016lx"
+
+// i.e. HashSet<char*>, with NULL values
+static hash_table     *paused_keys  = NULL;
+static char           *state_path   = NULL;
+static unsigned long   generation   = 0;
+static pthread_mutex_t pause_mutex  = PTHREAD_MUTEX_INITIALIZER;
+
+static inline hash_table *
+get_paused_keys (void) {
+  if (!paused_keys) {
+    paused_keys = ht_init_or_panic(0, NULL);
+  }
+  return paused_keys;
+}
+
+/**
+ * Rewrites the state file. Writes a temp file and renames it over the old one
+ * so a crash never leaves a truncated file behind. Caller must hold the lock.
+ */
+static void
+persist (void) {
+  if (!state_path) {
+    return;
+  }
+
+  char tmp_path[MED_BUFFER];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", state_path);
+
+  // Anyone who can write the file decides what runs, so create it owner-only (the daemon's umask is 0), and
+  // never through whatever sits at the temp path, e.g. one left by a crash or a planted symlink
+  unlink(tmp_path);
+
+  int   tmp_fd;
+  FILE *fd = NULL;
+  if ((tmp_fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, OWNER_RW_PERMS)) < 0
+      || !(fd = fdopen(tmp_fd, "w"))) {
+    log_warn("failed to persist pause state to %s (reason: %s)\n", tmp_path, strerror(errno));
+    if (tmp_fd >= 0) {
+      close(tmp_fd);
+      unlink(tmp_path);
+    }
+    return;
+  }
+
+  hash_table *keys = get_paused_keys();
+  HT_ITER_START(keys)
+  fprintf(fd, "%s\n", entry->key);
+  HT_ITER_END
+
+  if (fclose(fd) != 0 || rename(tmp_path, state_path) != 0) {
+    log_warn("failed to persist pause state to %s (reason: %s)\n", state_path, strerror(errno));
+    unlink(tmp_path);
+  }
+}
+
+void
+pause_state_init (const char *path) {
+  pthread_mutex_lock(&pause_mutex);
+
+  state_path = path ? s_copy_or_panic(path)
+                    : usr.root ? s_copy_or_panic(SYS_PAUSE_STATE_PATH)
+                               : s_fmt(USR_PAUSE_STATE_PATH_FMT, usr.home);
+
+  int   state_fd = open(state_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  FILE *fd       = state_fd >= 0 ? fdopen(state_fd, "r") : NULL;
+  if (fd) {
+    char buf[MED_BUFFER * 2];
+
+    while (fgets(buf, sizeof(buf), fd)) {
+      size_t len = strlen(buf);
+      if (len && buf[len - 1] == '\n') {
+        buf[--len] = '\0';
+      }
+      if (len) {
+        ht_insert(get_paused_keys(), buf, NULL);
+      }
+    }
+
+    fclose(fd);
+    generation++;
+    log_info("loaded %d paused crontab(s)/entries from %s\n", get_paused_keys()->count, state_path);
+  } else if (state_fd >= 0) {
+    close(state_fd);
+  }
+
+  pthread_mutex_unlock(&pause_mutex);
+}
+
+char *
+pause_entry_key (const char *fpath, cron_entry *entry) {
+  // FNV-1a over the schedule and command (separated so "a b" + "c" != "a" + "b c")
+  uint64_t    h = 14695981039346656037ull;
+  const char *s = entry->info->schedule;
+
+  do {
+    h ^= (unsigned char)*s;
+    h *= 1099511628211ull;
+  } while (*s++);
+
+  for (s = entry->info->cmd; *s; s++) {
+    h ^= (unsigned char)*s;
+    h *= 1099511628211ull;
+  }
+
+  return s_fmt(ENTRY_KEY_FMT, fpath, (unsigned long)h);
+}
+
+void
+pause_state_set (const char *key, bool paused) {
+  pthread_mutex_lock(&pause_mutex);
+
+  bool exists = ht_search(get_paused_keys(), key) != NULL;
+  if (paused && !exists) {
+    ht_insert(get_paused_keys(), key, NULL);
+  } else if (!paused && exists) {
+    ht_delete(get_paused_keys(), key);
+  } else {
+    pthread_mutex_unlock(&pause_mutex);
+    return;
+  }
+
+  generation++;
+  persist();
+
+  pthread_mutex_unlock(&pause_mutex);
+}
+
+bool
+pause_state_get (const char *key) {
+  pthread_mutex_lock(&pause_mutex);
+  bool paused = paused_keys && ht_search(paused_keys, key) != NULL;
+  pthread_mutex_unlock(&pause_mutex);
+
+  return paused;
+}
+
+void
+pause_state_apply (const char *fpath, crontab_t *ct) {
+  pthread_mutex_lock(&pause_mutex);
+
+  // Common case: nothing is paused, so there's no need to fingerprint entries
+  if (!paused_keys || paused_keys->count == 0) {
+    __atomic_store_n(&ct->paused, false, __ATOMIC_RELAXED);
+    foreach (ct->entries, i) {
+      cron_entry *entry = array_get_or_panic(ct->entries, i);
+      __atomic_store_n(&entry->paused, false, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&pause_mutex);
+    return;
+  }
+
+  __atomic_store_n(&ct->paused, ht_search(paused_keys, fpath) != NULL, __ATOMIC_RELAXED);
+
+  foreach (ct->entries, i) {
+    cron_entry *entry = array_get_or_panic(ct->entries, i);
+    char       *key   = pause_entry_key(fpath, entry);
+
+    __atomic_store_n(&entry->paused, ht_search(paused_keys, key) != NULL, __ATOMIC_RELAXED);
+    free(key);
+  }
+
+  pthread_mutex_unlock(&pause_mutex);
+}
+
+void
+pause_state_sync (hash_table *db) {
+  static unsigned long applied = 0;
+
+  pthread_mutex_lock(&pause_mutex);
+  unsigned long current = generation;
+  pthread_mutex_unlock(&pause_mutex);
+
+  if (current == applied) {
+    return;
+  }
+
+  log_debug("pause state changed (generation %lu); re-applying\n", current);
+
+  HT_ITER_START(db)
+  pause_state_apply(entry->key, entry->value);
+  HT_ITER_END
+
+  applied = current;
+}
@@ -5,19 +5,39 @@
 #include "sig.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <string.h>
 #include <ucontext.h>
+#include <unistd.h>
 
 #include "daemon.h"
 #include "globals.h"
 #include "logger.h"
+#include "utils/time.h"
 #include "utils/xpanic.h"
 
+// Set by the handlers, acted on by the main loop in sig_sleep. Shutting down and
+// reopening the log take locks and join threads, none of which is safe to do in
+// a handler that may have interrupted a thread holding those locks.
+static volatile sig_atomic_t exit_signal  = 0;
+static volatile sig_atomic_t hangup       = 0;
+// Self-pipe the handlers write to, so sig_sleep wakes whichever thread the
+// signal was delivered to
+static int                   wake_fds[2] = {-1, -1};
+
+static void
+wake (void) {
+  int saved_errno = errno;
+  write(wake_fds[1], "", 1);
+  errno = saved_errno;
+}
+
 static void
 handle_exit (int sig) {
-  log_info("received a kill signal (%d); shutting down...\n", sig);
-  daemon_shutdown();
+  exit_signal = sig;
+  wake();
 }
 
 static void
@@ -64,9 +84,44 @@ handle_sigsegv (int sig, siginfo_t* info, void* context) {
 
 static void
 handle_sighup (int sig) {
-  // TODO: inotify
-  logger_reinit();
-  log_info("logfile was closed (SIGHUP); re-opened\n");
+  hangup = 1;
+  wake();
+}
+
+/**
+ * Acts on the signals received since the last call.
+ */
+static void
+handle_pending (void) {
+  if (exit_signal) {
+    log_info("received a kill signal (%d); shutting down...\n", (int)exit_signal);
+    daemon_shutdown();
+  }
+
+  if (hangup) {
+    hangup = 0;
+    // TODO: inotify
+    logger_reinit();
+    log_info("logfile was closed (SIGHUP); re-opened\n");
+  }
+}
+
+void
+sig_sleep (unsigned int secs) {
+  uint64_t deadline = get_monotonic_usec() + (uint64_t)secs * 1000000;
+  uint64_t now;
+
+  // Flags set just before we got here wrote to the pipe too, so poll returns at once
+  while ((now = get_monotonic_usec()) < deadline) {
+    struct pollfd pfd = {.fd = wake_fds[0], .events = POLLIN};
+    if (poll(&pfd, 1, (int)((deadline - now + 999) / 1000)) > 0) {
+      char drain[16];
+      while (read(wake_fds[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+
+    handle_pending();
+  }
 }
 
 static void
@@ -83,6 +138,11 @@ sigaction_init (struct sigaction* sa) {
 // TODO: reap on sigchld
 void
 sig_handlers_init (void) {
+  // Non-blocking so a flood of signals can't block a handler on a full pipe
+  if (pipe2(wake_fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+    xpanic("Failed to create signal wake pipe: %s", strerror(errno));
+  }
+
   struct sigaction sa_exit;
   sigaction_init(&sa_exit);
   sa_exit.sa_handler = handle_exit;
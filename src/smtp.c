@@ -0,0 +1,778 @@
+#include "smtp.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "constants.h"
+#include "globals.h"
+#include "logger.h"
+#include "metrics.h"
+#include "proginfo.h"
+#include "utils/xmalloc.h"
+#include "utils/xpanic.h"
+
+#undef LOG_CATEGORY
+#define LOG_CATEGORY LOG_CAT_JOB
+
+#define SMTP_BUFFER    (16 * 1024)
+#define SMTP_LINE_MAX  512
+// Messages taken off the queue per pipelined batch
+#define SMTP_BATCH     32
+// Replies outstanding at most: the previous message's final dot, RSET, MAIL,
+// RCPT and DATA
+#define SMTP_MAX_OWED  5
+
+/**
+ * A message waiting to be, or being, submitted.
+ */
+typedef struct {
+  char        *rcpt;
+  char        *subject;
+  /* Our own dup of the report */
+  int          body_fd;
+  unsigned int attempts;
+  /* Set once the relay answered DATA with 354, so the body must follow */
+  bool         data_ok;
+  /* Set once the relay accepted the message */
+  bool         delivered;
+  /* The first failure reply to the message's transaction, if any */
+  int          reject_code;
+} smtp_message;
+
+typedef enum {
+  REPLY_RSET,
+  REPLY_MAIL,
+  REPLY_RCPT,
+  REPLY_DATA,
+  /* The reply to the "." ending a message */
+  REPLY_DOT,
+} reply_kind;
+
+typedef struct {
+  reply_kind    kind;
+  smtp_message *msg;
+} owed_reply;
+
+/**
+ * The connection to the relay. Only the submitter thread touches it.
+ */
+typedef struct {
+  int          fd;
+  bool         pipelining;
+  /* Set after a failed transaction, which must be reset before the next */
+  bool         need_rset;
+  char         out[SMTP_BUFFER];
+  size_t       out_len;
+  char         in[SMTP_BUFFER];
+  size_t       in_len;
+  size_t       in_off;
+  /* Replies owed for commands sent (or buffered), in order */
+  owed_reply   owed[SMTP_MAX_OWED];
+  unsigned int n_owed;
+} smtp_conn;
+
+static bool            lmtp        = false;
+static char           *relay_host  = NULL;
+static char           *relay_port  = NULL;
+static char            sender[SMALL_BUFFER * 2];
+static char           *helo_name   = NULL;
+
+static smtp_conn       conn        = {.fd = -1};
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queue_cond  = PTHREAD_COND_INITIALIZER;
+// Signaled whenever a batch is done with
+static pthread_cond_t  idle_cond   = PTHREAD_COND_INITIALIZER;
+/* Messages waiting for the submitter i.e. List<smtp_message*> */
+static array_t        *queue       = NULL;
+static unsigned int    in_flight   = 0;
+// Set once, before the submitter starts
+static bool            started     = false;
+static mail_send_fn   *fallback    = NULL;
+
+static void
+free_message (smtp_message *m) {
+  close(m->body_fd);
+  free(m->rcpt);
+  free(m->subject);
+  free(m);
+}
+
+static retval_t
+flush_out (smtp_conn *c) {
+  for (size_t off = 0; off < c->out_len;) {
+    ssize_t n = send(c->fd, c->out + off, c->out_len - off, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      log_warn("failed to write to mail relay (reason: %s)\n", strerror(errno));
+      return ERR;
+    }
+    off += n;
+  }
+  c->out_len = 0;
+
+  return OK;
+}
+
+static retval_t
+put_bytes (smtp_conn *c, const char *s, size_t n) {
+  while (n > 0) {
+    if (c->out_len == sizeof(c->out) && flush_out(c) != OK) {
+      return ERR;
+    }
+
+    size_t take = sizeof(c->out) - c->out_len;
+    take        = take < n ? take : n;
+    memcpy(c->out + c->out_len, s, take);
+    c->out_len += take;
+    s          += take;
+    n          -= take;
+  }
+
+  return OK;
+}
+
+static retval_t
+put_fmt (smtp_conn *c, const char *fmt, ...) {
+  char    line[SMTP_LINE_MAX];
+  va_list va;
+  va_start(va, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, va);
+  va_end(va);
+
+  return put_bytes(c, line, n < (int)sizeof(line) ? (size_t)n : sizeof(line) - 1);
+}
+
+/**
+ * Buffers a command and notes the reply it's owed.
+ */
+static retval_t
+put_cmd (smtp_conn *c, reply_kind kind, smtp_message *m, const char *fmt, ...) {
+  char    line[SMTP_LINE_MAX];
+  va_list va;
+  va_start(va, fmt);
+  vsnprintf(line, sizeof(line), fmt, va);
+  va_end(va);
+
+  c->owed[c->n_owed++] = (owed_reply){.kind = kind, .msg = m};
+  return put_bytes(c, line, strlen(line));
+}
+
+/**
+ * Reads a line, without its CRLF, into `line`; overlong lines are truncated.
+ *
+ * @return int The line's length, or -1 if the connection failed.
+ */
+static int
+read_line (smtp_conn *c, char *line, size_t sz) {
+  size_t len = 0;
+
+  while (true) {
+    while (c->in_off < c->in_len) {
+      char ch = c->in[c->in_off++];
+      if (ch == '\n') {
+        if (len > 0 && line[len - 1] == '\r') {
+          len--;
+        }
+        line[len] = '\0';
+        return len;
+      }
+      if (len < sz - 1) {
+        line[len++] = ch;
+      }
+    }
+
+    ssize_t n = recv(c->fd, c->in, sizeof(c->in), 0);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      log_warn("lost connection to mail relay (reason: %s)\n", n == 0 ? "closed by relay" : strerror(errno));
+      return -1;
+    }
+    c->in_len = n;
+    c->in_off = 0;
+  }
+}
+
+/**
+ * Reads a (possibly multi-line) reply. The last line is left in `text`.
+ *
+ * @param pipelining If not NULL, set to whether any line advertises PIPELINING.
+ * @return int The reply code, or -1 if the connection failed or the reply is
+ * malformed.
+ */
+static int
+read_reply (smtp_conn *c, char *text, size_t sz, bool *pipelining) {
+  int len;
+
+  do {
+    if ((len = read_line(c, text, sz)) < 3 || !isdigit(text[0]) || !isdigit(text[1]) || !isdigit(text[2])) {
+      if (len >= 0) {
+        log_warn("malformed reply from mail relay: %s\n", text);
+      }
+      return -1;
+    }
+    if (pipelining && len >= 14 && strncasecmp(text + 4, "PIPELINING", 10) == 0) {
+      *pipelining = true;
+    }
+  } while (len > 3 && text[3] == '-');
+
+  return atoi(text);
+}
+
+static void
+hang_up (smtp_conn *c, bool quit) {
+  if (c->fd < 0) {
+    return;
+  }
+
+  if (quit) {
+    char text[SMTP_LINE_MAX];
+    c->out_len = 0;
+    if (put_fmt(c, "QUIT\r\n") == OK && flush_out(c) == OK) {
+      read_reply(c, text, sizeof(text), NULL);
+    }
+  }
+
+  close(c->fd);
+  c->fd = -1;
+}
+
+static int
+dial (void) {
+  int fd = -1;
+
+  if (lmtp) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, relay_host, sizeof(addr.sun_path) - 1);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0
+        && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      fd = -1;
+    }
+    return fd;
+  }
+
+  struct addrinfo  hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+  struct addrinfo *res;
+  int              rc;
+  if ((rc = getaddrinfo(relay_host, relay_port, &hints, &res)) != 0) {
+    log_warn("failed to resolve mail relay %s (reason: %s)\n", relay_host, gai_strerror(rc));
+    errno = EHOSTUNREACH;
+    return -1;
+  }
+
+  for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol)) >= 0
+        && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+
+  return fd;
+}
+
+/**
+ * Connects to the relay and introduces ourselves.
+ */
+static retval_t
+connect_relay (smtp_conn *c) {
+  if ((c->fd = dial()) < 0) {
+    log_warn("failed to connect to mail relay %s (reason: %s)\n", relay_host, strerror(errno));
+    return ERR;
+  }
+
+  struct timeval tv = {.tv_sec = SMTP_TIMEOUT_SECS};
+  setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  c->in_len     = 0;
+  c->in_off     = 0;
+  c->out_len    = 0;
+  c->n_owed     = 0;
+  c->need_rset  = false;
+  c->pipelining = false;
+
+  char text[SMTP_LINE_MAX];
+  int  code;
+  if ((code = read_reply(c, text, sizeof(text), NULL)) != 220) {
+    goto refused;
+  }
+
+  // LMTP has no HELO to fall back to, but all LMTP servers pipeline
+  put_fmt(c, "%s %s\r\n", lmtp ? "LHLO" : "EHLO", helo_name);
+  if (flush_out(c) != OK || (code = read_reply(c, text, sizeof(text), &c->pipelining)) < 0) {
+    goto refused;
+  }
+  if (code != 250 && !lmtp) {
+    c->pipelining = false;
+    put_fmt(c, "HELO %s\r\n", helo_name);
+    if (flush_out(c) != OK || (code = read_reply(c, text, sizeof(text), NULL)) < 0) {
+      goto refused;
+    }
+  }
+  if (code != 250) {
+    goto refused;
+  }
+
+  metrics_add(METRIC_MAIL_CONNECTIONS, 1);
+  log_info(
+    "connected to mail relay %s (%s%s)\n",
+    relay_host,
+    lmtp ? "LMTP" : "SMTP",
+    c->pipelining ? ", pipelining" : ""
+  );
+  return OK;
+
+refused:
+  if (code >= 0) {
+    log_warn("mail relay %s refused us: %s\n", relay_host, text);
+  }
+  hang_up(c, false);
+  return ERR;
+}
+
+static void
+reject (smtp_conn *c, smtp_message *m, int code, const char *text) {
+  c->need_rset = true;
+  if (m->reject_code == 0) {
+    m->reject_code = code;
+    log_warn("mail relay didn't accept the message to %s: %s\n", m->rcpt, text);
+  }
+}
+
+/**
+ * Sends everything buffered and reads every reply owed.
+ *
+ * @return retval_t ERR if the connection is no longer usable.
+ */
+static retval_t
+settle (smtp_conn *c) {
+  if (flush_out(c) != OK) {
+    return ERR;
+  }
+
+  char text[SMTP_LINE_MAX];
+  for (unsigned int i = 0; i < c->n_owed; i++) {
+    owed_reply *r    = &c->owed[i];
+    int         code = read_reply(c, text, sizeof(text), NULL);
+
+    // 421: the relay is closing the connection on us
+    if (code < 0 || code == 421) {
+      return ERR;
+    }
+
+    switch (r->kind) {
+      case REPLY_RSET: break;
+      case REPLY_MAIL:
+      case REPLY_RCPT:
+        if (code / 100 != 2) {
+          reject(c, r->msg, code, text);
+        }
+        break;
+      case REPLY_DATA:
+        if (code == 354) {
+          r->msg->data_ok = true;
+        } else {
+          reject(c, r->msg, code, text);
+        }
+        break;
+      case REPLY_DOT:
+        if (code / 100 == 2) {
+          r->msg->delivered = true;
+        } else {
+          reject(c, r->msg, code, text);
+        }
+        break;
+    }
+  }
+  c->n_owed = 0;
+
+  return OK;
+}
+
+/**
+ * Buffers a message's headers and body (dot-stuffed, with CRLF line endings)
+ * followed by the "." ending it.
+ */
+static retval_t
+put_body (smtp_conn *c, smtp_message *m) {
+  char      date[64];
+  struct tm tm;
+  time_t    now = time(NULL);
+  strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S %z", localtime_r(&now, &tm));
+
+  if (put_fmt(
+        c,
+        "From: %s\r\nTo: %s\r\nSubject: %s\r\nDate: %s\r\nAuto-Submitted: auto-generated\r\n\r\n",
+        sender,
+        m->rcpt,
+        m->subject,
+        date
+      )
+      != OK) {
+    return ERR;
+  }
+
+  char    chunk[PIPE_BUF];
+  // Escaped line starts and line endings at most double the chunk
+  char    wire[PIPE_BUF * 2];
+  char    last   = '\n';
+  off_t   offset = 0;
+  ssize_t n;
+  while ((n = pread(m->body_fd, chunk, sizeof(chunk), offset)) > 0) {
+    size_t w  = 0;
+    offset   += n;
+    for (ssize_t i = 0; i < n; i++) {
+      if (last == '\n' && chunk[i] == '.') {
+        wire[w++] = '.';
+      }
+      if (chunk[i] == '\n' && last != '\r') {
+        wire[w++] = '\r';
+      }
+      wire[w++] = chunk[i];
+      last      = chunk[i];
+    }
+    if (put_bytes(c, wire, w) != OK) {
+      return ERR;
+    }
+  }
+
+  c->owed[c->n_owed++] = (owed_reply){.kind = REPLY_DOT, .msg = m};
+  return put_fmt(c, "%s.\r\n", last == '\n' ? "" : "\r\n");
+}
+
+/**
+ * Submits a batch of messages over an open connection. When the relay
+ * pipelines, each message costs one round trip: its body and final dot go out
+ * with the next message's envelope.
+ *
+ * @return retval_t ERR if the connection was lost; messages not yet accepted
+ * are left undelivered.
+ */
+static retval_t
+submit_batch (smtp_conn *c, smtp_message **batch, unsigned int n) {
+  smtp_message *prev = NULL;
+  for (unsigned int i = 0; i < n; i++) {
+    smtp_message *m = batch[i];
+
+    if (prev && put_body(c, prev) != OK) {
+      goto broken;
+    }
+    prev = NULL;
+
+    if (c->need_rset) {
+      c->need_rset = false;
+      if (put_cmd(c, REPLY_RSET, NULL, "RSET\r\n") != OK) {
+        goto broken;
+      }
+    }
+
+    // Without pipelining, every command waits for its reply
+    if (put_cmd(c, REPLY_MAIL, m, "MAIL FROM:<%s>\r\n", sender) != OK || (!c->pipelining && settle(c) != OK)
+        || put_cmd(c, REPLY_RCPT, m, "RCPT TO:<%s>\r\n", m->rcpt) != OK || (!c->pipelining && settle(c) != OK)
+        || put_cmd(c, REPLY_DATA, m, "DATA\r\n") != OK || settle(c) != OK) {
+      goto broken;
+    }
+
+    if (m->data_ok) {
+      prev = m;
+    }
+  }
+
+  if (prev && (put_body(c, prev) != OK || settle(c) != OK)) {
+    goto broken;
+  }
+
+  return OK;
+
+broken:
+  hang_up(c, false);
+  return ERR;
+}
+
+/**
+ * Sends the given messages via the fallback and frees them. Caller must not
+ * hold the lock: the fallback may take others, which are held around
+ * `smtp_submit`.
+ *
+ * @param failed List<smtp_message*>
+ */
+static void
+hand_over (array_t *failed) {
+  foreach (failed, i) {
+    smtp_message *m = array_get_or_panic(failed, i);
+    fallback(m->rcpt, m->subject, m->body_fd);
+    free_message(m);
+  }
+  array_free(failed, NULL);
+}
+
+static void
+give_up (smtp_message *m, const char *reason, array_t *failed) {
+  log_error("giving up on mail to %s via the relay (reason: %s); spawning %s instead\n", m->rcpt, reason, opts.mail_cmd);
+  metrics_add(METRIC_MAIL_FAILED, 1);
+  array_push_or_panic(failed, m);
+}
+
+/**
+ * Settles each message of a submitted batch: frees the accepted ones, moves
+ * those given up on to `failed` and puts the rest back at the front of the
+ * queue, in order. Caller must hold the lock.
+ */
+static void
+settle_batch (smtp_message **batch, unsigned int n, array_t *failed) {
+  array_t *next = array_init_or_panic();
+
+  for (unsigned int i = 0; i < n; i++) {
+    smtp_message *m = batch[i];
+
+    if (m->delivered) {
+      metrics_add(METRIC_MAIL_SUBMITTED, 1);
+      free_message(m);
+    } else if (m->reject_code / 100 == 5) {
+      give_up(m, "rejected by relay", failed);
+    } else if (++m->attempts >= SMTP_MAX_ATTEMPTS) {
+      give_up(m, "too many attempts", failed);
+    } else {
+      m->data_ok     = false;
+      m->reject_code = 0;
+      array_push_or_panic(next, m);
+    }
+  }
+
+  foreach (queue, i) {
+    array_push_or_panic(next, array_get_or_panic(queue, i));
+  }
+  array_free(queue, NULL);
+  queue = next;
+}
+
+/**
+ * Submits queued messages to the relay, keeping the connection open between
+ * batches until it has been idle for SMTP_IDLE_SECS.
+ */
+static void *
+submit_routine (void *arg __attribute__((unused))) {
+  smtp_message *batch[SMTP_BATCH];
+
+  while (true) {
+    pthread_mutex_lock(&queue_mutex);
+    while (array_size(queue) == 0) {
+      if (conn.fd < 0) {
+        pthread_cond_wait(&queue_cond, &queue_mutex);
+        continue;
+      }
+
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += SMTP_IDLE_SECS;
+      if (pthread_cond_timedwait(&queue_cond, &queue_mutex, &deadline) == ETIMEDOUT && array_size(queue) == 0) {
+        pthread_mutex_unlock(&queue_mutex);
+        hang_up(&conn, true);
+        pthread_mutex_lock(&queue_mutex);
+      }
+    }
+
+    unsigned int n = 0;
+    while (n < SMTP_BATCH && array_size(queue) > 0) {
+      batch[n++] = array_get_or_panic(queue, 0);
+      array_remove(queue, 0);
+    }
+    in_flight = n;
+    pthread_mutex_unlock(&queue_mutex);
+
+    // A connection lost mid-batch is retried right away, on a new one
+    bool reachable = conn.fd >= 0 || connect_relay(&conn) == OK;
+    if (reachable) {
+      submit_batch(&conn, batch, n);
+    }
+
+    array_t *failed = array_init_or_panic();
+    pthread_mutex_lock(&queue_mutex);
+    settle_batch(batch, n, failed);
+    pthread_mutex_unlock(&queue_mutex);
+
+    // Still in flight until handed over, so smtp_drain waits for it
+    hand_over(failed);
+
+    pthread_mutex_lock(&queue_mutex);
+    in_flight = 0;
+    pthread_cond_broadcast(&idle_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    if (!reachable) {
+      sleep(SMTP_RETRY_SECS);
+    }
+  }
+
+  return NULL;
+}
+
+static void
+submit_routine_init (void) {
+  pthread_t      thread_id;
+  pthread_attr_t attr;
+  int            rc = pthread_attr_init(&attr);
+  if (rc != 0) {
+    xpanic("pthread_attr_init failed with rc %d\n", rc);
+  }
+  if ((rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) != 0) {
+    xpanic("pthread_attr_setdetachstate failed with rc %d\n", rc);
+  }
+  if ((rc = pthread_create(&thread_id, &attr, submit_routine, NULL)) != 0) {
+    xpanic("pthread_create failed with rc %d\n", rc);
+  }
+}
+
+/**
+ * Splits `opts.mail_relay` into the relay's host (or socket path) and port.
+ */
+static retval_t
+parse_relay (const char *relay) {
+  if (*relay == '/') {
+    lmtp       = true;
+    relay_host = s_copy_or_panic(relay);
+    return strlen(relay) < sizeof(((struct sockaddr_un *)0)->sun_path) ? OK : ERR;
+  }
+
+  // [v6 address]:port
+  const char *host_end = relay[0] == '[' ? strchr(relay, ']') : strrchr(relay, ':');
+  const char *port     = host_end ? strchr(host_end, ':') : NULL;
+  if (relay[0] == '[' && !host_end) {
+    return ERR;
+  }
+
+  const char *host   = relay[0] == '[' ? relay + 1 : relay;
+  size_t      len    = host_end ? (size_t)(host_end - host) : strlen(host);
+  relay_host         = s_copy_or_panic(host);
+  relay_host[len]    = '\0';
+  relay_port         = s_copy_or_panic(port && port[1] ? port + 1 : SMTP_PORT);
+
+  return len > 0 ? OK : ERR;
+}
+
+retval_t
+smtp_init (mail_send_fn *send) {
+  if (!opts.mail_relay) {
+    return ERR;
+  }
+
+  if (parse_relay(opts.mail_relay) != OK) {
+    log_error("invalid mail relay address '%s'; spawning %s instead\n", opts.mail_relay, opts.mail_cmd);
+    return ERR;
+  }
+
+  helo_name = *proginfo.hostname ? proginfo.hostname : "localhost";
+  snprintf(sender, sizeof(sender), "%s@%s", DAEMON_IDENT, helo_name);
+
+  queue     = array_init_or_panic();
+  fallback  = send;
+  started   = true;
+  submit_routine_init();
+
+  log_info("submitting mail to %s\n", opts.mail_relay);
+  return OK;
+}
+
+retval_t
+smtp_submit (const char *mailto, const char *subject, int body_fd) {
+  if (!started) {
+    return ERR;
+  }
+
+  // Would let MAILTO smuggle in commands or extra recipients
+  if (strpbrk(mailto, "\r\n<> \t,")) {
+    log_warn("not submitting mail to invalid recipient '%s'\n", mailto);
+    return ERR;
+  }
+
+  int fd;
+  if ((fd = fcntl(body_fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+    log_warn("failed to queue mail to %s (reason: %s)\n", mailto, strerror(errno));
+    return ERR;
+  }
+
+  smtp_message *m = xmalloc(sizeof(smtp_message));
+  m->rcpt         = strchr(mailto, '@') ? s_copy_or_panic(mailto) : s_fmt("%s@%s", mailto, helo_name);
+  m->subject      = s_copy_or_panic(subject);
+  m->body_fd      = fd;
+  m->attempts     = 0;
+  m->data_ok      = false;
+  m->delivered    = false;
+  m->reject_code  = 0;
+
+  pthread_mutex_lock(&queue_mutex);
+  // Every queued message holds an open report; past the cap, spawning the mail
+  // program is the better way to wait on a slow relay
+  if (array_size(queue) + in_flight >= SMTP_MAX_QUEUED) {
+    pthread_mutex_unlock(&queue_mutex);
+    log_warn("mail relay queue is full; not queueing mail to %s\n", mailto);
+    free_message(m);
+    return ERR;
+  }
+  array_push_or_panic(queue, m);
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+
+  return OK;
+}
+
+retval_t
+smtp_drain (unsigned int timeout_secs) {
+  if (!started) {
+    return OK;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_secs;
+
+  pthread_mutex_lock(&queue_mutex);
+  while (array_size(queue) > 0 || in_flight > 0) {
+    if (pthread_cond_timedwait(&idle_cond, &queue_mutex, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+
+  if (array_size(queue) == 0 && in_flight == 0) {
+    pthread_mutex_unlock(&queue_mutex);
+    return OK;
+  }
+
+  array_t     *left = queue;
+  unsigned int busy = in_flight;
+  queue             = array_init_or_panic();
+  pthread_mutex_unlock(&queue_mutex);
+
+  log_warn(
+    "mail relay didn't drain in %us; spawning %s for %zu queued message(s), %u still in flight\n",
+    timeout_secs,
+    opts.mail_cmd,
+    array_size(left),
+    busy
+  );
+  hand_over(left);
+
+  return ERR;
+}
@@ -0,0 +1,150 @@
+#include "status.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "logger.h"
+
+#define STATUS_GUARD \
+  if (!shm) {        \
+    return;          \
+  }
+
+static status_shm     *shm = NULL;
+// Serializes writers (the main loop and the reaper); readers never lock.
+static pthread_mutex_t status_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void
+write_begin (void) {
+  pthread_mutex_lock(&status_mutex);
+
+  uint64_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+  atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static inline void
+write_end (void) {
+  shm->updated_at = time(NULL);
+
+  uint64_t seq    = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+  atomic_store_explicit(&shm->seq, seq + 1, memory_order_release);
+
+  pthread_mutex_unlock(&status_mutex);
+}
+
+void
+status_init (void) {
+  if (!opts.status_shm) {
+    return;
+  }
+
+  int fd;
+  if ((fd = open(opts.status_shm, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644)) < 0) {
+    log_warn("failed to open status segment %s (reason: %s)\n", opts.status_shm, strerror(errno));
+    return;
+  }
+
+  // Make sure it's readable by monitors regardless of our umask
+  fchmod(fd, 0644);
+
+  if (ftruncate(fd, sizeof(status_shm)) < 0) {
+    log_warn("failed to size status segment %s (reason: %s)\n", opts.status_shm, strerror(errno));
+    close(fd);
+    return;
+  }
+
+  void *addr = mmap(NULL, sizeof(status_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (addr == MAP_FAILED) {
+    log_warn("failed to map status segment %s (reason: %s)\n", opts.status_shm, strerror(errno));
+    return;
+  }
+
+  shm             = addr;
+  shm->magic      = STATUS_SHM_MAGIC;
+  shm->version    = STATUS_SHM_VERSION;
+  shm->pid        = proginfo.pid;
+  shm->start_time = proginfo.start->tv_sec;
+  shm->max_jobs   = STATUS_SHM_MAX_JOBS;
+  shm->updated_at = time(NULL);
+
+  log_info("publishing status segment at %s\n", opts.status_shm);
+}
+
+void
+status_job_started (job_t *job) {
+  STATUS_GUARD
+
+  write_begin();
+
+  shm->jobs_launched++;
+  shm->running_jobs++;
+
+  for (unsigned int i = 0; i < STATUS_SHM_MAX_JOBS; i++) {
+    status_job *slot = &shm->jobs[i];
+    if (slot->pid == 0) {
+      slot->pid        = job->pid;
+      slot->started_at = time(NULL);
+      ident_format(job->id, slot->ident);
+      strncpy(slot->cmd, job->cmd, sizeof(slot->cmd) - 1);
+      break;
+    }
+  }
+
+  write_end();
+}
+
+void
+status_job_exited (job_t *job) {
+  STATUS_GUARD
+
+  write_begin();
+
+  shm->jobs_exited++;
+  if (job->ret != 0) {
+    shm->jobs_failed++;
+  }
+  if (shm->running_jobs > 0) {
+    shm->running_jobs--;
+  }
+
+  // By the time a job is reaped its pid has been cleared, so match on ident
+  char ident[IDENT_STR_LEN];
+  ident_format(job->id, ident);
+  for (unsigned int i = 0; i < STATUS_SHM_MAX_JOBS; i++) {
+    status_job *slot = &shm->jobs[i];
+    if (slot->pid != 0 && strcmp(slot->ident, ident) == 0) {
+      memset(slot, 0, sizeof(status_job));
+      break;
+    }
+  }
+
+  write_end();
+}
+
+void
+status_tick (time_t ts) {
+  STATUS_GUARD
+
+  write_begin();
+  shm->last_tick = ts;
+  shm->ticks++;
+  write_end();
+}
+
+void
+status_close (void) {
+  STATUS_GUARD
+
+  munmap(shm, sizeof(status_shm));
+  shm = NULL;
+  unlink(opts.status_shm);
+}
@@ -7,7 +7,9 @@
 
 void
 user_init (void) {
-  usr.uid   = getuid();
-  usr.root  = usr.uid == 0;
-  usr.uname = getpwuid(usr.uid)->pw_name;
+  struct passwd* pw = getpwuid(getuid());
+  usr.uid           = pw->pw_uid;
+  usr.root          = usr.uid == 0;
+  usr.uname         = pw->pw_name;
+  usr.home          = pw->pw_dir;
 }
@@ -0,0 +1,119 @@
+#include "utils/arena.h"
+
+#include <stdarg.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/xmalloc.h"
+
+#define ARENA_ALIGN     alignof(max_align_t)
+// First chunk size. Later chunks are half the arena's size so far, up to
+// ARENA_CHUNK_MAX: gentler than doubling, as the last chunk's unused tail is
+// wasted, and a crontab's arena is never added to once it's built.
+#define ARENA_CHUNK_MIN 1024
+#define ARENA_CHUNK_MAX (64 * 1024)
+
+struct arena_chunk {
+  arena_chunk *next;
+  size_t       size;
+  size_t       used;
+  alignas(ARENA_ALIGN) char data[];
+};
+
+static inline size_t
+arena_round (size_t sz, size_t align) {
+  return (sz + align - 1) & ~(align - 1);
+}
+
+static arena_chunk *
+arena_chunk_new (size_t size, arena_chunk *next) {
+  arena_chunk *c = xmalloc(sizeof(arena_chunk) + size);
+  c->next        = next;
+  c->size        = size;
+  c->used        = 0;
+
+  return c;
+}
+
+arena_t *
+arena_init (void) {
+  arena_chunk *c     = arena_chunk_new(ARENA_CHUNK_MIN, NULL);
+  arena_t     *arena = (arena_t *)c->data;
+  c->used            = sizeof(arena_t);
+  arena->chunk       = c;
+  arena->reserved    = sizeof(arena_chunk) + ARENA_CHUNK_MIN;
+
+  return arena;
+}
+
+/**
+ * Returns `sz` bytes aligned to `align`, a power of two no greater than
+ * ARENA_ALIGN.
+ */
+static void *
+arena_bump (arena_t *arena, size_t sz, size_t align) {
+  arena_chunk *c   = arena->chunk;
+  size_t       off = arena_round(c->used, align);
+
+  if (off > c->size || c->size - off < sz) {
+    size_t size = arena->reserved / 2;
+    size        = size < ARENA_CHUNK_MIN ? ARENA_CHUNK_MIN : size > ARENA_CHUNK_MAX ? ARENA_CHUNK_MAX : size;
+    if (size < sz) {
+      // Too big to share a chunk. Put it behind the current one, which may
+      // still have room.
+      c->next          = arena_chunk_new(sz, c->next);
+      c->next->used    = sz;
+      arena->reserved += sizeof(arena_chunk) + sz;
+      return c->next->data;
+    }
+
+    c                = arena_chunk_new(size, c);
+    arena->chunk     = c;
+    arena->reserved += sizeof(arena_chunk) + size;
+    off              = 0;
+  }
+
+  c->used = off + sz;
+
+  return c->data + off;
+}
+
+void *
+arena_alloc (arena_t *arena, size_t sz) {
+  return arena_bump(arena, sz, ARENA_ALIGN);
+}
+
+char *
+arena_strdup (arena_t *arena, const char *s) {
+  size_t len = strlen(s) + 1;
+  return memcpy(arena_bump(arena, len, 1), s, len);
+}
+
+char *
+arena_fmt (arena_t *arena, const char *fmt, ...) {
+  va_list args, args2;
+  va_start(args, fmt);
+  va_copy(args2, args);
+
+  int   len = vsnprintf(NULL, 0, fmt, args);
+  char *s   = arena_bump(arena, len + 1, 1);
+  vsnprintf(s, len + 1, fmt, args2);
+
+  va_end(args2);
+  va_end(args);
+
+  return s;
+}
+
+void
+arena_free (arena_t *arena) {
+  // The arena lives in its first chunk, the last in the list
+  arena_chunk *c = arena->chunk;
+  while (c) {
+    arena_chunk *next = c->next;
+    free(c);
+    c = next;
+  }
+}
@@ -0,0 +1,331 @@
+#include "utils/encoder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/time.h"
+#include "utils/xpanic.h"
+
+#define MP_FALSE      0xc2
+#define MP_TRUE       0xc3
+#define MP_UINT8      0xcc
+#define MP_UINT16     0xcd
+#define MP_UINT32     0xce
+#define MP_UINT64     0xcf
+#define MP_INT8       0xd0
+#define MP_INT16      0xd1
+#define MP_INT32      0xd2
+#define MP_INT64      0xd3
+#define MP_FIXEXT4    0xd6
+#define MP_FIXEXT8    0xd7
+#define MP_EXT8       0xc7
+#define MP_STR8       0xd9
+#define MP_STR16      0xda
+#define MP_STR32      0xdb
+#define MP_ARRAY16    0xdc
+#define MP_ARRAY32    0xdd
+#define MP_MAP16      0xde
+#define MP_MAP32      0xdf
+#define MP_FIXSTR     0xa0
+#define MP_FIXARRAY   0x90
+#define MP_FIXMAP     0x80
+#define MP_TIMESTAMP  0xff  // ext type -1
+
+static inline void
+flush (encoder_t *enc) {
+  if (enc->len) {
+    buffer_append_with(enc->out, enc->staging, enc->len);
+    enc->len = 0;
+  }
+}
+
+static inline void
+put (encoder_t *enc, const void *p, size_t len) {
+  if (enc->len + len > sizeof(enc->staging)) {
+    flush(enc);
+    if (len > sizeof(enc->staging)) {
+      buffer_append_with(enc->out, p, len);
+      return;
+    }
+  }
+  memcpy(enc->staging + enc->len, p, len);
+  enc->len += len;
+}
+
+static inline void
+put_byte (encoder_t *enc, uint8_t b) {
+  if (enc->len == sizeof(enc->staging)) {
+    flush(enc);
+  }
+  enc->staging[enc->len++] = (char)b;
+}
+
+/**
+ * Writes a type byte followed by `width` bytes of `v`, big-endian.
+ */
+static inline void
+put_be (encoder_t *enc, uint8_t type, uint64_t v, unsigned int width) {
+  uint8_t b[9];
+  b[0] = type;
+  for (unsigned int i = 0; i < width; i++) {
+    b[width - i] = (uint8_t)(v >> (i * 8));
+  }
+  put(enc, b, width + 1);
+}
+
+/**
+ * Writes a container or string header: the fix variant when `size` fits in
+ * `fix_max`, else the 8/16/32-bit variant.
+ */
+static inline void
+put_header (encoder_t *enc, uint32_t size, uint8_t fix, uint32_t fix_max, int t8, uint8_t t16, uint8_t t32) {
+  if (size <= fix_max) {
+    put_byte(enc, fix | (uint8_t)size);
+  } else if (t8 >= 0 && size <= UINT8_MAX) {
+    put_be(enc, (uint8_t)t8, size, 1);
+  } else if (size <= UINT16_MAX) {
+    put_be(enc, t16, size, 2);
+  } else {
+    put_be(enc, t32, size, 4);
+  }
+}
+
+/**
+ * Emits the JSON separator for a new value and counts it. Keys in maps are
+ * separated in `enc_key` instead.
+ */
+static inline void
+before_value (encoder_t *enc) {
+  if (enc->depth == 0 || enc->is_map[enc->depth - 1]) {
+    return;
+  }
+
+  if (enc->format == ENC_JSON && enc->n[enc->depth - 1] > 0) {
+    put_byte(enc, ',');
+  }
+  enc->n[enc->depth - 1]++;
+}
+
+static void
+open_container (encoder_t *enc, uint32_t size, bool is_map) {
+  before_value(enc);
+
+  if (enc->depth == ENCODER_MAX_DEPTH) {
+    xpanic("encoder nesting exceeds %d levels - this is a bug\n", ENCODER_MAX_DEPTH);
+  }
+  enc->is_map[enc->depth] = is_map;
+  enc->size[enc->depth]   = size;
+  enc->n[enc->depth]      = 0;
+  enc->depth++;
+
+  if (enc->format == ENC_JSON) {
+    put_byte(enc, is_map ? '{' : '[');
+  } else if (is_map) {
+    put_header(enc, size, MP_FIXMAP, 15, -1, MP_MAP16, MP_MAP32);
+  } else {
+    put_header(enc, size, MP_FIXARRAY, 15, -1, MP_ARRAY16, MP_ARRAY32);
+  }
+}
+
+retval_t
+enc_format_parse (const char *name, enc_format *format) {
+  if (strcmp(name, "json") == 0) {
+    *format = ENC_JSON;
+  } else if (strcmp(name, "msgpack") == 0) {
+    *format = ENC_MSGPACK;
+  } else {
+    return ERR;
+  }
+
+  return OK;
+}
+
+void
+enc_init (encoder_t *enc, buffer_t *out, enc_format format) {
+  enc->out    = out;
+  enc->format = format;
+  enc->depth  = 0;
+  enc->len    = 0;
+}
+
+void
+enc_map (encoder_t *enc, uint32_t size) {
+  open_container(enc, size, true);
+}
+
+void
+enc_array (encoder_t *enc, uint32_t size) {
+  open_container(enc, size, false);
+}
+
+void
+enc_end (encoder_t *enc) {
+  if (enc->depth == 0) {
+    xpanic("%s\n", "enc_end called without an open container - this is a bug");
+  }
+  enc->depth--;
+
+  // A size mismatch would silently corrupt MessagePack output
+  if (enc->n[enc->depth] != enc->size[enc->depth]) {
+    xpanic(
+      "encoder container declared %u items but got %u - this is a bug\n",
+      enc->size[enc->depth],
+      enc->n[enc->depth]
+    );
+  }
+
+  if (enc->format == ENC_JSON) {
+    put_byte(enc, enc->is_map[enc->depth] ? '}' : ']');
+  }
+}
+
+static void
+put_json_str (encoder_t *enc, const char *s) {
+  static const char hex[] = "0123456789abcdef";
+
+  put_byte(enc, '"');
+
+  const char *run = s;
+  for (; *s; s++) {
+    unsigned char c = *s;
+    if (c > 0x1F && c != '"' && c != '\\') {
+      continue;
+    }
+
+    put(enc, run, s - run);
+    if (c == '"' || c == '\\') {
+      char esc[2] = {'\\', c};
+      put(enc, esc, 2);
+    } else {
+      char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+      put(enc, esc, 6);
+    }
+    run = s + 1;
+  }
+  put(enc, run, s - run);
+
+  put_byte(enc, '"');
+}
+
+void
+enc_key (encoder_t *enc, const char *key) {
+  if (enc->depth == 0 || !enc->is_map[enc->depth - 1]) {
+    xpanic("%s\n", "enc_key called outside of a map - this is a bug");
+  }
+
+  if (enc->format == ENC_JSON) {
+    if (enc->n[enc->depth - 1] > 0) {
+      put_byte(enc, ',');
+    }
+    put_json_str(enc, key);
+    put_byte(enc, ':');
+  } else {
+    uint32_t len = strlen(key);
+    put_header(enc, len, MP_FIXSTR, 31, MP_STR8, MP_STR16, MP_STR32);
+    put(enc, key, len);
+  }
+  enc->n[enc->depth - 1]++;
+}
+
+void
+enc_str (encoder_t *enc, const char *s) {
+  before_value(enc);
+
+  if (enc->format == ENC_JSON) {
+    put_json_str(enc, s);
+  } else {
+    uint32_t len = strlen(s);
+    put_header(enc, len, MP_FIXSTR, 31, MP_STR8, MP_STR16, MP_STR32);
+    put(enc, s, len);
+  }
+}
+
+void
+enc_int (encoder_t *enc, int64_t v) {
+  before_value(enc);
+
+  if (enc->format == ENC_JSON) {
+    char num[24];
+    put(enc, num, snprintf(num, sizeof(num), "%ld", (long)v));
+    return;
+  }
+
+  if (v >= 0) {
+    uint64_t u = v;
+    if (u < 128) {
+      put_byte(enc, (uint8_t)u);
+    } else if (u <= UINT8_MAX) {
+      put_be(enc, MP_UINT8, u, 1);
+    } else if (u <= UINT16_MAX) {
+      put_be(enc, MP_UINT16, u, 2);
+    } else if (u <= UINT32_MAX) {
+      put_be(enc, MP_UINT32, u, 4);
+    } else {
+      put_be(enc, MP_UINT64, u, 8);
+    }
+  } else if (v >= -32) {
+    put_byte(enc, (uint8_t)(int8_t)v);
+  } else if (v >= INT8_MIN) {
+    put_be(enc, MP_INT8, (uint64_t)v, 1);
+  } else if (v >= INT16_MIN) {
+    put_be(enc, MP_INT16, (uint64_t)v, 2);
+  } else if (v >= INT32_MIN) {
+    put_be(enc, MP_INT32, (uint64_t)v, 4);
+  } else {
+    put_be(enc, MP_INT64, (uint64_t)v, 8);
+  }
+}
+
+void
+enc_bool (encoder_t *enc, bool v) {
+  before_value(enc);
+
+  if (enc->format == ENC_JSON) {
+    put(enc, v ? "true" : "false", v ? 4 : 5);
+  } else {
+    put_byte(enc, v ? MP_TRUE : MP_FALSE);
+  }
+}
+
+void
+enc_time (encoder_t *enc, time_t ts) {
+  if (enc->format == ENC_JSON) {
+    char   s[TIME_STR_LEN + 8];
+    size_t len = format_time_str(s, ts, 0);
+
+    before_value(enc);
+    if (!len) {
+      put(enc, "null", 4);
+      return;
+    }
+    put_byte(enc, '"');
+    put(enc, s, len);
+    put_byte(enc, '"');
+    return;
+  }
+
+  before_value(enc);
+
+  if (ts >= 0 && ts <= UINT32_MAX) {
+    // timestamp 32
+    uint8_t b[6] = {MP_FIXEXT4, MP_TIMESTAMP, ts >> 24, ts >> 16, ts >> 8, ts};
+    put(enc, b, sizeof(b));
+  } else if (ts >= 0 && (uint64_t)ts < (1ull << 34)) {
+    // timestamp 64 with zero nanoseconds
+    uint8_t b[10] = {MP_FIXEXT8, MP_TIMESTAMP, 0, 0, 0, ts >> 32, ts >> 24, ts >> 16, ts >> 8, ts};
+    put(enc, b, sizeof(b));
+  } else {
+    // timestamp 96: 32-bit nanoseconds then 64-bit signed seconds
+    uint8_t  b[15] = {MP_EXT8, 12, MP_TIMESTAMP, 0, 0, 0, 0};
+    uint64_t s     = (uint64_t)(int64_t)ts;
+    for (unsigned int i = 0; i < 8; i++) {
+      b[14 - i] = (uint8_t)(s >> (i * 8));
+    }
+    put(enc, b, sizeof(b));
+  }
+}
+
+void
+enc_finish (encoder_t *enc) {
+  flush(enc);
+}
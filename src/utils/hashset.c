@@ -0,0 +1,80 @@
+#include "utils/hashset.h"
+
+#include <string.h>
+
+#include "utils/xmalloc.h"
+
+#define HASHSET_MIN_CAPACITY 64
+
+static inline size_t
+home_of (const hashset_t *set, const void *item) {
+  return set->hash_of(item) & (set->capacity - 1);
+}
+
+static void
+hashset_resize (hashset_t *set, size_t new_capacity) {
+  void **old     = set->slots;
+  size_t old_cap = set->capacity;
+
+  set->slots     = xmalloc(new_capacity * sizeof(void *));
+  set->capacity  = new_capacity;
+  memset(set->slots, 0, new_capacity * sizeof(void *));
+
+  for (size_t i = 0; i < old_cap; i++) {
+    if (old[i]) {
+      size_t j = home_of(set, old[i]);
+      while (set->slots[j]) {
+        j = (j + 1) & (set->capacity - 1);
+      }
+      set->slots[j] = old[i];
+    }
+  }
+
+  free(old);
+}
+
+void
+hashset_reserve (hashset_t *set) {
+  if ((set->count + 1) * 2 > set->capacity) {
+    hashset_resize(set, set->capacity ? set->capacity * 2 : HASHSET_MIN_CAPACITY);
+  }
+}
+
+void **
+hashset_probe (hashset_t *set, uint64_t hash, hashset_eq_fn *eq, const void *key) {
+  size_t i = hash & (set->capacity - 1);
+  for (; set->slots[i]; i = (i + 1) & (set->capacity - 1)) {
+    if (set->hash_of(set->slots[i]) == hash && eq(set->slots[i], key)) {
+      break;
+    }
+  }
+
+  return &set->slots[i];
+}
+
+void
+hashset_insert (hashset_t *set, void **slot, void *item) {
+  *slot = item;
+  set->count++;
+}
+
+void
+hashset_remove (hashset_t *set, const void *item) {
+  size_t mask = set->capacity - 1;
+  size_t i    = home_of(set, item);
+  while (set->slots[i] != item) {
+    i = (i + 1) & mask;
+  }
+
+  // Backward-shift deletion: pull later entries of the probe run into the hole
+  for (size_t j = (i + 1) & mask; set->slots[j]; j = (j + 1) & mask) {
+    size_t home = home_of(set, set->slots[j]);
+    // Move it unless its home lies cyclically in (i, j]
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      set->slots[i] = set->slots[j];
+      i             = j;
+    }
+  }
+  set->slots[i] = NULL;
+  set->count--;
+}
@@ -0,0 +1,129 @@
+#include "utils/ident.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "globals.h"
+
+#define UUID_VERSION 0x80
+#define UUID_VARIANT 0x80
+
+static pthread_once_t       ident_once = PTHREAD_ONCE_INIT;
+static atomic_uint_fast64_t next_ident;
+
+static void
+ident_init (void) {
+  atomic_init(&next_ident, (uint64_t)time(NULL) << 32);
+}
+
+ident_t
+ident_next (void) {
+  pthread_once(&ident_once, ident_init);
+  return atomic_fetch_add_explicit(&next_ident, 1, memory_order_relaxed);
+}
+
+/*
+ * The UUID form is RFC 9562 version 8 (custom) with the ident's top 48 bits in
+ * custom_a, the next 12 in custom_b and the low 4 at the top of custom_c.
+ */
+void
+ident_to_uuid (ident_t id, uint8_t out[16]) {
+  memset(out, 0, 16);
+  for (unsigned int i = 0; i < 6; i++) {
+    out[i] = id >> (56 - i * 8);
+  }
+  out[6] = UUID_VERSION | ((id >> 12) & 0x0f);
+  out[7] = id >> 4;
+  out[8] = UUID_VARIANT | ((id & 0x0f) << 2);
+}
+
+char *
+ident_format (ident_t id, char buf[IDENT_STR_LEN]) {
+  static const char hex[] = "0123456789abcdef";
+
+  // By hand: snprintf costs more than generating the id
+  if (!opts.uuid_ids) {
+    for (unsigned int i = 0; i < 16; i++) {
+      buf[i] = hex[(id >> (60 - i * 4)) & 0x0f];
+    }
+    buf[16] = '\0';
+    return buf;
+  }
+
+  uint8_t u[16];
+  char   *p = buf;
+  ident_to_uuid(id, u);
+
+  for (unsigned int i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      *p++ = '-';
+    }
+    *p++ = hex[u[i] >> 4];
+    *p++ = hex[u[i] & 0x0f];
+  }
+  *p = '\0';
+
+  return buf;
+}
+
+static int
+hex_value (char c) {
+  return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+retval_t
+ident_parse (const char *s, ident_t *id) {
+  size_t len = strlen(s);
+
+  if (len == 16) {
+    ident_t v = 0;
+    for (unsigned int i = 0; i < 16; i++) {
+      int d;
+      if ((d = hex_value(s[i])) < 0) {
+        return ERR;
+      }
+      v = v << 4 | d;
+    }
+    *id = v;
+    return OK;
+  }
+
+  if (len != IDENT_STR_LEN - 1) {
+    return ERR;
+  }
+
+  uint8_t u[16];
+  for (unsigned int i = 0, n = 0; i < len; i++) {
+    if (i == 8 || i == 13 || i == 18 || i == 23) {
+      if (s[i] != '-') {
+        return ERR;
+      }
+      continue;
+    }
+    int hi = hex_value(s[i]), lo = hex_value(s[++i]);
+    if (hi < 0 || lo < 0) {
+      return ERR;
+    }
+    u[n++] = hi << 4 | lo;
+  }
+
+  // Only UUIDs we rendered
+  if ((u[6] & 0xf0) != UUID_VERSION || (u[8] & 0xc3) != UUID_VARIANT) {
+    return ERR;
+  }
+  for (unsigned int i = 9; i < 16; i++) {
+    if (u[i] != 0) {
+      return ERR;
+    }
+  }
+
+  ident_t v = 0;
+  for (unsigned int i = 0; i < 6; i++) {
+    v = v << 8 | u[i];
+  }
+  *id = v << 16 | (ident_t)(u[6] & 0x0f) << 12 | (ident_t)u[7] << 4 | (u[8] >> 2 & 0x0f);
+
+  return OK;
+}
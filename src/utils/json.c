@@ -82,7 +82,7 @@ parse_json (const char* json, hash_table* pairs) {
     } else {
       value_start = start;
       while (*start && *start != ',' && !isspace((unsigned char)*start)) {
-        start;
+        start++;
       }
     }
     char* value = value_start;
@@ -98,7 +98,7 @@ regex_matches (pcre *re, char *cmp) {
 
 // ??? typedef enum { Match, NoMatch } MatchResult;
 bool
-match_variable (char *line, hash_table *vars) {
+match_variable (char *line, hash_table *vars, arena_t *arena) {
   pcre *re = regex_cache_get(get_regex_cache(), VARIABLE_PATTERN);
   if (!re) {
     xpanic("[%s@L%d] an error occurred when compiling regex\n", __func__, __LINE__);
@@ -106,7 +106,7 @@ match_variable (char *line, hash_table *vars) {
 
   array_t *matches = regex_matches(re, line);
   if (matches && array_size(matches) == 3) {
-    ht_insert(vars, s_copy_or_panic(array_get_or_panic(matches, 1)), s_copy_or_panic(array_get_or_panic(matches, 2)));
+    ht_insert(vars, array_get_or_panic(matches, 1), arena_strdup(arena, array_get_or_panic(matches, 2)));
     array_free(matches, free);
 
     return true;
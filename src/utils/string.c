@@ -2,13 +2,6 @@
 
 #include <ctype.h>
 #include <string.h>
-#include <uuid/uuid.h>
-
-#include "utils/xpanic.h"
-
-#ifndef UUID_STR_LEN
-#  define UUID_STR_LEN 37
-#endif
 
 char*
 trim_whitespace (char* str) {
@@ -36,14 +29,3 @@ replace_tabs_with_spaces (char* str) {
     }
   }
 }
-
-char*
-create_uuid (void) {
-  char uuid[UUID_STR_LEN];
-
-  uuid_t bin_uuid;
-  uuid_generate_random(bin_uuid);
-  uuid_unparse(bin_uuid, uuid);
-
-  return s_copy_or_panic(uuid);
-}
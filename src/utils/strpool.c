@@ -0,0 +1,89 @@
+#include "utils/strpool.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libhash/hash.h"
+#include "utils/hashset.h"
+#include "utils/xmalloc.h"
+
+typedef struct {
+  uint64_t     hash;
+  unsigned int refs;
+  char         s[];
+} pooled_str;
+
+static uint64_t
+str_hash_of (const void *item) {
+  return ((const pooled_str *)item)->hash;
+}
+
+static bool
+str_eq (const void *item, const void *key) {
+  return strcmp(((const pooled_str *)item)->s, key) == 0;
+}
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static hashset_t       pool       = {.hash_of = str_hash_of};
+
+static inline pooled_str *
+pooled (const char *s) {
+  return (pooled_str *)(s - offsetof(pooled_str, s));
+}
+
+const char *
+strpool_intern (const char *s) {
+  uint64_t hash = h_hash_key(s);
+
+  pthread_mutex_lock(&pool_mutex);
+
+  hashset_reserve(&pool);
+  void **slot = hashset_probe(&pool, hash, str_eq, s);
+  if (*slot) {
+    pooled_str *p = *slot;
+    p->refs++;
+    pthread_mutex_unlock(&pool_mutex);
+    return p->s;
+  }
+
+  size_t      len = strlen(s) + 1;
+  pooled_str *p   = xmalloc(sizeof(pooled_str) + len);
+  p->hash         = hash;
+  p->refs         = 1;
+  memcpy(p->s, s, len);
+
+  hashset_insert(&pool, slot, p);
+
+  pthread_mutex_unlock(&pool_mutex);
+
+  return p->s;
+}
+
+void
+strpool_release (const char *s) {
+  pooled_str *p = pooled(s);
+
+  pthread_mutex_lock(&pool_mutex);
+
+  if (--p->refs > 0) {
+    pthread_mutex_unlock(&pool_mutex);
+    return;
+  }
+
+  hashset_remove(&pool, p);
+
+  pthread_mutex_unlock(&pool_mutex);
+
+  free(p);
+}
+
+size_t
+strpool_count (void) {
+  pthread_mutex_lock(&pool_mutex);
+  size_t n = pool.count;
+  pthread_mutex_unlock(&pool_mutex);
+
+  return n;
+}
@@ -27,38 +27,66 @@ get_time (struct timespec* ts) {
 #endif
 }
 
+uint64_t
+get_monotonic_usec (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+size_t
+format_time_str (char* buf, time_t sec, long msec) {
+  // A log burst at the top of the minute shares the same second across
+  // thousands of lines, so gmtime/strftime only run when the second changes
+  static _Thread_local time_t cached_sec = 0;
+  static _Thread_local size_t cached_len = 0;
+  static _Thread_local char   cached[TIME_STR_LEN + 8];
+
+  if (cached_len == 0 || sec != cached_sec) {
+    struct tm tm_buf;
+    if (!gmtime_r(&sec, &tm_buf)) {
+      return 0;
+    }
+
+    cached_len = strftime(cached, sizeof(cached), "%Y-%m-%dT%H:%M:%S.000Z", &tm_buf);
+    if (cached_len == 0) {
+      return 0;
+    }
+    cached_sec = sec;
+  }
+
+  memcpy(buf, cached, cached_len + 1);
+
+  // Patch the "000" before the trailing 'Z'
+  char* ms = buf + cached_len - 4;
+  ms[0]    = '0' + msec / 100 % 10;
+  ms[1]    = '0' + msec / 10 % 10;
+  ms[2]    = '0' + msec % 10;
+
+  return cached_len;
+}
+
 char*
 to_time_str_secs (time_t ts) {
-  struct tm* utc_time = gmtime(&ts);
-  if (!utc_time) {
+  char buf[TIME_STR_LEN + 8];
+  if (!format_time_str(buf, ts, 0)) {
     log_warn("gmtime call failed (reason: %s)\n", strerror(errno));
     return NULL;
   }
 
-  char buffer[30];
-  strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", utc_time);
-
-  char result[40];
-  snprintf(result, sizeof(result), "%s.%03ldZ", buffer, 0L);
-
-  return s_copy(result);
+  return s_copy(buf);
 }
 
 char*
 to_time_str_millis (struct timespec* ts) {
-  struct tm* utc_time = gmtime(&ts->tv_sec);
-  if (!utc_time) {
+  char buf[TIME_STR_LEN + 8];
+  if (!format_time_str(buf, ts->tv_sec, ts->tv_nsec / 1000000)) {
     log_warn("gmtime call failed (reason: %s)\n", strerror(errno));
     return NULL;
   }
 
-  char buffer[32];
-  strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", utc_time);
-
-  char result[64];
-  snprintf(result, sizeof(result), "%s.%03ldZ", buffer, ts->tv_nsec / 1000000);
-
-  return s_copy(result);
+  return s_copy(buf);
 }
 
 char*
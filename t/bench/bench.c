@@ -0,0 +1,97 @@
+#include "bench.h"
+
+#include <time.h>
+
+#include "cli.h"
+#include "cronentry.h"
+#include "globals.h"
+#include "proginfo.h"
+#include "user.h"
+#include "utils/xpanic.h"
+
+// Externs initialized in main
+cli_opts   opts = {0};
+proginfo_t proginfo;
+
+user_t usr             = {0};
+
+hash_table* db         = NULL;
+array_t*    job_queue  = NULL;
+array_t*    mail_queue = NULL;
+
+static const char* schedules[] = {
+  "* * * * *",
+  "*/5 * * * *",
+  "0 * * * *",
+  "30 2 * * *",
+  "0 0 * * 0",
+  "15 9-17 * * 1-5",
+  "0 0 1 * *",
+  "*/10 8-20 * * *",
+};
+
+static const char* commands[] = {
+  "/usr/local/bin/backup.sh --incremental",
+  "curl -fsS https://example.com/health > /dev/null",
+  "find /tmp -mtime +7 -delete",
+  "echo \"report\" | mail -s 'nightly' ops@example.com",
+};
+
+#define LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+uint64_t
+bench_now_nsec (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+crontab_t*
+bench_crontab (unsigned int n_entries, const char* uname) {
+  static char* envp[] = {"HOME=/home/bench", "SHELL=/bin/sh", "PATH=/usr/bin:/bin", NULL};
+
+  arena_t*   arena     = arena_init();
+  crontab_t* ct        = arena_alloc(arena, sizeof(crontab_t));
+  *ct                  = (crontab_t){0};
+  ct->arena            = arena;
+  ct->info_arena       = arena_init();
+  ct->uname            = arena_strdup(arena, uname);
+  ct->refs             = 1;
+  ct->entries          = array_init_or_panic();
+  ct->vars             = ht_init_or_panic(0, NULL);
+
+  time_t now           = time(NULL);
+  for (unsigned int i = 0; i < n_entries; i++) {
+    char line[512];
+    snprintf(line, sizeof(line), "%s %s #%u", schedules[i % LEN(schedules)], commands[i % LEN(commands)], i);
+
+    cron_entry* entry = new_cron_entry(line, now, ct, CADENCE_NA);
+    if (entry) {
+      array_push_or_panic(ct->entries, entry);
+    }
+  }
+
+  // Not owned by the crontab; bench crontabs are never freed
+  ct->envp = envp;
+
+  return ct;
+}
+
+hash_table*
+bench_db (unsigned int n_entries) {
+  hash_table* bdb = ht_init_or_panic(0, NULL);
+
+  for (unsigned int i = 0; n_entries > 0; i++) {
+    unsigned int n = n_entries < 100 ? n_entries : 100;
+    char         uname[32], fpath[64];
+
+    snprintf(uname, sizeof(uname), "user%u", i);
+    snprintf(fpath, sizeof(fpath), "/var/spool/cron/%s", uname);
+    ht_insert(bdb, fpath, bench_crontab(n, uname));
+
+    n_entries -= n;
+  }
+
+  return bdb;
+}
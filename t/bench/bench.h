@@ -0,0 +1,48 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "crontab.h"
+#include "libhash/libhash.h"
+
+/**
+ * Times `expr` over `reps` runs and stores the fastest, in nanoseconds, in `out`.
+ */
+#define BENCH_BEST(out, reps, expr)                   \
+  do {                                                \
+    (out) = UINT64_MAX;                               \
+    for (unsigned int _r = 0; _r < (reps); _r++) {    \
+      uint64_t _start = bench_now_nsec();             \
+      expr;                                           \
+      uint64_t _took = bench_now_nsec() - _start;     \
+      if (_took < (out)) {                            \
+        (out) = _took;                                \
+      }                                               \
+    }                                                 \
+  } while (0)
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+uint64_t bench_now_nsec(void);
+
+/**
+ * Builds a synthetic crontab with `n_entries` entries, cycling through a set
+ * of realistic schedules and commands.
+ *
+ * @param n_entries
+ * @param uname
+ */
+crontab_t *bench_crontab(unsigned int n_entries, const char *uname);
+
+/**
+ * Builds a synthetic crontab db with `n_entries` entries in total, spread over
+ * crontabs of at most 100 entries each.
+ *
+ * @return hash_table* i.e. HashTable<char*, crontab_t*>
+ */
+hash_table *bench_db(unsigned int n_entries);
+
+#endif /* BENCH_H */
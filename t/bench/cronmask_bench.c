@@ -0,0 +1,64 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "cronmask.h"
+#include "utils/xpanic.h"
+
+#define CALLS 100000
+#define REPS  3
+
+// Keeps the compiler from dropping unused results
+static volatile time_t sink;
+
+static const char *schedules[] = {
+  "* * * * *",
+  "*/5 * * * *",
+  "0 * * * *",
+  "30 2 * * *",
+  "0 0 * * 0",
+  "15 9-17 * * 1-5",
+  "0 0 1 * *",
+  "0 0 1 1 *",
+  "0 12 13 * 5",
+};
+
+/**
+ * Times the next fire time of `s` from `CALLS` times, a little under a minute
+ * apart so each lands somewhere new.
+ */
+static void
+run (const char *s) {
+  cron_expr expr;
+  cron_mask mask;
+  cron_parse_expr(s, &expr, NULL);
+  if (!cronmask_compile(&expr, &mask)) {
+    xpanic("%s doesn't fit a mask\n", s);
+  }
+
+  time_t   start = 1700000000;
+  uint64_t slow, fast;
+  BENCH_BEST(slow, REPS, {
+    for (unsigned int i = 0; i < CALLS; i++) {
+      sink = cron_next(&expr, start + (time_t)i * 59);
+    }
+  });
+  BENCH_BEST(fast, REPS, {
+    for (unsigned int i = 0; i < CALLS; i++) {
+      sink = cronmask_next(&mask, start + (time_t)i * 59);
+    }
+  });
+
+  printf("%-18s %10.1f %10.1f %9.1fx\n", s, (double)slow / CALLS, (double)fast / CALLS, (double)slow / fast);
+}
+
+int
+main (void) {
+  printf("next fire time (ns/call), best of %d\n", REPS);
+  printf("%-18s %10s %10s %10s\n", "expression", "cron_next", "cronmask", "speedup");
+
+  for (unsigned int i = 0; i < sizeof(schedules) / sizeof(schedules[0]); i++) {
+    run(schedules[i]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#include "../unit/cronmask_fuzz.h"
+#include "bench.h"
+
+#define EXPRS 10000
+#define TIMES 200
+#define SEED  0x9e3779b97f4a7c15
+
+/**
+ * The full differential run against cron_next: millions of comparisons, too
+ * slow for the unit suite. Exits non-zero on a mismatch.
+ */
+int
+main (void) {
+  cronmask_fuzz_result res;
+  uint64_t             seed  = cronmask_fuzz_seed(SEED);
+  uint64_t             start = bench_now_nsec();
+
+  cronmask_fuzz(seed, EXPRS, TIMES, &res);
+
+  double secs = (bench_now_nsec() - start) / 1e9;
+  printf("cronmask_next vs cron_next, seed %#lx (set %s to vary)\n", seed, CRONMASK_FUZZ_SEED_ENVVAR);
+  printf("%u expressions, %u comparisons in %.1f s\n", res.usable, res.compared, secs);
+  printf("cron_next wrong:     %u\n", res.cron_next_wrong);
+  printf("cronmask_next wrong: %u\n", res.mismatched);
+  if (res.mismatched > 0) {
+    printf("first mismatch after %ld: %ld != %ld\n", res.curr, res.got, res.want);
+    return 1;
+  }
+
+  return 0;
+}
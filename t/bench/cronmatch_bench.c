@@ -0,0 +1,71 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "cronentry.h"
+#include "cronmatch.h"
+#include "utils/xpanic.h"
+
+#define DB_ENTRIES 100000
+#define REPS       3
+// Minutes matched per rep by the kernels, e.g. an hour of lookahead
+#define WINDOW     60
+
+// Keeps the compiler from dropping unused results
+static volatile size_t sink;
+
+int
+main (void) {
+  static const char *names[] = {"scalar", "SSE2", "AVX2"};
+
+  hash_table  *bdb   = bench_db(DB_ENTRIES);
+  cron_expr  **exprs = malloc(DB_ENTRIES * sizeof(cron_expr *));
+  cron_mask_set set;
+  cronmatch_init(&set);
+
+  // One lane per entry, not per distinct expression, to time the kernel at scale
+  size_t n = 0;
+  HT_ITER_START(bdb)
+  crontab_t *ct = entry->value;
+  foreach (ct->entries, i) {
+    cron_entry *ce = array_get_or_panic(ct->entries, i);
+    exprs[n++]     = &ce->expr->expr;
+    cronmatch_push(&set, &ce->expr->mask);
+  }
+  HT_ITER_END
+
+  uint64_t *fired  = malloc(set.capacity / 64 * sizeof(uint64_t));
+  // 2024-01-31 09:00, a Wednesday
+  time_t    minute = 1706691600;
+  uint64_t  best;
+
+  printf("which of %zu entries fire at a minute (ms/minute), best of %d\n", n, REPS);
+
+  BENCH_BEST(best, REPS, {
+    size_t due = 0;
+    for (size_t i = 0; i < n; i++) {
+      due += cron_next(exprs[i], minute - 1) == minute;
+    }
+    sink = due;
+  });
+  printf("%-24s %10.3f\n", "cron_next per entry", best / 1e6);
+
+  for (cronmatch_kernel k = CRONMATCH_SCALAR; k <= CRONMATCH_AVX2; k++) {
+    if (!cronmatch_use(k)) {
+      continue;
+    }
+
+    BENCH_BEST(best, REPS, {
+      for (unsigned int m = 0; m < WINDOW; m++) {
+        cronmatch_fires(&set, minute + m * 60, fired);
+        sink = fired[0];
+      }
+    });
+    printf("%-24s %10.3f  (%.2f ns/entry)\n", names[k], best / 1e6 / WINDOW, (double)best / WINDOW / n);
+  }
+
+  free(fired);
+  free(exprs);
+  cronmatch_free(&set);
+
+  return 0;
+}
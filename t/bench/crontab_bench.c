@@ -0,0 +1,153 @@
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "cronentry.h"
+#include "utils/xpanic.h"
+
+#define CRONTABS    10000
+#define REPS        3
+// For the entry footprint: 1000 crontabs of 100 entries
+#define DB_ENTRIES  100000
+#define CT_ENTRIES  100
+
+// A single job, as most users' crontabs are
+static const char *small_crontab = "MAILTO=ops@example.com\n0 4 * * * /usr/local/bin/nightly.sh\n";
+
+static const char *typical_crontab =
+  "SHELL=/bin/sh\n"
+  "PATH=/usr/local/bin:/usr/bin:/bin\n"
+  "MAILTO=ops@example.com\n"
+  "# m h dom mon dow command\n"
+  "*/5 * * * * /usr/local/bin/poll.sh\n"
+  "0 * * * * /usr/local/bin/backup.sh --incremental\n"
+  "30 2 * * * /usr/local/bin/backup.sh --full\n"
+  "15 9-17 * * 1-5 curl -fsS https://example.com/health > /dev/null\n"
+  "0 0 * * 0 find /tmp -mtime +7 -delete\n"
+  "0 0 1 * * echo \"report\" | mail -s 'monthly' ops@example.com\n"
+  "*/10 8-20 * * * /usr/local/bin/sync.sh\n"
+  "0 4 * * * /usr/sbin/logrotate /etc/logrotate.conf\n";
+
+static const char *schedules[] = {"*/5 * * * *", "0 * * * *", "30 2 * * *", "15 9-17 * * 1-5"};
+
+static const char *commands[]  = {
+  "/usr/local/bin/backup.sh --incremental",
+  "curl -fsS https://example.com/health > /dev/null",
+  "find /tmp -mtime +7 -delete",
+  "/usr/sbin/logrotate /etc/logrotate.conf",
+};
+
+/**
+ * Heap bytes in use, including allocations' unused tails. Unlike RSS, not
+ * hidden by the allocator reusing memory freed earlier.
+ */
+static size_t
+heap_in_use (void) {
+  return mallinfo2().uordblks;
+}
+
+/**
+ * Parses `CRONTABS` copies of `crontab`, as a rescan of that many modified
+ * files would, then frees them all.
+ */
+static int
+crontab_fd (const char *crontab) {
+  char path[] = "/tmp/crontab_bench_XXXXXX";
+  int  fd     = mkstemp(path);
+  if (fd < 0 || write(fd, crontab, strlen(crontab)) != (ssize_t)strlen(crontab)) {
+    xpanic("cannot write %s\n", path);
+  }
+  unlink(path);
+
+  return fd;
+}
+
+static void
+run (const char *name, const char *crontab) {
+  int fd = crontab_fd(crontab);
+
+  crontab_t **cts        = malloc(CRONTABS * sizeof(crontab_t *));
+  uint64_t    parse_ns   = UINT64_MAX, free_ns = UINT64_MAX;
+  size_t      heap_bytes = 0, n_entries = 0;
+  time_t      now        = time(NULL);
+
+  for (unsigned int r = 0; r < REPS; r++) {
+    size_t   before = heap_in_use();
+    uint64_t start  = bench_now_nsec();
+    for (unsigned int i = 0; i < CRONTABS; i++) {
+      lseek(fd, 0, SEEK_SET);
+      cts[i] = new_crontab(fd, false, now, now, "root");
+    }
+    uint64_t took = bench_now_nsec() - start;
+    parse_ns      = took < parse_ns ? took : parse_ns;
+    heap_bytes    = heap_in_use() - before;
+    n_entries     = array_size(cts[0]->entries);
+
+    start         = bench_now_nsec();
+    for (unsigned int i = 0; i < CRONTABS; i++) {
+      free_crontab(cts[i]);
+    }
+    took    = bench_now_nsec() - start;
+    free_ns = took < free_ns ? took : free_ns;
+  }
+
+  printf("%-8s %7zu %10.2f %10.2f %10.0f\n", name, n_entries, (double)parse_ns / CRONTABS / 1e3, (double)free_ns / CRONTABS / 1e3, (double)heap_bytes / CRONTABS);
+
+  close(fd);
+  free(cts);
+}
+
+/**
+ * Heap bytes per entry of a `DB_ENTRIES` entry db. Fleets share a handful of
+ * commands; with `unique`, every entry's command is its own.
+ */
+static void
+entry_footprint (const char *name, bool unique) {
+  crontab_t **cts    = malloc(DB_ENTRIES / CT_ENTRIES * sizeof(crontab_t *));
+  time_t      now    = time(NULL);
+  size_t      before = heap_in_use();
+
+  for (unsigned int c = 0; c < DB_ENTRIES / CT_ENTRIES; c++) {
+    buffer_t *buf = buffer_init("");
+    for (unsigned int i = 0; i < CT_ENTRIES; i++) {
+      char line[256];
+      if (unique) {
+        snprintf(line, sizeof(line), "%s /usr/local/bin/task.sh --user %u --task %u\n", schedules[i % 4], c, i);
+      } else {
+        snprintf(line, sizeof(line), "%s %s\n", schedules[i % 4], commands[(i / 4) % 4]);
+      }
+      buffer_append(buf, line);
+    }
+
+    int fd = crontab_fd(buffer_state(buf));
+    lseek(fd, 0, SEEK_SET);
+    cts[c] = new_crontab(fd, false, now, now, "root");
+    close(fd);
+    buffer_free(buf);
+  }
+
+  printf("%-8s %10.0f\n", name, (double)(heap_in_use() - before) / DB_ENTRIES);
+
+  for (unsigned int c = 0; c < DB_ENTRIES / CT_ENTRIES; c++) {
+    free_crontab(cts[c]);
+  }
+  free(cts);
+}
+
+int
+main (void) {
+  printf("crontab parse + free, %d crontabs, best of %d\n", CRONTABS, REPS);
+  printf("%-8s %7s %10s %10s %10s\n", "crontab", "entries", "parse (us)", "free (us)", "heap (B)");
+
+  run("small", small_crontab);
+  run("typical", typical_crontab);
+
+  printf("\nheap per entry (B), %d entries in crontabs of %d\n", DB_ENTRIES, CT_ENTRIES);
+  entry_footprint("shared", false);
+  entry_footprint("unique", true);
+
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libhash/libhash.h"
+#include "utils/xpanic.h"
+
+#define KEY_LEN 48
+#define REPS    3
+
+/**
+ * Keys shaped like the db's: crontab paths.
+ */
+static char *
+make_keys (unsigned int n) {
+  char *keys = malloc((size_t)n * KEY_LEN);
+  for (unsigned int i = 0; i < n; i++) {
+    snprintf(keys + (size_t)i * KEY_LEN, KEY_LEN, "/var/spool/cron/user%u", i);
+  }
+
+  return keys;
+}
+
+/**
+ * A fixed shuffle of [0, n), so lookups don't just follow allocation order.
+ */
+static unsigned int *
+make_order (unsigned int n) {
+  unsigned int *order = malloc((size_t)n * sizeof(unsigned int));
+  uint64_t      x     = 88172645463325252ull;
+  for (unsigned int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  for (unsigned int i = n - 1; i > 0; i--) {
+    x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+    unsigned int j = x % (i + 1), t = order[i];
+    order[i]       = order[j];
+    order[j]       = t;
+  }
+
+  return order;
+}
+
+/**
+ * Times inserting, finding (hits and misses) and deleting `n` keys, the latter
+ * in random order.
+ */
+static void
+run (unsigned int n) {
+  char                 *keys      = make_keys(n);
+  unsigned int         *order     = make_order(n);
+  uint64_t              insert_ns = UINT64_MAX, hit_ns = UINT64_MAX, miss_ns = UINT64_MAX, delete_ns = UINT64_MAX;
+  volatile unsigned int found     = 0;
+
+  for (unsigned int r = 0; r < REPS; r++) {
+    hash_table *ht    = ht_init(0, NULL);
+
+    uint64_t    start = bench_now_nsec();
+    for (unsigned int i = 0; i < n; i++) {
+      ht_insert(ht, keys + (size_t)i * KEY_LEN, keys);
+    }
+    uint64_t took = bench_now_nsec() - start;
+    insert_ns     = took < insert_ns ? took : insert_ns;
+
+    start         = bench_now_nsec();
+    for (unsigned int i = 0; i < n; i++) {
+      found += ht_get(ht, keys + (size_t)order[i] * KEY_LEN) != NULL;
+    }
+    took   = bench_now_nsec() - start;
+    hit_ns = took < hit_ns ? took : hit_ns;
+
+    start  = bench_now_nsec();
+    for (unsigned int i = 0; i < n; i++) {
+      // Same length and prefix as the real keys, so misses compare in full
+      char *key = keys + (size_t)order[i] * KEY_LEN;
+      key[5]    = 'X';
+      found    += ht_get(ht, key) != NULL;
+      key[5]    = 's';
+    }
+    took    = bench_now_nsec() - start;
+    miss_ns = took < miss_ns ? took : miss_ns;
+
+    start   = bench_now_nsec();
+    for (unsigned int i = 0; i < n; i++) {
+      ht_delete(ht, keys + (size_t)order[i] * KEY_LEN);
+    }
+    took      = bench_now_nsec() - start;
+    delete_ns = took < delete_ns ? took : delete_ns;
+
+    ht_delete_table(ht);
+  }
+
+  printf(
+    "%-9u %10.1f %10.1f %10.1f %10.1f\n",
+    n,
+    (double)insert_ns / n,
+    (double)hit_ns / n,
+    (double)miss_ns / n,
+    (double)delete_ns / n
+  );
+
+  free(order);
+  free(keys);
+}
+
+static int
+cmp_u64 (const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Times each of `n` inserts into a growing table on its own, to show what the
+ * unluckiest ones (those that resize the table) cost.
+ */
+static void
+insert_latency (unsigned int n) {
+  char     *keys = make_keys(n);
+  uint64_t *lat  = malloc((size_t)n * sizeof(uint64_t));
+
+  hash_table *ht = ht_init(0, NULL);
+  for (unsigned int i = 0; i < n; i++) {
+    uint64_t start = bench_now_nsec();
+    ht_insert(ht, keys + (size_t)i * KEY_LEN, keys);
+    lat[i] = bench_now_nsec() - start;
+  }
+  ht_delete_table(ht);
+
+  qsort(lat, n, sizeof(uint64_t), cmp_u64);
+  printf(
+    "\ninsert latency (ns), %u keys, clock overhead included\n%-9s %10s %10s %10s\n%-9lu %10lu %10lu %10lu\n",
+    n,
+    "p50",
+    "p99",
+    "p99.9",
+    "max",
+    lat[n / 2],
+    lat[(size_t)n * 99 / 100],
+    lat[(size_t)n * 999 / 1000],
+    lat[n - 1]
+  );
+
+  free(lat);
+  free(keys);
+}
+
+int
+main (void) {
+  static const unsigned int sizes[] = {1000, 10000, 100000, 1000000};
+
+  printf("libhash (ns/op), best of %d\n", REPS);
+  printf("%-9s %10s %10s %10s %10s\n", "keys", "insert", "hit", "miss", "delete");
+
+  for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    run(sizes[i]);
+  }
+
+  insert_latency(1000000);
+
+  return 0;
+}
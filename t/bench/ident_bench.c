@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <sys/random.h>
+
+#include "bench.h"
+#include "cronentry.h"
+#include "globals.h"
+#include "job.h"
+#include "utils/ident.h"
+#include "utils/xpanic.h"
+
+#define IDS             1000000
+#define SPAWNS          100000
+#define REBUILD_ENTRIES 10000
+#define REPS            5
+
+// Keeps the compiler from dropping unused results
+static volatile char sink;
+
+/**
+ * What each job and entry used to cost: a random (v4) UUID unparsed to text, as
+ * libuuid's uuid_generate_random + uuid_unparse do.
+ */
+static void
+random_uuid (char buf[IDENT_STR_LEN]) {
+  static const char hex[] = "0123456789abcdef";
+  uint8_t           u[16];
+  char             *p     = buf;
+
+  getrandom(u, sizeof(u), 0);
+  u[6] = (u[6] & 0x0f) | 0x40;
+  u[8] = (u[8] & 0x3f) | 0x80;
+
+  for (unsigned int i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      *p++ = '-';
+    }
+    *p++ = hex[u[i] >> 4];
+    *p++ = hex[u[i] & 0x0f];
+  }
+  *p = '\0';
+}
+
+static void
+id_costs (void) {
+  char     buf[IDENT_STR_LEN];
+  uint64_t best;
+
+  printf("id creation (ns/id), %d ids\n", IDS);
+
+  BENCH_BEST(best, REPS, {
+    for (unsigned int i = 0; i < IDS; i++) {
+      random_uuid(buf);
+      sink = buf[0];
+    }
+  });
+  printf("%-28s %8.1f\n", "random uuid + unparse", (double)best / IDS);
+
+  BENCH_BEST(best, REPS, {
+    for (unsigned int i = 0; i < IDS; i++) {
+      sink = (char)ident_next();
+    }
+  });
+  printf("%-28s %8.1f\n", "ident_next", (double)best / IDS);
+
+  BENCH_BEST(best, REPS, {
+    for (unsigned int i = 0; i < IDS; i++) {
+      sink = ident_format(ident_next(), buf)[0];
+    }
+  });
+  printf("%-28s %8.1f\n", "ident_next + format (hex)", (double)best / IDS);
+
+  opts.uuid_ids = true;
+  BENCH_BEST(best, REPS, {
+    for (unsigned int i = 0; i < IDS; i++) {
+      sink = ident_format(ident_next(), buf)[0];
+    }
+  });
+  printf("%-28s %8.1f\n", "ident_next + format (uuid)", (double)best / IDS);
+  opts.uuid_ids = false;
+}
+
+/**
+ * Builds a crontab the way a rebuild does, one new_cron_entry per line.
+ */
+static void
+rebuild_cost (void) {
+  uint64_t best;
+  BENCH_BEST(best, REPS, {
+    crontab_t *ct = bench_crontab(REBUILD_ENTRIES, "bench");
+    sink          = (char)array_size(ct->entries);
+  });
+
+  printf("\ncrontab rebuild, %d entries: %.2f ms (%.0f ns/entry)\n", REBUILD_ENTRIES, best / 1e6, (double)best / REBUILD_ENTRIES);
+}
+
+/**
+ * Creates and frees jobs as the scheduler and reaper do, minus the fork.
+ */
+static void
+spawn_cost (void) {
+  crontab_t  *ct    = bench_crontab(1, "bench");
+  cron_entry *entry = array_get_or_panic(ct->entries, 0);
+
+  uint64_t best;
+  BENCH_BEST(best, REPS, {
+    for (unsigned int i = 0; i < SPAWNS; i++) {
+      free_cronjob(new_cronjob(entry));
+    }
+  });
+
+  printf("job create + free, %d jobs: %.1f ns/job\n", SPAWNS, (double)best / SPAWNS);
+}
+
+int
+main (void) {
+  id_costs();
+  rebuild_cost();
+  spawn_cost();
+
+  return 0;
+}
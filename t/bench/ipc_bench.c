@@ -0,0 +1,40 @@
+#include "api/commands.h"
+#include "bench.h"
+#include "db.h"
+#include "utils/xpanic.h"
+
+#define REPS 5
+
+/**
+ * Compares IPC_LIST_CRONTABS encode time and response size across formats.
+ */
+int
+main (void) {
+  static const unsigned int sizes[] = {10000, 100000};
+
+  printf("IPC_LIST_CRONTABS\n%-10s %-8s %12s %14s\n", "entries", "format", "encode (ms)", "bytes");
+
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    db_publish(bench_db(sizes[s]));
+
+    const char* formats[] = {"json", "msgpack"};
+    for (unsigned int f = 0; f < 2; f++) {
+      hash_table* args = ht_init_or_panic(0, NULL);
+      ht_insert(args, "format", (void*)formats[f]);
+
+      uint64_t best;
+      size_t   bytes = 0;
+      BENCH_BEST(best, REPS, {
+        buffer_t* buf = buffer_init(NULL);
+        write_crontabs_info(buf, args, 0);
+        bytes = buffer_size(buf);
+        buffer_free(buf);
+      });
+
+      printf("%-10u %-8s %12.2f %14zu\n", sizes[s], formats[f], best / 1e6, bytes);
+      ht_delete_table(args);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "globals.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils/xpanic.h"
+
+#define CALLS_PER_THREAD 20000
+#define MAX_THREADS      8
+#define LOG_PATH         "/tmp/chronic_logger_bench.log"
+
+static uint64_t samples[MAX_THREADS][CALLS_PER_THREAD];
+
+static void*
+log_calls (void* arg) {
+  uint64_t* out = arg;
+
+  for (unsigned int i = 0; i < CALLS_PER_THREAD; i++) {
+    uint64_t start = bench_now_nsec();
+    log_info("[job %s] New running job with pid %d\n", "5f1b1c9e-5d7e-4c52-9a55-2a7b8f7f1f7e", i);
+    out[i] = bench_now_nsec() - start;
+  }
+
+  return NULL;
+}
+
+static int
+cmp_u64 (const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Measures per-call log latency with `n_threads` threads logging concurrently.
+ */
+static void
+run (const char* label, log_mode mode, unsigned int n_threads) {
+  unlink(LOG_PATH);
+  opts.log_file = s_copy_or_panic(LOG_PATH);
+  opts.log_mode = mode;
+
+  int saved_stderr = dup(STDERR_FILENO);
+  logger_init();
+
+  uint64_t  dropped = metrics_get(METRIC_LOG_DROPPED);
+  pthread_t threads[MAX_THREADS];
+  for (unsigned int t = 0; t < n_threads; t++) {
+    pthread_create(&threads[t], NULL, log_calls, samples[t]);
+  }
+  for (unsigned int t = 0; t < n_threads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  logger_close();
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stderr);
+  dropped = metrics_get(METRIC_LOG_DROPPED) - dropped;
+
+  size_t    n   = (size_t)n_threads * CALLS_PER_THREAD;
+  uint64_t* all = malloc(n * sizeof(uint64_t));
+  uint64_t  sum = 0;
+  for (unsigned int t = 0; t < n_threads; t++) {
+    memcpy(all + (size_t)t * CALLS_PER_THREAD, samples[t], sizeof(samples[t]));
+  }
+  for (size_t i = 0; i < n; i++) {
+    sum += all[i];
+  }
+  qsort(all, n, sizeof(uint64_t), cmp_u64);
+
+  printf(
+    "%-12s %7u %10.0f %10lu %10lu %10lu\n",
+    label,
+    n_threads,
+    (double)sum / n,
+    (unsigned long)all[n / 2],
+    (unsigned long)all[n * 99 / 100],
+    (unsigned long)dropped
+  );
+
+  free(all);
+}
+
+int
+main (void) {
+  static const unsigned int thread_counts[] = {1, 4, 8};
+
+  printf("log call latency (ns), %d calls per thread\n", CALLS_PER_THREAD);
+  printf("%-12s %7s %10s %10s %10s %10s\n", "mode", "threads", "mean", "p50", "p99", "dropped");
+
+  for (unsigned int i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+    run("sync", LOG_MODE_SYNC, thread_counts[i]);
+    run("async-block", LOG_MODE_ASYNC_BLOCK, thread_counts[i]);
+    run("async-drop", LOG_MODE_ASYNC_DROP, thread_counts[i]);
+  }
+
+  unlink(LOG_PATH);
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+#include "cronentry.h"
+#include "exprpool.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils/xpanic.h"
+
+#define DB_ENTRIES 100000
+#define TICKS      20
+// A db the size the counters are compared on, over a day of ticks
+#define LAZY_ENTRIES 10000
+#define LAZY_TICKS   1440
+
+/**
+ * Renews every entry in the db, as a scan over unmodified crontabs does.
+ */
+static void
+renew_db (hash_table *bdb, time_t curr) {
+  HT_ITER_START(bdb)
+  crontab_t *ct = entry->value;
+  foreach (ct->entries, i) {
+    renew_cron_entry(array_get_or_panic(ct->entries, i), curr);
+  }
+  HT_ITER_END
+}
+
+/**
+ * Renews only the entries that fire at `curr`, as try_run_jobs does, short of
+ * running them.
+ */
+static void
+renew_due (hash_table *bdb, time_t curr) {
+  HT_ITER_START(bdb)
+  crontab_t *ct = entry->value;
+  foreach (ct->entries, i) {
+    cron_entry *ce = array_get_or_panic(ct->entries, i);
+    if (exprpool_fires(ce->expr, curr)) {
+      renew_cron_entry(ce, curr);
+    }
+  }
+  HT_ITER_END
+}
+
+/**
+ * A db where entries rarely share a schedule: one a day at each minute of the
+ * first 28 days of the month, 40320 in all.
+ */
+static hash_table *
+unique_db (unsigned int n_entries) {
+  hash_table *udb = ht_init_or_panic(0, NULL);
+  time_t      now = time(NULL);
+
+  for (unsigned int c = 0; c * 100 < n_entries; c++) {
+    char fpath[64];
+    snprintf(fpath, sizeof(fpath), "/var/spool/cron/unique%u", c);
+    crontab_t *ct = bench_crontab(0, fpath + 16);
+
+    for (unsigned int i = c * 100; i < (c + 1) * 100 && i < n_entries; i++) {
+      char line[128];
+      snprintf(line, sizeof(line), "%u %u %u * * /usr/local/bin/job.sh #%u", i % 60, i / 60 % 24, i / 1440 % 28 + 1, i);
+      array_push_or_panic(ct->entries, new_cron_entry(line, now, ct, CADENCE_NA));
+    }
+    ht_insert(udb, fpath, ct);
+  }
+
+  return udb;
+}
+
+/**
+ * Times renewing `bdb` each tick, at a new minute each time.
+ */
+static void
+run (const char *name, hash_table *bdb, size_t n_exprs) {
+  time_t   curr = time(NULL);
+  uint64_t best;
+  BENCH_BEST(best, TICKS, {
+    curr += 60;
+    // As the main loop does each tick before renewing
+    exprpool_advance(curr);
+    renew_db(bdb, curr);
+  });
+
+  printf("%-8s %8zu %10.2f %10.1f\n", name, n_exprs, best / 1e6, (double)best / DB_ENTRIES);
+}
+
+/**
+ * Counts the entries renewed, and the next fire times worked out, per tick of
+ * a day when renewing every entry against renewing only those that fire.
+ */
+static void
+count (const char *name, hash_table *bdb, bool lazy) {
+  time_t   curr     = time(NULL) / 60 * 60;
+  uint64_t renewed  = metrics_get(METRIC_ENTRIES_RENEWED);
+  uint64_t computed = metrics_get(METRIC_NEXT_COMPUTED);
+  for (unsigned int t = 0; t < LAZY_TICKS; t++) {
+    curr += 60;
+    exprpool_advance(curr);
+    if (lazy) {
+      renew_due(bdb, curr);
+    } else {
+      renew_db(bdb, curr);
+    }
+  }
+
+  printf(
+    "%-8s %10.1f %10.1f\n",
+    name,
+    (double)(metrics_get(METRIC_ENTRIES_RENEWED) - renewed) / LAZY_TICKS,
+    (double)(metrics_get(METRIC_NEXT_COMPUTED) - computed) / LAZY_TICKS
+  );
+}
+
+int
+main (void) {
+  // Renewing logs each entry at debug, which would swamp the rest
+  logger_set_levels("info");
+
+  printf("renew, %d entries, best of %d ticks\n", DB_ENTRIES, TICKS);
+  printf("%-8s %8s %10s %10s\n", "db", "exprs", "ms/tick", "ns/entry");
+
+  hash_table *bdb = bench_db(DB_ENTRIES);
+  run("bench", bdb, exprpool_count());
+
+  size_t      before = exprpool_count();
+  hash_table *udb    = unique_db(DB_ENTRIES);
+  run("unique", udb, exprpool_count() - before);
+
+  printf("\nper tick over %d ticks, %d entries\n", LAZY_TICKS, LAZY_ENTRIES);
+  printf("%-8s %10s %10s\n", "renew", "entries", "computed");
+
+  hash_table *ldb = bench_db(LAZY_ENTRIES);
+  count("all", ldb, false);
+  count("due", ldb, true);
+
+  return 0;
+}
@@ -108,6 +108,17 @@ describe 'ipc API failure modes'
     done
   ti
 
+  it 'responds appropriately to unknown format'
+    out="$(sock_call '{"command":"IPC_SHOW_INFO","format":"xml"}')"
+    assert equal "$(jq -r '.error' <<< "$out")" "unknown format 'xml'"
+  ti
+
+  it 'responds in MessagePack when asked to'
+    # A MessagePack map of 4 (fixmap) starts with 0x84
+    first_byte="$(sock_call '{"command":"IPC_SHOW_INFO","format":"msgpack"}' | head -c 1 | od -An -tx1 | xargs)"
+    assert equal "$first_byte" '84'
+  ti
+
   stop_chronic
 end_describe
 
@@ -194,3 +205,85 @@ describe 'ipc API IPC_LIST_JOBS command'
 
   stop_chronic
 end_describe
+
+describe 'ipc API IPC_METRICS command'
+  start_chronic
+  sleep 2
+
+  out="$(sock_call '{"command":"IPC_METRICS"}')"
+
+  it 'counts scanned crontab files'
+    assert egrep "$out" "^chronic_files_scanned_total [1-9][0-9]*$"
+  ti
+
+  it 'has the update_db duration histogram'
+    assert egrep "$out" '^chronic_update_db_duration_seconds_count [1-9][0-9]*$'
+  ti
+
+  it 'counts its own IPC requests'
+    assert egrep "$(sock_call '{"command":"IPC_METRICS"}')" "^chronic_ipc_requests_total [2-9][0-9]*$"
+  ti
+
+  it 'ends with the EOF marker'
+    assert equal "$(tail -n 1 <<< "$out")" '# EOF'
+  ti
+
+  stop_chronic
+end_describe
+
+describe 'ipc API job control commands'
+  start_chronic
+  sleep 2
+
+  entry_id="$(sock_call '{"command":"IPC_LIST_CRONTABS"}' | jq -r '.[0].id')"
+
+  it 'pauses an entry'
+    out="$(sock_call "{\"command\":\"IPC_PAUSE\",\"id\":\"$entry_id\"}")"
+    assert equal "$(jq -r '.paused' <<< "$out")" 'true'
+  ti
+
+  it 'resumes an entry'
+    out="$(sock_call "{\"command\":\"IPC_RESUME\",\"id\":\"$entry_id\"}")"
+    assert equal "$(jq -r '.paused' <<< "$out")" 'false'
+  ti
+
+  it 'runs an entry on demand'
+    job_id="$(sock_call "{\"command\":\"IPC_RUN_NOW\",\"id\":\"$entry_id\"}" | jq -r '.job')"
+    out="$(sock_call "{\"command\":\"IPC_JOB_INFO\",\"id\":\"$job_id\"}")"
+    assert equal "$(jq -r '.id' <<< "$out")" "$job_id"
+  ti
+
+  it 'rejects unknown jobs'
+    out="$(sock_call '{"command":"IPC_KILL_JOB","id":"nope"}')"
+    assert equal "$(jq -r '.error' <<< "$out")" 'no such job'
+  ti
+
+  it 'serves captured job output'
+    out="$(sock_call "{\"command\":\"IPC_JOB_OUTPUT\",\"id\":\"$job_id\"}")"
+    assert equal "$(jq -r '.id' <<< "$out")" "$job_id"
+  ti
+
+  it 'has no output for unknown jobs'
+    out="$(sock_call '{"command":"IPC_JOB_OUTPUT","id":"nope"}')"
+    assert equal "$(jq -r '.error' <<< "$out")" 'no output for job'
+  ti
+
+  stop_chronic
+end_describe
+
+describe 'ipc API log level command'
+  start_chronic
+  sleep 1
+
+  it 'reports the current levels'
+    out="$(sock_call '{"command":"IPC_LOG_LEVEL"}')"
+    assert equal "$(jq -r '.scan' <<< "$out")" 'debug'
+  ti
+
+  it 'changes levels at runtime'
+    out="$(sock_call '{"command":"IPC_LOG_LEVEL","level":"info,job=debug"}')"
+    assert equal "$(jq -r '.scan + " " + .job' <<< "$out")" 'info debug'
+  ti
+
+  stop_chronic
+end_describe
@@ -0,0 +1,185 @@
+#ifndef CRONMASK_FUZZ_H
+#define CRONMASK_FUZZ_H
+
+/*
+ * Differential fuzzing of cronmask_next against cron_next, shared by the unit
+ * test (a small, fixed-seed run) and cronmask_fuzz_bench (millions of
+ * comparisons). Set CRONMASK_FUZZ_SEED to replay or vary a run.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cronmask.h"
+
+#define CRONMASK_FUZZ_SEED_ENVVAR "CRONMASK_FUZZ_SEED"
+
+typedef struct {
+  unsigned int usable;
+  unsigned int compared;
+  /* Times where cronmask_next was wrong */
+  unsigned int mismatched;
+  /* Times where cron_next was wrong and cronmask_next right */
+  unsigned int cron_next_wrong;
+  /* The first mismatch, if any */
+  time_t       curr;
+  time_t       got;
+  time_t       want;
+} cronmask_fuzz_result;
+
+static uint64_t rng;
+
+static unsigned int
+rand_below (unsigned int n) {
+  rng ^= rng << 13, rng ^= rng >> 7, rng ^= rng << 17;
+  return (unsigned int)(rng % n);
+}
+
+/**
+ * Writes a random field over [min, max]: a wildcard, value, range or step,
+ * sometimes several of them in a list.
+ */
+static void
+rand_field (char *buf, size_t sz, unsigned int min, unsigned int max) {
+  unsigned int n   = rand_below(8) == 0 ? 2 + rand_below(3) : 1;
+  size_t       len = 0;
+  buf[0]           = '\0';
+
+  for (unsigned int i = 0; i < n; i++) {
+    unsigned int a    = min + rand_below(max - min + 1);
+    unsigned int b    = a + rand_below(max - a + 1);
+    unsigned int step = 1 + rand_below((max - min) / 2 + 1);
+    const char  *sep  = i ? "," : "";
+
+    switch (rand_below(6)) {
+      case 0: len += snprintf(buf + len, sz - len, "%s*", sep); break;
+      case 1: len += snprintf(buf + len, sz - len, "%s*/%u", sep, step); break;
+      case 2: len += snprintf(buf + len, sz - len, "%s%u-%u", sep, a, b); break;
+      case 3: len += snprintf(buf + len, sz - len, "%s%u-%u/%u", sep, a, b, step); break;
+      default: len += snprintf(buf + len, sz - len, "%s%u", sep, a); break;
+    }
+  }
+}
+
+static void
+rand_expr (cron_expr *expr) {
+  char min[64], hour[64], dom[64], mon[64], dow[64], s[512];
+  do {
+    rand_field(min, sizeof(min), 0, 59);
+    rand_field(hour, sizeof(hour), 0, 23);
+    rand_field(dom, sizeof(dom), 1, 31);
+    rand_field(mon, sizeof(mon), 1, 12);
+    rand_field(dow, sizeof(dow), 0, 7);
+    // Mostly one of day of month or week left open, as in real crontabs
+    switch (rand_below(4)) {
+      case 0: strcpy(dom, "*"); break;
+      case 1: strcpy(dow, "*"); break;
+    }
+    snprintf(s, sizeof(s), "%s %s %s %s %s", min, hour, dom, mon, dow);
+
+    const char *err = NULL;
+    cron_parse_expr(s, expr, &err);
+    if (!err) {
+      return;
+    }
+  } while (true);
+}
+
+static bool
+has_bit (const uint8_t *bits, int i) {
+  return bits[i / 8] >> (i % 8) & 1;
+}
+
+static bool
+day_matches (const cron_expr *expr, const struct tm *tm) {
+  return has_bit(expr->months, tm->tm_mon) && has_bit(expr->days_of_month, tm->tm_mday) && has_bit(expr->days_of_week, tm->tm_wday);
+}
+
+/**
+ * The first time after `curr` the expression fires, found the slow way: gmtime
+ * on each day up to `until`, then each minute of the matching days.
+ */
+static time_t
+brute_next (const cron_expr *expr, time_t curr, time_t until) {
+  for (time_t day = curr - curr % 86400; day <= until; day += 86400) {
+    struct tm tm;
+    gmtime_r(&day, &tm);
+    if (!day_matches(expr, &tm)) {
+      continue;
+    }
+
+    for (int m = 0; m < 24 * 60; m++) {
+      time_t t = day + m * 60;
+      if (t > curr && has_bit(expr->hours, m / 60) && has_bit(expr->minutes, m % 60)) {
+        return t;
+      }
+    }
+  }
+
+  return CRON_INVALID_INSTANT;
+}
+
+/**
+ * Returns the seed given in CRONMASK_FUZZ_SEED, else `fallback`.
+ */
+static uint64_t
+cronmask_fuzz_seed (uint64_t fallback) {
+  const char *s = getenv(CRONMASK_FUZZ_SEED_ENVVAR);
+  return s && *s ? strtoull(s, NULL, 0) : fallback;
+}
+
+/**
+ * Compares cronmask_next with cron_next on `n_exprs` random expressions at
+ * `n_times` random times each. Where they disagree, the brute force search
+ * settles it; cron_next can land on a day that doesn't match when it has to
+ * search both days of the month and of the week for long.
+ */
+static void
+cronmask_fuzz (uint64_t seed, unsigned int n_exprs, unsigned int n_times, cronmask_fuzz_result *res) {
+  *res = (cronmask_fuzz_result){0};
+  // xorshift is stuck at 0
+  rng  = seed ? seed : 1;
+
+  for (unsigned int i = 0; i < n_exprs; i++) {
+    cron_expr expr;
+    cron_mask mask;
+    rand_expr(&expr);
+    if (!cronmask_compile(&expr, &mask)) {
+      continue;
+    }
+    res->usable++;
+
+    for (unsigned int j = 0; j < n_times; j++) {
+      // Anywhere from 1970 to 2100, half of them on a minute boundary
+      time_t curr = (time_t)rand_below(4102444800u);
+      if (j % 2) {
+        curr -= curr % 60;
+      }
+
+      time_t got = cronmask_next(&mask, curr);
+      if (got == CRON_INVALID_INSTANT) {
+        continue;
+      }
+      res->compared++;
+
+      time_t want = cron_next(&expr, curr);
+      if (got == want) {
+        continue;
+      }
+
+      time_t brute = brute_next(&expr, curr, got);
+      if (got == brute) {
+        res->cron_next_wrong++;
+      } else if (res->mismatched++ == 0) {
+        res->curr = curr;
+        res->got  = got;
+        res->want = brute;
+      }
+    }
+  }
+}
+
+#endif /* CRONMASK_FUZZ_H */
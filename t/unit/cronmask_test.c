@@ -0,0 +1,97 @@
+#include "cronmask.h"
+
+#include <time.h>
+
+#include "cronmask_fuzz.h"
+#include "tests.h"
+
+#define FUZZ_EXPRS 2000
+#define FUZZ_TIMES 50
+#define FUZZ_SEED  0x2545f4914f6cdd1d
+
+static void
+compile_test (void) {
+  typedef struct {
+    const char *expr;
+    bool        usable;
+  } test_case;
+
+  test_case tests[] = {
+    {.expr = "*/5 9-17 * * 1-5", .usable = true },
+    {.expr = "0 0 1,15 * 0",     .usable = true },
+    {.expr = "0 0 * JAN-MAR 7",  .usable = true },
+    {.expr = "0 0 L * *",        .usable = false},
+    {.expr = "0 0 LW * *",       .usable = false},
+    {.expr = "0 0 15W * *",      .usable = false},
+    {.expr = "0 0 * * 5L",       .usable = false},
+    {.expr = "0 0 * * 5#3",      .usable = false},
+    {.expr = "30 0 0 * * *",     .usable = false},
+  };
+
+  ITER_CASES_TEST(tests, test_case) {
+    cron_expr expr;
+    cron_mask mask;
+    cron_parse_expr(tests[i].expr, &expr, NULL);
+
+    ok(cronmask_compile(&expr, &mask) == tests[i].usable, "%s %s a mask", tests[i].expr, tests[i].usable ? "fits" : "doesn't fit");
+  }
+}
+
+static void
+next_test (void) {
+  typedef struct {
+    const char *expr;
+    time_t      curr;
+    time_t      want;
+  } test_case;
+
+  test_case tests[] = {
+    // 2024-02-28 23:59:30, to the leap day
+    {.expr = "0 0 * * *",    .curr = 1709164770, .want = 1709164800},
+    // On a fire time, to the next one
+    {.expr = "*/15 * * * *", .curr = 1709164800, .want = 1709165700},
+    // 2023-12-31 12:00, over the year to the first Monday
+    {.expr = "0 9 * * 1",    .curr = 1704024000, .want = 1704099600},
+    // 2024-02-01, skipping months without a 31st
+    {.expr = "0 0 31 * *",   .curr = 1706745600, .want = 1711843200},
+  };
+
+  ITER_CASES_TEST(tests, test_case) {
+    cron_expr expr;
+    cron_mask mask;
+    cron_parse_expr(tests[i].expr, &expr, NULL);
+    cronmask_compile(&expr, &mask);
+
+    time_t got = cronmask_next(&mask, tests[i].curr);
+    ok(got == tests[i].want && got == cron_next(&expr, tests[i].curr), "%s fires at %ld after %ld", tests[i].expr, tests[i].want, tests[i].curr);
+  }
+}
+
+/**
+ * Differential test against cron_next on random expressions and times; see
+ * cronmask_fuzz. The seed is fixed so every run checks the same inputs.
+ */
+static void
+fuzz_test (void) {
+  cronmask_fuzz_result res;
+  uint64_t             seed = cronmask_fuzz_seed(FUZZ_SEED);
+
+  diag("fuzzing with seed %#lx", seed);
+  cronmask_fuzz(seed, FUZZ_EXPRS, FUZZ_TIMES, &res);
+  if (res.mismatched > 0) {
+    diag("mismatch after %ld: %ld != %ld", res.curr, res.got, res.want);
+  }
+
+  ok(res.usable == FUZZ_EXPRS && res.compared > FUZZ_EXPRS * FUZZ_TIMES * 9 / 10, "fuzzing compares most expressions and times");
+  ok(res.mismatched == 0,
+     "agrees with cron_next on %u random expressions and times, or is right where it isn't (%u)",
+     res.compared,
+     res.cron_next_wrong);
+}
+
+void
+run_cronmask_tests (void) {
+  compile_test();
+  next_test();
+  fuzz_test();
+}
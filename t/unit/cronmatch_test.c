@@ -0,0 +1,170 @@
+#include "cronmatch.h"
+
+#include <stdlib.h>
+
+#include "exprpool.h"
+#include "tests.h"
+
+#define N_MASKS   1000
+#define N_MINUTES 2000
+
+static uint64_t rng = 88172645463325252ull;
+
+static uint64_t
+rand64 (void) {
+  rng ^= rng << 13, rng ^= rng >> 7, rng ^= rng << 17;
+  return rng;
+}
+
+/**
+ * A mask with about three in four bits of each field set, so that about one
+ * in four fires at any given minute.
+ */
+static void
+rand_mask (cron_mask *mask) {
+  mask->minutes       = (rand64() | rand64()) & ((1ull << 60) - 1);
+  mask->hours         = (uint32_t)(rand64() | rand64()) & ((1u << 24) - 1);
+  mask->days_of_month = (uint32_t)(rand64() | rand64()) & ~1u;
+  mask->months        = (uint16_t)(rand64() | rand64()) & ((1u << 12) - 1);
+  mask->days_of_week  = (uint8_t)(rand64() | rand64()) & ((1u << 7) - 1);
+  mask->usable        = rand64() % 16 != 0;
+}
+
+static bool
+fires (const cron_mask *mask, const cron_mask *at) {
+  return mask->usable && (mask->minutes & at->minutes) && (mask->hours & at->hours) && (mask->days_of_month & at->days_of_month) &&
+         (mask->months & at->months) && (mask->days_of_week & at->days_of_week);
+}
+
+static bool
+has_fired (const uint64_t *fired, size_t lane) {
+  return fired[lane / 64] >> (lane % 64) & 1;
+}
+
+static void
+kernels_test (void) {
+  static const char *names[] = {"scalar", "SSE2", "AVX2"};
+
+  cron_mask    *masks     = malloc(N_MASKS * sizeof(cron_mask));
+  cron_mask_set set;
+  cronmatch_init(&set);
+  for (unsigned int i = 0; i < N_MASKS; i++) {
+    rand_mask(&masks[i]);
+    cronmatch_push(&set, &masks[i]);
+  }
+
+  uint64_t *fired = malloc(set.capacity / 64 * sizeof(uint64_t));
+  for (cronmatch_kernel k = CRONMATCH_SCALAR; k <= CRONMATCH_AVX2; k++) {
+    if (!cronmatch_use(k)) {
+      skip(true, "kernel not supported on this CPU");
+      continue;
+    }
+
+    unsigned int wrong = 0, n_fired = 0;
+    for (unsigned int m = 0; m < N_MINUTES; m++) {
+      // A minute somewhere between 2001 and 2033
+      time_t    minute = (time_t)(1000000000 + rand64() % 1000000000) / 60 * 60;
+      cron_mask at;
+      cronmask_at(minute, &at);
+      cronmatch_fires(&set, minute, fired);
+
+      for (size_t lane = 0; lane < set.capacity; lane++) {
+        bool want  = lane < N_MASKS && fires(&masks[lane], &at);
+        wrong     += has_fired(fired, lane) != want;
+        n_fired   += want;
+      }
+    }
+    ok(wrong == 0 && n_fired > 0, "the %s kernel finds which masks fire", names[k]);
+  }
+  cronmatch_use(cronmatch_best());
+
+  // Moving the last lane over the first, as the pool does on release
+  cronmatch_put(&set, 0, &masks[N_MASKS - 1]);
+  cronmatch_pop(&set);
+  bool moved = true;
+  for (unsigned int m = 0; m < 100; m++) {
+    time_t    minute = (time_t)(1000000000 + m * 3607) / 60 * 60;
+    cron_mask at;
+    cronmask_at(minute, &at);
+    cronmatch_fires(&set, minute, fired);
+    moved = moved && has_fired(fired, 0) == fires(&masks[N_MASKS - 1], &at) && !has_fired(fired, N_MASKS - 1);
+  }
+  ok(moved && set.count == N_MASKS - 1, "moves and drops lanes");
+
+  free(fired);
+  free(masks);
+  cronmatch_free(&set);
+}
+
+/**
+ * Checks every minute of the window, and next fire times from a few points in
+ * it, against the masks and cron_next.
+ */
+static bool
+window_agrees (shared_expr **exprs, unsigned int n, time_t start) {
+  for (unsigned int i = 0; i < n; i++) {
+    for (time_t m = start; m < start + EXPRPOOL_WINDOW * 60; m += 60) {
+      cron_mask at;
+      cronmask_at(m, &at);
+      bool want = exprs[i]->mask.usable ? fires(&exprs[i]->mask, &at) : cron_next(&exprs[i]->expr, m - 1) == m;
+      if (exprpool_fires(exprs[i], m) != want) {
+        diag("expression %u at %ld: want %d", i, m, want);
+        return false;
+      }
+    }
+
+    for (time_t t = start - 1; t < start + EXPRPOOL_WINDOW * 60; t += 7919) {
+      if (exprpool_next(exprs[i], t) != cron_next(&exprs[i]->expr, t)) {
+        diag("expression %u after %ld: %ld != %ld", i, t, exprpool_next(exprs[i], t), cron_next(&exprs[i]->expr, t));
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void
+exprpool_window_test (void) {
+  static const char *schedules[] = {"*/7 * * * *", "15 9-17 * * 1-5", "0 0 1 * *", "30 23 * * *", "0 0 L * *", "0 9 31 1 *"};
+  shared_expr       *exprs[6];
+
+  for (unsigned int i = 0; i < 6; i++) {
+    cron_expr expr;
+    cron_parse_expr(schedules[i], &expr, NULL);
+    exprs[i] = exprpool_intern(&expr);
+  }
+
+  // 2024-01-31 08:59:40; then a minute on, 90 minutes, two days, back an hour
+  time_t now = 1706691580;
+  exprpool_advance(now);
+  ok(window_agrees(exprs, 6, now - now % 60), "fills each expression's window");
+
+  bool slid = true;
+  for (unsigned int i = 0; i < 4; i++) {
+    static const time_t steps[] = {60, 90 * 60, 2 * 86400, -3600};
+    now += steps[i];
+    exprpool_advance(now);
+    slid = slid && window_agrees(exprs, 6, now - now % 60);
+  }
+  ok(slid, "slides and refills windows");
+
+  // Moves the last lane, and adds one that must be filled in on its own
+  exprpool_release(exprs[0]);
+  cron_expr expr;
+  cron_parse_expr("*/11 * * * *", &expr, NULL);
+  exprs[0] = exprpool_intern(&expr);
+  now     += 60;
+  exprpool_advance(now);
+  ok(window_agrees(exprs, 6, now - now % 60), "keeps windows across lane moves and new expressions");
+
+  for (unsigned int i = 0; i < 6; i++) {
+    exprpool_release(exprs[i]);
+  }
+}
+
+void
+run_cronmatch_tests (void) {
+  kernels_test();
+  exprpool_window_test();
+}
@@ -7,13 +7,14 @@
 #include <time.h>
 
 #include "cronentry.h"
+#include "metrics.h"
 #include "tests.h"
 #include "utils/retval.h"
 
 static void
 validate_entry (cron_entry* entry, cron_entry* expected) {
-  eq_str(expected->cmd, entry->cmd, "Expect cmd '%s'", expected->cmd);
-  eq_str(expected->schedule, entry->schedule, "Expect schedule '%s'", expected->schedule);
+  eq_str(expected->info->cmd, entry->info->cmd, "Expect cmd '%s'", expected->info->cmd);
+  eq_str(expected->info->schedule, entry->info->schedule, "Expect schedule '%s'", expected->info->schedule);
   eq_str(
     expected->parent->uname,
     entry->parent->uname,
@@ -37,13 +38,14 @@ new_crontab_test (void) {
 
   crontab_t* ct      = new_crontab(crontab_fd, false, now, now, test_uname);
   array_t*   entries = ct->entries;
+  close(crontab_fd);
 
   // clang-format off
   cron_entry expected_entries[] = {
-    { .cmd = "script.sh",               .schedule = "*/1 * * * *",  .parent = ct },
-    { .cmd = "exec.sh",                 .schedule = "*/2 * * * *",  .parent = ct },
-    { .cmd = "echo whatever > /tmp/hi", .schedule = "*/10 * * * *", .parent = ct },
-    { .cmd = "date",                    .schedule = "*/15 * * * *", .parent = ct }
+    { .info = &(cron_entry_info){ .cmd = "script.sh",               .schedule = "*/1 * * * *"  }, .parent = ct },
+    { .info = &(cron_entry_info){ .cmd = "exec.sh",                 .schedule = "*/2 * * * *"  }, .parent = ct },
+    { .info = &(cron_entry_info){ .cmd = "echo whatever > /tmp/hi", .schedule = "*/10 * * * *" }, .parent = ct },
+    { .info = &(cron_entry_info){ .cmd = "date",                    .schedule = "*/15 * * * *" }, .parent = ct }
   };
   // clang-format on
 
@@ -55,7 +57,6 @@ new_crontab_test (void) {
     cron_entry* actual   = array_get(entries, i);
 
     validate_entry(actual, &expected);
-    free(actual);
   }
 
   ok(ct->vars->count == 3, "has 3 environment variables");
@@ -75,6 +76,7 @@ new_crontab_test (void) {
   }
 
   array_free(expected_envp_entries, free);
+  free_crontab(ct);
   close(crontab_fd);
 }
 
@@ -93,24 +95,21 @@ new_crontab_test_2 (void) {
 
   crontab_t* ct      = new_crontab(crontab_fd, false, now, now, test_uname);
   array_t*   entries = ct->entries;
+  close(crontab_fd);
 
   // clang-format off
   cron_entry expected_entries[] = {
-    { .cmd      = "root    cd / && run-parts --report /etc/cron.hourly",
-      .schedule = "17 * * * *",
-      .parent   = ct
+    { .info   = &(cron_entry_info){ .cmd = "root    cd / && run-parts --report /etc/cron.hourly", .schedule = "17 * * * *" },
+      .parent = ct
     },
-    { .cmd      = "root	test -x /usr/sbin/anacron || ( cd / && run-parts --report /etc/cron.daily )",
-      .schedule = "25 6 * * *",
-      .parent   = ct
+    { .info   = &(cron_entry_info){ .cmd = "root	test -x /usr/sbin/anacron || ( cd / && run-parts --report /etc/cron.daily )", .schedule = "25 6 * * *" },
+      .parent = ct
     },
-    { .cmd      = "root	test -x /usr/sbin/anacron || ( cd / && run-parts --report /etc/cron.weekly )",
-      .schedule = "47 6 * * 7",
-      .parent   = ct
+    { .info   = &(cron_entry_info){ .cmd = "root	test -x /usr/sbin/anacron || ( cd / && run-parts --report /etc/cron.weekly )", .schedule = "47 6 * * 7" },
+      .parent = ct
     },
-    { .cmd      = "root	test -x /usr/sbin/anacron || ( cd / && run-parts --report /etc/cron.monthly )",
-      .schedule = "52 6 1 * *",
-      .parent   = ct
+    { .info   = &(cron_entry_info){ .cmd = "root	test -x /usr/sbin/anacron || ( cd / && run-parts --report /etc/cron.monthly )", .schedule = "52 6 1 * *" },
+      .parent = ct
     }
   };
   // clang-format on
@@ -123,7 +122,6 @@ new_crontab_test_2 (void) {
     cron_entry* actual   = array_get(entries, i);
 
     validate_entry(actual, &expected);
-    free(actual);
   }
 
   ok(ct->vars->count == 2, "has 2 environment variables");
@@ -142,9 +140,68 @@ new_crontab_test_2 (void) {
   }
 
   array_free(expected_envp_entries, free);
+  free_crontab(ct);
   close(crontab_fd);
 }
 
+static void
+long_command_test (void) {
+  // Longer than both the old 256-byte command limit and a stdio line buffer
+  char cmd[4096];
+  memset(cmd, 'x', sizeof(cmd) - 1);
+  memcpy(cmd, "echo ", 5);
+  cmd[sizeof(cmd) - 1] = '\0';
+
+  char* dirname        = setup_test_directory();
+  char* content        = s_fmt("0 * * * * %s\n*/5 * * * * date\n", cmd);
+  setup_test_file(dirname, "user1", content);
+
+  char*      fpath = s_fmt("%s/%s", dirname, "user1");
+  int        fd    = get_fd(fpath);
+  time_t     now   = time(NULL);
+  crontab_t* ct    = new_crontab(fd, false, now, now, "user1");
+  ok(close(fd) == 0, "leaves the caller's fd for the caller to close");
+
+  ok(array_size(ct->entries) == 2, "parses entries with long commands as one line");
+  eq_str(((cron_entry*)array_get(ct->entries, 0))->info->cmd, cmd, "keeps long commands whole");
+
+  free_crontab(ct);
+  cleanup_test_file(dirname, "user1");
+  cleanup_test_directory(dirname);
+  free(fpath);
+  free(content);
+}
+
+static void
+shared_expr_test (void) {
+  char* dirname = setup_test_directory();
+  setup_test_file(dirname, "user1", "0,30 * * * * date\n0-59/30 * * * * uptime\n0 2 * * 1 date\n");
+
+  char*      fpath  = s_fmt("%s/%s", dirname, "user1");
+  int        fd     = get_fd(fpath);
+  time_t     now    = time(NULL);
+  size_t     before = exprpool_count();
+  crontab_t* ct     = new_crontab(fd, false, now, now, "user1");
+  close(fd);
+
+  cron_entry* a     = array_get(ct->entries, 0);
+  cron_entry* b     = array_get(ct->entries, 1);
+  cron_entry* c     = array_get(ct->entries, 2);
+  ok(a->expr == b->expr && a->expr != c->expr && exprpool_count() == before + 2, "entries on the same schedule share an expression");
+  ok((char*)b - (char*)a < (ptrdiff_t)(sizeof(cron_entry) + sizeof(cron_entry_info)), "keeps entries back to back, apart from their infos");
+  ok(
+    a->next == cron_next(&a->expr->expr, now) && exprpool_next(c->expr, now + 3600) == cron_next(&c->expr->expr, now + 3600),
+    "shared expressions compute the same next fire time as cron_next"
+  );
+
+  free_crontab(ct);
+  ok(exprpool_count() == before, "frees shared expressions with their last entry");
+
+  cleanup_test_file(dirname, "user1");
+  cleanup_test_directory(dirname);
+  free(fpath);
+}
+
 static void
 scan_crontabs_test (void) {
   char* usr_dirname = setup_test_directory();
@@ -154,8 +211,8 @@ scan_crontabs_test (void) {
 
   dir_config usr_dir = {.is_root = false, .path = usr_dirname};
 
-  hash_table* db     = ht_init(0, (free_fn*)free_crontab);
-  hash_table* new_db = ht_init(0, (free_fn*)free_crontab);
+  hash_table* db     = ht_init(0, (free_fn*)release_crontab);
+  hash_table* new_db = ht_init(0, (free_fn*)release_crontab);
   time_t      now    = time(NULL);
 
   scan_crontabs(db, new_db, &usr_dir, now);
@@ -184,7 +241,7 @@ scan_crontabs_test (void) {
   sleep(1);
   modify_test_file(usr_dirname, "user3", "* * * * * echo 'sup dud'\n");
 
-  new_db = ht_init(0, (free_fn*)free_crontab);
+  new_db = ht_init(0, (free_fn*)release_crontab);
   scan_crontabs(db, new_db, &usr_dir, now);
   *db = *new_db;
 
@@ -221,10 +278,12 @@ update_db_test (void) {
   setup_test_file(sys_dirname, "root2", "* * * * * echo 'test2'\n");
   dir_config sys_dir = {.is_root = true, .path = sys_dirname};
 
-  hash_table* db     = ht_init(0, (free_fn*)free_crontab);
+  hash_table* db     = ht_init(0, (free_fn*)release_crontab);
   time_t      now    = time(NULL);
 
-  db                 = update_db(db, now, &usr_dir, &sys_dir, NULL);
+  hash_table* old_db = db;
+  db                 = update_db(old_db, now, &usr_dir, &sys_dir, NULL);
+  ht_delete_table(old_db);
 
   ok(db->count == 4, "Four crontab files should have been processed");
 
@@ -252,7 +311,9 @@ update_db_test (void) {
   modify_test_file(usr_dirname, "user1", "* * * * * echo 'sup dud'\n");
   modify_test_file(sys_dirname, "root2", "* * * * * echo 'sup dud'\n");
 
-  db  = update_db(db, now, &usr_dir, &sys_dir, NULL);
+  old_db = db;
+  db     = update_db(old_db, now, &usr_dir, &sys_dir, NULL);
+  ht_delete_table(old_db);
 
   ct1 = (crontab_t*)ht_get(db, s_fmt("%s/%s", usr_dirname, "user1"));
   ct2 = (crontab_t*)ht_get(db, s_fmt("%s/%s", usr_dirname, "user2"));
@@ -274,6 +335,45 @@ update_db_test (void) {
   ht_delete_table(db);
 }
 
+static void
+lazy_renew_test (void) {
+  char* dirname = setup_test_directory();
+  setup_test_file(dirname, "user1", "0 * * * * date\n30 2 * * * uptime\n");
+  dir_config dir  = {.is_root = false, .path = dirname};
+  char*      key  = s_fmt("%s/%s", dirname, "user1");
+
+  // 2024-01-31 08:59:40
+  time_t      now = 1706691580;
+  hash_table* old = ht_init(0, (free_fn*)release_crontab);
+  hash_table* db  = update_db(old, now, &dir, NULL);
+  ht_delete_table(old);
+
+  crontab_t*  ct      = ht_get(db, key);
+  cron_entry* hourly  = array_get(ct->entries, 0);
+  time_t      next    = hourly->next;
+  uint64_t    renewed = metrics_get(METRIC_ENTRIES_RENEWED);
+
+  // Hours on, over the same unmodified crontab
+  old = db;
+  db  = update_db(old, now + 4 * 3600, &dir, NULL);
+  ht_delete_table(old);
+  ok(
+    ht_get(db, key) == ct && metrics_get(METRIC_ENTRIES_RENEWED) == renewed && hourly->next == next,
+    "doesn't renew the entries of unmodified crontabs"
+  );
+
+  renew_crontabs(db, now + 4 * 3600);
+  ok(
+    metrics_get(METRIC_ENTRIES_RENEWED) == renewed + 2 && hourly->next == cron_next(&hourly->expr->expr, now + 4 * 3600),
+    "renews every entry when asked to"
+  );
+
+  cleanup_test_file(dirname, "user1");
+  cleanup_test_directory(dirname);
+  ht_delete_table(db);
+  free(key);
+}
+
 static void
 run_virtual_crontabs_tests (void) {
   char* dirname = setup_test_directory();
@@ -284,8 +384,9 @@ run_virtual_crontabs_tests (void) {
   char* fpath1   = s_fmt("%s/%s", dirname, "1");
   char* fpath2   = s_fmt("%s/%s", dirname, "2");
 
-  hash_table* db = ht_init(0, (free_fn*)free_crontab);
-  db             = update_db(db, time(NULL), &dir, NULL);
+  hash_table* old_db = ht_init(0, (free_fn*)release_crontab);
+  hash_table* db     = update_db(old_db, time(NULL), &dir, NULL);
+  ht_delete_table(old_db);
 
   ok(db->count == 2, "Two virtual crontab files should have been processed");
 
@@ -301,15 +402,17 @@ run_virtual_crontabs_tests (void) {
   cron_entry* ce1 = array_get(ct1->entries, 0);
   cron_entry* ce2 = array_get(ct2->entries, 0);
 
-  eq_str(ce1->cmd, fpath1, "uses executable name as cmd");
-  eq_str(ce2->cmd, fpath2, "uses executable name as cmd");
+  eq_str(ce1->info->cmd, fpath1, "uses executable name as cmd");
+  eq_str(ce2->info->cmd, fpath2, "uses executable name as cmd");
 
-  eq_str(ce1->schedule, HOURLY_EXPR, "has a once hourly schedule");
-  eq_str(ce2->schedule, HOURLY_EXPR, "has a once hourly schedule");
+  eq_str(ce1->info->schedule, HOURLY_EXPR, "has a once hourly schedule");
+  eq_str(ce2->info->schedule, HOURLY_EXPR, "has a once hourly schedule");
 
   cleanup_test_file(dirname, "1");
 
-  db = update_db(db, time(NULL), &dir, NULL);
+  old_db = db;
+  db     = update_db(old_db, time(NULL), &dir, NULL);
+  ht_delete_table(old_db);
 
   ok(db->count == 1, "Only one virtual crontab file exists in the database after deleting one and re-processing");
 
@@ -323,7 +426,10 @@ void
 run_crontab_tests (void) {
   new_crontab_test();
   new_crontab_test_2();
+  long_command_test();
+  shared_expr_test();
   scan_crontabs_test();
   update_db_test();
+  lazy_renew_test();
   run_virtual_crontabs_tests();
 }
@@ -0,0 +1,119 @@
+#include "db.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "api/commands.h"
+#include "crontab.h"
+#include "tests.h"
+
+#define STRESS_READERS    4
+#define STRESS_ITERATIONS 250
+
+static atomic_bool  stop_readers;
+static atomic_uint  num_reads;
+static atomic_uint  num_bad_reads;
+
+static void*
+stress_reader (void* arg) {
+  while (!atomic_load(&stop_readers)) {
+    buffer_t* buf = buffer_init(NULL);
+    write_crontabs_info(buf, NULL, 0);
+
+    const char* ret = buffer_state(buf);
+    size_t      len = buffer_size(buf);
+    if (len < 2 || ret[0] != '[' || ret[len - 1] != ']' || !strstr(ret, "\"owner\":\"stable\"")) {
+      atomic_fetch_add(&num_bad_reads, 1);
+    }
+
+    buffer_free(buf);
+    atomic_fetch_add(&num_reads, 1);
+  }
+
+  return NULL;
+}
+
+static void
+db_snapshot_pin_test (void) {
+  ok(db_acquire() == NULL, "nothing to pin before the first publish");
+
+  hash_table* a = ht_init(0, (free_fn*)release_crontab);
+  hash_table* b = ht_init(0, (free_fn*)release_crontab);
+
+  db_publish(a);
+  db_snapshot* snap = db_acquire();
+  ok(snap != NULL && snap->crontabs == a, "pins the published version");
+
+  db_publish(b);
+  ok(snap->crontabs == a, "a pinned snapshot is unaffected by a subsequent publish");
+  ok(db_reclaim() == 1, "a pinned snapshot is not reclaimed");
+
+  db_snapshot* next = db_acquire();
+  ok(next->crontabs == b && next->version > snap->version, "new readers see the new version");
+  db_release(next);
+
+  db_release(snap);
+  ok(db_reclaim() == 0, "a drained snapshot is reclaimed");
+
+  db_publish(NULL);
+  ok(db_reclaim() == 0, "retiring an unpinned snapshot reclaims it immediately");
+}
+
+static void
+db_stress_test (void) {
+  char* dirname = setup_test_directory();
+  setup_test_file(dirname, "stable", "* * * * * echo 'stable'\n");
+  dir_config dir = {.is_root = false, .path = dirname};
+
+  hash_table* empty   = ht_init(0, (free_fn*)release_crontab);
+  hash_table* working = update_db(empty, time(NULL), &dir, NULL);
+  ht_delete_table(empty);
+  db_publish(working);
+
+  atomic_store(&stop_readers, false);
+  atomic_store(&num_reads, 0);
+  atomic_store(&num_bad_reads, 0);
+
+  pthread_t readers[STRESS_READERS];
+  for (unsigned int i = 0; i < STRESS_READERS; i++) {
+    pthread_create(&readers[i], NULL, stress_reader, NULL);
+  }
+
+  // Continuously add and remove crontabs so every version frees the crontabs its predecessor had
+  char fname[32];
+  for (unsigned int i = 0; i < STRESS_ITERATIONS; i++) {
+    snprintf(fname, sizeof(fname), "churn%u", i);
+    setup_test_file(dirname, fname, "* * * * * echo 'churn'\n*/5 * * * * echo 'churn again'\n");
+    if (i > 0) {
+      snprintf(fname, sizeof(fname), "churn%u", i - 1);
+      cleanup_test_file(dirname, fname);
+    }
+
+    working = update_db(working, time(NULL), &dir, NULL);
+    db_publish(working);
+  }
+
+  atomic_store(&stop_readers, true);
+  for (unsigned int i = 0; i < STRESS_READERS; i++) {
+    pthread_join(readers[i], NULL);
+  }
+
+  ok(atomic_load(&num_reads) > 0, "readers completed %u listings during churn", atomic_load(&num_reads));
+  ok(atomic_load(&num_bad_reads) == 0, "no listing observed a torn or freed db");
+  ok(db_reclaim() == 0, "all retired versions are reclaimed once readers drain");
+  ok(working->count == 2, "the final version has the stable and latest churn crontabs");
+
+  db_publish(NULL);
+
+  snprintf(fname, sizeof(fname), "churn%u", STRESS_ITERATIONS - 1);
+  cleanup_test_file(dirname, fname);
+  cleanup_test_file(dirname, "stable");
+  cleanup_test_directory(dirname);
+}
+
+void
+run_db_tests (void) {
+  db_snapshot_pin_test();
+  db_stress_test();
+}
@@ -0,0 +1,212 @@
+#include <string.h>
+
+#include "libhash/libhash.h"
+#include "tests.h"
+
+#define N_KEYS 20000
+
+static unsigned int freed = 0;
+
+static void
+count_free (void *value __attribute__((unused))) {
+  freed++;
+}
+
+static void
+key_for (char *buf, size_t sz, unsigned int i) {
+  snprintf(buf, sz, "/var/spool/cron/user%u", i);
+}
+
+static void
+table_test (void) {
+  hash_table *ht = ht_init(0, count_free);
+  char        key[64];
+
+  for (unsigned int i = 0; i < N_KEYS; i++) {
+    key_for(key, sizeof(key), i);
+    ht_insert(ht, key, (void *)(uintptr_t)(i + 1));
+  }
+  ok(ht->count == N_KEYS, "grows to fit every key");
+
+  unsigned int found = 0;
+  for (unsigned int i = 0; i < N_KEYS; i++) {
+    key_for(key, sizeof(key), i);
+    found += ht_get(ht, key) == (void *)(uintptr_t)(i + 1);
+  }
+  ok(found == N_KEYS, "finds every key");
+
+  ht_insert(ht, "/var/spool/cron/user7", (void *)1);
+  ok(ht->count == N_KEYS && ht_get(ht, "/var/spool/cron/user7") == (void *)1, "updates existing keys in place");
+
+  // Deleting leaves sentinels behind; keys past them must stay reachable
+  unsigned int deleted = 0;
+  for (unsigned int i = 0; i < N_KEYS; i += 2) {
+    key_for(key, sizeof(key), i);
+    deleted += ht_delete(ht, key);
+  }
+  ok(deleted == N_KEYS / 2 && freed == N_KEYS / 2 && ht->count == N_KEYS / 2, "deletes keys and frees their values");
+
+  unsigned int kept = 0, gone = 0;
+  for (unsigned int i = 0; i < N_KEYS; i++) {
+    key_for(key, sizeof(key), i);
+    if (i % 2) {
+      kept += ht_get(ht, key) != NULL;
+    } else {
+      gone += ht_get(ht, key) == NULL;
+    }
+  }
+  ok(kept == N_KEYS / 2 && gone == N_KEYS / 2, "finds keys that probed past deleted ones");
+
+  unsigned int iterated = 0;
+  HT_ITER_START(ht)
+  iterated += entry->key != NULL;
+  HT_ITER_END
+  ok(iterated == ht->count, "iterates every live entry once");
+
+  ok(ht_delete(ht, "nope") == 0 && ht_search(ht, "") == NULL, "misses unknown keys");
+
+  // The table keeps its own copy of each key
+  strcpy(key, "borrowed");
+  ht_insert(ht, key, (void *)1);
+  strcpy(key, "mutated");
+  ok(ht_get(ht, "borrowed") == (void *)1 && ht_get(ht, "mutated") == NULL, "copies keys");
+
+  ht_delete_table(ht);
+}
+
+static void
+churn_test (void) {
+  // Reusing a small table keeps it full of sentinels, which must not fill it
+  hash_table *ht = ht_init(0, NULL);
+  char        key[64];
+
+  for (unsigned int i = 0; i < N_KEYS; i++) {
+    key_for(key, sizeof(key), i);
+    ht_insert(ht, key, key);
+    ht_insert(ht, "pinned", key);
+    ht_delete(ht, key);
+  }
+  ok(ht->count == 1 && ht_get(ht, "pinned") != NULL, "survives insert/delete churn");
+
+  ht_delete_table(ht);
+}
+
+static unsigned int
+deleted_slots (hash_table *ht) {
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < ht->capacity; i++) {
+    n += ht->ctrl[i] == HT_CTRL_DELETED;
+  }
+
+  return n;
+}
+
+static void
+migrate_deleted_test (void) {
+  hash_table *ht = ht_init(0, NULL);
+  char        key[64];
+
+  // Stop right after a grow, with the old slots still to move
+  unsigned int n = 0;
+  do {
+    key_for(key, sizeof(key), n++);
+    ht_insert(ht, key, key);
+  } while (!ht->old_ctrl || n < 1000 || ht->migrated > HT_GROUP_SIZE * 4);
+
+  // Mark a tenth of the new slots deleted, as churn would, for moving keys to land in
+  for (unsigned int i = 0; i < ht->capacity / 10; i++) {
+    if (ht->ctrl[i] == HT_CTRL_EMPTY) {
+      ht->ctrl[i] = HT_CTRL_DELETED;
+      ht->deleted++;
+    }
+  }
+  while (ht->old_ctrl) {
+    key_for(key, sizeof(key), n++);
+    ht_insert(ht, key, key);
+  }
+  ok(ht->deleted == deleted_slots(ht), "counts deleted slots reused by moving keys (%u, %u)", ht->deleted, deleted_slots(ht));
+
+  ht_delete_table(ht);
+}
+
+static void
+resize_test (void) {
+  hash_table *ht = ht_init(0, NULL);
+  char        key[64];
+
+  // Stop right after a grow, with entries left in the old slots
+  unsigned int n = 0;
+  do {
+    key_for(key, sizeof(key), n);
+    ht_insert(ht, key, (void *)(uintptr_t)(n + 1));
+    n++;
+  } while (!ht->old_ctrl || ht->migrated == 0 || n < 1000);
+
+  unsigned int found = 0, iterated = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    key_for(key, sizeof(key), i);
+    found += ht_get(ht, key) == (void *)(uintptr_t)(i + 1);
+  }
+  HT_ITER_START(ht)
+  iterated++;
+  HT_ITER_END
+  ok(ht->old_ctrl && found == n && iterated == n, "finds and iterates every key mid-resize");
+
+  // Update one entry still in the old slots, and delete another
+  unsigned int in_old[2], n_old = 0;
+  for (unsigned int i = 0; i < n && n_old < 2; i++) {
+    key_for(key, sizeof(key), i);
+    ht_entry *r = ht_search(ht, key);
+    if (r >= ht->old_entries && r < ht->old_entries + ht->old_capacity) {
+      in_old[n_old++] = i;
+    }
+  }
+  key_for(key, sizeof(key), in_old[0]);
+  ht_insert(ht, key, (void *)1);
+  bool updated = ht_get(ht, key) == (void *)1;
+  key_for(key, sizeof(key), in_old[1]);
+  ht_delete(ht, key);
+  ok(n_old == 2 && updated && ht->count == n - 1 && ht_get(ht, key) == NULL, "updates and deletes mid-resize");
+
+  // Hovering around either threshold must not keep resizing the table
+  unsigned int capacity = ht->capacity, resizes = 0;
+  for (unsigned int r = 0; r < 1000; r++) {
+    key_for(key, sizeof(key), N_KEYS + r);
+    ht_insert(ht, key, key);
+    ht_delete(ht, key);
+    resizes  += ht->capacity != capacity;
+    capacity  = ht->capacity;
+  }
+  ok(resizes == 0, "doesn't thrash around a resize threshold");
+
+  ht_delete_table(ht);
+}
+
+static void
+set_test (void) {
+  hash_set *hs = hs_init(0);
+  char      key[64];
+
+  for (unsigned int i = 0; i < 1000; i++) {
+    key_for(key, sizeof(key), i);
+    hs_insert(hs, key);
+  }
+
+  unsigned int found = 0;
+  for (unsigned int i = 0; i < 1000; i++) {
+    key_for(key, sizeof(key), i);
+    found += hs_contains(hs, key);
+  }
+  ok(hs->count == 1000 && found == 1000 && !hs_contains(hs, "nope"), "hash sets find every key");
+
+  hs_delete_set(hs);
+}
+
+void
+run_hash_tests (void) {
+  table_test();
+  churn_test();
+  resize_test();
+  migrate_deleted_test();
+  set_test();
+}
@@ -2,8 +2,11 @@
 
 #include "api/commands.h"
 #include "crontab.h"
+#include "db.h"
 #include "globals.h"
 #include "job.h"
+#include "logger.h"
+#include "pause.h"
 #include "proginfo.h"
 #include "tests.h"
 #include "utils/json.h"
@@ -12,8 +15,13 @@
 #define TIMESTAMP_REGEX \
   "\\d{4}-\\d{2}-\\d{2}T\\d{2}:\\d{2}:\\d{2}(?:\\.\\d{3})?Z"
 
+#define ID_REGEX "[0-9a-f]{16}"
+
+// Neither root nor the daemon's user, and owns none of the test crontabs
+#define STRANGER 4242
+
 #define UUID_REGEX \
-  "[0-9a-f]{8}-[0-9a-f]{4}-[0-9a-f]{4}-[0-9a-f]{4}-[0-9a-f]{12}"
+  "[0-9a-f]{8}-[0-9a-f]{4}-8[0-9a-f]{3}-[89ab][0-9a-f]{3}-[0-9a-f]{12}"
 
 hash_table* test_db;
 char*       usr_dirname;
@@ -33,10 +41,12 @@ setup_test_data (void) {
   setup_test_file(sys_dirname, "root2", "* * * * * echo 'test2'\n");
   dir_config sys_dir = {.is_root = true, .path = sys_dirname};
 
-  hash_table* tmp_db = ht_init(0, (free_fn*)free_crontab);
+  hash_table* tmp_db = ht_init(0, (free_fn*)release_crontab);
   time_t      now    = time(NULL);
 
   test_db            = update_db(tmp_db, now, &usr_dir, &sys_dir, NULL);
+  ht_delete_table(tmp_db);
+  db_publish(test_db);
 }
 
 static inline void
@@ -47,7 +57,15 @@ teardown_test_data (void) {
   cleanup_test_file(sys_dirname, "root2");
   cleanup_test_directory(usr_dirname);
   cleanup_test_directory(sys_dirname);
-  ht_delete_table(test_db);
+  // Retires (and frees) the test db
+  db_publish(NULL);
+}
+
+static hash_table*
+make_args (const char* json) {
+  hash_table* args = ht_init(0, free);
+  parse_json(json, args);
+  return args;
 }
 
 static void
@@ -65,19 +83,20 @@ test_write_jobs_info (void) {
   HT_ITER_END
 
   buffer_t* buf = buffer_init(NULL);
-  write_jobs_info(buf);
+  write_jobs_info(buf, NULL, 0);
 
   // Shitty approx tests until we setup a proper JSON parser
   // TODO: Proper parser
   const char* ret = buffer_state(buf);
 
   ok(strlen(ret) > 32, "approx len looks OK");
-  match_str(ret, "\"id\":\"" UUID_REGEX "\"", "has valid job id");
+  match_str(ret, "\"id\":\"" ID_REGEX "\"", "has valid job id");
   match_str(ret, "\"mailto\":\"root\"", "has mailto for root");
   match_str(ret, "\"mailto\":\"user1\"", "has mailto for user1");
   match_str(ret, "\"mailto\":\"user2\"", "has mailto for user2");
   match_str(ret, "\"state\":\"PENDING\"", "has state");
   match_str(ret, "\"next\":\"" TIMESTAMP_REGEX "\"", "has valid next timestamps");
+  match_str(ret, "\"next\":\"\\d{4}-\\d{2}-\\d{2}T\\d{2}:\\d{2}:\\d{2}\\.000Z\"", "keeps whole-second next timestamps");
 
   buffer_free(buf);
   array_free(job_queue, (free_fn*)free_cronjob);
@@ -87,9 +106,8 @@ test_write_jobs_info (void) {
 static void
 test_write_crontabs_info (void) {
   setup_test_data();
-  db            = test_db;
   buffer_t* buf = buffer_init(NULL);
-  write_crontabs_info(buf);
+  write_crontabs_info(buf, NULL, 0);
 
   const char* ret = buffer_state(buf);
 
@@ -102,9 +120,16 @@ test_write_crontabs_info (void) {
   match_str(ret, "\"owner\":\"root\"", "has expected owner");
   match_str(ret, "\"owner\":\"user1\"", "has expected owner");
   match_str(ret, "\"owner\":\"user2\"", "has expected owner");
-  match_str(ret, "\"id\":\"" UUID_REGEX "\"", "has valid entry id");
+  match_str(ret, "\"id\":\"" ID_REGEX "\"", "has valid entry id");
   match_str(ret, "\"next\":\"" TIMESTAMP_REGEX "\"", "has valid next timestamps");
+  buffer_free(buf);
 
+  hash_table* args = make_args("{\"command\":\"IPC_LIST_CRONTABS\",\"format\":\"msgpack\"}");
+  buf              = buffer_init(NULL);
+  write_crontabs_info(buf, args, 0);
+  ok((unsigned char)buffer_state(buf)[0] == 0x94, "encodes MessagePack when asked to (an array of 4 entries)");
+
+  ht_delete_table(args);
   buffer_free(buf);
   teardown_test_data();
 }
@@ -118,9 +143,9 @@ test_write_program_info (void) {
   memcpy(proginfo.version, "777", 4);
 
   buffer_t* buf = buffer_init(NULL);
-  write_program_info(buf);
+  write_program_info(buf, NULL, 0);
 
-  hash_table* ht = ht_init(HT_DEFAULT_CAPACITY, free);
+  hash_table* ht = ht_init(0, free);
 
   ok(parse_json(buffer_state(buf), ht) == OK, "is valid JSON");
   eq_str(ht_get(ht, "pid"), "123", "has correct pid");
@@ -132,9 +157,188 @@ test_write_program_info (void) {
   ht_delete_table(ht);
 }
 
+static void
+test_handle_pause (void) {
+  setup_test_data();
+
+  HT_ITER_START(test_db)
+  if (strstr(entry->key, "user1")) {
+    crontab_t*  ct   = entry->value;
+    cron_entry* ce   = array_get(ct->entries, 0);
+    char        ident[IDENT_STR_LEN];
+    char*       json = s_fmt("{\"command\":\"IPC_PAUSE\",\"id\":\"%s\"}", ident_format(ce->info->id, ident));
+
+    hash_table* args = make_args(json);
+    buffer_t*   buf  = buffer_init(NULL);
+    handle_pause(buf, args, 0);
+    match_str(buffer_state(buf), "\"paused\":true", "acknowledges the pause");
+
+    char* key = pause_entry_key(entry->key, ce);
+    ok(pause_state_get(key), "records the pause in the registry");
+
+    buffer_free(buf);
+    buf = buffer_init(NULL);
+    handle_resume(buf, args, STRANGER);
+    eq_str(buffer_state(buf), "{\"error\":\"permission denied\"}", "won't resume others' entries");
+    ok(pause_state_get(key), "leaves others' entries paused");
+
+    pause_state_sync(test_db);
+    ok(ce->paused, "pause is applied to the entry on sync");
+
+    buffer_free(buf);
+    buf = buffer_init(NULL);
+    write_crontabs_info(buf, NULL, 0);
+    match_str(buffer_state(buf), "\"paused\":true", "is reported by IPC_LIST_CRONTABS");
+
+    buffer_free(buf);
+    buf = buffer_init(NULL);
+    handle_resume(buf, args, 0);
+    pause_state_sync(test_db);
+    ok(!pause_state_get(key) && !ce->paused, "resumes");
+
+    buffer_free(buf);
+    ht_delete_table(args);
+    free(key);
+    free(json);
+  }
+  HT_ITER_END
+
+  buffer_t*   buf  = buffer_init(NULL);
+  hash_table* args = make_args("{\"command\":\"IPC_PAUSE\",\"id\":\"nope\"}");
+  handle_pause(buf, args, 0);
+  eq_str(buffer_state(buf), "{\"error\":\"no such entry\"}", "rejects unknown entries");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  args = make_args("{\"command\":\"IPC_PAUSE\",\"crontab\":\"/etc/cron.d/nope\"}");
+  buf  = buffer_init(NULL);
+  handle_pause(buf, args, STRANGER);
+  eq_str(buffer_state(buf), "{\"error\":\"permission denied\"}", "won't pause crontabs it can't tell the owner of");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  buf = buffer_init(NULL);
+  handle_pause(buf, NULL, 0);
+  eq_str(buffer_state(buf), "{\"error\":\"missing id or crontab\"}", "requires an id or crontab");
+  buffer_free(buf);
+
+  teardown_test_data();
+}
+
+static void
+test_job_control (void) {
+  job_queue = array_init();
+  setup_test_data();
+
+  HT_ITER_START(test_db)
+  crontab_t* ct = entry->value;
+  array_push(job_queue, (void*)new_cronjob(array_get(ct->entries, 0)));
+  HT_ITER_END
+
+  job_t*      job  = array_get(job_queue, 0);
+  char        ident[IDENT_STR_LEN];
+  char*       json = s_fmt("{\"command\":\"IPC_JOB_INFO\",\"id\":\"%s\",\"signal\":9}", ident_format(job->id, ident));
+  hash_table* args = make_args(json);
+
+  buffer_t* buf    = buffer_init(NULL);
+  write_job_info(buf, args, 0);
+  match_str(buffer_state(buf), "^\\{\"id\":\"" ID_REGEX "\"", "job info has the job id");
+  match_str(buffer_state(buf), "\"state\":\"PENDING\",\"pid\":-1,\"ret\":-1", "job info has the state, pid and ret");
+  buffer_free(buf);
+
+  buf = buffer_init(NULL);
+  handle_kill_job(buf, args, 0);
+  eq_str(buffer_state(buf), "{\"error\":\"job is not running\"}", "won't signal a job that isn't running");
+  buffer_free(buf);
+
+  buf = buffer_init(NULL);
+  handle_kill_job(buf, args, STRANGER);
+  eq_str(buffer_state(buf), "{\"error\":\"permission denied\"}", "won't signal others' jobs");
+  buffer_free(buf);
+
+  job->owner = STRANGER;
+  buf        = buffer_init(NULL);
+  handle_kill_job(buf, args, STRANGER);
+  eq_str(buffer_state(buf), "{\"error\":\"job is not running\"}", "lets users signal their own jobs");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  char* run = s_fmt("{\"command\":\"IPC_RUN_NOW\",\"id\":\"%s\"}", ident_format(job->entry_id, ident));
+  args      = make_args(run);
+  buf       = buffer_init(NULL);
+  handle_run_now(buf, args, STRANGER);
+  eq_str(buffer_state(buf), "{\"error\":\"permission denied\"}", "won't run others' entries");
+  buffer_free(buf);
+  ht_delete_table(args);
+  free(run);
+
+  args = make_args("{\"command\":\"IPC_KILL_JOB\",\"id\":\"x\",\"signal\":\"abc\"}");
+  buf  = buffer_init(NULL);
+  handle_kill_job(buf, args, 0);
+  eq_str(buffer_state(buf), "{\"error\":\"invalid signal\"}", "rejects invalid signals");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  // Clients that expect UUIDs get them, and may pass them back
+  opts.uuid_ids = true;
+  free(json);
+  json = s_fmt("{\"command\":\"IPC_JOB_INFO\",\"id\":\"%s\"}", ident_format(job->id, ident));
+  args = make_args(json);
+  buf  = buffer_init(NULL);
+  write_job_info(buf, args, 0);
+  match_str(buffer_state(buf), "^\\{\"id\":\"" UUID_REGEX "\"", "renders job ids as UUIDs when asked to");
+  buffer_free(buf);
+  ht_delete_table(args);
+  opts.uuid_ids = false;
+
+  args = make_args("{\"command\":\"IPC_JOB_INFO\",\"id\":\"nope\"}");
+  buf  = buffer_init(NULL);
+  write_job_info(buf, args, 0);
+  eq_str(buffer_state(buf), "{\"error\":\"no such job\"}", "rejects unknown jobs");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  free(json);
+  array_free(job_queue, (free_fn*)free_cronjob);
+  teardown_test_data();
+}
+
+static void
+test_log_level (void) {
+  hash_table* args = make_args("{\"command\":\"IPC_LOG_LEVEL\",\"level\":\"info,job=debug\"}");
+  buffer_t*   buf  = buffer_init(NULL);
+  handle_log_level(buf, args, 0);
+  eq_str(
+    buffer_state(buf),
+    "{\"core\":\"info\",\"scan\":\"info\",\"sched\":\"info\",\"job\":\"debug\",\"ipc\":\"info\"}",
+    "sets and reports levels per category"
+  );
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  args = make_args("{\"command\":\"IPC_LOG_LEVEL\",\"level\":\"loud\"}");
+  buf  = buffer_init(NULL);
+  handle_log_level(buf, args, 0);
+  eq_str(buffer_state(buf), "{\"error\":\"invalid level\"}", "rejects invalid levels");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  args = make_args("{\"command\":\"IPC_LOG_LEVEL\",\"level\":\"error\"}");
+  buf  = buffer_init(NULL);
+  handle_log_level(buf, args, STRANGER);
+  eq_str(buffer_state(buf), "{\"error\":\"permission denied\"}", "only privileged callers set levels");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  logger_set_levels("debug");
+}
+
 void
 run_ipc_commands_test (void) {
   test_write_jobs_info();
   test_write_crontabs_info();
   test_write_program_info();
+  test_handle_pause();
+  test_job_control();
+  test_log_level();
 }
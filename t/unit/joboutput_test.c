@@ -0,0 +1,213 @@
+#include "joboutput.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "api/commands.h"
+#include "config.h"
+#include "globals.h"
+#include "metrics.h"
+#include "tests.h"
+#include "utils/json.h"
+
+#define JOB_ID     0x1b4e28ba00000001
+#define CAPPED_ID  0x1b4e28ba00000002
+#define FLOOD_ID   0x1b4e28ba00000003
+#define RETAIN_ID  0x1b4e28ba00001000
+#define LINKED_ID  0x1b4e28ba00000004
+#define OUTPUT_CAP 16
+// Neither root nor the daemon's user
+#define JOB_OWNER  4242
+// Well past the pipe's capacity, so the writer blocks unless we drain
+#define FLOOD_SIZE (256 * 1024)
+
+static void
+write_str (int fd, const char* s) {
+  write(fd, s, strlen(s));
+}
+
+static off_t
+file_size (ident_t id) {
+  char        path[256];
+  struct stat st;
+  joboutput_path(path, sizeof(path), id);
+  return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+static void
+remove_output (ident_t id) {
+  char path[256];
+  joboutput_path(path, sizeof(path), id);
+  unlink(path);
+}
+
+static void
+capture_test (void) {
+  joboutput_info info;
+  int            fd = joboutput_open(JOB_ID, JOB_OWNER);
+  ok(fd >= 0, "opens a pipe for the job's output");
+
+  write_str(fd, "hello ");
+  write_str(fd, "world\n");
+  ok(joboutput_stat(JOB_ID, &info) == OK && info.running, "reports output of running jobs");
+  close(fd);
+
+  ok(joboutput_finish(JOB_ID, &info) == OK && info.bytes == 12 && info.dropped == 0 && !info.running,
+     "collects the job's output once it exits");
+
+  buffer_t* buf = buffer_init(NULL);
+  ok(joboutput_read(JOB_ID, buf, &info) == OK && strcmp(buffer_state(buf), "hello world\n") == 0,
+     "keeps finished jobs' output");
+  buffer_free(buf);
+
+  ok(joboutput_finish(JOB_ID, &info) == ERR, "finishes a capture once");
+  ok(joboutput_stat(0, &info) == ERR, "has no output for unknown jobs");
+}
+
+static void
+cap_test (void) {
+  joboutput_info info;
+  uint64_t       dropped = metrics_get(METRIC_JOB_OUTPUT_DROPPED);
+
+  int fd = joboutput_open(CAPPED_ID, 0);
+  write_str(fd, "0123456789abcdef0123456789");
+  close(fd);
+
+  joboutput_finish(CAPPED_ID, &info);
+  ok(info.bytes == OUTPUT_CAP && info.dropped == 10 && file_size(CAPPED_ID) == OUTPUT_CAP,
+     "discards output past the cap");
+  ok(metrics_get(METRIC_JOB_OUTPUT_DROPPED) - dropped == 10, "counts discarded output");
+}
+
+static void
+drain_test (void) {
+  joboutput_info info;
+  int            fd = joboutput_open(FLOOD_ID, 0);
+
+  pid_t pid;
+  if ((pid = fork()) == 0) {
+    char chunk[4096];
+    memset(chunk, 'x', sizeof(chunk));
+    for (unsigned int i = 0; i < FLOOD_SIZE / sizeof(chunk); i++) {
+      write(fd, chunk, sizeof(chunk));
+    }
+    _exit(0);
+  }
+  close(fd);
+
+  // Only returns if the drain thread keeps the pipe from filling up
+  int status;
+  waitpid(pid, &status, 0);
+
+  joboutput_finish(FLOOD_ID, &info);
+  ok(info.bytes + info.dropped == FLOOD_SIZE, "drains output while the job runs (%zu bytes)", info.bytes + info.dropped);
+}
+
+static void
+ipc_test (void) {
+  hash_table* args = ht_init(0, free);
+  char        ident[IDENT_STR_LEN];
+  char*       json = s_fmt("{\"command\":\"IPC_JOB_OUTPUT\",\"id\":\"%s\"}", ident_format(JOB_ID, ident));
+  parse_json(json, args);
+  free(json);
+
+  buffer_t* buf = buffer_init(NULL);
+  write_job_output(buf, args, 0);
+  char* ret = buffer_state(buf);
+  match_str(ret, "\"output\":\"hello world\\\\u000a\"", "serves output over IPC");
+  match_str(ret, "\"running\":false", "reports whether the job is running");
+  buffer_free(buf);
+
+  buf = buffer_init(NULL);
+  write_job_output(buf, args, JOB_OWNER);
+  match_str(buffer_state(buf), "\"output\":\"hello world", "serves output to the job's owner");
+  buffer_free(buf);
+
+  buf = buffer_init(NULL);
+  write_job_output(buf, args, JOB_OWNER + 1);
+  eq_str(buffer_state(buf), "{\"error\":\"permission denied\"}", "doesn't serve others' output");
+  buffer_free(buf);
+  ht_delete_table(args);
+
+  args = ht_init(0, free);
+  parse_json("{\"command\":\"IPC_JOB_OUTPUT\",\"id\":\"../../etc/passwd\"}", args);
+  buf = buffer_init(NULL);
+  write_job_output(buf, args, 0);
+  match_str(buffer_state(buf), "no output for job", "only serves output of known jobs");
+  buffer_free(buf);
+  ht_delete_table(args);
+}
+
+static void
+retention_test (void) {
+  for (unsigned int i = 0; i < JOB_OUTPUT_KEEP; i++) {
+    close(joboutput_open(RETAIN_ID + i, 0));
+    joboutput_finish(RETAIN_ID + i, NULL);
+  }
+
+  ok(file_size(JOB_ID) < 0, "removes the oldest output files past the retention limit");
+
+  for (unsigned int i = 0; i < JOB_OUTPUT_KEEP; i++) {
+    remove_output(RETAIN_ID + i);
+  }
+}
+
+void
+run_joboutput_tests (void) {
+  char* dirname   = setup_test_directory();
+  opts.output_max = OUTPUT_CAP;
+
+  // Anyone could have made a directory others can write to, or a link to one
+  char* shared    = s_fmt("%s/shared", dirname);
+  char* link      = s_fmt("%s/link", dirname);
+  mkdir(shared, 0777);
+  chmod(shared, 0777);
+  symlink(dirname, link);
+  opts.output_dir = shared;
+  ok(joboutput_init() == ERR, "refuses an output directory others can write to");
+  opts.output_dir = link;
+  ok(joboutput_init() == ERR, "refuses an output directory that is a symlink");
+  unlink(link);
+  rmdir(shared);
+  free(link);
+  free(shared);
+
+  opts.output_dir = dirname;
+  // Leftovers from a previous run are removed, but nothing else
+  setup_test_file(dirname, "00000000000000aa.out", "");
+  setup_test_file(dirname, "notes.out", "");
+
+  ok(joboutput_init() == OK, "sets up job output capture");
+  char* stale = s_fmt("%s/00000000000000aa.out", dirname);
+  char* other = s_fmt("%s/notes.out", dirname);
+  ok(access(stale, F_OK) < 0, "removes stale output files");
+  ok(access(other, F_OK) == 0, "keeps files it didn't create");
+  unlink(other);
+  free(other);
+  free(stale);
+
+  char  path[256];
+  char* target = s_fmt("%s/target", dirname);
+  joboutput_path(path, sizeof(path), LINKED_ID);
+  setup_test_file(dirname, "target", "keep");
+  symlink(target, path);
+  ok(joboutput_open(LINKED_ID, 0) < 0 && file_size(LINKED_ID) == 4, "won't write output through a symlink");
+  unlink(path);
+  unlink(target);
+  free(target);
+
+  capture_test();
+  cap_test();
+  drain_test();
+  ipc_test();
+  retention_test();
+
+  remove_output(JOB_ID);
+  remove_output(CAPPED_ID);
+  remove_output(FLOOD_ID);
+  cleanup_test_directory(dirname);
+  opts.output_dir = NULL;
+  opts.output_max = JOB_OUTPUT_MAX;
+}
@@ -0,0 +1,102 @@
+#include "journal.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "globals.h"
+#include "metrics.h"
+#include "tests.h"
+#include "utils/time.h"
+
+#define JOB_ID   0x1b4e28ba2fa10027
+#define ENTRY_ID 0x6ba7b8109dad0001
+
+/**
+ * Maps a journal file read-only, as the decoder does.
+ */
+static journal_header*
+map_journal (const char* path, size_t* size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  *size               = lseek(fd, 0, SEEK_END);
+  journal_header* hdr = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  return hdr == MAP_FAILED ? NULL : hdr;
+}
+
+static void
+journal_append_test (void) {
+  char* dirname = setup_test_directory();
+  char* path    = s_fmt("%s/%s", dirname, "journal");
+  opts.journal  = path;
+
+  journal_init();
+
+  job_t job = {.id = JOB_ID, .entry_id = ENTRY_ID, .pid = 1234, .ret = -1, .type = CRON};
+  job.started_usec = get_monotonic_usec();
+  journal_append(JOURNAL_JOB_STARTED, &job, NULL);
+
+  struct rusage ru = {.ru_utime = {.tv_sec = 1, .tv_usec = 5}, .ru_maxrss = 2048};
+  job.ret          = 3;
+  journal_append(JOURNAL_JOB_EXITED, &job, &ru);
+
+  size_t          size;
+  journal_header* hdr = map_journal(path, &size);
+  ok(hdr && hdr->magic == JOURNAL_MAGIC && hdr->version == JOURNAL_VERSION, "creates the journal with a header");
+  ok(size <= JOURNAL_MAX_BYTES && size == sizeof(journal_header) + hdr->capacity * sizeof(journal_record),
+     "preallocates the journal up to its size cap");
+  ok(atomic_load(&hdr->count) == 2, "publishes appended records");
+
+  journal_record* recs = (journal_record*)(hdr + 1);
+  ok(recs[0].type == JOURNAL_JOB_STARTED && recs[0].pid == 1234 && recs[0].status == -1, "records the start event");
+  ok(recs[0].job_id[0] == 0x1b && recs[0].job_id[7] == 0x02 && recs[0].entry_id[0] == 0x6b,
+     "stores the job and entry ids as raw UUIDs");
+  ok(recs[1].type == JOURNAL_JOB_EXITED && recs[1].status == 3, "records the exit status");
+  ok(recs[1].utime_usec == 1000005 && recs[1].maxrss_kb == 2048, "records resource usage");
+  munmap(hdr, size);
+
+  // A restarted daemon picks up where the last one left off
+  journal_close();
+  journal_init();
+  journal_append(JOURNAL_JOB_STARTED, &job, NULL);
+
+  hdr = map_journal(path, &size);
+  ok(atomic_load(&hdr->count) == 3, "continues an existing journal");
+  uint32_t capacity = hdr->capacity;
+  munmap(hdr, size);
+
+  uint64_t rotations = metrics_get(METRIC_JOURNAL_ROTATIONS);
+  for (uint32_t i = 3; i <= capacity; i++) {
+    journal_append(JOURNAL_JOB_STARTED, &job, NULL);
+  }
+  ok(metrics_get(METRIC_JOURNAL_ROTATIONS) == rotations + 1, "rotates the journal once full");
+
+  char* rotated = s_fmt("%s.1", path);
+  hdr           = map_journal(rotated, &size);
+  ok(hdr && atomic_load(&hdr->count) == capacity, "keeps the full journal as <path>.1");
+  munmap(hdr, size);
+
+  hdr = map_journal(path, &size);
+  ok(hdr && atomic_load(&hdr->count) == 1, "starts a new journal");
+  munmap(hdr, size);
+
+  journal_close();
+  opts.journal = NULL;
+  unlink(path);
+  unlink(rotated);
+  free(rotated);
+  free(path);
+  cleanup_test_directory(dirname);
+}
+
+void
+run_journal_tests (void) {
+  journal_append_test();
+}
@@ -0,0 +1,286 @@
+#include "logger.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "globals.h"
+#include "metrics.h"
+#include "tests.h"
+
+#define LOG_THREADS    4
+#define LINES_PER_THREAD 1500
+
+static char log_path[64];
+static int  saved_stderr;
+
+static void
+start_logger (log_mode mode) {
+  snprintf(log_path, sizeof(log_path), "/tmp/tap_logger.XXXXXX");
+  close(mkstemp(log_path));
+
+  opts.log_file = s_copy(log_path);
+  opts.log_mode = mode;
+
+  // The logger redirects stderr into the log file
+  saved_stderr  = dup(STDERR_FILENO);
+  logger_init();
+}
+
+/**
+ * A line is well-formed if it carries exactly one header and both halves of the
+ * test message, in order.
+ */
+static bool
+is_intact (const char* line) {
+  const char* hdr  = strstr(line, "[INFO]");
+  const char* head = strstr(line, "logger test thread ");
+  const char* tail = strstr(line, " line ");
+
+  return hdr && !strstr(hdr + 1, "[INFO]") && head && tail > head && line[strlen(line) - 1] == '\n';
+}
+
+/**
+ * Stops the logger and counts well-formed lines in the log file.
+ */
+static unsigned int
+stop_logger (unsigned int* n_lines) {
+  logger_close();
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stderr);
+  opts.log_mode   = LOG_MODE_SYNC;
+
+  unsigned int n_ok = 0;
+  char         line[LOG_RECORD_MAX * 2];
+  FILE*        f    = fopen(log_path, "r");
+
+  *n_lines          = 0;
+  while (fgets(line, sizeof(line), f)) {
+    (*n_lines)++;
+    n_ok += is_intact(line);
+  }
+
+  fclose(f);
+  unlink(log_path);
+
+  return n_ok;
+}
+
+static void*
+log_lines (void* arg) {
+  for (unsigned int i = 0; i < LINES_PER_THREAD; i++) {
+    // Logged in two calls: the second continues the first's record
+    log_info("logger test thread %lu", (unsigned long)arg);
+    log_info(" line %u\n", i);
+  }
+
+  return NULL;
+}
+
+static void
+run_log_threads (void) {
+  pthread_t threads[LOG_THREADS];
+  for (unsigned long i = 0; i < LOG_THREADS; i++) {
+    pthread_create(&threads[i], NULL, log_lines, (void*)i);
+  }
+  for (unsigned int i = 0; i < LOG_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+static void
+sync_test (void) {
+  unsigned int n_lines;
+  start_logger(LOG_MODE_SYNC);
+  run_log_threads();
+  unsigned int n_ok = stop_logger(&n_lines);
+
+  ok(n_lines == LOG_THREADS * LINES_PER_THREAD, "sync mode writes every record (%u)", n_lines);
+  ok(n_ok == n_lines, "no record is torn by concurrent writers");
+}
+
+static void
+long_record_test (void) {
+  char long_msg[LOG_RECORD_MAX * 2];
+  memset(long_msg, 'x', sizeof(long_msg) - 1);
+  long_msg[sizeof(long_msg) - 1] = '\0';
+
+  start_logger(LOG_MODE_SYNC);
+  log_info("%s", long_msg);
+  log_info("logger test thread 0 line 0\n");
+  logger_close();
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stderr);
+
+  char  line[LOG_RECORD_MAX * 2];
+  FILE* f = fopen(log_path, "r");
+  fgets(line, sizeof(line), f);
+  ok(strlen(line) == LOG_RECORD_MAX - 1 && line[LOG_RECORD_MAX - 2] == '\n', "truncates and terminates oversized records");
+  fgets(line, sizeof(line), f);
+  ok(is_intact(line), "starts the next record on its own line");
+  fclose(f);
+  unlink(log_path);
+}
+
+static void
+async_block_test (void) {
+  unsigned int n_lines;
+  start_logger(LOG_MODE_ASYNC_BLOCK);
+  run_log_threads();
+  unsigned int n_ok = stop_logger(&n_lines);
+
+  ok(n_lines == LOG_THREADS * LINES_PER_THREAD, "block policy writes every record (%u)", n_lines);
+  ok(n_ok == n_lines, "every record is intact");
+}
+
+static void
+async_drop_test (void) {
+  unsigned int n_lines;
+  uint64_t     dropped_before = metrics_get(METRIC_LOG_DROPPED);
+
+  start_logger(LOG_MODE_ASYNC_DROP);
+  run_log_threads();
+  unsigned int n_ok    = stop_logger(&n_lines);
+  uint64_t     dropped = metrics_get(METRIC_LOG_DROPPED) - dropped_before;
+
+  ok(n_lines + dropped == LOG_THREADS * LINES_PER_THREAD, "drop policy writes or counts every record (%u + %lu)", n_lines, (unsigned long)dropped);
+  ok(n_ok == n_lines, "every record is intact");
+}
+
+/**
+ * Counts lines, well-formed lines and rotation notices in a file, if it exists.
+ */
+static bool
+count_lines (const char* path, unsigned int* n_ok, unsigned int* n_notices) {
+  char  line[LOG_RECORD_MAX * 2];
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    return false;
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    *n_ok      += is_intact(line);
+    *n_notices += strstr(line, "rotated log file to ") != NULL;
+  }
+
+  fclose(f);
+  return true;
+}
+
+static bool
+exists (const char* fmt, unsigned int i) {
+  char path[sizeof(log_path) + 16];
+  snprintf(path, sizeof(path), fmt, log_path, i);
+  return access(path, F_OK) == 0;
+}
+
+static void
+remove_archives (void) {
+  char path[sizeof(log_path) + 16];
+  for (unsigned int i = 1; i <= 32; i++) {
+    snprintf(path, sizeof(path), "%s.%u", log_path, i);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s.%u.gz", log_path, i);
+    unlink(path);
+  }
+}
+
+static void
+rotation_test (void) {
+  uint64_t rotations_before = metrics_get(METRIC_LOG_ROTATIONS);
+  opts.log_max_size         = 64 * 1024;
+  opts.log_max_files        = 32;
+
+  start_logger(LOG_MODE_SYNC);
+  run_log_threads();
+
+  // Closing the log waits for the background archiver
+  unsigned int n_lines;
+  unsigned int n_ok      = stop_logger(&n_lines);
+  unsigned int n_notices = 0, n_files = 0;
+  for (unsigned int i = 1; i <= opts.log_max_files; i++) {
+    char path[sizeof(log_path) + 16];
+    snprintf(path, sizeof(path), "%s.%u", log_path, i);
+    n_files += count_lines(path, &n_ok, &n_notices);
+  }
+
+  ok(n_files >= 2 && n_files == metrics_get(METRIC_LOG_ROTATIONS) - rotations_before,
+     "rotates the log once it reaches its size cap (%u files)", n_files);
+  ok(n_ok == LOG_THREADS * LINES_PER_THREAD, "no record is lost or torn across rotations (%u)", n_ok);
+
+  // Writers that race a rotation can overshoot the cap, but never undershoot it
+  bool        at_cap = true;
+  struct stat st;
+  for (unsigned int i = 1; i <= n_files; i++) {
+    char path[sizeof(log_path) + 16];
+    snprintf(path, sizeof(path), "%s.%u", log_path, i);
+    at_cap &= stat(path, &st) == 0 && (size_t)st.st_size + LOG_THREADS * LOG_RECORD_MAX >= opts.log_max_size;
+  }
+  ok(at_cap, "rotates only once the log reaches its size cap");
+
+  remove_archives();
+  opts.log_max_size  = 0;
+  opts.log_max_files = LOG_MAX_FILES;
+}
+
+static void
+rotation_compress_test (void) {
+  uint64_t rotations_before    = metrics_get(METRIC_LOG_ROTATIONS);
+  uint64_t compressions_before = metrics_get(METRIC_LOG_COMPRESSIONS);
+  opts.log_max_size            = 4096;
+  opts.log_max_files           = 2;
+  opts.log_compress            = true;
+
+  start_logger(LOG_MODE_SYNC);
+  for (unsigned int i = 0; i < 200; i++) {
+    log_info("logger test thread 0 line %u\n", i);
+  }
+
+  unsigned int n_lines;
+  stop_logger(&n_lines);
+  uint64_t rotations = metrics_get(METRIC_LOG_ROTATIONS) - rotations_before;
+
+  ok(rotations >= 3 && metrics_get(METRIC_LOG_COMPRESSIONS) - compressions_before == rotations,
+     "compresses every archived file");
+  ok(exists("%s.%u.gz", 1) && exists("%s.%u.gz", 2) && !exists("%s.%u.gz", 3) && !exists("%s.%u", 3),
+     "keeps at most --log-max-files archives");
+
+  remove_archives();
+  opts.log_max_size  = 0;
+  opts.log_max_files = LOG_MAX_FILES;
+  opts.log_compress  = false;
+}
+
+static void
+log_levels_test (void) {
+  ok(logger_set_levels("warn,scan=debug,ipc=error") == OK, "parses a level spec");
+  ok(log_thresholds[LOG_CAT_CORE] == LOG_LEVEL_WARN && log_thresholds[LOG_CAT_SCAN] == LOG_LEVEL_DEBUG
+       && log_thresholds[LOG_CAT_IPC] == LOG_LEVEL_ERROR,
+     "applies bare and per-category levels");
+
+  ok(logger_set_levels("info,scan=noisy") == ERR && log_thresholds[LOG_CAT_CORE] == LOG_LEVEL_WARN,
+     "rejects invalid specs without applying them");
+  ok(logger_set_levels("verbose=debug") == ERR, "rejects unknown categories");
+
+  unsigned int evaluated = 0;
+  log_info("%u\n", ++evaluated);
+  log_at(LOG_CAT_SCAN, LOG_LEVEL_INFO, "%u\n", ++evaluated);
+  ok(evaluated == 1, "skips filtered calls before evaluating their arguments");
+
+  logger_set_levels("debug");
+}
+
+void
+run_logger_tests (void) {
+  log_levels_test();
+  sync_test();
+  long_record_test();
+  async_block_test();
+  async_drop_test();
+  rotation_test();
+  rotation_compress_test();
+}
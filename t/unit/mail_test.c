@@ -0,0 +1,251 @@
+#include "mail.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "constants.h"
+#include "globals.h"
+#include "libutil/libutil.h"
+#include "tests.h"
+#include "utils/xmalloc.h"
+#include "utils/xpanic.h"
+
+#define MBOX           "mbox"
+#define DIGEST_WINDOW  60
+
+// Appends its arguments and stdin to the mbox, like a local MTA delivering mail
+#define STUB_MTA                                           \
+  "#!/bin/sh\n"                                            \
+  "dir=$(dirname \"$0\")\n"                                \
+  "{ echo \"ARGS: $*\"; cat; echo '--END--'; } >> \"$dir/" MBOX "\"\n"
+
+typedef struct {
+  char* mailto;
+  char* subject;
+  char* body;
+} sent_mail;
+
+static array_t* sent = NULL;
+
+static job_t
+make_job (ident_t id, char* mailto, mail_policy policy, int ret, size_t bytes) {
+  return (job_t){
+    .id          = id,
+    .cmd         = "echo hi",
+    .mailto      = mailto,
+    .mail_policy = policy,
+    .ret         = ret,
+    .output      = {.bytes = bytes},
+  };
+}
+
+static char*
+read_all (int fd) {
+  buffer_t* buf = buffer_init(NULL);
+  char      chunk[256];
+  ssize_t   n;
+
+  lseek(fd, 0, SEEK_SET);
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+    buffer_append_with(buf, chunk, n);
+  }
+
+  char* ret = s_copy_or_panic(buffer_state(buf) ? buffer_state(buf) : "");
+  buffer_free(buf);
+  return ret;
+}
+
+static void
+record_mail (const char* mailto, const char* subject, int body_fd) {
+  sent_mail* m = xmalloc(sizeof(sent_mail));
+  m->mailto    = s_copy_or_panic(mailto);
+  m->subject   = s_copy_or_panic(subject);
+  m->body      = read_all(body_fd);
+  array_push_or_panic(sent, m);
+}
+
+static void
+free_sent_mail (sent_mail* m) {
+  free(m->mailto);
+  free(m->subject);
+  free(m->body);
+  free(m);
+}
+
+static sent_mail*
+find_sent (const char* mailto) {
+  foreach (sent, i) {
+    sent_mail* m = array_get_or_panic(sent, i);
+    if (strcmp(m->mailto, mailto) == 0) {
+      return m;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+policy_parse_test (void) {
+  mail_policy policy = MAIL_ALWAYS;
+  ok(mail_policy_parse("on-failure", &policy) == OK && policy == MAIL_ON_FAILURE, "parses the on-failure policy");
+  ok(mail_policy_parse("never", &policy) == OK && policy == MAIL_NEVER, "parses the never policy");
+  ok(mail_policy_parse("sometimes", &policy) == ERR && policy == MAIL_NEVER, "rejects unknown policies");
+}
+
+static void
+mail_wanted_test (void) {
+  job_t quiet_ok     = make_job(1, "u", MAIL_ALWAYS, 0, 0);
+  ok(mail_wanted(&quiet_ok), "always mails with the always policy");
+
+  quiet_ok.mail_policy = MAIL_ON_FAILURE;
+  job_t failed         = make_job(2, "u", MAIL_ON_FAILURE, 2, 0);
+  ok(!mail_wanted(&quiet_ok) && mail_wanted(&failed), "mails only failed jobs with the on-failure policy");
+
+  quiet_ok.mail_policy = MAIL_ON_OUTPUT;
+  job_t chatty         = make_job(3, "u", MAIL_ON_OUTPUT, 0, 10);
+  ok(!mail_wanted(&quiet_ok) && mail_wanted(&chatty), "mails only jobs with output with the on-output policy");
+
+  failed.mail_policy = MAIL_NEVER;
+  ok(!mail_wanted(&failed), "never mails with the never policy");
+}
+
+static mail_policy
+crontab_policy (char* dirname, const char* content) {
+  setup_test_file(dirname, "policy", content);
+
+  char* fpath = s_fmt("%s/policy", dirname);
+  int   fd    = get_fd(fpath);
+  free(fpath);
+
+  time_t      now    = time(NULL);
+  crontab_t*  ct     = new_crontab(fd, false, now, now, "some_user");
+  mail_policy policy = ct->mail_policy;
+  close(fd);
+  free_crontab(ct);
+
+  return policy;
+}
+
+static void
+crontab_policy_test (char* dirname) {
+  ok(crontab_policy(dirname, "* * * * * echo hi\n") == MAIL_ALWAYS, "mails every job by default");
+  ok(crontab_policy(dirname, "MAILPOLICY=on-output\n* * * * * echo hi\n") == MAIL_ON_OUTPUT,
+     "reads the policy from the MAILPOLICY variable");
+  ok(crontab_policy(dirname, "MAILPOLICY=bogus\n* * * * * echo hi\n") == MAIL_ALWAYS,
+     "falls back to mailing every job given an invalid policy");
+  ok(crontab_policy(dirname, "MAILTO=\n* * * * * echo hi\n") == MAIL_NEVER, "sends no mail given an empty MAILTO");
+  ok(crontab_policy(dirname, "MAILTO=\"\"\nMAILPOLICY=always\n* * * * * echo hi\n") == MAIL_NEVER,
+     "sends no mail given a quoted empty MAILTO");
+}
+
+static void
+option_mailto_test (char* dirname) {
+  setup_test_file(dirname, "policy", "MAILTO=-Ssendmail=/tmp/x\n* * * * * echo hi\n");
+
+  char*      fpath = s_fmt("%s/policy", dirname);
+  int        fd    = get_fd(fpath);
+  time_t     now   = time(NULL);
+  crontab_t* ct    = new_crontab(fd, false, now, now, "some_user");
+  job_t*     job   = new_cronjob(array_get(ct->entries, 0));
+  close(fd);
+
+  ok(job->mail_policy == MAIL_NEVER, "won't mail a MAILTO that looks like an option");
+
+  free_cronjob(job);
+  free_crontab(ct);
+  free(fpath);
+}
+
+static void
+spawn_test (char* dirname) {
+  char* mta = s_fmt("%s/mta", dirname);
+  setup_test_file(dirname, "mta", STUB_MTA);
+  chmod(mta, 0755);
+  opts.mail_cmd = mta;
+
+  job_t job     = make_job(0x1b4e28ba2fa10001, "someone@example.com", MAIL_ALWAYS, 3, 0);
+  int   body_fd = mail_report_open(&job);
+  ok(body_fd >= 0, "writes the job's report");
+
+  pid_t pid     = mail_spawn(job.mailto, MAIL_SUBJECT, body_fd);
+  int   status  = -1;
+  waitpid(pid, &status, 0);
+  close(body_fd);
+  ok(pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0, "runs the mail program directly");
+
+  char* mbox_path = s_fmt("%s/" MBOX, dirname);
+  int   mbox_fd   = get_fd(mbox_path);
+  char* mbox      = read_all(mbox_fd);
+  close(mbox_fd);
+
+  match_str(mbox, "ARGS: -r " DAEMON_IDENT "@\\S* -s " MAIL_SUBJECT " -- someone@example.com", "passes the sender, subject and recipient");
+  match_str(mbox, "command: echo hi\nexit status: 3\n--END--", "feeds the report to the mail program's stdin");
+
+  opts.mail_cmd = "/nonexistent/mail";
+  body_fd       = mail_report_open(&job);
+  ok(mail_spawn(job.mailto, MAIL_SUBJECT, body_fd) < 0, "fails when the mail program can't be run");
+  close(body_fd);
+
+  opts.mail_cmd = MAILCMD_PATH;
+  free(mbox);
+  free(mbox_path);
+  free(mta);
+}
+
+static void
+digest_test (void) {
+  opts.mail_digest = DIGEST_WINDOW;
+  sent             = array_init_or_panic();
+
+  job_t first      = make_job(0x11, "alice", MAIL_ALWAYS, 0, 0);
+  job_t second     = make_job(0x12, "alice", MAIL_ALWAYS, 1, 0);
+  job_t other      = make_job(0x13, "bob", MAIL_ALWAYS, 0, 0);
+  mail_digest_add(&first);
+  mail_digest_add(&second);
+  mail_digest_add(&other);
+
+  time_t now       = time(NULL);
+  ok(mail_digest_flush(now, false, record_mail) == 0 && array_size(sent) == 0, "holds digests until their window ends");
+  ok(mail_digest_flush(now + DIGEST_WINDOW, false, record_mail) == 2, "sends one digest per recipient");
+
+  sent_mail* alice = find_sent("alice");
+  ok(alice && strcmp(alice->subject, "cron digest: 2 jobs (1 failed)") == 0, "summarizes the digest in its subject");
+  match_str(alice ? alice->body : "", "---- \\[job 0000000000000011\\]\ncommand: echo hi\nexit status: 0\n", "reports the first job");
+  match_str(alice ? alice->body : "", "---- \\[job 0000000000000012\\]\ncommand: echo hi\nexit status: 1\n", "reports the second job");
+
+  ok(mail_digest_flush(now + DIGEST_WINDOW * 2, true, record_mail) == 0, "sends each digest once");
+
+  mail_digest_add(&other);
+  ok(mail_digest_flush(now, true, record_mail) == 1, "sends pending digests early when forced");
+
+  // Nothing can be delivered here; what matters is that nothing is left over
+  opts.mail_cmd = "/nonexistent/mail";
+  mail_digest_add(&other);
+  job_mail_flush();
+  ok(mail_digest_flush(now, true, record_mail) == 0, "sends pending digests at shutdown");
+  opts.mail_cmd = MAILCMD_PATH;
+
+  array_free(sent, (free_fn*)free_sent_mail);
+  sent             = NULL;
+  opts.mail_digest = 0;
+}
+
+void
+run_mail_tests (void) {
+  char* dirname = setup_test_directory();
+
+  policy_parse_test();
+  mail_wanted_test();
+  crontab_policy_test(dirname);
+  option_mailto_test(dirname);
+  spawn_test(dirname);
+  digest_test();
+
+  cleanup_test_file(dirname, "policy");
+  cleanup_test_file(dirname, "mta");
+  cleanup_test_file(dirname, MBOX);
+  cleanup_test_directory(dirname);
+}
@@ -20,13 +20,25 @@ main (int _argc, char** _argv) {
   usr.uname = "root";
   usr.root  = true;
 
-  plan(221);
+  plan(477);
 
   run_parser_tests();
   run_regexpr_tests();
   run_crontab_tests();
   run_utils_tests();
   run_ipc_commands_test();
+  run_db_tests();
+  run_status_tests();
+  run_metrics_tests();
+  run_pause_tests();
+  run_logger_tests();
+  run_journal_tests();
+  run_joboutput_tests();
+  run_mail_tests();
+  run_smtp_tests();
+  run_hash_tests();
+  run_cronmask_tests();
+  run_cronmatch_tests();
 
   done_testing();
 }
@@ -0,0 +1,62 @@
+#include "metrics.h"
+
+#include <string.h>
+
+#include "api/commands.h"
+#include "tests.h"
+
+static void
+metrics_user_get_test (void) {
+  metrics_user* a = metrics_user_get("metrics_user_a");
+  metrics_user* b = metrics_user_get("metrics_user_b");
+
+  ok(a != NULL && b != NULL, "claims per-user slots");
+  ok(a != b, "different users get different slots");
+  ok(metrics_user_get("metrics_user_a") == a, "the same user always gets the same slot");
+  eq_str(a->uname, "metrics_user_a", "the slot records the username");
+
+  char long_uname[METRICS_MAX_UNAME + 8];
+  memset(long_uname, 'x', sizeof(long_uname) - 1);
+  long_uname[sizeof(long_uname) - 1] = '\0';
+  eq_str(metrics_user_get(long_uname)->uname, METRICS_OVERFLOW_UNAME, "overlong usernames share the overflow slot");
+}
+
+static void
+metrics_write_test (void) {
+  metrics_user* u = metrics_user_get("metrics_user_c");
+  atomic_fetch_add(&u->jobs_launched, 3);
+  atomic_fetch_add(&u->jobs_failed, 1);
+
+  metrics_add(METRIC_PARSE_ERRORS, 2);
+
+  // 60us lands in the 0.0001 bucket, 2s in +Inf
+  metrics_observe(METRIC_SPAWN_LATENCY, 60);
+  metrics_observe(METRIC_SPAWN_LATENCY, 2000000);
+
+  buffer_t* buf = buffer_init(NULL);
+  write_metrics_info(buf, NULL, 0);
+  const char* ret = buffer_state(buf);
+
+  ok(strstr(ret, "chronic_jobs_launched_total{user=\"metrics_user_c\"} 3\n") != NULL, "has per-user launched jobs");
+  ok(strstr(ret, "chronic_jobs_failed_total{user=\"metrics_user_c\"} 1\n") != NULL, "has per-user failed jobs");
+  match_str(ret, "\nchronic_parse_errors_total [1-9]\\d*\n", "has the parse errors counter");
+  ok(strstr(ret, "# TYPE chronic_spawn_latency_seconds histogram\n") != NULL, "declares the histogram type");
+  ok(strstr(ret, "chronic_spawn_latency_seconds_bucket{le=\"0.00005\"} 0\n") != NULL, "has an empty first bucket");
+  ok(strstr(ret, "chronic_spawn_latency_seconds_bucket{le=\"0.0001\"} 1\n") != NULL, "buckets are cumulative");
+  ok(strstr(ret, "chronic_spawn_latency_seconds_bucket{le=\"0.1\"} 1\n") != NULL, "buckets are cumulative");
+  ok(strstr(ret, "chronic_spawn_latency_seconds_bucket{le=\"+Inf\"} 2\n") != NULL, "has the +Inf bucket");
+  ok(strstr(ret, "chronic_spawn_latency_seconds_sum 2.00006\n") != NULL, "has the sum in seconds");
+  ok(strstr(ret, "chronic_spawn_latency_seconds_count 2\n") != NULL, "has the count");
+  ok(strstr(ret, "_total{user=\"" METRICS_OVERFLOW_UNAME "\"} 0") == NULL, "omits the overflow slot when unused");
+
+  size_t len = buffer_size(buf);
+  ok(len > 6 && strcmp(ret + len - 6, "# EOF\n") == 0, "ends with the EOF marker");
+
+  buffer_free(buf);
+}
+
+void
+run_metrics_tests (void) {
+  metrics_user_get_test();
+  metrics_write_test();
+}
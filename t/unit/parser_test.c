@@ -147,7 +147,9 @@ parse_cmd_test (void) {
     { .input   = "* * * * * xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
        "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
        "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx",
-      .err_msg = "too long"
+      .expect  = "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+       "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+       "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
     },
     {
       .input   = NULL,
@@ -159,8 +161,8 @@ parse_cmd_test (void) {
   ITER_CASES_TEST(tests, test_case) {
     test_case tc = tests[i];
 
-    char     ret[256];
-    retval_t rv = parse_cmd(tc.input, ret);
+    char*    ret = NULL;
+    retval_t rv  = parse_cmd(tc.input, &ret);
 
     if (tc.err_msg) {
       ok(rv == ERR, "returns ERR (reason: %s)", tc.err_msg);
@@ -193,11 +195,10 @@ parse_expr_test (void) {
   ITER_CASES_TEST(tests, test_case) {
     test_case tc = tests[i];
 
-    cron_entry entry;
-    memcpy(entry.schedule, tc.input, strlen(tc.input));
-    entry.schedule[strlen(tc.input)] = '\0';
-
-    retval_t rv                      = parse_expr(&entry);
+    cron_expr expr;
+    char*     schedule = s_copy(tc.input);
+    retval_t  rv       = parse_expr(schedule, &expr);
+    free(schedule);
     if (tc.err_msg) {
       ok(rv == ERR, "returns ERR (reason: %s)", tc.err_msg);
     } else {
@@ -226,8 +227,9 @@ parse_entry_test (void) {
   // clang-format on
 
   ITER_CASES_TEST(tests, test_case) {
-    test_case  tc = tests[i];
-    cron_entry entry;
+    test_case       tc    = tests[i];
+    cron_entry_info info;
+    cron_entry      entry = {.info = &info};
 
     retval_t ret = parse_entry(&entry, tc.input);
 
@@ -235,7 +237,8 @@ parse_entry_test (void) {
       ok(ret == ERR, "Expect result to be ERR (%d)", ERR);
     } else {
       ok(ret == OK, "Expect result to be OK (%d)", OK);
-      eq_str(entry.cmd, tc.expect, "Expect '%s'", tc.expect);
+      eq_str(entry.info->cmd, tc.expect, "Expect '%s'", tc.expect);
+      release_cron_entry(&entry);
     }
   }
 }
@@ -0,0 +1,130 @@
+#include "pause.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crontab.h"
+#include "tests.h"
+#include "utils/retval.h"
+
+#define TEST_FPATH "./t/fixtures/crontab.party"
+
+static void
+pause_entry_key_test (void) {
+  crontab_t  ct = {.uname = "u"};
+  cron_entry a  = {.info = &(cron_entry_info){.schedule = "* * * * *", .cmd = "a b"}, .parent = &ct};
+  cron_entry b  = {.info = &(cron_entry_info){.schedule = "* * * * *", .cmd = "a b"}, .parent = &ct};
+  cron_entry c  = {.info = &(cron_entry_info){.schedule = "* * * * * a", .cmd = "b"}, .parent = &ct};
+
+  char* ka      = pause_entry_key("/x/u", &a);
+  char* kb      = pause_entry_key("/x/u", &b);
+  char* kc      = pause_entry_key("/x/u", &c);
+  char* kd      = pause_entry_key("/y/u", &a);
+
+  match_str(ka, "^/x/u#[0-9a-f]{16}$", "key is the crontab path plus a fingerprint");
+  eq_str(ka, kb, "identical entries get the same key");
+  ok(strcmp(ka, kc) != 0, "the schedule/command boundary is part of the key");
+  ok(strcmp(ka, kd) != 0, "entries in different crontabs get different keys");
+
+  free(ka);
+  free(kb);
+  free(kc);
+  free(kd);
+}
+
+static void
+pause_state_persist_test (void) {
+  char path[] = "/tmp/tap_pause_state.XXXXXX";
+  int  fd     = mkstemp(path);
+  write(fd, "/persisted/crontab\n", 19);
+  close(fd);
+
+  pause_state_init(path);
+  ok(pause_state_get("/persisted/crontab"), "loads persisted state");
+
+  // As the daemon runs, with a symlink planted at the temp path
+  char tmp_path[sizeof(path) + 4], victim[] = "/tmp/tap_pause_victim.XXXXXX";
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  close(mkstemp(victim));
+  symlink(victim, tmp_path);
+  mode_t old_mask = umask(0);
+
+  pause_state_set("/some/crontab", true);
+  ok(pause_state_get("/some/crontab"), "pauses");
+
+  umask(old_mask);
+  struct stat st, victim_st;
+  stat(path, &st);
+  stat(victim, &victim_st);
+  ok((st.st_mode & 0777) == 0600, "persists owner-only whatever the umask (%o)", st.st_mode & 0777);
+  ok(victim_st.st_size == 0 && access(tmp_path, F_OK) != 0, "doesn't write through a symlink at the temp path");
+  unlink(victim);
+
+  char  buf[256] = {0};
+  FILE* f        = fopen(path, "r");
+  fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  ok(strstr(buf, "/some/crontab\n") != NULL, "persists pauses");
+
+  pause_state_set("/some/crontab", false);
+  pause_state_set("/persisted/crontab", false);
+  ok(!pause_state_get("/some/crontab"), "resumes");
+
+  memset(buf, 0, sizeof(buf));
+  f = fopen(path, "r");
+  fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  eq_str(buf, "", "persists resumes");
+
+  unlink(path);
+}
+
+static void
+pause_state_apply_test (void) {
+  int fd = get_fd(TEST_FPATH);
+  if (fd < OK) {
+    fail("get_fd failed\n");
+  }
+
+  time_t     now = time(NULL);
+  crontab_t* ct  = new_crontab(fd, false, now, now, "some_user");
+  close(fd);
+
+  cron_entry* target = array_get(ct->entries, 1);
+  char*       key    = pause_entry_key(TEST_FPATH, target);
+
+  pause_state_set(key, true);
+  pause_state_apply(TEST_FPATH, ct);
+
+  unsigned int n_paused = 0;
+  foreach (ct->entries, i) {
+    n_paused += ((cron_entry*)array_get(ct->entries, i))->paused;
+  }
+  ok(target->paused && n_paused == 1, "pauses only the targeted entry");
+  ok(!ct->paused, "does not pause the crontab");
+
+  hash_table* test_db = ht_init(0, NULL);
+  ht_insert(test_db, TEST_FPATH, ct);
+
+  pause_state_set(TEST_FPATH, true);
+  pause_state_set(key, false);
+  pause_state_sync(test_db);
+  ok(ct->paused && !target->paused, "sync re-applies changed state");
+
+  pause_state_set(TEST_FPATH, false);
+  pause_state_sync(test_db);
+  ok(!ct->paused, "sync clears resumed crontabs");
+
+  free(key);
+  ht_delete_table(test_db);
+  free_crontab(ct);
+}
+
+void
+run_pause_tests (void) {
+  pause_entry_key_test();
+  pause_state_persist_test();
+  pause_state_apply_test();
+}
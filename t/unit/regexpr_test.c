@@ -1,5 +1,6 @@
 #include "libutil/libutil.h"
 #include "tests.h"
+#include "utils/arena.h"
 #include "utils/regex.h"
 
 static void
@@ -29,7 +30,8 @@ match_variable_test (void) {
     {.invalid_str = "~=\"valid_val_but_invalid_key\""}
   };
 
-  hash_table* ht = ht_init(0, NULL);
+  hash_table* ht    = ht_init(0, NULL);
+  arena_t*    arena = arena_init();
 
   ITER_CASES_TEST(tests, TestCase) {
     TestCase tc = tests[i];
@@ -37,7 +39,7 @@ match_variable_test (void) {
       char* input = s_copy(tc.invalid_str);
 
       int before  = ht->count;
-      match_variable(input, ht);
+      match_variable(input, ht, arena);
       int after = ht->count;
 
       ok(before == after, "doesn't update the hash table when no variable");
@@ -46,11 +48,14 @@ match_variable_test (void) {
     } else {
       char* input = s_fmt("%s=%s", s_copy(tc.key), s_copy(tc.value));
 
-      match_variable(input, ht);
+      match_variable(input, ht, arena);
 
       eq_str(ht_get(ht, tc.key), tc.value, "parses the variable and updates the hash table");
     }
   }
+
+  ht_delete_table(ht);
+  arena_free(arena);
 }
 
 static void
@@ -0,0 +1,397 @@
+#define _GNU_SOURCE  // For memfd_create
+#include "smtp.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "globals.h"
+#include "libutil/libutil.h"
+#include "metrics.h"
+#include "tests.h"
+#include "utils/time.h"
+#include "utils/xpanic.h"
+
+#define RELAY_SOCK     "lmtp.sock"
+#define BURST_MESSAGES 300
+#define DRAIN_SECS     60
+
+/**
+ * A fake LMTP relay: accepts every recipient but those containing "reject"
+ * (550) or "later" (451), and records what it receives.
+ */
+static struct {
+  pthread_mutex_t lock;
+  int             listen_fd;
+  /* Whether LHLO advertises PIPELINING */
+  bool            pipelining;
+  /* Close the connection after the next message */
+  bool            hangup_once;
+  unsigned int    connections;
+  /* Most commands that arrived in one read */
+  unsigned int    max_cmds;
+  /* Lines that ended in a bare LF */
+  unsigned int    bare_lf;
+  unsigned int    later_rcpts;
+  /* What was delivered, as "<rcpt>\n<data>" i.e. List<char*> */
+  array_t        *received;
+} relay = {.lock = PTHREAD_MUTEX_INITIALIZER, .pipelining = true};
+
+/**
+ * What the submitter handed back to be sent another way.
+ */
+static struct {
+  pthread_mutex_t lock;
+  unsigned int    count;
+  char            rcpt[256];
+} handed = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void
+hand_back (const char *mailto, const char *subject __attribute__((unused)), int body_fd __attribute__((unused))) {
+  pthread_mutex_lock(&handed.lock);
+  handed.count++;
+  snprintf(handed.rcpt, sizeof(handed.rcpt), "%s", mailto);
+  pthread_mutex_unlock(&handed.lock);
+}
+
+static unsigned int
+handed_count (void) {
+  pthread_mutex_lock(&handed.lock);
+  unsigned int n = handed.count;
+  pthread_mutex_unlock(&handed.lock);
+
+  return n;
+}
+
+/**
+ * One connection to the fake relay.
+ */
+typedef struct {
+  bool      in_data;
+  bool      hangup;
+  char      rcpt[256];
+  buffer_t *data;
+  /* Replies to everything in the current read, sent at once */
+  buffer_t *out;
+} session;
+
+static void
+handle_data_line (session *s, char *line) {
+  if (strcmp(line, ".") != 0) {
+    buffer_append(s->data, line[0] == '.' ? line + 1 : line);
+    buffer_append(s->data, "\n");
+    return;
+  }
+
+  array_push_or_panic(relay.received, s_fmt("%s\n%s", s->rcpt, buffer_state(s->data) ? buffer_state(s->data) : ""));
+  buffer_free(s->data);
+  s->data    = NULL;
+  s->in_data = false;
+  buffer_append(s->out, "250 2.0.0 delivered\r\n");
+
+  if (relay.hangup_once) {
+    relay.hangup_once = false;
+    s->hangup         = true;
+  }
+}
+
+static void
+handle_command (session *s, char *line) {
+  if (strncmp(line, "LHLO ", 5) == 0) {
+    buffer_append(s->out, relay.pipelining ? "250-fake\r\n250-PIPELINING\r\n250 ENHANCEDSTATUSCODES\r\n" : "250-fake\r\n250 8BITMIME\r\n");
+  } else if (strncmp(line, "MAIL FROM:", 10) == 0 || strcmp(line, "RSET") == 0) {
+    s->rcpt[0] = '\0';
+    buffer_append(s->out, "250 2.1.0 ok\r\n");
+  } else if (strncmp(line, "RCPT TO:", 8) == 0) {
+    if (strstr(line, "reject")) {
+      buffer_append(s->out, "550 5.1.1 no such user\r\n");
+    } else if (strstr(line, "later")) {
+      relay.later_rcpts++;
+      buffer_append(s->out, "451 4.3.0 try again later\r\n");
+    } else {
+      snprintf(s->rcpt, sizeof(s->rcpt), "%s", line + 8);
+      buffer_append(s->out, "250 2.1.5 ok\r\n");
+    }
+  } else if (strcmp(line, "DATA") == 0) {
+    if (s->rcpt[0]) {
+      s->in_data = true;
+      s->data    = buffer_init(NULL);
+      buffer_append(s->out, "354 go ahead\r\n");
+    } else {
+      buffer_append(s->out, "503 5.5.1 no valid recipients\r\n");
+    }
+  } else if (strcmp(line, "QUIT") == 0) {
+    buffer_append(s->out, "221 2.0.0 bye\r\n");
+    s->hangup = true;
+  } else {
+    buffer_append(s->out, "500 5.5.2 unrecognized command\r\n");
+  }
+}
+
+static void
+serve (int fd) {
+  char    buf[64 * 1024];
+  size_t  len = 0;
+  session s   = {0};
+
+  write(fd, "220 fake LMTP\r\n", 15);
+
+  while (!s.hangup) {
+    ssize_t n = read(fd, buf + len, sizeof(buf) - len);
+    if (n <= 0) {
+      break;
+    }
+    len          += n;
+    s.out         = buffer_init(NULL);
+
+    char        *line = buf, *nl;
+    unsigned int cmds = 0;
+    pthread_mutex_lock(&relay.lock);
+    while (!s.hangup && (nl = memchr(line, '\n', buf + len - line))) {
+      *nl = '\0';
+      if (nl > line && nl[-1] == '\r') {
+        nl[-1] = '\0';
+      } else {
+        relay.bare_lf++;
+      }
+
+      if (s.in_data) {
+        handle_data_line(&s, line);
+      } else {
+        cmds++;
+        handle_command(&s, line);
+      }
+      line = nl + 1;
+    }
+    relay.max_cmds = cmds > relay.max_cmds ? cmds : relay.max_cmds;
+    pthread_mutex_unlock(&relay.lock);
+
+    len -= line - buf;
+    memmove(buf, line, len);
+
+    if (buffer_state(s.out)) {
+      write(fd, buffer_state(s.out), buffer_size(s.out));
+    }
+    buffer_free(s.out);
+  }
+
+  if (s.data) {
+    buffer_free(s.data);
+  }
+  close(fd);
+}
+
+static void *
+relay_routine (void *arg __attribute__((unused))) {
+  int fd;
+  while ((fd = accept(relay.listen_fd, NULL, NULL)) >= 0) {
+    pthread_mutex_lock(&relay.lock);
+    relay.connections++;
+    pthread_mutex_unlock(&relay.lock);
+
+    serve(fd);
+  }
+
+  return NULL;
+}
+
+static void
+start_relay (const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  relay.received  = array_init_or_panic();
+  relay.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (bind(relay.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(relay.listen_fd, 4) < 0) {
+    xpanic("failed to start the fake relay at %s\n", path);
+  }
+
+  pthread_t thread_id;
+  pthread_create(&thread_id, NULL, relay_routine, NULL);
+  pthread_detach(thread_id);
+}
+
+static int
+make_body (const char *content) {
+  int fd = memfd_create("smtp-test", MFD_CLOEXEC);
+  write(fd, content, strlen(content));
+  return fd;
+}
+
+/**
+ * Returns the last message the relay received (owned by the relay), or "".
+ */
+static char *
+last_received (void) {
+  pthread_mutex_lock(&relay.lock);
+  size_t n   = array_size(relay.received);
+  char  *ret = n > 0 ? array_get_or_panic(relay.received, n - 1) : "";
+  pthread_mutex_unlock(&relay.lock);
+
+  return ret;
+}
+
+static unsigned int
+relay_stat (unsigned int *field) {
+  pthread_mutex_lock(&relay.lock);
+  unsigned int n = *field;
+  pthread_mutex_unlock(&relay.lock);
+
+  return n;
+}
+
+static size_t
+received_count (void) {
+  pthread_mutex_lock(&relay.lock);
+  size_t n = array_size(relay.received);
+  pthread_mutex_unlock(&relay.lock);
+
+  return n;
+}
+
+static void
+format_test (void) {
+  int body = make_body("hello\n.dot line\nno newline");
+  ok(smtp_submit("alice", "cron job completed", body) == OK, "queues a message for the relay");
+  close(body);
+  smtp_drain(DRAIN_SECS);
+
+  char *msg = last_received();
+  ok(received_count() == 1, "submits the message");
+  match_str(msg, "^<alice@\\S+>\nFrom: crond@\\S+\nTo: alice@\\S+\nSubject: cron job completed\n", "qualifies local recipients and adds headers");
+  match_str(msg, "\n\nhello\n\\.dot line\nno newline\n$", "dot-stuffs the body");
+  ok(relay_stat(&relay.bare_lf) == 0, "ends every line with CRLF");
+
+  body = make_body("x");
+  ok(smtp_submit("a@b>\r\nRCPT TO:<c@d", "s", body) == ERR, "refuses recipients that could inject commands");
+  close(body);
+}
+
+static void
+burst_test (void) {
+  size_t   before = received_count();
+  int      body   = make_body("command: true\nexit status: 0\n");
+  uint64_t start  = get_monotonic_usec();
+
+  for (unsigned int i = 0; i < BURST_MESSAGES; i++) {
+    smtp_submit("bob@example.com", "cron job completed", body);
+  }
+  close(body);
+  smtp_drain(DRAIN_SECS);
+
+  uint64_t elapsed = get_monotonic_usec() - start;
+  ok(received_count() - before == BURST_MESSAGES, "submits a burst of messages");
+  diag("%u messages in %lu us (%.0f/s)", BURST_MESSAGES, elapsed, BURST_MESSAGES * 1e6 / (elapsed ? elapsed : 1));
+
+  ok(relay_stat(&relay.connections) == 1, "reuses one connection (%u made)", relay_stat(&relay.connections));
+  ok(relay_stat(&relay.max_cmds) >= 3, "pipelines commands (%u in one read)", relay_stat(&relay.max_cmds));
+}
+
+static void
+failure_test (void) {
+  uint64_t     failed = metrics_get(METRIC_MAIL_FAILED);
+  unsigned int before = handed_count();
+  int          body   = make_body("report\n");
+
+  smtp_submit("reject-me@example.com", "s", body);
+  smtp_submit("carol@example.com", "s", body);
+  smtp_drain(DRAIN_SECS);
+  ok(metrics_get(METRIC_MAIL_FAILED) - failed == 1 && strstr(last_received(), "<carol@example.com>") == last_received(),
+     "drops rejected messages and resets for the next one");
+
+  smtp_submit("later@example.com", "s", body);
+  smtp_drain(DRAIN_SECS);
+  ok(metrics_get(METRIC_MAIL_FAILED) - failed == 2 && relay_stat(&relay.later_rcpts) == SMTP_MAX_ATTEMPTS,
+     "retries deferred messages before giving up");
+  ok(handed_count() - before == 2 && strcmp(handed.rcpt, "later@example.com") == 0,
+     "hands the messages it gives up on to the fallback");
+
+  close(body);
+}
+
+static void
+reconnect_test (void) {
+  size_t before = received_count();
+  int    body   = make_body("report\n");
+
+  pthread_mutex_lock(&relay.lock);
+  relay.hangup_once = true;
+  pthread_mutex_unlock(&relay.lock);
+
+  for (unsigned int i = 0; i < 3; i++) {
+    smtp_submit("dave@example.com", "s", body);
+  }
+  smtp_drain(DRAIN_SECS);
+  ok(received_count() - before == 3 && relay_stat(&relay.connections) == 2, "reconnects when the relay hangs up");
+
+  // Drop the pipelining connection so the next one is made without it
+  pthread_mutex_lock(&relay.lock);
+  relay.pipelining  = false;
+  relay.hangup_once = true;
+  pthread_mutex_unlock(&relay.lock);
+  smtp_submit("dave@example.com", "s", body);
+  smtp_drain(DRAIN_SECS);
+
+  pthread_mutex_lock(&relay.lock);
+  relay.max_cmds = 0;
+  pthread_mutex_unlock(&relay.lock);
+  before         = received_count();
+  for (unsigned int i = 0; i < 5; i++) {
+    smtp_submit("erin@example.com", "s", body);
+  }
+  smtp_drain(DRAIN_SECS);
+  ok(received_count() - before == 5, "submits to relays that don't pipeline");
+  ok(relay_stat(&relay.max_cmds) == 1, "sends one command at a time without pipelining");
+
+  close(body);
+}
+
+static void
+queue_cap_test (void) {
+  size_t       before_received = received_count();
+  unsigned int before_handed   = handed_count();
+  unsigned int queued          = 0;
+  int          body            = make_body("report\n");
+
+  // The relay can't answer while its lock is held, so nothing leaves the queue
+  pthread_mutex_lock(&relay.lock);
+  while (queued <= SMTP_MAX_QUEUED && smtp_submit("frank@example.com", "s", body) == OK) {
+    queued++;
+  }
+  ok(queued == SMTP_MAX_QUEUED, "refuses mail once its queue is full (%u queued)", queued);
+
+  ok(smtp_drain(1) == ERR, "stops waiting on a relay that doesn't drain");
+  unsigned int spilled = handed_count() - before_handed;
+  ok(spilled > 0, "hands what's still queued to the fallback (%u messages)", spilled);
+  pthread_mutex_unlock(&relay.lock);
+
+  ok(smtp_drain(DRAIN_SECS) == OK && received_count() - before_received + spilled == SMTP_MAX_QUEUED,
+     "delivers the messages that were in flight");
+
+  close(body);
+}
+
+void
+run_smtp_tests (void) {
+  char *dirname = setup_test_directory();
+  char *path    = s_fmt("%s/" RELAY_SOCK, dirname);
+
+  ok(smtp_submit("alice", "s", 0) == ERR, "refuses mail when no relay is configured");
+
+  start_relay(path);
+  opts.mail_relay = path;
+  ok(smtp_init(hand_back) == OK, "starts the mail submitter");
+
+  format_test();
+  burst_test();
+  failure_test();
+  reconnect_test();
+  queue_cap_test();
+
+  unlink(path);
+  cleanup_test_directory(dirname);
+}
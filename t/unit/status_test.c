@@ -0,0 +1,71 @@
+#include "status.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "tests.h"
+#include "utils/time.h"
+
+static void
+status_segment_test (void) {
+  char* dirname = setup_test_directory();
+  char* path    = s_fmt("%s/%s", dirname, "status");
+
+  struct timespec ts;
+  get_time(&ts);
+  proginfo.start  = &ts;
+  proginfo.pid    = 4242;
+  opts.status_shm = path;
+
+  status_init();
+
+  int fd = open(path, O_RDONLY);
+  ok(fd >= 0, "creates the status segment file");
+
+  // Map it as a monitor would: read-only, in a separate mapping
+  status_shm* shm = mmap(NULL, sizeof(status_shm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  status_shm st;
+  ok(status_snapshot(shm, &st, 10), "reads a consistent snapshot");
+  ok(st.magic == STATUS_SHM_MAGIC && st.version == STATUS_SHM_VERSION, "has the magic and version");
+  ok(st.pid == 4242, "has the daemon pid");
+  ok(st.start_time == ts.tv_sec, "has the daemon start time");
+
+  job_t job = {.id = 0x0123456789abcdef, .cmd = "echo hello", .pid = 1234, .ret = -1, .type = CRON};
+  status_job_started(&job);
+  status_tick(1234567);
+
+  status_snapshot(shm, &st, 10);
+  ok(st.running_jobs == 1 && st.jobs_launched == 1, "counts the running job");
+  ok(st.jobs[0].pid == 1234, "lists the running job's pid");
+  eq_str(st.jobs[0].ident, "0123456789abcdef", "lists the running job's ident");
+  eq_str(st.jobs[0].cmd, "echo hello", "lists the running job's cmd");
+  ok(st.last_tick == 1234567 && st.ticks == 1, "records the last tick");
+  ok(st.seq % 2 == 0 && st.seq > 0, "seqlock is even after updates");
+
+  job.pid = -1;
+  job.ret = 1;
+  status_job_exited(&job);
+
+  status_snapshot(shm, &st, 10);
+  ok(st.running_jobs == 0, "the exited job is no longer running");
+  ok(st.jobs[0].pid == 0, "the exited job's slot is freed");
+  ok(st.jobs_exited == 1 && st.jobs_failed == 1, "counts the failed job");
+
+  munmap(shm, sizeof(status_shm));
+  status_close();
+  ok(access(path, F_OK) != 0, "removes the status segment on close");
+
+  opts.status_shm = NULL;
+  proginfo.start  = NULL;
+  free(path);
+  cleanup_test_directory(dirname);
+}
+
+void
+run_status_tests (void) {
+  status_segment_test();
+}
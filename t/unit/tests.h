@@ -21,5 +21,17 @@ void run_crontab_tests(void);
 void run_utils_tests(void);
 void run_regexpr_tests(void);
 void run_ipc_commands_test(void);
+void run_db_tests(void);
+void run_status_tests(void);
+void run_metrics_tests(void);
+void run_pause_tests(void);
+void run_logger_tests(void);
+void run_journal_tests(void);
+void run_joboutput_tests(void);
+void run_mail_tests(void);
+void run_smtp_tests(void);
+void run_hash_tests(void);
+void run_cronmask_tests(void);
+void run_cronmatch_tests(void);
 
 #endif /* TESTS_H */
@@ -1,9 +1,17 @@
+#include <string.h>
+
+#include "globals.h"
 #include "libhash/libhash.h"
 #include "libutil/libutil.h"
 #include "tests.h"
+#include "utils/arena.h"
+#include "utils/encoder.h"
 #include "utils/file.h"
+#include "utils/hashset.h"
+#include "utils/ident.h"
 #include "utils/json.h"
 #include "utils/retval.h"
+#include "utils/strpool.h"
 #include "utils/time.h"
 
 void
@@ -122,6 +130,100 @@ json_parser_test (void) {
   eq_str(ht_get(pairs, "command"), "list_tabs", "selects the expected json field");
 }
 
+static void
+encode_sample (encoder_t* enc) {
+  enc_map(enc, 4);
+  enc_key(enc, "s");
+  enc_str(enc, "a\"b\\c\n");
+  enc_key(enc, "n");
+  enc_array(enc, 3);
+  enc_int(enc, 1);
+  enc_int(enc, -33);
+  enc_int(enc, 70000);
+  enc_end(enc);
+  enc_key(enc, "b");
+  enc_bool(enc, true);
+  enc_key(enc, "t");
+  enc_time(enc, 1700000000);
+  enc_end(enc);
+  enc_finish(enc);
+}
+
+static void
+encoder_json_test (void) {
+  buffer_t* buf = buffer_init(NULL);
+  encoder_t enc;
+  enc_init(&enc, buf, ENC_JSON);
+  encode_sample(&enc);
+
+  eq_str(
+    buffer_state(buf),
+    "{\"s\":\"a\\\"b\\\\c\\u000a\",\"n\":[1,-33,70000],\"b\":true,\"t\":\"2023-11-14T22:13:20.000Z\"}",
+    "encodes JSON, escaping strings"
+  );
+
+  enc_format format;
+  ok(enc_format_parse("msgpack", &format) == OK && format == ENC_MSGPACK, "parses format names");
+  ok(enc_format_parse("xml", &format) == ERR, "rejects unknown formats");
+
+  buffer_free(buf);
+}
+
+static void
+encoder_msgpack_test (void) {
+  buffer_t* buf = buffer_init(NULL);
+  encoder_t enc;
+  enc_init(&enc, buf, ENC_MSGPACK);
+  encode_sample(&enc);
+
+  // clang-format off
+  const unsigned char expect[] = {
+    0x84,
+    0xa1, 's', 0xa6, 'a', '"', 'b', '\\', 'c', '\n',
+    0xa1, 'n', 0x93, 0x01, 0xd0, 0xdf, 0xce, 0x00, 0x01, 0x11, 0x70,
+    0xa1, 'b', 0xc3,
+    0xa1, 't', 0xd6, 0xff, 0x65, 0x53, 0xf1, 0x00
+  };
+  // clang-format on
+
+  ok(buffer_size(buf) == sizeof(expect), "encodes MessagePack of the expected size");
+  ok(memcmp(buffer_state(buf), expect, sizeof(expect)) == 0, "encodes MessagePack, with timestamp extensions");
+
+  // Exceed the staging block to exercise flushing
+  buffer_t* big = buffer_init(NULL);
+  enc_init(&enc, big, ENC_MSGPACK);
+  enc_array(&enc, 1000);
+  for (unsigned int i = 0; i < 1000; i++) {
+    enc_str(&enc, "0123456789");
+  }
+  enc_end(&enc);
+  enc_finish(&enc);
+  ok(buffer_size(big) == 3 + 1000 * 11, "flushes staged output");
+
+  buffer_free(big);
+  buffer_free(buf);
+}
+
+static void
+format_time_str_test (void) {
+  char buf[TIME_STR_LEN + 8];
+
+  ok(format_time_str(buf, 1700000000, 0) == TIME_STR_LEN, "returns the formatted length");
+  eq_str(buf, "2023-11-14T22:13:20.000Z", "formats the timestamp");
+
+  format_time_str(buf, 1700000000, 7);
+  eq_str(buf, "2023-11-14T22:13:20.007Z", "patches the milliseconds within the cached second");
+
+  format_time_str(buf, 1700000061, 999);
+  eq_str(buf, "2023-11-14T22:14:21.999Z", "reformats when the second changes");
+
+  ok(format_time_str(buf, INT64_MAX, 0) == 0, "fails on unrepresentable timestamps");
+
+  char* s = to_time_str_secs(1700000061);
+  eq_str(s, "2023-11-14T22:14:21.000Z", "backs to_time_str_secs");
+  free(s);
+}
+
 static void
 pretty_print_seconds_test (void) {
   typedef struct {
@@ -150,6 +252,131 @@ pretty_print_seconds_test (void) {
   }
 }
 
+static void
+ident_test (void) {
+  ident_t a = ident_next(), b = ident_next();
+  ok(a != 0 && b > a, "issues increasing ids");
+  ok((a >> 32) >= (ident_t)time(NULL) - 60, "seeds ids with the start time");
+
+  char    buf[IDENT_STR_LEN];
+  ident_t parsed = 0;
+  ident_format(0x0123456789abcdef, buf);
+  eq_str(buf, "0123456789abcdef", "renders ids as hex by default");
+  ok(ident_parse(buf, &parsed) == OK && parsed == 0x0123456789abcdef, "parses hex ids");
+
+  opts.uuid_ids = true;
+  ident_format(0x0123456789abcdef, buf);
+  eq_str(buf, "01234567-89ab-8cde-bc00-000000000000", "renders ids as version 8 UUIDs when asked to");
+  parsed = 0;
+  ok(ident_parse(buf, &parsed) == OK && parsed == 0x0123456789abcdef, "parses the ids' UUIDs");
+  opts.uuid_ids = false;
+
+  ok(ident_parse("1b4e28ba-2fa1-41d2-883f-0016d3cca427", &parsed) == ERR, "rejects UUIDs it didn't render");
+  ok(ident_parse("../../etc/passwd", &parsed) == ERR && ident_parse("0123456789abcdeg", &parsed) == ERR,
+     "rejects malformed ids");
+
+  uint8_t u[16];
+  ident_to_uuid(0x0123456789abcdef, u);
+  ok(u[0] == 0x01 && u[5] == 0xab && u[6] == 0x8c && u[8] == 0xbc, "packs ids into raw UUIDs");
+}
+
+static void
+arena_test (void) {
+  arena_t *arena = arena_init();
+
+  char    *s     = arena_strdup(arena, "a");
+  double  *d     = arena_alloc(arena, sizeof(double));
+  *d             = 1.5;
+  ok((uintptr_t)d % _Alignof(max_align_t) == 0 && *s == 'a', "aligns allocations that follow strings");
+
+  size_t reserved = arena->reserved;
+  char  *big      = arena_alloc(arena, 1 << 20);
+  memset(big, 'x', 1 << 20);
+  char *small = arena_strdup(arena, "after");
+  ok(arena->reserved >= reserved + (1 << 20) && *d == 1.5, "gives oversized allocations their own chunk");
+  eq_str(small, "after", "keeps filling the current chunk after an oversized allocation");
+
+  char *first = arena_fmt(arena, "%s=%d", "KEY", 0);
+  for (unsigned int i = 1; i < 10000; i++) {
+    arena_fmt(arena, "%s=%u", "KEY", i);
+  }
+  eq_str(first, "KEY=0", "keeps earlier allocations intact as it grows");
+
+  arena_free(arena);
+}
+
+// Everything lands in one probe run
+static uint64_t
+colliding_hash (const void *item) {
+  return 7;
+}
+
+static bool
+int_eq (const void *item, const void *key) {
+  return *(const int *)item == *(const int *)key;
+}
+
+static void
+hashset_test (void) {
+  hashset_t set = {.hash_of = colliding_hash};
+  int       items[100];
+
+  for (int i = 0; i < 100; i++) {
+    items[i] = i;
+    hashset_reserve(&set);
+    hashset_insert(&set, hashset_probe(&set, 7, int_eq, &i), &items[i]);
+  }
+  ok(set.count == 100 && set.capacity >= 200, "grows to stay at most half full");
+
+  for (int i = 0; i < 100; i += 3) {
+    hashset_remove(&set, &items[i]);
+  }
+
+  bool found = true;
+  for (int i = 0; i < 100; i++) {
+    void **slot = hashset_probe(&set, 7, int_eq, &i);
+    found       = found && (i % 3 ? *slot == &items[i] : *slot == NULL);
+  }
+  ok(found && set.count == 66, "keeps the rest of a probe run findable after removals");
+
+  free(set.slots);
+}
+
+static void
+strpool_test (void) {
+  size_t before = strpool_count();
+  char   buf[32];
+
+  const char *a = strpool_intern("/usr/bin/strpool-test");
+  strcpy(buf, "/usr/bin/strpool-test");
+  const char *b = strpool_intern(buf);
+  ok(a == b && strpool_count() == before + 1, "shares one copy of equal strings");
+
+  strpool_release(a);
+  ok(strpool_count() == before + 1 && strcmp(b, "/usr/bin/strpool-test") == 0, "keeps strings that are still referenced");
+  strpool_release(b);
+  ok(strpool_count() == before, "frees strings once released by all");
+
+  // Releasing from the middle of probe runs must keep the rest findable
+  const char *strs[2000];
+  for (unsigned int i = 0; i < 2000; i++) {
+    snprintf(buf, sizeof(buf), "strpool-test %u", i);
+    strs[i] = strpool_intern(buf);
+  }
+  for (unsigned int i = 0; i < 2000; i += 2) {
+    strpool_release(strs[i]);
+  }
+  unsigned int same = 0;
+  for (unsigned int i = 1; i < 2000; i += 2) {
+    snprintf(buf, sizeof(buf), "strpool-test %u", i);
+    const char *s  = strpool_intern(buf);
+    same          += s == strs[i];
+    strpool_release(s);
+    strpool_release(strs[i]);
+  }
+  ok(same == 1000 && strpool_count() == before, "finds strings after others are released");
+}
+
 void
 run_utils_tests (void) {
   round_ts_test();
@@ -158,4 +385,11 @@ run_utils_tests (void) {
   get_filenames_with_regex_test();
   json_parser_test();
   pretty_print_seconds_test();
+  format_time_str_test();
+  encoder_json_test();
+  encoder_msgpack_test();
+  ident_test();
+  arena_test();
+  hashset_test();
+  strpool_test();
 }
@@ -0,0 +1,220 @@
+/**
+ * journalcat - decodes chronic's binary job journal.
+ *
+ * Usage: journalcat [-j] [-e event] [-i id] <path>...
+ *
+ *   -j        print one JSON object per record instead of text
+ *   -e event  only print events of this type: job-started, job-exited,
+ *             mail-started or mail-exited
+ *   -i id     only print records whose job or entry id starts with `id`
+ *
+ * Files are read in the order given, so pass rotated files oldest first e.g.
+ * `journalcat journal.2 journal.1 journal`. Safe to run against the live file.
+ */
+#define JOURNAL_READER 1
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+#define UUID_STR_LEN 37
+
+static const char *event_names[] = {
+  [JOURNAL_JOB_STARTED]  = "job-started",
+  [JOURNAL_JOB_EXITED]   = "job-exited",
+  [JOURNAL_MAIL_STARTED] = "mail-started",
+  [JOURNAL_MAIL_EXITED]  = "mail-exited",
+};
+
+typedef struct {
+  bool        json;
+  int         event;
+  const char *id;
+} filter_opts;
+
+static const char *
+event_name (uint16_t type) {
+  if (type < sizeof(event_names) / sizeof(event_names[0]) && event_names[type]) {
+    return event_names[type];
+  }
+  return "unknown";
+}
+
+static void
+format_uuid (const uint8_t *id, char *dest) {
+  static const char hex[] = "0123456789abcdef";
+
+  for (unsigned int i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      *dest++ = '-';
+    }
+    *dest++ = hex[id[i] >> 4];
+    *dest++ = hex[id[i] & 0xF];
+  }
+  *dest = '\0';
+}
+
+static void
+format_ts (int64_t ts_usec, char *dest, size_t sz) {
+  time_t    secs = ts_usec / 1000000;
+  struct tm tm_buf;
+
+  gmtime_r(&secs, &tm_buf);
+  size_t len = strftime(dest, sz, "%Y-%m-%dT%H:%M:%S", &tm_buf);
+  snprintf(dest + len, sz - len, ".%03dZ", (int)(ts_usec % 1000000 / 1000));
+}
+
+static void
+print_record (journal_record *rec, filter_opts *f) {
+  char job_id[UUID_STR_LEN], entry_id[UUID_STR_LEN], ts[40];
+  format_uuid(rec->job_id, job_id);
+  format_uuid(rec->entry_id, entry_id);
+
+  if (f->event && rec->type != f->event) {
+    return;
+  }
+  if (f->id && strncmp(job_id, f->id, strlen(f->id)) != 0 && strncmp(entry_id, f->id, strlen(f->id)) != 0) {
+    return;
+  }
+
+  format_ts(rec->ts_usec, ts, sizeof(ts));
+  bool exited = rec->type == JOURNAL_JOB_EXITED || rec->type == JOURNAL_MAIL_EXITED;
+
+  if (f->json) {
+    printf(
+      "{\"ts\":\"%s\",\"event\":\"%s\",\"job\":\"%s\",\"entry\":\"%s\",\"pid\":%" PRId32,
+      ts,
+      event_name(rec->type),
+      job_id,
+      entry_id,
+      rec->pid
+    );
+    if (exited) {
+      printf(
+        ",\"status\":%" PRId32 ",\"duration_usec\":%" PRIu64 ",\"utime_usec\":%" PRIu64 ",\"stime_usec\":%" PRIu64
+        ",\"maxrss_kb\":%" PRIu64 ",\"majflt\":%" PRIu64 ",\"inblock\":%" PRIu64 ",\"oublock\":%" PRIu64
+        ",\"nvcsw\":%" PRIu64 ",\"nivcsw\":%" PRIu64,
+        rec->status,
+        rec->duration_usec,
+        rec->utime_usec,
+        rec->stime_usec,
+        rec->maxrss_kb,
+        rec->majflt,
+        rec->inblock,
+        rec->oublock,
+        rec->nvcsw,
+        rec->nivcsw
+      );
+    }
+    printf("}\n");
+    return;
+  }
+
+  printf("%s %-12s job=%s entry=%s pid=%" PRId32, ts, event_name(rec->type), job_id, entry_id, rec->pid);
+  if (exited) {
+    printf(
+      " status=%" PRId32 " duration=%.3fs utime=%.3fs stime=%.3fs maxrss=%" PRIu64 "kB",
+      rec->status,
+      rec->duration_usec / 1e6,
+      rec->utime_usec / 1e6,
+      rec->stime_usec / 1e6,
+      rec->maxrss_kb
+    );
+  }
+  printf("\n");
+}
+
+static int
+decode_file (const char *path, filter_opts *f) {
+  int fd;
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    perror(path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(journal_header)) {
+    fprintf(stderr, "%s is not a chronic journal\n", path);
+    close(fd);
+    return -1;
+  }
+
+  journal_header *hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (hdr == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+
+  if (hdr->magic != JOURNAL_MAGIC || hdr->version != JOURNAL_VERSION || hdr->record_size != sizeof(journal_record)
+      || sizeof(journal_header) + (size_t)hdr->capacity * sizeof(journal_record) > (size_t)st.st_size) {
+    fprintf(stderr, "%s is not a chronic journal (or is from an incompatible version)\n", path);
+    munmap(hdr, st.st_size);
+    return -1;
+  }
+
+  // Records below `count` are complete, even if the daemon is still appending
+  uint64_t count = atomic_load_explicit(&hdr->count, memory_order_acquire);
+  if (count > hdr->capacity) {
+    count = hdr->capacity;
+  }
+
+  journal_record *records = (journal_record *)(hdr + 1);
+  for (uint64_t i = 0; i < count; i++) {
+    print_record(&records[i], f);
+  }
+
+  munmap(hdr, st.st_size);
+  return 0;
+}
+
+int
+main (int argc, char **argv) {
+  filter_opts f = {0};
+  int         opt;
+
+  while ((opt = getopt(argc, argv, "je:i:")) != -1) {
+    switch (opt) {
+      case 'j': f.json = true; break;
+      case 'i': f.id = optarg; break;
+      case 'e':
+        for (unsigned int i = 0; i < sizeof(event_names) / sizeof(event_names[0]); i++) {
+          if (event_names[i] && strcmp(event_names[i], optarg) == 0) {
+            f.event = i;
+          }
+        }
+        if (!f.event) {
+          fprintf(stderr, "unknown event '%s'\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      default: goto usage;
+    }
+  }
+
+  if (optind >= argc) {
+    goto usage;
+  }
+
+  int rc = EXIT_SUCCESS;
+  for (int i = optind; i < argc; i++) {
+    if (decode_file(argv[i], &f) < 0) {
+      rc = EXIT_FAILURE;
+    }
+  }
+
+  return rc;
+
+usage:
+  fprintf(stderr, "usage: %s [-j] [-e event] [-i id] <path>...\n", argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,97 @@
+/**
+ * shmstat - reads chronic's shared-memory status segment.
+ *
+ * Usage: shmstat <path> [interval seconds]
+ *
+ * Maps the segment read-only and prints a consistent snapshot of the daemon's
+ * state. If an interval is given, keeps polling at that interval. Never talks
+ * to the daemon itself.
+ */
+#define STATUS_READER 1
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "status.h"
+
+#define MAX_READ_ATTEMPTS 1000
+
+static void
+print_status (status_shm *st) {
+  time_t now = time(NULL);
+
+  printf("pid:           %" PRId64 "\n", st->pid);
+  printf("uptime:        %" PRId64 "s\n", (int64_t)now - st->start_time);
+  printf("last tick:     %" PRId64 " (%" PRIu64 " ticks)\n", st->last_tick, st->ticks);
+  printf("updated:       %" PRId64 "s ago\n", (int64_t)now - st->updated_at);
+  printf("jobs launched: %" PRIu64 "\n", st->jobs_launched);
+  printf("jobs exited:   %" PRIu64 " (%" PRIu64 " failed)\n", st->jobs_exited, st->jobs_failed);
+  printf("running jobs:  %u\n", st->running_jobs);
+
+  for (unsigned int i = 0; i < STATUS_SHM_MAX_JOBS; i++) {
+    status_job *job = &st->jobs[i];
+    if (job->pid == 0) {
+      continue;
+    }
+    printf(
+      "  [%s] pid=%" PRId64 " running=%" PRId64 "s cmd=%.*s\n",
+      job->ident,
+      job->pid,
+      (int64_t)now - job->started_at,
+      STATUS_SHM_CMD_LEN,
+      job->cmd
+    );
+  }
+}
+
+int
+main (int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <path> [interval seconds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  unsigned int interval = argc > 2 ? (unsigned int)atoi(argv[2]) : 0;
+
+  int fd;
+  if ((fd = open(argv[1], O_RDONLY)) < 0) {
+    perror("open");
+    return EXIT_FAILURE;
+  }
+
+  status_shm *shm = mmap(NULL, sizeof(status_shm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) {
+    perror("mmap");
+    return EXIT_FAILURE;
+  }
+
+  if (shm->magic != STATUS_SHM_MAGIC || shm->version != STATUS_SHM_VERSION) {
+    fprintf(stderr, "%s is not a chronic status segment (or is from an incompatible version)\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  status_shm st;
+  do {
+    if (!status_snapshot(shm, &st, MAX_READ_ATTEMPTS)) {
+      fprintf(stderr, "failed to read a consistent snapshot\n");
+      return EXIT_FAILURE;
+    }
+
+    print_status(&st);
+    if (interval) {
+      printf("\n");
+      fflush(stdout);
+      sleep(interval);
+    }
+  } while (interval);
+
+  munmap(shm, sizeof(status_shm));
+
+  return EXIT_SUCCESS;
+}